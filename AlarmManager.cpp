@@ -1,26 +1,305 @@
 #include "AlarmManager.h"
+#include "BLEManager.h"
+#include <math.h>
 
-AlarmManager::AlarmManager() : _currentAlarmState(0) {
+// Alarm değerlendirici ayarları (dahili sensör ve BLE tag alarmları)
+static const float ALARM_HYSTERESIS_C = 0.5f;      // Alarmdan çıkış için eşik payı
+static const uint32_t ALARM_HOLDOFF_MS = 5000;     // Yeni durum bu süre boyunca devam etmeli
+static const uint32_t ALARM_TRANSITION_SAVE_MS = 60000; // Durum geçişi en geç bu sürede kaydedilir
+
+// Uygunluk birikimi
+static const uint32_t ALARM_MIN_STEP_MS = 1000;    // Birikim çözünürlüğü
+static const uint32_t ALARM_MAX_GAP_MS = 600000;   // Daha uzun boşluk (sensör yok) sayılmaz
+static const uint32_t ALARM_SAVE_MS = 900000;      // Değişen istatistikler 15 dk'da bir kaydedilir
+static const double MKT_DH_R = 10000.0;            // ΔH/R (K) - 83.144 kJ/mol
+static const double MKT_TREF_K = 278.15;           // Normalizasyon (5 °C)
+
+// NVS blob kimliği - magic/sürümü veya boyutu tutmayan kayıt okunmaz, birikim sıfırdan başlar
+static const uint16_t EXCURSION_MAGIC = 0x5845;    // "EX"
+static const uint8_t EXCURSION_VERSION = 1;
+
+AlarmManager::AlarmManager() : _currentAlarmState(0), _lastSaveMs(0), _transitionPending(false) {
+    _resetTracker(_internal, "");
+    for (uint8_t i = 0; i < ALARM_MAX_TAGS; i++) _resetTracker(_tags[i], "");
+}
+
+void AlarmManager::_resetTracker(Tracker& t, const char* mac) {
+    memset(&t, 0, sizeof(t));
+    t.stats.magic = EXCURSION_MAGIC;
+    t.stats.version = EXCURSION_VERSION;
+    strlcpy(t.stats.mac, mac, sizeof(t.stats.mac));
+    t.stats.tempMin = 999.0f;
+    t.stats.tempMax = -999.0f;
+}
+
+bool AlarmManager::_loadTracker(Tracker& t, const char* key) {
+    if (_prefs.getBytesLength(key) != sizeof(ExcursionStats)) return false;
+    ExcursionStats stored;
+    _prefs.getBytes(key, &stored, sizeof(stored));
+    if (stored.magic != EXCURSION_MAGIC || stored.version != EXCURSION_VERSION) return false;
+    t.stats = stored;
+    t.stats.mac[sizeof(t.stats.mac) - 1] = '\0';
+    if (t.stats.openState == 1 || t.stats.openState == 2) {
+        // Excursion reboot'tan önce başlamıştı - tekrar sayılmaz, başlangıcı saatle geri kurulur
+        t.state = t.stats.openState;
+        t.candidate = t.state;
+        t.excursionStartMs = millis();
+        t.resumePending = true;
+    } else {
+        t.stats.openState = 0;
+    }
+    return true;
+}
+
+void AlarmManager::begin() {
+    _prefs.begin("excur", true);
+    _loadTracker(_internal, "int");
+    _currentAlarmState = _internal.state;
+    uint8_t restored = 0;
+    for (uint8_t i = 0; i < ALARM_MAX_TAGS; i++) {
+        char key[6];
+        snprintf(key, sizeof(key), "t%u", i);
+        if (_loadTracker(_tags[i], key)) restored++;
+    }
+    _prefs.end();
+    Serial.printf("[ALARM] Excursion stats restored (internal %lu s, state %u, %u tags)\n",
+                  _internal.stats.totalSec, _internal.state, restored);
+}
+
+void AlarmManager::_resumeExcursion(Tracker& t, unsigned long now) {
+    // Saat yoksa bekle; başlangıç epoch'u bilinmiyorsa excursion boot anından sayılır
+    if (t.stats.openSinceEpoch == 0) {
+        t.resumePending = false;
+        return;
+    }
+    time_t epoch = time(nullptr);
+    if (epoch <= 1600000000) return;
+    t.resumePending = false;
+    if ((uint32_t)epoch <= t.stats.openSinceEpoch) return;
+    uint32_t elapsedSec = (uint32_t)epoch - t.stats.openSinceEpoch;
+    uint32_t bootSec = (now - t.excursionStartMs) / 1000;
+    if (elapsedSec > bootSec) t.excursionStartMs -= (elapsedSec - bootSec) * 1000UL;
+}
+
+uint8_t AlarmManager::evaluateThreshold(uint8_t state, uint8_t& candidate, uint32_t& candidateSinceMs,
+                                        float temp, float tempHigh, float tempLow, uint32_t nowMs) {
+    // Histerezis: alarmdan çıkmak için eşiğin ALARM_HYSTERESIS_C içine dönülmeli
+    uint8_t target = 0;
+    if (state == 1) {
+        target = (temp > tempHigh - ALARM_HYSTERESIS_C) ? 1 : 0;
+    } else if (state == 2) {
+        target = (temp < tempLow + ALARM_HYSTERESIS_C) ? 2 : 0;
+    }
+    if (target == 0) {
+        if (temp > tempHigh) target = 1;
+        else if (temp < tempLow) target = 2;
+    }
+    
+    if (target == state) {
+        candidate = state; // Aday iptal
+        return state;
+    }
+    // Hold-off: aynı aday durum ALARM_HOLDOFF_MS boyunca sürmeli (tek örneklik sıçrama alarm üretmez)
+    if (target != candidate) {
+        candidate = target;
+        candidateSinceMs = nowMs;
+        return state;
+    }
+    if (nowMs - candidateSinceMs < ALARM_HOLDOFF_MS) return state;
+    return target;
 }
 
 uint8_t AlarmManager::checkTemperature(float temp, float tempHigh, float tempLow) {
-    uint8_t newState = 0;
+    _update(_internal, temp, tempHigh, tempLow, millis());
+    _currentAlarmState = _internal.state;
+    return _currentAlarmState;
+}
+
+void AlarmManager::_update(Tracker& t, float temp, float tempHigh, float tempLow, unsigned long now) {
+    ExcursionStats& s = t.stats;
+    
+    // Zaman ağırlıklı birikim: son aralık bu örnekle temsil edilir
+    if (!t.hasLast) {
+        t.hasLast = true;
+        t.lastMs = now;
+        if (s.sinceEpoch == 0) {
+            time_t epoch = time(nullptr);
+            if (epoch > 1600000000) s.sinceEpoch = (uint32_t)epoch;
+        }
+    } else if (now - t.lastMs >= ALARM_MIN_STEP_MS) {
+        if (now - t.lastMs > ALARM_MAX_GAP_MS) {
+            t.lastMs = now;     // Veri yoktu - boşluk sayılmaz
+        } else {
+            uint32_t sec = (now - t.lastMs) / 1000;
+            t.lastMs += sec * 1000;
+            double tk = (double)temp + 273.15;
+            s.mktSum += exp(-MKT_DH_R * (1.0 / tk - 1.0 / MKT_TREF_K)) * sec;
+            s.totalSec += sec;
+            if (temp > tempHigh) s.aboveSec += sec;
+            else if (temp < tempLow) s.belowSec += sec;
+            if (temp < s.tempMin) s.tempMin = temp;
+            if (temp > s.tempMax) s.tempMax = temp;
+            t.dirty = true;
+        }
+    }
+    t.lastTemp = temp;
+    if (t.resumePending) _resumeExcursion(t, now);
+    
+    uint8_t target = evaluateThreshold(t.state, t.candidate, t.candidateSinceMs,
+                                       temp, tempHigh, tempLow, now);
+    if (target == t.state) return;
     
-    if (temp > tempHigh) {
-        newState = 1; // High alarm
-    } else if (temp < tempLow) {
-        newState = 2; // Low alarm
+    // Geçiş onaylandı - excursion süresi ilk eşik aşımından itibaren sayılır
+    if (t.state != 0) {
+        uint32_t duration = (t.candidateSinceMs - t.excursionStartMs) / 1000;
+        if (duration > s.longestSec) s.longestSec = duration;
     }
+    if (target == 1) s.excHigh++;
+    else if (target == 2) s.excLow++;
+    t.excursionStartMs = t.candidateSinceMs;
+    t.state = target;
+    t.resumePending = false;
     
-    _currentAlarmState = newState;
-    return newState;
+    // Açık excursion kalıcı: reboot sonrası aynı excursion tekrar sayılmaz
+    s.openState = target;
+    s.openSinceEpoch = 0;
+    time_t epoch = time(nullptr);
+    if (target != 0 && epoch > 1600000000) {
+        s.openSinceEpoch = (uint32_t)epoch - (now - t.candidateSinceMs) / 1000;
+    }
+    t.dirty = true;
+    _transitionPending = true;
+}
+
+AlarmManager::Tracker* AlarmManager::_findTag(const char* mac, BLEManager& ble) {
+    Tracker* freeSlot = nullptr;
+    for (uint8_t i = 0; i < ALARM_MAX_TAGS; i++) {
+        if (!strcmp(_tags[i].stats.mac, mac)) return &_tags[i];
+        if (!freeSlot && _tags[i].stats.mac[0] == '\0') freeSlot = &_tags[i];
+    }
+    if (!freeSlot) {
+        // Config'den çıkarılmış tag'ın yerini al
+        for (uint8_t i = 0; i < ALARM_MAX_TAGS; i++) {
+            if (ble.getTagConfigIndex(_tags[i].stats.mac) < 0) {
+                freeSlot = &_tags[i];
+                break;
+            }
+        }
+    }
+    if (freeSlot) _resetTracker(*freeSlot, mac);
+    return freeSlot;
+}
+
+void AlarmManager::serviceTags(BLEManager& ble) {
+    unsigned long now = millis();
+    uint8_t count = ble.getScannedTagCount();
+    for (uint8_t i = 0; i < count; i++) {
+        BLETagData tag;
+        if (!ble.getScannedTag(i, tag) || !tag.valid) continue;
+        BLETagConfig* config = ble.getTagConfig(tag.macAddress);
+        if (!config || !config->enabled) continue;
+        
+        Tracker* t = _findTag(tag.macAddress, ble);
+        if (!t) continue;
+        if (t->hasLast && t->lastAdvCount == tag.advCount) continue;  // Yeni TLM yok
+        t->lastAdvCount = tag.advCount;
+        _update(*t, tag.temperature, config->tempHigh, config->tempLow, now);
+    }
+}
+
+void AlarmManager::_saveTracker(Tracker& t, const char* key) {
+    _prefs.putBytes(key, &t.stats, sizeof(ExcursionStats));
+    t.dirty = false;
+}
+
+void AlarmManager::save() {
+    bool opened = false;
+    for (int i = -1; i < ALARM_MAX_TAGS; i++) {
+        Tracker& t = (i < 0) ? _internal : _tags[i];
+        if (!t.dirty) continue;
+        if (!opened) {
+            _prefs.begin("excur", false);
+            opened = true;
+        }
+        char key[6];
+        if (i < 0) strlcpy(key, "int", sizeof(key));
+        else snprintf(key, sizeof(key), "t%d", i);
+        _saveTracker(t, key);
+    }
+    if (opened) _prefs.end();
+    _transitionPending = false;
 }
 
-const char* AlarmManager::getAlarmReason(uint8_t alarmState) {
-    switch(alarmState) {
-        case 1: return "TEMP_HIGH";
-        case 2: return "TEMP_LOW";
-        default: return "NORMAL";
+void AlarmManager::service(unsigned long now) {
+    // Durum geçişleri birikim kaydını beklemez (NVS yazımı yine de sınırlı)
+    uint32_t interval = _transitionPending ? ALARM_TRANSITION_SAVE_MS : ALARM_SAVE_MS;
+    if (now - _lastSaveMs < interval) return;
+    _lastSaveMs = now;
+    save();
+}
+
+void AlarmManager::reset() {
+    _resetTracker(_internal, "");
+    for (uint8_t i = 0; i < ALARM_MAX_TAGS; i++) _resetTracker(_tags[i], "");
+    _prefs.begin("excur", false);
+    _prefs.clear();
+    _prefs.end();
+    _currentAlarmState = 0;
+    _transitionPending = false;
+    Serial.println("[ALARM] Excursion stats cleared");
+}
+
+float AlarmManager::getMkt(const ExcursionStats& stats) {
+    if (stats.totalSec == 0 || stats.mktSum <= 0) return NAN;
+    double tk = 1.0 / (1.0 / MKT_TREF_K - log(stats.mktSum / stats.totalSec) / MKT_DH_R);
+    return (float)(tk - 273.15);
+}
+
+uint32_t AlarmManager::_longest(const Tracker& t, unsigned long now) {
+    // Süren excursion da hesaba katılır
+    uint32_t longest = t.stats.longestSec;
+    if (t.state != 0) {
+        uint32_t current = (now - t.excursionStartMs) / 1000;
+        if (current > longest) longest = current;
     }
+    return longest;
 }
 
+static float round2(float v) {
+    return roundf(v * 100.0f) / 100.0f;
+}
+
+void AlarmManager::report(JsonObject& out) {
+    unsigned long now = millis();
+    const ExcursionStats& s = _internal.stats;
+    
+    JsonObject internal = out.createNestedObject("int");
+    if (s.totalSec > 0) {
+        internal["mkt"] = round2(getMkt(s));
+        internal["min"] = round2(s.tempMin);
+        internal["max"] = round2(s.tempMax);
+    }
+    internal["sec"] = s.totalSec;
+    internal["above"] = s.aboveSec;
+    internal["below"] = s.belowSec;
+    internal["excH"] = s.excHigh;
+    internal["excL"] = s.excLow;
+    internal["longest"] = _longest(_internal, now);
+    internal["since"] = s.sinceEpoch;
+    
+    // Tag başına kompakt dizi (info boyutu): [mac, mkt, sec, above, below, excH, excL, longest]
+    JsonArray tags = out.createNestedArray("tags");
+    for (uint8_t i = 0; i < ALARM_MAX_TAGS; i++) {
+        const Tracker& t = _tags[i];
+        if (t.stats.mac[0] == '\0' || t.stats.totalSec == 0) continue;
+        JsonArray row = tags.createNestedArray();
+        row.add(t.stats.mac);
+        row.add(round2(getMkt(t.stats)));
+        row.add(t.stats.totalSec);
+        row.add(t.stats.aboveSec);
+        row.add(t.stats.belowSec);
+        row.add(t.stats.excHigh);
+        row.add(t.stats.excLow);
+        row.add(_longest(t, now));
+    }
+}
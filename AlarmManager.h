@@ -2,20 +2,96 @@
 #define ALARM_MANAGER_H
 
 #include <Arduino.h>
+#include <Preferences.h>
+#include <ArduinoJson.h>
 #include "ConfigManager.h"
 
+class BLEManager;
+
+#define ALARM_MAX_TAGS      32      // BLEManager tag config sayısı ile aynı
+
+// Soğuk zincir uygunluk istatistikleri (sensör başına, NVS'e kalıcı)
+// Zaman ağırlıklı birikim: her güncellemede son sıcaklık geçen süreyle çarpılır,
+// bellek sensör başına sabittir (örnek saklanmaz).
+//
+// MKT (Mean Kinetic Temperature, USP <1079>, ΔH/R = 10000 K):
+//   MKT = 1 / (1/Tref - ln(mktSum / totalSec) / (ΔH/R))
+//   mktSum = Σ exp(-ΔH/R · (1/T - 1/Tref)) · dt  (Tref ile normalize - double'da taşma/kayıp yok)
+struct ExcursionStats {
+  uint16_t magic;         // EXCURSION_MAGIC - yerleşim değişirse version artırılır
+  uint8_t version;
+  char mac[18];           // Tag MAC'i; dahili sensörde boş
+  uint32_t sinceEpoch;    // Birikim başlangıcı (0 = saat yoktu)
+  uint32_t totalSec;      // İzlenen toplam süre
+  double mktSum;
+  uint32_t aboveSec;      // Üst eşik üstünde geçen süre (histerezis/bekleme yok)
+  uint32_t belowSec;      // Alt eşik altında geçen süre
+  uint16_t excHigh;       // Onaylanmış yüksek excursion sayısı
+  uint16_t excLow;        // Onaylanmış düşük excursion sayısı
+  uint32_t longestSec;    // En uzun excursion (biten)
+  float tempMin;
+  float tempMax;
+  // Süren excursion (yeniden başlatmada tekrar sayılmaz, süresi kesilmez)
+  uint8_t openState;      // 0 yok, 1 yüksek, 2 düşük
+  uint32_t openSinceEpoch;// Excursion başlangıcı (0 = saat yoktu)
+};
+
 class AlarmManager {
 public:
     AlarmManager();
+    void begin();                       // Kalıcı istatistikleri yükle
+    
+    // Dahili sensör: histerezis ve bekleme süresi ile onaylanmış alarm durumu
     uint8_t checkTemperature(float temp, float tempHigh, float tempLow);
     const char* getAlarmReason(uint8_t alarmState);
     bool isAlarmActive() { return _currentAlarmState != 0; }
     uint8_t getAlarmState() { return _currentAlarmState; }
     
+    // BLE tag'ları: yeni TLM gelen tag'ların sıcaklığını birikime ekle (alarm periyodunda)
+    void serviceTags(BLEManager& ble);
+    
+    void service(unsigned long now);    // Değişen istatistikleri periyodik kaydet
+    void save();                        // Hemen kaydet (reset öncesi)
+    void reset();                       // Tüm istatistikleri sıfırla
+    
+    static float getMkt(const ExcursionStats& stats);   // °C; veri yoksa NAN
+    
+    // Eşik değerlendirici (dahili sensör ve BLE tag alarmları ortak): histerezis + hold-off.
+    // Onaylanmış yeni durumu döner (değişmediyse state); aday alanlarını günceller.
+    static uint8_t evaluateThreshold(uint8_t state, uint8_t& candidate, uint32_t& candidateSinceMs,
+                                     float temp, float tempHigh, float tempLow, uint32_t nowMs);
+    void report(JsonObject& out);       // Info mesajı için
+    
 private:
+    struct Tracker {
+        ExcursionStats stats;
+        float lastTemp;
+        unsigned long lastMs;
+        bool hasLast;
+        uint8_t state;                  // 0 normal, 1 yüksek, 2 düşük
+        uint8_t candidate;
+        uint32_t candidateSinceMs;
+        unsigned long excursionStartMs;
+        bool resumePending;             // NVS'ten açık excursion geldi, saat bekleniyor
+        uint32_t lastAdvCount;          // Tag: yeni TLM tespiti
+        bool dirty;
+    };
+    
     uint8_t _currentAlarmState;
     // 0: Normal, 1: High, 2: Low
+    Tracker _internal;
+    Tracker _tags[ALARM_MAX_TAGS];
+    unsigned long _lastSaveMs;
+    bool _transitionPending;            // Durum geçişi henüz kaydedilmedi
+    Preferences _prefs;
+    
+    void _resetTracker(Tracker& t, const char* mac);
+    bool _loadTracker(Tracker& t, const char* key);
+    void _resumeExcursion(Tracker& t, unsigned long now);
+    void _update(Tracker& t, float temp, float tempHigh, float tempLow, unsigned long now);
+    Tracker* _findTag(const char* mac, BLEManager& ble);
+    uint32_t _longest(const Tracker& t, unsigned long now);
+    void _saveTracker(Tracker& t, const char* key);
 };
 
 #endif
-
@@ -1,15 +1,60 @@
 #include "BLEManager.h"
 #include "MQTTManager.h"
+#include "AlarmManager.h"
 #include "ConfigManager.h"
+#include "JsonArena.h"
 #include "hardware.h"
 #include <BLEDevice.h>
 #include <BLEUtils.h>
 #include <BLEScan.h>
 #include <BLEAdvertisedDevice.h>
 #include <ArduinoJson.h>
+#include <math.h>
 
 static BLEScan* pBLEScan = nullptr;
 
+// Tarama zamanlayıcı ayarları
+static const uint32_t BLE_DISCOVERY_WINDOW_S = 5;   // Öğrenilmemiş tag için pencere (sn)
+static const uint32_t BLE_MIN_GUARD_MS = 1000;      // Beklenen TLM etrafındaki min. tolerans
+static const uint32_t BLE_STALE_PERIODS = 4;        // Bu kadar periyot TLM gelmezse yeniden öğren
+
+// Tag alarm değerlendirici ayarları
+static const uint32_t BLE_ALARM_RETRY_MS = 10000;   // Başarısız publish tekrar aralığı
+
+// RSSI Kalman filtresi (dBm^2)
+static const float BLE_RSSI_PROCESS_NOISE = 1.0f;     // Frame başına durum değişimi (tag hareketi)
+static const float BLE_RSSI_MEASURE_NOISE = 16.0f;    // Ölçüm gürültüsü (~4 dB std, fading)
+
+// Korelasyon tablosu kimlik bayrakları
+static const uint8_t BLE_ID_UID = 0x01;
+static const uint8_t BLE_ID_URL = 0x02;
+static const uint8_t BLE_ID_EID = 0x04;
+static const uint8_t BLE_ID_IBEACON = 0x08;
+static const uint8_t BLE_ID_MATCHABLE = BLE_ID_UID | BLE_ID_EID | BLE_ID_IBEACON; // URL ortak olabilir
+
+// MAC'i normalize et (büyük harf, ':' yok) - sabit buffer, heap kullanmaz
+static void normalizeMac(const char* mac, char out[13]) {
+    uint8_t n = 0;
+    for (const char* p = mac; *p && n < 12; p++) {
+        if (*p == ':' || *p == '-') continue;
+        out[n++] = toupper((unsigned char)*p);
+    }
+    out[n] = '\0';
+}
+
+// Ham MAC, normalize biçimle eşleşiyor mu (büyük/küçük harf ve ':' fark etmez)
+static bool macMatches(const char* mac, const char* norm) {
+    for (const char* p = mac; *p; p++) {
+        if (*p == ':' || *p == '-') continue;
+        if (toupper((unsigned char)*p) != *norm++) return false;
+    }
+    return *norm == '\0';
+}
+
+// Async tarama bitiş callback'i (pencere sonu scan() içinde isScanning() ile yakalanır)
+static void onScanComplete(BLEScanResults results) {
+}
+
 // BLE Scan Callback Class
 class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
     BLEManager* _bleMgr;
@@ -23,14 +68,27 @@ public:
 // Callback implementation (must be defined after BLEManager class declaration)
 void MyAdvertisedDeviceCallbacks::onResult(BLEAdvertisedDevice advertisedDevice) {
     if (_bleMgr) {
+        uint32_t t0 = micros();
         _bleMgr->onBLEScanResult(advertisedDevice);
+        _bleMgr->noteCallback(micros() - t0);
     }
 }
 
 BLEManager::BLEManager() 
-    : _initialized(false), _tagCount(0), _configCount(0) {
+    : _initialized(false), _tagCount(0), _configCount(0),
+      _scanning(false), _activeScan(true), _windowStartMs(0), _callbackCount(0), _callbackMaxUs(0),
+      _cycleRadioOnMs(0),
+      _sampleIntervalMs(30000), _presenceEventHead(0), _presenceEventCount(0), _presenceRetryMs(0),
+      _presenceEnterRssi(-75), _presenceExitRssi(-85), _presenceEnterMs(5000),
+      _presenceExitMs(15000), _presenceTimeoutMs(120000) {
+    _stateMux = portMUX_INITIALIZER_UNLOCKED;
     memset(_scannedTags, 0, sizeof(_scannedTags));
     memset(_tagConfigs, 0, sizeof(_tagConfigs));
+    memset(_schedules, 0, sizeof(_schedules));
+    memset(_alarms, 0, sizeof(_alarms));
+    memset(_presence, 0, sizeof(_presence));
+    memset(_presenceEvents, 0, sizeof(_presenceEvents));
+    _clearCorrelation();
 }
 
 bool BLEManager::begin() {
@@ -40,10 +98,12 @@ bool BLEManager::begin() {
     
     BLEDevice::init("");
     pBLEScan = BLEDevice::getScan();
-    pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks(this));
-    pBLEScan->setActiveScan(true); // Active scan (higher power, better results)
+    // wantDuplicates=true: aynı tag'ın ardışık TLM'leri de callback'e gelsin (aralık öğrenimi için)
+    pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks(this), true);
+    pBLEScan->setActiveScan(true); // Tag'lar öğrenilene kadar active scan, sonra pasif
     pBLEScan->setInterval(100); // Scan interval in ms
-    pBLEScan->setWindow(99); // Scan window in ms
+    pBLEScan->setWindow(99); // Scan window in ms (radyo süresi pencere zamanlayıcısı ile sınırlanır)
+    _activeScan = true;
     
     _initialized = true;
     Serial.println("[BLE] BLE scanner initialized");
@@ -53,160 +113,161 @@ bool BLEManager::begin() {
 void BLEManager::scan() {
     if (!_initialized || !pBLEScan) return;
     
-    // Start scan (non-blocking)
-    if (!pBLEScan->isScanning()) {
-        static unsigned long lastScanLog = 0;
-        unsigned long now = millis();
-        // Her 30 saniyede bir log bas (sürekli spam önlemek için)
-        if (now - lastScanLog > 30000) {
-            Serial.printf("[BLE] Starting scan... (looking for %d configured tags)\n", _configCount);
-            lastScanLog = now;
-        }
-        pBLEScan->start(5, false); // 5 seconds scan, don't delete results
+    uint32_t now = millis();
+    
+    // Async pencere bitti mi?
+    if (_scanning && !pBLEScan->isScanning()) {
+        _cycleRadioOnMs += now - _windowStartMs;
+        _scanning = false;
+        pBLEScan->clearResults();
     }
-}
-
-void BLEManager::onBLEScanResult(BLEAdvertisedDevice advertisedDevice) {
-    // Get MAC address
-    String macStr = advertisedDevice.getAddress().toString().c_str();
-    macStr.toUpperCase();
-    String macStrNoColon = macStr;
-    macStrNoColon.replace(":", "");
     
-    // Check if MAC address matches target prefix
-    if (!macStrNoColon.startsWith(BLE_TARGET_PREFIX)) {
-        return; // Not our target prefix
+    // Periyot seti tamamlandıysa sadece istatistik örneklemesi yapılır:
+    // her tag için en fazla _sampleIntervalMs'de bir, beklenen TLM anında kısa pencere
+    bool complete = allConfiguredTagsFound();
+    
+    if (_scanning) {
+        // Beklenen TLM'ler alındı - pencereyi erken kapat
+        if (complete && !_anySampleDue(now)) _stopWindow();
+        return;
     }
     
-    // Prefix'e uyan tüm cihazları logla (aynı MAC'i tekrar loglamayı önle)
-    static String lastLoggedMacs[32];
-    static uint8_t lastLoggedCount = 0;
-    static unsigned long lastLogReset = 0;
+    // Sadece TLM beklenen anlarda pencere aç
+    uint32_t windowS = _nextWindowSeconds(now, complete);
+    if (windowS == 0) return;
     
-    // 60 saniyede bir log listesini sıfırla (yeni tarama)
-    if (millis() - lastLogReset > 60000) {
-        lastLoggedCount = 0;
-        lastLogReset = millis();
+    // Tüm tag'ların periyodu öğrenildiyse pasif taramaya geç (scan response gerekmez)
+    bool wantActive = !_allSchedulesLearned();
+    if (wantActive != _activeScan) {
+        pBLEScan->setActiveScan(wantActive);
+        _activeScan = wantActive;
+        Serial.printf("[BLE] Switched to %s scan\n", wantActive ? "active" : "passive");
     }
     
-    // Bu MAC daha önce loglanmış mı kontrol et
-    bool alreadyLogged = false;
-    for (uint8_t i = 0; i < lastLoggedCount; i++) {
-        if (lastLoggedMacs[i] == macStrNoColon) {
-            alreadyLogged = true;
-            break;
-        }
+    static unsigned long lastScanLog = 0;
+    // Her 30 saniyede bir log bas (sürekli spam önlemek için)
+    if (now - lastScanLog > 30000) {
+        Serial.printf("[BLE] Opening %lu s scan window... (found %d/%d configured tags)\n",
+                     (unsigned long)windowS, getFoundConfiguredTagCount(), _configCount);
+        lastScanLog = now;
     }
     
-    if (!alreadyLogged && lastLoggedCount < 32) {
-        lastLoggedMacs[lastLoggedCount++] = macStrNoColon;
-        Serial.printf("[BLE-SCAN] Found device with prefix %s: MAC=%s, RSSI=%d dBm\n", 
-                     BLE_TARGET_PREFIX, macStr.c_str(), advertisedDevice.getRSSI());
+    if (pBLEScan->start(windowS, onScanComplete, false)) { // Non-blocking, don't continue old results
+        _scanning = true;
+        _windowStartMs = now;
+    }
+}
+
+void BLEManager::onBLEScanResult(BLEAdvertisedDevice advertisedDevice) {
+    // MAC adresi: ham 6 byte'tan sabit buffer'lara (reklam başına heap ayrılmaz)
+    BLEAddress address = advertisedDevice.getAddress();
+    const uint8_t* raw = (const uint8_t*)address.getNative();
+    char deviceAddress[18];   // "8c:69:6b:xx:xx:xx" (BLEAddress::toString biçimi, tag buffer anahtarı)
+    char macNorm[13];         // "8C696BXXXXXX"
+    snprintf(deviceAddress, sizeof(deviceAddress), "%02x:%02x:%02x:%02x:%02x:%02x",
+             raw[0], raw[1], raw[2], raw[3], raw[4], raw[5]);
+    snprintf(macNorm, sizeof(macNorm), "%02X%02X%02X%02X%02X%02X",
+             raw[0], raw[1], raw[2], raw[3], raw[4], raw[5]);
+    
+    // Reklamdaki tüm frame'leri tek geçişte çöz (Eddystone TLM/UID/URL/EID + iBeacon)
+    BLETagData tagData;
+    memset(&tagData, 0, sizeof(BLETagData));
+    BLEFrameInfo frames;
+    memset(&frames, 0, sizeof(BLEFrameInfo));
+    _parseAdvertisement(advertisedDevice, frames, tagData);
+    
+    bool prefixMatch = strncmp(macNorm, BLE_TARGET_PREFIX, strlen(BLE_TARGET_PREFIX)) == 0;
+    
+    // Prefix'e uymayan (ör. adres döndüren) cihazlar sadece kimlik frame'i taşıyorsa
+    // veya adresi korelasyon tablosunda varsa incelenir
+    if (!prefixMatch && frames.idFlags == 0) {
+        portENTER_CRITICAL(&_stateMux);
+        bool known = _findCorrelationByAddress(macNorm) >= 0;
+        portEXIT_CRITICAL(&_stateMux);
+        if (!known) return; // Not our target prefix
     }
     
-    // Check if this MAC is in config (only accept configured tags for processing)
-    bool isConfigured = false;
     int matchedConfigIndex = -1;
     
-    for (uint8_t i = 0; i < _configCount; i++) {
-        String configMac = String(_tagConfigs[i].macAddress);
-        configMac.toUpperCase();
-        configMac.replace(":", "");
+    if (prefixMatch) {
+        // Prefix'e uyan tüm cihazları logla (aynı MAC'i tekrar loglamayı önle)
+        static char lastLoggedMacs[32][13];
+        static uint8_t lastLoggedCount = 0;
+        static unsigned long lastLogReset = 0;
         
-        if (configMac == macStrNoColon && _tagConfigs[i].enabled) {
-            isConfigured = true;
-            matchedConfigIndex = i;
-            break;
+        // 60 saniyede bir log listesini sıfırla (yeni tarama)
+        if (millis() - lastLogReset > 60000) {
+            lastLoggedCount = 0;
+            lastLogReset = millis();
+        }
+        
+        // Bu MAC daha önce loglanmış mı kontrol et
+        bool alreadyLogged = false;
+        for (uint8_t i = 0; i < lastLoggedCount; i++) {
+            if (strcmp(lastLoggedMacs[i], macNorm) == 0) {
+                alreadyLogged = true;
+                break;
+            }
+        }
+        
+        if (!alreadyLogged && lastLoggedCount < 32) {
+            memcpy(lastLoggedMacs[lastLoggedCount++], macNorm, sizeof(macNorm));
+            Serial.printf("[BLE-SCAN] Found device with prefix %s: MAC=%s, RSSI=%d dBm\n", 
+                         BLE_TARGET_PREFIX, macNorm, advertisedDevice.getRSSI());
+        }
+        
+        // Check if this MAC is in config (only accept configured tags for processing)
+        int index = _findConfigIndexNorm(macNorm);
+        if (index >= 0 && _tagConfigs[index].enabled) {
+            matchedConfigIndex = index;
         }
     }
     
-    if (!isConfigured) {
-        return; // Not in config list, don't process further
+    // Korelasyon: aynı fiziksel tag'ın farklı adres/frame'lerini birleştir.
+    // Tag buffer anahtarı: config'e bağlandığı adres (adres dönse de aynı kayıt güncellenir)
+    // Tag buffer, zamanlama ve korelasyon tabloları loop'ta da okunur - _stateMux altında
+    portENTER_CRITICAL(&_stateMux);
+    int corrIndex = _correlate(macNorm, deviceAddress, frames, matchedConfigIndex);
+    if (corrIndex >= 0) {
+        if (matchedConfigIndex < 0) matchedConfigIndex = _correlation[corrIndex].configIndex;
+        strlcpy(tagData.macAddress, _correlation[corrIndex].homeAddress, sizeof(tagData.macAddress));
+    } else {
+        strlcpy(tagData.macAddress, deviceAddress, sizeof(tagData.macAddress));
     }
+    portEXIT_CRITICAL(&_stateMux);
     
-    // Parse Eddystone data from advertised data
-    BLETagData tagData;
-    memset(&tagData, 0, sizeof(BLETagData));
-    strlcpy(tagData.macAddress, advertisedDevice.getAddress().toString().c_str(), sizeof(tagData.macAddress));
+    if (matchedConfigIndex < 0 || !_tagConfigs[matchedConfigIndex].enabled) {
+        return; // Not in config list, don't process further
+    }
     tagData.rssi = advertisedDevice.getRSSI();
     tagData.lastSeenTime = time(nullptr); // Current epoch time
     
-    // Parse Eddystone TLM frame
-    bool foundEddystone = false;
-    
-    // Method 1: getServiceData() ile dene
-    if (advertisedDevice.haveServiceData()) {
-        String serviceDataStr = advertisedDevice.getServiceData();
-        int sdLen = serviceDataStr.length();
-        
-        if (sdLen >= 12) {
-            const uint8_t* data = (const uint8_t*)serviceDataStr.c_str();
-            uint8_t frameType = data[0];
-            
-            if (frameType == 0x20) { // TLM frame
-                if (_parseEddystoneTLM(data, sdLen, tagData)) {
-                    foundEddystone = true;
-                }
-            }
-        }
-    }
+    // Her frame RSSI filtresini besler (varlık durumu loop'ta değerlendirilir)
+    _filterRssi(matchedConfigIndex, tagData.rssi, millis());
     
-    // Method 2: Raw payload'dan parse et (Method 1 başarısız olduysa)
-    if (!foundEddystone) {
-        uint8_t* payload = advertisedDevice.getPayload();
-        size_t payloadLen = advertisedDevice.getPayloadLength();
-        
-        for (size_t i = 0; i < payloadLen; ) {
-            uint8_t fieldLen = payload[i];
-            if (fieldLen == 0 || i + fieldLen >= payloadLen) break;
-            
-            uint8_t fieldType = payload[i + 1];
-            
-            // Service Data - 16-bit UUID (type 0x16)
-            if (fieldType == 0x16 && fieldLen >= 4) {
-                uint16_t serviceUUID = payload[i + 2] | (payload[i + 3] << 8);
-                
-                if (serviceUUID == 0xFEAA) {
-                    const uint8_t* eddystoneData = &payload[i + 4];
-                    int eddystoneLen = fieldLen - 3;
-                    
-                    if (eddystoneLen > 0 && eddystoneData[0] == 0x20) {
-                        if (_parseEddystoneTLM(eddystoneData, eddystoneLen, tagData)) {
-                            foundEddystone = true;
-                        }
-                    }
-                }
-            }
-            
-            i += fieldLen + 1;
-        }
-    }
-    
-    if (!foundEddystone) {
-        // TLM frame gelmediyse sadece RSSI ve lastSeenTime güncelle (eğer tag zaten varsa)
-        for (uint8_t i = 0; i < _tagCount; i++) {
-            if (strcmp(_scannedTags[i].macAddress, tagData.macAddress) == 0) {
-                _scannedTags[i].rssi = tagData.rssi;
-                _scannedTags[i].lastSeenTime = tagData.lastSeenTime;
-                return;
-            }
+    if (!frames.hasTlm) {
+        // TLM frame gelmediyse sadece RSSI ve lastSeenTime güncelle (eğer tag zaten varsa,
+        // yoksa TLM frame beklenir)
+        portENTER_CRITICAL(&_stateMux);
+        uint8_t index = _findTagIndex(tagData.macAddress);
+        if (index != 255) {
+            _scannedTags[index].rssi = tagData.rssi;
+            _scannedTags[index].lastSeenTime = tagData.lastSeenTime;
+            _accumulateRssi(_scannedTags[index].stats, tagData.rssi, tagData.lastSeenTime);
         }
-        return; // Tag henüz yoksa, TLM frame bekliyoruz
+        portEXIT_CRITICAL(&_stateMux);
+        return;
     }
     
     // TLM frame bulundu - tag'ı kaydet
     tagData.valid = true;
+    _evaluateAlarm(matchedConfigIndex, tagData.temperature, tagData.batteryPct, millis());
     
-    // Bu tag daha önce kaydedilmiş mi kontrol et
-    bool isNewTag = true;
-    for (uint8_t i = 0; i < _tagCount; i++) {
-        if (strcmp(_scannedTags[i].macAddress, tagData.macAddress) == 0) {
-            isNewTag = false;
-            break;
-        }
-    }
-    
+    portENTER_CRITICAL(&_stateMux);
+    _learnSchedule(matchedConfigIndex, tagData.advCount, millis());
+    bool isNewTag = (_findTagIndex(tagData.macAddress) == 255); // Sadece yeni bulunan sensörler loglanır
     _updateTagData(tagData.macAddress, tagData);
+    portEXIT_CRITICAL(&_stateMux);
     
     // Sadece yeni bulunan sensörleri logla
     if (isNewTag) {
@@ -214,6 +275,9 @@ void BLEManager::onBLEScanResult(BLEAdvertisedDevice advertisedDevice) {
         Serial.println("\n========== BLE SENSOR FOUND ==========");
         Serial.printf("[BLE] Name: %s\n", config ? config->name : "Unknown");
         Serial.printf("[BLE] MAC: %s\n", tagData.macAddress);
+        if (!prefixMatch) {
+            Serial.printf("[BLE] Via correlated address: %s\n", macNorm);
+        }
         Serial.printf("[BLE] Temp: %.2f C | Batt: %d%% | RSSI: %d dBm\n", 
                      tagData.temperature, tagData.batteryPct, tagData.rssi);
         Serial.printf("[BLE] Found %d/%d configured sensors\n", getFoundConfiguredTagCount(), _configCount);
@@ -221,6 +285,65 @@ void BLEManager::onBLEScanResult(BLEAdvertisedDevice advertisedDevice) {
     }
 }
 
+void BLEManager::_parseAdvertisement(BLEAdvertisedDevice& device, BLEFrameInfo& frames, BLETagData& tag) {
+    // Raw payload: AD yapılarını gez
+    uint8_t* payload = device.getPayload();
+    size_t payloadLen = device.getPayloadLength();
+    
+    for (size_t i = 0; payload && i < payloadLen; ) {
+        uint8_t fieldLen = payload[i];
+        if (fieldLen == 0 || i + fieldLen >= payloadLen) break;
+        
+        uint8_t fieldType = payload[i + 1];
+        
+        // Service Data - 16-bit UUID (type 0x16)
+        if (fieldType == 0x16 && fieldLen >= 4) {
+            uint16_t serviceUUID = payload[i + 2] | (payload[i + 3] << 8);
+            if (serviceUUID == 0xFEAA) {
+                _parseEddystoneFrame(&payload[i + 4], fieldLen - 3, frames, tag);
+            }
+        }
+        
+        // Manufacturer Specific Data (type 0xFF) - Apple iBeacon
+        if (fieldType == 0xFF) {
+            _parseIBeacon(&payload[i + 2], fieldLen - 1, frames);
+        }
+        
+        i += fieldLen + 1;
+    }
+    
+    // Scan response'tan gelen service data (raw payload'da TLM yoksa)
+    // UUID burada bilinmediği için sadece TLM kabul edilir
+    if (!frames.hasTlm && device.haveServiceData()) {
+        String serviceDataStr = device.getServiceData();
+        const uint8_t* data = (const uint8_t*)serviceDataStr.c_str();
+        if (serviceDataStr.length() >= 12 && data[0] == 0x20) {
+            frames.hasTlm = _parseEddystoneTLM(data, serviceDataStr.length(), tag);
+        }
+    }
+}
+
+void BLEManager::_parseEddystoneFrame(const uint8_t* data, int len, BLEFrameInfo& frames, BLETagData& tag) {
+    if (len < 1) return;
+    
+    switch (data[0]) {
+        case 0x00: // UID
+            _parseEddystoneUID(data, len, frames);
+            break;
+        case 0x10: // URL
+            _parseEddystoneURL(data, len, frames);
+            break;
+        case 0x20: // TLM
+            if (_parseEddystoneTLM(data, len, tag)) {
+                frames.hasTlm = true;
+            }
+            break;
+        case 0x30: // EID
+            _parseEddystoneEID(data, len, frames);
+            break;
+    }
+}
+
 bool BLEManager::_parseEddystoneTLM(const uint8_t* data, int len, BLETagData& tag) {
     // Eddystone-TLM format (after service UUID):
     // [0] Frame Type (0x20)
@@ -253,39 +376,147 @@ bool BLEManager::_parseEddystoneTLM(const uint8_t* data, int len, BLETagData& ta
     return true;
 }
 
-bool BLEManager::_parseEddystoneUID(const uint8_t* data, int len, BLETagData& tag) {
-    // Eddystone-UID format: [Frame Type (0x00)] [TX Power] [Namespace (10 bytes)] [Instance (6 bytes)]
-    // UID frame doesn't contain temperature/battery data
-    // This would need to be combined with TLM frame
-    return false;
+bool BLEManager::_parseEddystoneUID(const uint8_t* data, int len, BLEFrameInfo& frames) {
+    // Eddystone-UID format: [Frame Type (0x00)] [TX Power] [Namespace (10 bytes)] [Instance (6 bytes)] [RFU (2)]
+    // UID frame doesn't contain temperature/battery data - korelasyon tablosunda TLM ile birleştirilir
+    if (len < 18) return false;
+    
+    memcpy(frames.uid, &data[2], sizeof(frames.uid));
+    frames.idFlags |= BLE_ID_UID;
+    return true;
 }
 
-bool BLEManager::_parseEddystoneURL(const uint8_t* data, int len, BLETagData& tag) {
+bool BLEManager::_parseEddystoneURL(const uint8_t* data, int len, BLEFrameInfo& frames) {
     // Eddystone-URL format: [Frame Type (0x10)] [TX Power] [URL Scheme] [Encoded URL]
     // URL frame doesn't contain temperature/battery data
-    return false;
+    static const char* const schemes[] = { "http://www.", "https://www.", "http://", "https://" };
+    static const char* const expansions[] = {
+        ".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/",
+        ".com", ".org", ".edu", ".net", ".info", ".biz", ".gov"
+    };
+    
+    if (len < 3 || data[2] > 3) return false;
+    
+    size_t pos = strlcpy(frames.url, schemes[data[2]], sizeof(frames.url));
+    for (int i = 3; i < len && pos < sizeof(frames.url) - 1; i++) {
+        if (data[i] < 14) {
+            pos += strlcpy(&frames.url[pos], expansions[data[i]], sizeof(frames.url) - pos);
+        } else if (data[i] > 0x20 && data[i] < 0x7F) {
+            frames.url[pos++] = (char)data[i];
+            frames.url[pos] = '\0';
+        }
+    }
+    frames.idFlags |= BLE_ID_URL;
+    return true;
+}
+
+bool BLEManager::_parseEddystoneEID(const uint8_t* data, int len, BLEFrameInfo& frames) {
+    // Eddystone-EID format: [Frame Type (0x30)] [TX Power] [Ephemeral ID (8 bytes)]
+    // EID periyodik döner; dönüş anına kadar adres değişimlerini birleştirmek için kullanılır
+    if (len < 10) return false;
+    
+    memcpy(frames.eid, &data[2], sizeof(frames.eid));
+    frames.idFlags |= BLE_ID_EID;
+    return true;
+}
+
+bool BLEManager::_parseIBeacon(const uint8_t* data, int len, BLEFrameInfo& frames) {
+    // iBeacon: [Company 0x004C (LE)] [Type 0x02] [Len 0x15] [UUID (16)] [Major (2)] [Minor (2)] [TX Power]
+    if (len < 25) return false;
+    if (data[0] != 0x4C || data[1] != 0x00 || data[2] != 0x02 || data[3] != 0x15) return false;
+    
+    memcpy(frames.ibeacon, &data[4], sizeof(frames.ibeacon)); // UUID + major + minor
+    frames.idFlags |= BLE_ID_IBEACON;
+    return true;
 }
 
 bool BLEManager::_matchesTargetPrefix(const char* macAddress) {
-    String macStr = String(macAddress);
-    macStr.toUpperCase();
-    macStr.replace(":", "");
-    return macStr.startsWith(BLE_TARGET_PREFIX);
+    char norm[13];
+    normalizeMac(macAddress, norm);
+    return strncmp(norm, BLE_TARGET_PREFIX, strlen(BLE_TARGET_PREFIX)) == 0;
 }
 
 void BLEManager::_updateTagData(const char* macAddress, const BLETagData& newData) {
     uint8_t index = _findTagIndex(macAddress);
+    bool newSample = true;
     
     if (index == 255) {
         // New tag - add it
-        if (_tagCount < 32) {
-            _scannedTags[_tagCount] = newData;
-            _tagCount++;
-        }
+        if (_tagCount >= 32) return;
+        index = _tagCount;
+        _scannedTags[index] = newData;
+        memset(&_scannedTags[index].stats, 0, sizeof(BLETagStats));
+        _tagCount++;
     } else {
-        // Existing tag - update it
+        // Existing tag - update latest values, keep cycle statistics
+        // Aynı TLM PDU'su tekrar raporlandıysa sıcaklık örneği sayılmaz (_learnSchedule ile aynı kural)
+        newSample = (_scannedTags[index].advCount != newData.advCount);
+        BLETagStats stats = _scannedTags[index].stats;
         _scannedTags[index] = newData;
+        _scannedTags[index].stats = stats;
+    }
+    
+    if (newSample) _accumulateTemp(_scannedTags[index].stats, newData.temperature);
+    _accumulateRssi(_scannedTags[index].stats, newData.rssi, newData.lastSeenTime);
+}
+
+void BLEManager::_accumulateTemp(BLETagStats& stats, float temp) {
+    // Welford: ortalama ve varyans tek geçişte, sabit bellekle
+    if (stats.tlmCount == 0) {
+        stats.tempMin = temp;
+        stats.tempMax = temp;
+    } else {
+        if (temp < stats.tempMin) stats.tempMin = temp;
+        if (temp > stats.tempMax) stats.tempMax = temp;
+    }
+    if (stats.tlmCount < 0xFFFF) stats.tlmCount++;
+    float delta = temp - stats.tempMean;
+    stats.tempMean += delta / stats.tlmCount;
+    stats.tempM2 += delta * (temp - stats.tempMean);
+}
+
+void BLEManager::_accumulateRssi(BLETagStats& stats, int rssi, uint32_t epoch) {
+    if (stats.frameCount == 0) {
+        stats.rssiMin = rssi;
+        stats.rssiMax = rssi;
+        stats.firstSeenTime = epoch;
+    } else {
+        if (rssi < stats.rssiMin) stats.rssiMin = rssi;
+        if (rssi > stats.rssiMax) stats.rssiMax = rssi;
+    }
+    if (stats.frameCount < 0xFFFF) stats.frameCount++;
+    stats.rssiMean += (rssi - stats.rssiMean) / stats.frameCount;
+}
+
+void BLEManager::appendTagStats(JsonObject& sensor, const BLETagData& tag) {
+    const BLETagStats& st = tag.stats;
+    if (st.frameCount == 0) return;
+    
+    float tempStd = (st.tlmCount > 1) ? sqrtf(st.tempM2 / st.tlmCount) : 0.0f;
+    
+    JsonObject stats = sensor.createNestedObject("stats");
+    stats["tMin"] = roundf(st.tempMin * 100.0f) / 100.0f;
+    stats["tMax"] = roundf(st.tempMax * 100.0f) / 100.0f;
+    stats["tAvg"] = roundf(st.tempMean * 100.0f) / 100.0f;
+    stats["tStd"] = roundf(tempStd * 100.0f) / 100.0f;
+    stats["rMin"] = st.rssiMin;
+    stats["rMax"] = st.rssiMax;
+    stats["rAvg"] = roundf(st.rssiMean * 10.0f) / 10.0f;
+    int configIndex = _findConfigIndex(tag.macAddress);
+    if (configIndex >= 0) {
+        portENTER_CRITICAL(&_stateMux);
+        float estimate = _presence[configIndex].rssiEstimate;
+        bool filtered = _presence[configIndex].rssiVariance > 0;
+        portEXIT_CRITICAL(&_stateMux);
+        if (filtered) {
+            stats["rF"] = roundf(estimate * 10.0f) / 10.0f; // Kalman
+            stats["present"] = _presence[configIndex].present;
+        }
     }
+    stats["frames"] = st.frameCount;
+    stats["tlm"] = st.tlmCount;
+    stats["first"] = st.firstSeenTime;
+    stats["last"] = tag.lastSeenTime;
 }
 
 uint8_t BLEManager::_findTagIndex(const char* macAddress) {
@@ -297,19 +528,158 @@ uint8_t BLEManager::_findTagIndex(const char* macAddress) {
     return 255; // Not found
 }
 
+int BLEManager::_findConfigIndex(const char* macAddress) {
+    char norm[13];
+    normalizeMac(macAddress, norm);
+    return _findConfigIndexNorm(norm);
+}
+
+int BLEManager::_findConfigIndexNorm(const char* normMac) {
+    for (uint8_t i = 0; i < _configCount; i++) {
+        if (strcmp(_tagConfigs[i].normMac, normMac) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool BLEManager::_isConfigFound(uint8_t configIndex) {
+    // Bu MAC taranan tag'larda var mı ve valid mi?
+    const char* configMac = _tagConfigs[configIndex].normMac;
+    bool found = false;
+    portENTER_CRITICAL(&_stateMux);
+    for (uint8_t j = 0; j < _tagCount && !found; j++) {
+        found = _scannedTags[j].valid && macMatches(_scannedTags[j].macAddress, configMac);
+    }
+    portEXIT_CRITICAL(&_stateMux);
+    return found;
+}
+
+// ===== Tarama Zamanlayıcı =====
+
+void BLEManager::_learnSchedule(uint8_t configIndex, uint32_t advCount, uint32_t nowMs) {
+    if (configIndex >= 32) return;
+    BLETagSchedule& sch = _schedules[configIndex];
+    
+    if (sch.samples > 0) {
+        if (advCount == sch.lastAdvCount) return; // Aynı PDU tekrar raporlandı
+        
+        if (advCount < sch.lastAdvCount) {
+            // Tag yeniden başlamış (sayaç sıfırlandı) - yeniden öğren
+            memset(&sch, 0, sizeof(BLETagSchedule));
+        } else {
+            uint32_t dAdv = advCount - sch.lastAdvCount;
+            uint32_t dt = nowMs - sch.lastTlmMs;
+            uint32_t interval = dt / dAdv;
+            if (interval > 0) {
+                sch.advIntervalMs = (sch.advIntervalMs == 0) ? interval 
+                                                             : (sch.advIntervalMs * 3 + interval) / 4;
+            }
+            // Kaçırılan TLM'ler farkı katlarına çıkarır, en küçüğü gerçek adımdır
+            if (sch.tlmStride == 0 || dAdv < sch.tlmStride) {
+                sch.tlmStride = dAdv;
+            }
+        }
+    }
+    
+    if (sch.samples < 255) sch.samples++;
+    sch.lastAdvCount = advCount;
+    sch.lastTlmMs = nowMs;
+}
+
+static uint32_t expectedTlmInterval(const BLETagSchedule& sch) {
+    if (sch.samples < 2 || sch.advIntervalMs == 0 || sch.tlmStride == 0) return 0;
+    return sch.advIntervalMs * sch.tlmStride;
+}
+
+// Callback'in yazdığı zamanlama kaydının tutarlı kopyası
+BLETagSchedule BLEManager::_copySchedule(uint8_t configIndex) {
+    portENTER_CRITICAL(&_stateMux);
+    BLETagSchedule sch = _schedules[configIndex];
+    portEXIT_CRITICAL(&_stateMux);
+    return sch;
+}
+
+uint32_t BLEManager::getExpectedTlmIntervalMs(uint8_t configIndex) {
+    if (configIndex >= _configCount) return 0;
+    return expectedTlmInterval(_copySchedule(configIndex));
+}
+
+bool BLEManager::_allSchedulesLearned() {
+    for (uint8_t i = 0; i < _configCount; i++) {
+        if (_tagConfigs[i].enabled && getExpectedTlmIntervalMs(i) == 0) return false;
+    }
+    return true;
+}
+
+bool BLEManager::_isSampleDue(uint8_t configIndex, uint32_t nowMs) {
+    // Hold-off'taki aday alarmı onaylamak için sonraki TLM hemen beklenir
+    if (_alarms[configIndex].candidate != _alarms[configIndex].state) return true;
+    if (_sampleIntervalMs == 0) return false;
+    return nowMs - _copySchedule(configIndex).lastTlmMs >= _sampleIntervalMs;
+}
+
+bool BLEManager::_anySampleDue(uint32_t nowMs) {
+    for (uint8_t i = 0; i < _configCount; i++) {
+        if (_tagConfigs[i].enabled && _isSampleDue(i, nowMs)) return true;
+    }
+    return false;
+}
+
+uint32_t BLEManager::_nextWindowSeconds(uint32_t nowMs, bool samplingOnly) {
+    uint32_t windowS = 0;
+    
+    for (uint8_t i = 0; i < _configCount; i++) {
+        if (!_tagConfigs[i].enabled) continue;
+        // Keşif: bu periyotta bulunmamış tag'lar; örnekleme: son TLM'i eskimiş tag'lar
+        if (samplingOnly ? !_isSampleDue(i, nowMs) : _isConfigFound(i)) continue;
+        
+        BLETagSchedule sch = _copySchedule(i);
+        uint32_t period = expectedTlmInterval(sch);
+        
+        // Öğrenilmemiş veya uzun süredir duyulmayan tag - keşif penceresi
+        if (period == 0 || nowMs - sch.lastTlmMs > period * BLE_STALE_PERIODS) {
+            return BLE_DISCOVERY_WINDOW_S;
+        }
+        
+        uint32_t guard = max(BLE_MIN_GUARD_MS, period / 8);
+        uint32_t sinceLast = (nowMs - sch.lastTlmMs) % period;
+        uint32_t untilNext = period - sinceLast;
+        
+        if (untilNext <= guard || sinceLast <= guard) {
+            uint32_t s = (2 * guard + 999) / 1000;
+            if (s > windowS) windowS = s;
+        }
+    }
+    
+    return windowS;
+}
+
+void BLEManager::_stopWindow() {
+    pBLEScan->stop();
+    _cycleRadioOnMs += millis() - _windowStartMs;
+    _scanning = false;
+    pBLEScan->clearResults();
+}
+
 uint8_t BLEManager::getScannedTagCount() {
     return _tagCount;
 }
 
-BLETagData* BLEManager::getScannedTag(uint8_t index) {
-    if (index >= _tagCount) return nullptr;
-    return &_scannedTags[index];
+bool BLEManager::getScannedTag(uint8_t index, BLETagData& out) {
+    portENTER_CRITICAL(&_stateMux);
+    bool found = index < _tagCount;
+    if (found) out = _scannedTags[index];
+    portEXIT_CRITICAL(&_stateMux);
+    return found;
 }
 
-BLETagData* BLEManager::getTagByMac(const char* macAddress) {
+bool BLEManager::getTagByMac(const char* macAddress, BLETagData& out) {
+    portENTER_CRITICAL(&_stateMux);
     uint8_t index = _findTagIndex(macAddress);
-    if (index == 255) return nullptr;
-    return &_scannedTags[index];
+    if (index != 255) out = _scannedTags[index];
+    portEXIT_CRITICAL(&_stateMux);
+    return index != 255;
 }
 
 void BLEManager::updateTagConfig(const BLETagConfig& config) {
@@ -317,6 +687,7 @@ void BLEManager::updateTagConfig(const BLETagConfig& config) {
     for (uint8_t i = 0; i < _configCount; i++) {
         if (strcmp(_tagConfigs[i].macAddress, config.macAddress) == 0) {
             _tagConfigs[i] = config;
+            normalizeMac(config.macAddress, _tagConfigs[i].normMac);
             return;
         }
     }
@@ -324,26 +695,31 @@ void BLEManager::updateTagConfig(const BLETagConfig& config) {
     // Add new config
     if (_configCount < 32) {
         _tagConfigs[_configCount] = config;
+        normalizeMac(config.macAddress, _tagConfigs[_configCount].normMac);
         _configCount++;
     }
 }
 
 BLETagConfig* BLEManager::getTagConfig(const char* macAddress) {
-    // MAC adresini normalize et (uppercase, no colons)
-    String searchMac = String(macAddress);
-    searchMac.toUpperCase();
-    searchMac.replace(":", "");
-    
+    int index = _findConfigIndex(macAddress);
+    if (index < 0) return nullptr;
+    return &_tagConfigs[index];
+}
+
+uint32_t BLEManager::getConfigDictionaryId() {
+    // FNV-1a (config sırası + MAC) - sunucu tarafı sözlük eşleşmesini doğrular
+    uint32_t hash = 2166136261UL;
     for (uint8_t i = 0; i < _configCount; i++) {
-        String configMac = String(_tagConfigs[i].macAddress);
-        configMac.toUpperCase();
-        configMac.replace(":", "");
-        
-        if (configMac == searchMac) {
-            return &_tagConfigs[i];
+        for (const char* p = _tagConfigs[i].macAddress; *p; p++) {
+            char c = toupper(*p);
+            if (c == ':') continue;
+            hash ^= (uint8_t)c;
+            hash *= 16777619UL;
         }
+        hash ^= 0xFF; // Kayıt ayırıcı
+        hash *= 16777619UL;
     }
-    return nullptr;
+    return hash;
 }
 
 void BLEManager::loadConfigFromCfg(const Cfg& cfg) {
@@ -353,6 +729,7 @@ void BLEManager::loadConfigFromCfg(const Cfg& cfg) {
         if (cfg.eddystoneSensors[i].enabled && strlen(cfg.eddystoneSensors[i].macAddress) > 0) {
             BLETagConfig tagConfig;
             strlcpy(tagConfig.macAddress, cfg.eddystoneSensors[i].macAddress, sizeof(tagConfig.macAddress));
+            normalizeMac(tagConfig.macAddress, tagConfig.normMac);
             strlcpy(tagConfig.name, cfg.eddystoneSensors[i].sensorName, sizeof(tagConfig.name));
             strlcpy(tagConfig.mahalId, cfg.eddystoneSensors[i].mahalId, sizeof(tagConfig.mahalId));
             tagConfig.tempHigh = cfg.eddystoneSensors[i].tempHigh;
@@ -363,23 +740,34 @@ void BLEManager::loadConfigFromCfg(const Cfg& cfg) {
             _configCount++;
         }
     }
+    portENTER_CRITICAL(&_stateMux);
+    memset(_schedules, 0, sizeof(_schedules)); // Yeni config - periyotlar yeniden öğrenilir
+    memset(_alarms, 0, sizeof(_alarms));
+    memset(_presence, 0, sizeof(_presence));
+    _presenceEventCount = 0;
+    _clearCorrelation(); // Config index'leri değişti
+    portEXIT_CRITICAL(&_stateMux);
+    applyBeaconSettings(cfg.beacon);
     Serial.printf("[BLE] Loaded %d eddystone configs from Cfg\n", _configCount);
 }
 
 void BLEManager::publishScannedTags(MQTTManager* mqtt, const char* gatewayMac, uint32_t epoch) {
     if (!mqtt || _tagCount == 0) return;
     
-    for (uint8_t i = 0; i < _tagCount; i++) {
-        if (!_scannedTags[i].valid) continue;
+    uint8_t count = _tagCount;
+    for (uint8_t i = 0; i < count; i++) {
+        BLETagData tag;
+        if (!getScannedTag(i, tag) || !tag.valid) continue;
         
-        BLETagConfig* config = getTagConfig(_scannedTags[i].macAddress);
+        BLETagConfig* config = getTagConfig(tag.macAddress);
         
         // MAC adresini normalize et (uppercase, no colons)
-        String normalizedMac = String(_scannedTags[i].macAddress);
+        String normalizedMac = String(tag.macAddress);
         normalizedMac.toUpperCase();
         normalizedMac.replace(":", "");
         
-        DynamicJsonDocument doc(1024);
+        JsonLease lease("bleTag", 1024);
+        JsonDocument& doc = lease.doc();
         doc["msg"] = "advData";
         doc["gmac"] = gatewayMac;
         doc["stat"] = "online";
@@ -391,17 +779,20 @@ void BLEManager::publishScannedTags(MQTTManager* mqtt, const char* gatewayMac, u
         sensor["dmac"] = normalizedMac; // Büyük harf, : olmadan
         sensor["name"] = config ? config->name : "Unknown";
         sensor["location"] = config ? config->mahalId : "";
-        sensor["temp"] = _scannedTags[i].temperature;
-        sensor["batt"] = _scannedTags[i].batteryPct;
-        sensor["rssi"] = _scannedTags[i].rssi;
+        sensor["temp"] = tag.temperature;
+        sensor["batt"] = tag.batteryPct;
+        sensor["rssi"] = tag.rssi;
         sensor["time"] = epoch;
-        sensor["advCount"] = _scannedTags[i].advCount;
+        sensor["advCount"] = tag.advCount;
+        appendTagStats(sensor, tag);
+        appendTagIdentity(sensor, tag);
         
         String topic = mqtt->getDataTopic(gatewayMac);
-        String payload;
-        serializeJson(doc, payload);
+        size_t payloadLen = 0;
+        const char* payload = lease.serialize(&payloadLen);
+        if (!payload) continue;
         
-        mqtt->publishRaw(topic.c_str(), payload.c_str());
+        mqtt->enqueue(topic.c_str(), (const uint8_t*)payload, payloadLen, MQTT_PRIO_DATA);
     }
 }
 
@@ -415,21 +806,8 @@ uint8_t BLEManager::getFoundConfiguredTagCount() {
     uint8_t foundCount = 0;
     
     for (uint8_t i = 0; i < _configCount; i++) {
-        // Config'deki MAC'i normalize et
-        String configMac = String(_tagConfigs[i].macAddress);
-        configMac.toUpperCase();
-        configMac.replace(":", "");
-        
-        // Bu MAC taranan tag'larda var mı ve valid mi?
-        for (uint8_t j = 0; j < _tagCount; j++) {
-            String scannedMac = String(_scannedTags[j].macAddress);
-            scannedMac.toUpperCase();
-            scannedMac.replace(":", "");
-            
-            if (configMac == scannedMac && _scannedTags[j].valid) {
-                foundCount++;
-                break;
-            }
+        if (_isConfigFound(i)) {
+            foundCount++;
         }
     }
     
@@ -442,13 +820,346 @@ bool BLEManager::allConfiguredTagsFound() {
 }
 
 void BLEManager::clearScannedTags() {
-    memset(_scannedTags, 0, sizeof(_scannedTags));
+    portENTER_CRITICAL(&_stateMux);
+    memset(_scannedTags, 0, sizeof(_scannedTags)); // İstatistikler de sıfırlanır
     _tagCount = 0;
+    portEXIT_CRITICAL(&_stateMux);
     Serial.println("[BLE] Cleared scanned tags buffer for new cycle");
 }
 
 void BLEManager::startScanCycle() {
     clearScannedTags();
+    _cycleRadioOnMs = 0;
     Serial.printf("[BLE] Starting new scan cycle - looking for %d configured sensors\n", _configCount);
 }
 
+void BLEManager::endScanCycle() {
+    if (_initialized && pBLEScan && _scanning) {
+        _stopWindow();
+    }
+    Serial.printf("[BLE] Cycle radio-on time: %lu ms (%s scan)\n", 
+                 (unsigned long)_cycleRadioOnMs, _activeScan ? "active" : "passive");
+}
+
+void BLEManager::pauseScan() {
+    if (_initialized && pBLEScan && _scanning) {
+        _stopWindow();
+    }
+}
+
+uint32_t BLEManager::getCycleRadioOnMs() {
+    // Açık pencere varsa şu ana kadarki süreyi de say
+    if (_scanning) return _cycleRadioOnMs + (millis() - _windowStartMs);
+    return _cycleRadioOnMs;
+}
+
+// ===== Tag Eşik Alarmları =====
+
+void BLEManager::_evaluateAlarm(uint8_t configIndex, float temp, int battPct, uint32_t nowMs) {
+    if (configIndex >= _configCount) return;
+    const BLETagConfig& config = _tagConfigs[configIndex];
+    BLETagAlarm& alarm = _alarms[configIndex];
+    
+    // Dahili sensörle aynı histerezis/hold-off (AlarmManager::evaluateThreshold)
+    uint8_t target = AlarmManager::evaluateThreshold(alarm.state, alarm.candidate, alarm.candidateSinceMs,
+                                                     temp, config.tempHigh, config.tempLow, nowMs);
+    if (target == alarm.state) return;
+    
+    portENTER_CRITICAL(&_stateMux);
+    alarm.state = target;
+    alarm.temperature = temp;
+    alarm.batteryPct = battPct;
+    alarm.publishPending = true;
+    alarm.seq++;
+    alarm.lastAttemptMs = 0;
+    portEXIT_CRITICAL(&_stateMux);
+}
+
+void BLEManager::processAlarms(MQTTManager* mqtt, const char* gatewayMac) {
+    uint32_t now = millis();
+    
+    for (uint8_t i = 0; i < _configCount; i++) {
+        BLETagAlarm& alarm = _alarms[i];
+        
+        // Callback'in yazdığı geçişin tutarlı kopyası
+        portENTER_CRITICAL(&_stateMux);
+        bool pending = alarm.publishPending &&
+                       !(alarm.lastAttemptMs != 0 && now - alarm.lastAttemptMs < BLE_ALARM_RETRY_MS);
+        if (pending) alarm.lastAttemptMs = now;
+        uint8_t state = alarm.state;
+        float temperature = alarm.temperature;
+        int batteryPct = alarm.batteryPct;
+        uint16_t seq = alarm.seq;
+        portEXIT_CRITICAL(&_stateMux);
+        if (!pending) continue;
+        
+        const char* reason = (state == 1) ? "TEMP_HIGH" : (state == 2) ? "TEMP_LOW" : "NORMAL";
+        Serial.printf("[BLE-ALARM] %s (%s): %s at %.2f C\n", 
+                     _tagConfigs[i].name, _tagConfigs[i].macAddress, reason, temperature);
+        
+        if (!mqtt) continue;
+        
+        if (mqtt->publishAlarm(gatewayMac, state, reason, temperature, batteryPct,
+                               _tagConfigs[i].normMac, _tagConfigs[i].name)) {
+            // Publish sırasında yeni geçiş olduysa bekleyen bayrağı korunur
+            portENTER_CRITICAL(&_stateMux);
+            if (alarm.seq == seq) alarm.publishPending = false;
+            portEXIT_CRITICAL(&_stateMux);
+        }
+    }
+}
+
+bool BLEManager::isBuzzerRequested() {
+    for (uint8_t i = 0; i < _configCount; i++) {
+        if (_tagConfigs[i].buzzerEnabled && _alarms[i].state != 0) return true;
+    }
+    return false;
+}
+
+uint8_t BLEManager::getTagAlarmState(const char* macAddress) {
+    int index = _findConfigIndex(macAddress);
+    if (index < 0) return 0;
+    return _alarms[index].state;
+}
+
+// ===== Frame Korelasyon Tablosu =====
+
+void BLEManager::_clearCorrelation() {
+    memset(_correlation, 0, sizeof(_correlation));
+    for (uint8_t i = 0; i < BLE_CORR_TABLE_SIZE; i++) {
+        _correlation[i].configIndex = -1;
+    }
+}
+
+int BLEManager::_findCorrelationByAddress(const char* address) {
+    for (uint8_t i = 0; i < BLE_CORR_TABLE_SIZE; i++) {
+        if (_correlation[i].configIndex >= 0 && strcmp(_correlation[i].address, address) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int BLEManager::_findCorrelationByIdentity(const BLEFrameInfo& frames) {
+    uint8_t flags = frames.idFlags & BLE_ID_MATCHABLE;
+    if (flags == 0) return -1;
+    
+    for (uint8_t i = 0; i < BLE_CORR_TABLE_SIZE; i++) {
+        const BLECorrelationEntry& e = _correlation[i];
+        if (e.configIndex < 0) continue;
+        uint8_t common = flags & e.idFlags;
+        
+        if ((common & BLE_ID_UID) && memcmp(e.uid, frames.uid, sizeof(e.uid)) == 0) return i;
+        if ((common & BLE_ID_EID) && memcmp(e.eid, frames.eid, sizeof(e.eid)) == 0) return i;
+        if ((common & BLE_ID_IBEACON) && memcmp(e.ibeacon, frames.ibeacon, sizeof(e.ibeacon)) == 0) return i;
+    }
+    return -1;
+}
+
+int BLEManager::_allocCorrelation() {
+    // Boş kayıt yoksa en uzun süredir kullanılmayanı (LRU) çıkar
+    int victim = 0;
+    for (uint8_t i = 0; i < BLE_CORR_TABLE_SIZE; i++) {
+        if (_correlation[i].configIndex < 0) {
+            victim = i;
+            break;
+        }
+        if (_correlation[i].lastUsedMs < _correlation[victim].lastUsedMs) {
+            victim = i;
+        }
+    }
+    memset(&_correlation[victim], 0, sizeof(BLECorrelationEntry));
+    _correlation[victim].configIndex = -1;
+    return victim;
+}
+
+int BLEManager::_correlate(const char* address, const char* deviceAddress, 
+                           const BLEFrameInfo& frames, int configIndex) {
+    int idx = _findCorrelationByAddress(address);
+    if (idx < 0) idx = _findCorrelationByIdentity(frames);
+    
+    if (idx < 0) {
+        // Tabloya sadece config'deki tag'lar girer (çevredeki cihazlar LRU'yu doldurmasın)
+        if (configIndex < 0) return -1;
+        idx = _allocCorrelation();
+    }
+    
+    BLECorrelationEntry& e = _correlation[idx];
+    strlcpy(e.address, address, sizeof(e.address)); // Adres dönmüş olabilir
+    if (frames.idFlags & BLE_ID_UID) memcpy(e.uid, frames.uid, sizeof(e.uid));
+    if (frames.idFlags & BLE_ID_EID) memcpy(e.eid, frames.eid, sizeof(e.eid));
+    if (frames.idFlags & BLE_ID_IBEACON) memcpy(e.ibeacon, frames.ibeacon, sizeof(e.ibeacon));
+    if (frames.idFlags & BLE_ID_URL) strlcpy(e.url, frames.url, sizeof(e.url));
+    e.idFlags |= frames.idFlags;
+    e.lastUsedMs = millis();
+    
+    // Config'deki adresten gelen frame kaydı o tag'a bağlar
+    if (configIndex >= 0 && e.configIndex != configIndex) {
+        e.configIndex = configIndex;
+        strlcpy(e.homeAddress, deviceAddress, sizeof(e.homeAddress));
+    }
+    
+    return (e.configIndex >= 0) ? idx : -1;
+}
+
+static void appendHex(String& out, const uint8_t* data, size_t len) {
+    char hex[3];
+    for (size_t i = 0; i < len; i++) {
+        snprintf(hex, sizeof(hex), "%02X", data[i]);
+        out += hex;
+    }
+}
+
+void BLEManager::appendTagIdentity(JsonObject& sensor, const BLETagData& tag) {
+    int configIndex = _findConfigIndex(tag.macAddress);
+    if (configIndex < 0) return;
+    
+    for (uint8_t i = 0; i < BLE_CORR_TABLE_SIZE; i++) {
+        // Callback korelasyon kaydını günceller - tutarlı kopya üzerinden biçimlendir
+        portENTER_CRITICAL(&_stateMux);
+        BLECorrelationEntry e = _correlation[i];
+        portEXIT_CRITICAL(&_stateMux);
+        if (e.configIndex != configIndex) continue;
+        
+        if (e.idFlags & BLE_ID_UID) {
+            String uid;
+            appendHex(uid, e.uid, sizeof(e.uid));
+            sensor["uid"] = uid;
+        }
+        if (e.idFlags & BLE_ID_URL) {
+            sensor["url"] = e.url;
+        }
+        if (e.idFlags & BLE_ID_IBEACON) {
+            String ib;
+            appendHex(ib, e.ibeacon, 16);
+            ib += ":" + String((e.ibeacon[16] << 8) | e.ibeacon[17]);
+            ib += ":" + String((e.ibeacon[18] << 8) | e.ibeacon[19]);
+            sensor["ibeacon"] = ib; // UUID:major:minor
+        }
+        return;
+    }
+}
+
+// ===== Varlık Algılama =====
+
+void BLEManager::applyBeaconSettings(const BeaconSettings& beacon) {
+    _sampleIntervalMs = beacon.scanInterval; // Periyot içi örnekleme aralığı (0 = kapalı)
+    _presenceEnterRssi = beacon.presenceEnterRssi;
+    _presenceExitRssi = beacon.presenceExitRssi;
+    _presenceEnterMs = beacon.presenceEnterMs;
+    _presenceExitMs = beacon.presenceExitMs;
+    _presenceTimeoutMs = beacon.timeoutMs;
+}
+
+void BLEManager::_filterRssi(uint8_t configIndex, int rssi, uint32_t nowMs) {
+    if (configIndex >= 32) return;
+    BLETagPresence& p = _presence[configIndex];
+    
+    portENTER_CRITICAL(&_stateMux);
+    if (p.rssiVariance <= 0) {
+        // İlk ölçüm - filtreyi başlat
+        p.rssiEstimate = rssi;
+        p.rssiVariance = BLE_RSSI_MEASURE_NOISE;
+    } else {
+        // 1-D Kalman: tahmin + güncelleme
+        float prior = p.rssiVariance + BLE_RSSI_PROCESS_NOISE;
+        float gain = prior / (prior + BLE_RSSI_MEASURE_NOISE);
+        p.rssiEstimate += gain * (rssi - p.rssiEstimate);
+        p.rssiVariance = (1.0f - gain) * prior;
+    }
+    p.lastSeenMs = nowMs;
+    portEXIT_CRITICAL(&_stateMux);
+}
+
+void BLEManager::_queuePresenceEvent(uint8_t configIndex, bool present, int rssi) {
+    // Kuyruk doluysa en eski olay düşer
+    uint8_t slot = (_presenceEventHead + _presenceEventCount) % 8;
+    if (_presenceEventCount == 8) {
+        _presenceEventHead = (_presenceEventHead + 1) % 8;
+    } else {
+        _presenceEventCount++;
+    }
+    _presenceEvents[slot].configIndex = configIndex;
+    _presenceEvents[slot].present = present;
+    _presenceEvents[slot].rssi = (int8_t)constrain(rssi, -127, 0);
+    _presenceEvents[slot].epoch = time(nullptr);
+}
+
+void BLEManager::processPresence(MQTTManager* mqtt, const char* gatewayMac) {
+    uint32_t now = millis();
+    
+    for (uint8_t i = 0; i < _configCount; i++) {
+        if (!_tagConfigs[i].enabled) continue;
+        BLETagPresence& p = _presence[i];
+        
+        // Callback'in yazdığı filtre alanlarının tutarlı kopyası
+        portENTER_CRITICAL(&_stateMux);
+        float estimate = p.rssiEstimate;
+        float variance = p.rssiVariance;
+        uint32_t lastSeenMs = p.lastSeenMs;
+        portEXIT_CRITICAL(&_stateMux);
+        if (variance <= 0) continue; // Hiç görülmedi
+        
+        int rssi = (int)lroundf(estimate);
+        // now örneklendikten sonra gelen frame (lastSeenMs > now) zaman aşımı sayılmaz
+        int32_t silentMs = (int32_t)(now - lastSeenMs);
+        bool timedOut = (_presenceTimeoutMs > 0 && silentMs >= 0 && (uint32_t)silentMs >= _presenceTimeoutMs);
+        
+        if (p.present && timedOut) {
+            // Uzun süredir frame yok - hemen çıkış; arada frame geldiyse filtre korunur
+            portENTER_CRITICAL(&_stateMux);
+            bool stillSilent = (p.lastSeenMs == lastSeenMs);
+            if (stillSilent) p.rssiVariance = 0; // Yeniden görüldüğünde filtre sıfırdan başlar
+            portEXIT_CRITICAL(&_stateMux);
+            if (!stillSilent) continue;
+            p.present = false;
+            p.candidateSinceMs = 0;
+            _queuePresenceEvent(i, false, rssi);
+            continue;
+        }
+        if (timedOut) continue;
+        
+        // Karşı eşik aşıldı mı? (enter/exit arası histerezis bölgesi)
+        bool crossing = p.present ? (estimate < _presenceExitRssi) 
+                                  : (estimate >= _presenceEnterRssi);
+        if (!crossing) {
+            p.candidateSinceMs = 0;
+            continue;
+        }
+        if (p.candidateSinceMs == 0) {
+            p.candidateSinceMs = now;
+        }
+        
+        uint32_t dwell = p.present ? _presenceExitMs : _presenceEnterMs;
+        if (now - p.candidateSinceMs >= dwell) {
+            p.present = !p.present;
+            p.candidateSinceMs = 0;
+            _queuePresenceEvent(i, p.present, rssi);
+        }
+    }
+    
+    // Olayları geçiş anında gönder (başarısızsa 10 sn sonra tekrar)
+    while (_presenceEventCount > 0) {
+        if (_presenceRetryMs != 0 && now - _presenceRetryMs < BLE_ALARM_RETRY_MS) return;
+        
+        const BLEPresenceEvent& ev = _presenceEvents[_presenceEventHead];
+        const BLETagConfig& config = _tagConfigs[ev.configIndex];
+        
+        Serial.printf("[BLE-PRESENCE] %s (%s): %s, RSSI=%d dBm\n", 
+                     config.name, config.normMac, ev.present ? "ENTER" : "EXIT", ev.rssi);
+        
+        if (!mqtt || !mqtt->publishPresence(gatewayMac, config.normMac, ev.present, ev.rssi, ev.epoch)) {
+            _presenceRetryMs = now;
+            return;
+        }
+        _presenceRetryMs = 0;
+        _presenceEventHead = (_presenceEventHead + 1) % 8;
+        _presenceEventCount--;
+    }
+}
+
+bool BLEManager::isTagPresent(const char* macAddress) {
+    int index = _findConfigIndex(macAddress);
+    if (index < 0) return false;
+    return _presence[index].present;
+}
@@ -2,25 +2,97 @@
 #define BLE_MANAGER_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include "ConfigManager.h"
 
 // Forward declaration
 class MQTTManager;
 
+// Tek bir reklamdan çözülen frame'ler (Eddystone UID/URL/EID/TLM + iBeacon)
+struct BLEFrameInfo {
+    uint8_t idFlags;          // Bulunan kimlik frame'leri (BLE_ID_* bayrakları)
+    bool hasTlm;              // TLM çözüldü (BLETagData'ya yazıldı)
+    uint8_t uid[16];          // Eddystone-UID namespace(10) + instance(6)
+    uint8_t eid[8];           // Eddystone-EID (dönen kimlik)
+    uint8_t ibeacon[20];      // iBeacon UUID(16) + major(2) + minor(2)
+    char url[32];             // Çözülmüş Eddystone-URL
+};
+
+// Korelasyon tablosu kaydı: aynı fiziksel tag'ın farklı adres ve frame'lerini birleştirir
+// Sabit boyutlu, LRU ile çıkarılır
+static constexpr uint8_t BLE_CORR_TABLE_SIZE = 16;
+struct BLECorrelationEntry {
+    char address[13];         // Son görülen adres (normalize, ':' yok)
+    char homeAddress[18];     // Config'e bağlandığı adres (tag buffer anahtarı)
+    int8_t configIndex;       // Bağlı config (-1 = boş kayıt)
+    uint8_t idFlags;          // Bilinen kimlikler
+    uint8_t uid[16];
+    uint8_t eid[8];
+    uint8_t ibeacon[20];
+    char url[32];
+    uint32_t lastUsedMs;      // LRU
+};
+
+// Tag varlık (giriş/çıkış) durumu - RSSI 1-D Kalman filtresi ile
+struct BLETagPresence {
+    float rssiEstimate;       // Filtrelenmiş RSSI (dBm)
+    float rssiVariance;       // Kalman hata varyansı (0 = henüz ölçüm yok)
+    uint32_t lastSeenMs;      // Son frame (herhangi bir tip)
+    bool present;             // Onaylanmış durum
+    uint32_t candidateSinceMs;// Karşı eşiğin aşıldığı an (0 = aday yok)
+};
+
+// Yayınlanmayı bekleyen varlık olayı
+struct BLEPresenceEvent {
+    uint8_t configIndex;
+    bool present;
+    int8_t rssi;
+    uint32_t epoch;
+};
+
+// Tag eşik alarm durumu (config index ile eşleşir)
+// Durum kodları AlarmManager ile aynı: 0 normal, 1 yüksek, 2 düşük
+struct BLETagAlarm {
+    uint8_t state;            // Onaylanmış alarm durumu
+    uint8_t candidate;        // Hold-off süresindeki aday durum
+    uint32_t candidateSinceMs;// Aday durumun ilk görüldüğü an
+    float temperature;        // Geçişi tetikleyen sıcaklık
+    int batteryPct;
+    bool publishPending;      // Loop'ta publish edilecek geçiş var
+    uint16_t seq;             // Her geçişte artar; publish sonrası temizleme bununla doğrulanır
+    uint32_t lastAttemptMs;   // Son publish denemesi
+};
+
+// Periyot içi tag istatistikleri (her frame'de O(1) güncellenir)
+struct BLETagStats {
+    float tempMin;            // Min sıcaklık (C)
+    float tempMax;            // Max sıcaklık (C)
+    float tempMean;           // Ortalama sıcaklık (Welford)
+    float tempM2;             // Welford kare farkları toplamı (stddev için)
+    int16_t rssiMin;          // Min RSSI (dBm)
+    int16_t rssiMax;          // Max RSSI (dBm)
+    float rssiMean;           // Ortalama RSSI (dBm)
+    uint16_t frameCount;      // Alınan toplam frame (tüm tipler)
+    uint16_t tlmCount;        // Alınan TLM frame (sıcaklık örneği)
+    uint32_t firstSeenTime;   // Periyotta ilk görülme (epoch)
+};
+
 // BLE Eddystone Tag Data Structure
 struct BLETagData {
     char macAddress[18];      // MAC address (e.g., "8C:69:6B:XX:XX:XX")
     float temperature;        // Temperature in Celsius
     int batteryPct;           // Battery percentage (0-100)
     int rssi;                 // RSSI in dBm
-    uint16_t advCount;        // Advertisement count
+    uint32_t advCount;        // Advertisement count (TLM 32-bit sayaç)
     uint32_t lastSeenTime;    // Last seen timestamp (epoch)
     bool valid;               // Is this tag data valid
+    BLETagStats stats;        // Periyot içi toplu istatistikler
 };
 
 // BLE Eddystone Tag Configuration (from broker)
 struct BLETagConfig {
     char macAddress[18];
+    char normMac[13];         // Normalize MAC (büyük harf, ':' yok) - yüklemede bir kez, tarama yolu bununla karşılaştırır
     char name[32];
     char mahalId[25];
     float tempHigh;
@@ -29,25 +101,61 @@ struct BLETagConfig {
     bool enabled;
 };
 
+// Tag başına tarama zamanlama durumu (periyotlar arası korunur)
+// advCount deltalarından tag'ın reklam aralığı ve TLM adımı öğrenilir,
+// böylece radyo sadece TLM beklenen anlarda açılır.
+struct BLETagSchedule {
+    uint32_t lastAdvCount;    // Son TLM'deki advCount
+    uint32_t lastTlmMs;       // Son TLM alındığı an (millis)
+    uint32_t advIntervalMs;   // Öğrenilen reklam aralığı (ms, EMA)
+    uint32_t tlmStride;       // İki TLM arasındaki en küçük advCount farkı
+    uint8_t samples;          // Öğrenme örnek sayısı
+};
+
 class BLEManager {
 public:
     BLEManager();
     bool begin();
     void loadConfigFromCfg(const Cfg& cfg); // Load eddystone config from Cfg
-    void scan(); // Call in loop to scan for BLE tags (only scans when GPS fix valid)
+    void scan(); // Call every loop - opens scan windows only when TLM frames are expected
+    // Tag buffer BLE task'ında yazılır - okuyucular _stateMux altında alınmış kopya kullanır
     uint8_t getScannedTagCount();
-    BLETagData* getScannedTag(uint8_t index);
-    BLETagData* getTagByMac(const char* macAddress);
+    bool getScannedTag(uint8_t index, BLETagData& out);
+    bool getTagByMac(const char* macAddress, BLETagData& out);
     void updateTagConfig(const BLETagConfig& config);
     BLETagConfig* getTagConfig(const char* macAddress);
+    BLETagConfig* getTagConfigAt(uint8_t index) { return index < _configCount ? &_tagConfigs[index] : nullptr; }
+    int getTagConfigIndex(const char* macAddress) { return _findConfigIndex(macAddress); } // İkili telemetri sözlük ID'si
+    
+    // Diagnostik: tarama callback sayısı ve en uzun süre (BLE task'ında yazılır)
+    void noteCallback(uint32_t us) { _callbackCount++; if (us > _callbackMaxUs) _callbackMaxUs = us; }
+    uint32_t getCallbackCount() { return _callbackCount; }
+    uint32_t getCallbackMaxUs() { return _callbackMaxUs; }
+    uint32_t getConfigDictionaryId(); // Config MAC listesinin özeti (sözlük değişimini algılamak için)
     void publishScannedTags(MQTTManager* mqtt, const char* gatewayMac, uint32_t epoch);
+    void appendTagStats(JsonObject& sensor, const BLETagData& tag); // advData obj'ye "stats" ekle
+    void appendTagIdentity(JsonObject& sensor, const BLETagData& tag); // Bilinen UID/URL/iBeacon kimlikleri
     
     // 2 dakikalık periyot yönetimi
     uint8_t getConfiguredTagCount();         // Config'deki kayıtlı sensör sayısı
     uint8_t getFoundConfiguredTagCount();    // Bulunan kayıtlı sensör sayısı (TLM alınmış)
     bool allConfiguredTagsFound();           // Tüm kayıtlı sensörler bulundu mu?
     void clearScannedTags();                 // Buffer'ı temizle (yeni periyot için)
-    void startScanCycle();                   // Yeni tarama döngüsü başlat
+    void startScanCycle();                   // Yeni periyot: buffer + istatistikleri sıfırla
+    void endScanCycle();                     // Radyoyu kapat, periyot radyo süresini logla
+    void pauseScan();                        // Açık pencereyi kapat (config yeniden yüklenmeden önce)
+    uint32_t getCycleRadioOnMs();            // Bu periyotta radyonun açık kaldığı süre (ms)
+    uint32_t getExpectedTlmIntervalMs(uint8_t configIndex); // Öğrenilen TLM aralığı (0 = bilinmiyor)
+    
+    // Tag eşik alarmları (TLM geldiğinde değerlendirilir, loop'ta publish edilir)
+    void processAlarms(MQTTManager* mqtt, const char* gatewayMac); // Bekleyen alarm geçişlerini hemen gönder
+    bool isBuzzerRequested();                // Buzzer'ı açık herhangi bir tag alarmda mı?
+    uint8_t getTagAlarmState(const char* macAddress);
+    
+    // Varlık algılama (RSSI filtresi + giriş/çıkış durum makinesi)
+    void applyBeaconSettings(const BeaconSettings& beacon); // Öğrenilen durumu silmeden eşikleri güncelle
+    void processPresence(MQTTManager* mqtt, const char* gatewayMac); // Geçişleri değerlendir, olayları gönder
+    bool isTagPresent(const char* macAddress);
     
     // Callback function for BLE scan results (called from callback class)
     void onBLEScanResult(class BLEAdvertisedDevice advertisedDevice);
@@ -59,12 +167,67 @@ private:
     uint8_t _tagCount;
     uint8_t _configCount;
     
+    // Tarama zamanlayıcı
+    BLETagSchedule _schedules[32]; // Config index ile eşleşir
+    bool _scanning;
+    bool _activeScan;
+    uint32_t _windowStartMs;
+    volatile uint32_t _callbackCount;
+    volatile uint32_t _callbackMaxUs;
+    uint32_t _cycleRadioOnMs;
+    uint32_t _sampleIntervalMs;    // Set tamamlandıktan sonra tag başına örnekleme aralığı
+    
+    // Alarm değerlendirici
+    BLETagAlarm _alarms[32];       // Config index ile eşleşir
+    
+    // BT task (callback) ile loop arasında paylaşılan filtre/alarm alanlarını korur
+    portMUX_TYPE _stateMux;
+    
+    // Varlık algılama
+    BLETagPresence _presence[32];  // Config index ile eşleşir
+    BLEPresenceEvent _presenceEvents[8]; // Loop içinde üretilir/tüketilir
+    uint8_t _presenceEventHead;
+    uint8_t _presenceEventCount;
+    uint32_t _presenceRetryMs;
+    int _presenceEnterRssi;
+    int _presenceExitRssi;
+    uint32_t _presenceEnterMs;
+    uint32_t _presenceExitMs;
+    uint32_t _presenceTimeoutMs;
+    
+    // Frame korelasyon tablosu
+    BLECorrelationEntry _correlation[BLE_CORR_TABLE_SIZE];
+    
+    void _parseAdvertisement(class BLEAdvertisedDevice& device, BLEFrameInfo& frames, BLETagData& tag);
+    void _parseEddystoneFrame(const uint8_t* data, int len, BLEFrameInfo& frames, BLETagData& tag);
     bool _parseEddystoneTLM(const uint8_t* data, int len, BLETagData& tag);
-    bool _parseEddystoneUID(const uint8_t* data, int len, BLETagData& tag);
-    bool _parseEddystoneURL(const uint8_t* data, int len, BLETagData& tag);
+    bool _parseEddystoneUID(const uint8_t* data, int len, BLEFrameInfo& frames);
+    bool _parseEddystoneURL(const uint8_t* data, int len, BLEFrameInfo& frames);
+    bool _parseEddystoneEID(const uint8_t* data, int len, BLEFrameInfo& frames);
+    bool _parseIBeacon(const uint8_t* data, int len, BLEFrameInfo& frames);
     bool _matchesTargetPrefix(const char* macAddress);
     void _updateTagData(const char* macAddress, const BLETagData& newData);
+    void _accumulateTemp(BLETagStats& stats, float temp);
+    void _accumulateRssi(BLETagStats& stats, int rssi, uint32_t epoch);
     uint8_t _findTagIndex(const char* macAddress);
+    int _findConfigIndex(const char* macAddress);
+    int _findConfigIndexNorm(const char* normMac);   // normMac: normalizeMac çıktısı
+    bool _isConfigFound(uint8_t configIndex);
+    void _learnSchedule(uint8_t configIndex, uint32_t advCount, uint32_t nowMs);
+    BLETagSchedule _copySchedule(uint8_t configIndex);
+    uint32_t _nextWindowSeconds(uint32_t nowMs, bool samplingOnly);
+    bool _isSampleDue(uint8_t configIndex, uint32_t nowMs);
+    bool _anySampleDue(uint32_t nowMs);
+    void _clearCorrelation();
+    int _findCorrelationByAddress(const char* address);
+    int _findCorrelationByIdentity(const BLEFrameInfo& frames);
+    int _allocCorrelation();
+    int _correlate(const char* address, const char* deviceAddress, const BLEFrameInfo& frames, int configIndex);
+    void _filterRssi(uint8_t configIndex, int rssi, uint32_t nowMs);
+    void _queuePresenceEvent(uint8_t configIndex, bool present, int rssi);
+    void _evaluateAlarm(uint8_t configIndex, float temp, int battPct, uint32_t nowMs);
+    bool _allSchedulesLearned();
+    void _stopWindow();
 };
 
 #endif
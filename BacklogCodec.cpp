@@ -0,0 +1,500 @@
+#include "BacklogCodec.h"
+#include "Checksum.h"
+#include "TelemetryEncoder.h"
+#include <math.h>
+#include <cstddef>
+
+static inline void put16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static inline void put32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+static inline uint16_t get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool BacklogCodec::decodeCycle(const uint8_t* in, size_t len, OfflineCycle& cycle) {
+    memset(&cycle, 0, sizeof(cycle));
+
+    // Eski format: sadece dahili sensör
+    if (len == sizeof(OfflineDataRecord)) {
+        OfflineDataRecord record;
+        memcpy(&record, in, sizeof(record));
+        if (record.crc32 != ConfigManager::calculateCRC32(record)) return false;
+        cycle.epoch = record.timestamp;
+        cycle.flags = OFFLINE_FLAG_LEGACY;
+        if (record.temperature > -99.0f) cycle.flags |= OFFLINE_FLAG_SENSOR_OK;
+        cycle.batt = (uint8_t)constrain(record.batteryPct, 0, 100);
+        cycle.rssi = (int8_t)constrain(record.rssi, -128, 127);
+        cycle.alarmState = record.alarmState;
+        cycle.tempCenti = (int16_t)lroundf(record.temperature * 100.0f);
+        return true;
+    }
+
+    if (len < OFFLINE_CYCLE_HEADER || in[0] != RECORD_VERSION) return false;
+    uint8_t tagCount = in[2];
+    if (tagCount > OFFLINE_MAX_TAGS || len != OFFLINE_CYCLE_HEADER + tagCount * OFFLINE_TAG_ENTRY) {
+        return false;
+    }
+
+    cycle.flags = in[1];
+    cycle.tagCount = tagCount;
+    cycle.batt = in[3];
+    cycle.epoch = get32(in + 4);
+    cycle.latE6 = (int32_t)get32(in + 8);
+    cycle.lonE6 = (int32_t)get32(in + 12);
+    cycle.speedDkmh = get16(in + 16);
+    cycle.courseDdeg = get16(in + 18);
+    cycle.sats = in[20];
+    cycle.hdopD = in[21];
+    cycle.rssi = (int8_t)in[22];
+    cycle.alarmState = in[23];
+    cycle.tempCenti = (int16_t)get16(in + 24);
+
+    const uint8_t* p = in + OFFLINE_CYCLE_HEADER;
+    for (uint8_t i = 0; i < tagCount; i++, p += OFFLINE_TAG_ENTRY) {
+        OfflineTag& tag = cycle.tags[i];
+        memcpy(tag.mac, p, 6);
+        tag.tempCenti = (int16_t)get16(p + 6);
+        tag.batt = p[8];
+        tag.rssi = (int8_t)p[9];
+    }
+    return true;
+}
+
+// ===== Sıkıştırılmış blok =====
+
+static const uint32_t BLOCK_MAGIC = 0x4B4C424F; // "OBLK"
+static const uint8_t MAC_NEW = 63;
+
+static OfflineSeriesState s_encodeState; // Sığmazsa blok durumu değişmesin diye kopya
+
+static size_t putVarint(uint8_t* out, size_t pos, size_t cap, uint32_t v) {
+    do {
+        if (pos >= cap) return cap + 1;
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        out[pos++] = v ? (b | 0x80) : b;
+    } while (v);
+    return pos;
+}
+
+static size_t putZigzag(uint8_t* out, size_t pos, size_t cap, int32_t value) {
+    return putVarint(out, pos, cap, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static size_t putByte(uint8_t* out, size_t pos, size_t cap, uint8_t v) {
+    if (pos >= cap) return cap + 1;
+    out[pos] = v;
+    return pos + 1;
+}
+
+static bool getVarint(const uint8_t* in, size_t len, size_t& pos, uint32_t& v) {
+    v = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (pos >= len) return false;
+        uint8_t b = in[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool getZigzag(const uint8_t* in, size_t len, size_t& pos, int32_t& value) {
+    uint32_t v;
+    if (!getVarint(in, len, pos, v)) return false;
+    value = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    return true;
+}
+
+static bool getByte(const uint8_t* in, size_t len, size_t& pos, uint8_t& v) {
+    if (pos >= len) return false;
+    v = in[pos++];
+    return true;
+}
+
+void BacklogCodec::resetBlock(OfflineBlock& block) {
+    memset(&block, 0, offsetof(OfflineBlock, data));
+    block.magic = BLOCK_MAGIC;
+    block.crc = _blockCrc(block);
+}
+
+uint32_t BacklogCodec::_blockCrc(const OfflineBlock& block) {
+    const uint8_t* start = (const uint8_t*)&block.firstEpoch;
+    size_t len = offsetof(OfflineBlock, data) - offsetof(OfflineBlock, firstEpoch);
+    if (block.length > OFFLINE_BLOCK_CAP) return ~block.crc; // Bozuk uzunluk - asla eşleşmez
+    uint32_t crc = Checksum::crc32(start, len);
+    return Checksum::crc32(block.data, block.length, crc);
+}
+
+bool BacklogCodec::isBlockValid(const OfflineBlock& block) {
+    return block.magic == BLOCK_MAGIC && block.count <= OFFLINE_BLOCK_CYCLES &&
+           block.crc == _blockCrc(block);
+}
+
+size_t BacklogCodec::_encodeStep(OfflineSeriesState& st, const OfflineCycle& c, bool first,
+                                 uint8_t* out, size_t cap) {
+    size_t pos = 0;
+
+    if (!first) {
+        int32_t delta = (int32_t)(c.epoch - st.epoch);
+        pos = putZigzag(out, pos, cap, delta - st.delta);
+        st.delta = delta;
+    }
+    st.epoch = c.epoch;
+
+    bool fix = c.flags & OFFLINE_FLAG_FIX;
+    bool motion = fix && (c.speedDkmh != st.speedDkmh || c.courseDdeg != st.courseDdeg ||
+                          c.sats != st.sats || c.hdopD != st.hdopD);
+    uint8_t mask = 0;
+    if (c.flags != st.flags) mask |= 0x01;
+    if (c.batt != st.batt) mask |= 0x02;
+    if (c.rssi != st.rssi) mask |= 0x04;
+    if (c.alarmState != st.alarmState) mask |= 0x08;
+    if (fix && (c.latE6 != st.latE6 || c.lonE6 != st.lonE6)) mask |= 0x10;
+    if (motion) mask |= 0x20;
+    if (c.flags & OFFLINE_FLAG_SENSOR_OK) mask |= 0x40;
+    pos = putByte(out, pos, cap, mask);
+
+    if (mask & 0x01) pos = putByte(out, pos, cap, c.flags);
+    if (mask & 0x02) pos = putByte(out, pos, cap, c.batt);
+    if (mask & 0x04) pos = putByte(out, pos, cap, (uint8_t)c.rssi);
+    if (mask & 0x08) pos = putByte(out, pos, cap, c.alarmState);
+    st.flags = c.flags;
+    st.batt = c.batt;
+    st.rssi = c.rssi;
+    st.alarmState = c.alarmState;
+
+    if (mask & 0x10) {
+        pos = putZigzag(out, pos, cap, c.latE6 - st.latE6);
+        pos = putZigzag(out, pos, cap, c.lonE6 - st.lonE6);
+        st.latE6 = c.latE6;
+        st.lonE6 = c.lonE6;
+    }
+    if (mask & 0x20) {
+        pos = putVarint(out, pos, cap, c.speedDkmh);
+        pos = putVarint(out, pos, cap, c.courseDdeg);
+        pos = putByte(out, pos, cap, c.sats);
+        pos = putByte(out, pos, cap, c.hdopD);
+        st.speedDkmh = c.speedDkmh;
+        st.courseDdeg = c.courseDdeg;
+        st.sats = c.sats;
+        st.hdopD = c.hdopD;
+    }
+    if (mask & 0x40) {
+        pos = putZigzag(out, pos, cap, c.tempCenti - st.tempCenti);
+        st.tempCenti = c.tempCenti;
+    }
+
+    uint8_t tagCount = min(c.tagCount, (uint8_t)OFFLINE_MAX_TAGS);
+    pos = putVarint(out, pos, cap, tagCount);
+    for (uint8_t i = 0; i < tagCount && pos <= cap; i++) {
+        const OfflineTag& tag = c.tags[i];
+        uint8_t idx = 0;
+        while (idx < st.macCount && memcmp(st.macs[idx], tag.mac, 6) != 0) idx++;
+        bool isNew = (idx == st.macCount);
+        if (isNew) {
+            if (st.macCount >= OFFLINE_BLOCK_MACS) return cap + 1; // Sözlük dolu - yeni blok
+            memcpy(st.macs[idx], tag.mac, 6);
+            st.macTemp[idx] = 0;
+            st.macBatt[idx] = 0;
+            st.macCount++;
+        }
+
+        bool battChanged = (tag.batt != st.macBatt[idx]);
+        pos = putByte(out, pos, cap, (isNew ? MAC_NEW : idx) | (battChanged ? 0x40 : 0));
+        if (isNew) {
+            for (uint8_t k = 0; k < 6; k++) pos = putByte(out, pos, cap, tag.mac[k]);
+        }
+        if (battChanged) pos = putByte(out, pos, cap, tag.batt);
+        pos = putZigzag(out, pos, cap, tag.tempCenti - st.macTemp[idx]);
+        pos = putByte(out, pos, cap, (uint8_t)tag.rssi);
+        st.macTemp[idx] = tag.tempCenti;
+        st.macBatt[idx] = tag.batt;
+    }
+    return pos;
+}
+
+bool BacklogCodec::_decodeStep(OfflineSeriesState& st, const uint8_t* in, size_t len, size_t& pos,
+                               bool first, OfflineCycle& c) {
+    memset(&c, 0, sizeof(c));
+
+    if (!first) {
+        int32_t dod;
+        if (!getZigzag(in, len, pos, dod)) return false;
+        st.delta += dod;
+        st.epoch += st.delta;
+    }
+    c.epoch = st.epoch;
+
+    uint8_t mask;
+    if (!getByte(in, len, pos, mask)) return false;
+    if ((mask & 0x01) && !getByte(in, len, pos, st.flags)) return false;
+    if ((mask & 0x02) && !getByte(in, len, pos, st.batt)) return false;
+    if (mask & 0x04) {
+        uint8_t v;
+        if (!getByte(in, len, pos, v)) return false;
+        st.rssi = (int8_t)v;
+    }
+    if ((mask & 0x08) && !getByte(in, len, pos, st.alarmState)) return false;
+    if (mask & 0x10) {
+        int32_t dLat, dLon;
+        if (!getZigzag(in, len, pos, dLat) || !getZigzag(in, len, pos, dLon)) return false;
+        st.latE6 += dLat;
+        st.lonE6 += dLon;
+    }
+    if (mask & 0x20) {
+        uint32_t speed, course;
+        if (!getVarint(in, len, pos, speed) || !getVarint(in, len, pos, course) ||
+            !getByte(in, len, pos, st.sats) || !getByte(in, len, pos, st.hdopD)) return false;
+        st.speedDkmh = speed;
+        st.courseDdeg = course;
+    }
+    if (mask & 0x40) {
+        int32_t dTemp;
+        if (!getZigzag(in, len, pos, dTemp)) return false;
+        st.tempCenti += dTemp;
+    }
+
+    c.flags = st.flags;
+    c.batt = st.batt;
+    c.rssi = st.rssi;
+    c.alarmState = st.alarmState;
+    if (c.flags & OFFLINE_FLAG_FIX) {
+        c.latE6 = st.latE6;
+        c.lonE6 = st.lonE6;
+        c.speedDkmh = st.speedDkmh;
+        c.courseDdeg = st.courseDdeg;
+        c.sats = st.sats;
+        c.hdopD = st.hdopD;
+    }
+    if (c.flags & OFFLINE_FLAG_SENSOR_OK) c.tempCenti = st.tempCenti;
+
+    uint32_t tagCount;
+    if (!getVarint(in, len, pos, tagCount) || tagCount > OFFLINE_MAX_TAGS) return false;
+    c.tagCount = tagCount;
+    for (uint8_t i = 0; i < c.tagCount; i++) {
+        OfflineTag& tag = c.tags[i];
+        uint8_t head;
+        if (!getByte(in, len, pos, head)) return false;
+        uint8_t idx = head & 0x3F;
+        if (idx == MAC_NEW) {
+            if (st.macCount >= OFFLINE_BLOCK_MACS || pos + 6 > len) return false;
+            idx = st.macCount++;
+            memcpy(st.macs[idx], in + pos, 6);
+            st.macTemp[idx] = 0;
+            st.macBatt[idx] = 0;
+            pos += 6;
+        } else if (idx >= st.macCount) {
+            return false;
+        }
+        if ((head & 0x40) && !getByte(in, len, pos, st.macBatt[idx])) return false;
+        int32_t dTemp;
+        uint8_t rssi;
+        if (!getZigzag(in, len, pos, dTemp) || !getByte(in, len, pos, rssi)) return false;
+        st.macTemp[idx] += dTemp;
+
+        memcpy(tag.mac, st.macs[idx], 6);
+        tag.tempCenti = st.macTemp[idx];
+        tag.batt = st.macBatt[idx];
+        tag.rssi = (int8_t)rssi;
+    }
+    return true;
+}
+
+bool BacklogCodec::appendCycle(OfflineBlock& block, const OfflineCycle& cycle) {
+    if (block.count >= OFFLINE_BLOCK_CYCLES) return false;
+
+    s_encodeState = block.state;
+    bool first = (block.count == 0);
+    if (first) s_encodeState.epoch = cycle.epoch;
+    size_t cap = OFFLINE_BLOCK_CAP - block.length;
+    size_t n = _encodeStep(s_encodeState, cycle, first, block.data + block.length, cap);
+    if (n > cap) return false;
+
+    if (first) block.firstEpoch = cycle.epoch;
+    block.state = s_encodeState;
+    block.length += n;
+    block.count++;
+    block.crc = _blockCrc(block);
+    return true;
+}
+
+size_t BacklogCodec::finishBlock(const OfflineBlock& block, uint8_t* out, size_t cap) {
+    size_t len = OFFLINE_BLOCK_HEADER + block.length;
+    if (block.count == 0 || len > cap) return 0;
+
+    out[0] = BLOCK_VERSION;
+    out[1] = block.count;
+    put16(out + 2, block.length);
+    put32(out + 4, block.firstEpoch);
+    put32(out + 8, Checksum::crc32(block.data, block.length));
+    memcpy(out + OFFLINE_BLOCK_HEADER, block.data, block.length);
+    return len;
+}
+
+// ===== Yükleme mesajı =====
+
+static const uint16_t LZ_WINDOW = 256;
+static const uint16_t LZ_MIN_MATCH = 3;
+static const uint16_t LZ_MAX_MATCH = 258;
+
+static uint8_t s_uploadRecord[OFFLINE_BLOCK_HEADER + OFFLINE_BLOCK_CAP];
+// LZSS en kötü durum: her 8 literal için 1 bayrak byte'ı
+static uint8_t s_packed[sizeof(s_uploadRecord) + sizeof(s_uploadRecord) / 8 + 1];
+
+uint8_t BacklogCodec::uploadCyclesForSignal(int rssi) {
+    if (rssi == 0) return 15;        // Bilinmiyor - yarım blok
+    if (rssi >= -75) return OFFLINE_BLOCK_CYCLES;
+    if (rssi >= -90) return 15;
+    if (rssi >= -100) return 8;
+    return 4;
+}
+
+size_t BacklogCodec::compress(const uint8_t* in, size_t len, uint8_t* out, size_t cap) {
+    size_t pos = 0;
+    size_t flagPos = 0;
+    uint8_t flagBit = 8;
+    size_t i = 0;
+
+    while (i < len) {
+        if (flagBit == 8) {
+            if (pos >= cap) return 0;
+            flagPos = pos;
+            out[pos++] = 0;
+            flagBit = 0;
+        }
+
+        // Pencerede en uzun eşleşmeyi ara (örtüşen eşleşme tekrar dizilerini yakalar)
+        size_t bestLen = 0;
+        size_t bestDist = 0;
+        size_t start = (i > LZ_WINDOW) ? i - LZ_WINDOW : 0;
+        size_t maxLen = min((size_t)LZ_MAX_MATCH, len - i);
+        for (size_t j = start; j < i && bestLen < maxLen; j++) {
+            size_t k = 0;
+            while (k < maxLen && in[j + k] == in[i + k]) k++;
+            if (k > bestLen) {
+                bestLen = k;
+                bestDist = i - j;
+            }
+        }
+
+        if (bestLen >= LZ_MIN_MATCH) {
+            if (pos + 2 > cap) return 0;
+            out[flagPos] |= (1 << flagBit);
+            out[pos++] = bestDist - 1;
+            out[pos++] = bestLen - LZ_MIN_MATCH;
+            i += bestLen;
+        } else {
+            if (pos >= cap) return 0;
+            out[pos++] = in[i++];
+        }
+        flagBit++;
+    }
+    return pos;
+}
+
+size_t BacklogCodec::decompress(const uint8_t* in, size_t len, uint8_t* out, size_t cap) {
+    size_t pos = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        uint8_t flags = in[i++];
+        for (uint8_t bit = 0; bit < 8 && i < len; bit++) {
+            if (flags & (1 << bit)) {
+                if (i + 2 > len) return 0;
+                size_t dist = in[i] + 1;
+                size_t n = in[i + 1] + LZ_MIN_MATCH;
+                i += 2;
+                if (dist > pos || pos + n > cap) return 0;
+                for (size_t k = 0; k < n; k++, pos++) out[pos] = out[pos - dist];
+            } else {
+                if (pos >= cap) return 0;
+                out[pos++] = in[i++];
+            }
+        }
+    }
+    return pos;
+}
+
+size_t BacklogCodec::encodeUpload(const char* gmac, const char* sensorName, const char* mahalId,
+                                  const OfflineBlock& block, uint8_t* out, size_t cap) {
+    size_t rawLen = finishBlock(block, s_uploadRecord, sizeof(s_uploadRecord));
+    if (rawLen == 0) return 0;
+    // Gürültülü tag verisinde LZ kazanç sağlamayabilir - o zaman blok ham gider
+    size_t packedLen = compress(s_uploadRecord, rawLen, s_packed, sizeof(s_packed));
+    bool packed = (packedLen > 0 && packedLen < rawLen);
+
+    CborWriter w(out, cap);
+    w.beginMap(packed ? 8 : 7);
+    w.writeUint(0); w.writeUint(UPLOAD_VERSION);
+    w.writeUint(1); TelemetryEncoder::writeMac(w, gmac);
+    w.writeUint(2); w.writeText(sensorName);
+    w.writeUint(3); w.writeText(mahalId);
+    w.writeUint(4); w.writeUint(block.count);
+    w.writeUint(5); w.writeUint(block.firstEpoch);
+    if (packed) {
+        w.writeUint(6); w.writeUint(rawLen);
+        w.writeUint(7); w.writeBytes(s_packed, packedLen);
+    } else {
+        w.writeUint(7); w.writeBytes(s_uploadRecord, rawLen);
+    }
+    if (w.overflow()) return 0;
+
+    Serial.printf("[BACKLOG] %u cycles: block %u bytes -> %s %u bytes\n", block.count, (unsigned)rawLen,
+                 packed ? "LZ" : "raw", (unsigned)(packed ? packedLen : rawLen));
+    return w.length();
+}
+
+// ===== OfflineBlockReader =====
+
+bool OfflineBlockReader::begin(const uint8_t* record, size_t len) {
+    _data = record;
+    _len = len;
+    _pos = 0;
+    _index = 0;
+    memset(&_state, 0, sizeof(_state));
+
+    if (len >= OFFLINE_BLOCK_HEADER && record[0] == BacklogCodec::BLOCK_VERSION) {
+        _single = false;
+        _count = record[1];
+        uint16_t payload = get16(record + 2);
+        if (_count == 0 || _count > OFFLINE_BLOCK_CYCLES || OFFLINE_BLOCK_HEADER + payload != len) return false;
+        if (Checksum::crc32(record + OFFLINE_BLOCK_HEADER, payload) != get32(record + 8)) {
+            Serial.println("[BACKLOG] Block CRC mismatch");
+            return false;
+        }
+        _state.epoch = get32(record + 4);
+        _pos = OFFLINE_BLOCK_HEADER;
+        return true;
+    }
+
+    // v2 periyot kaydı veya eski kayıt - tek periyotluk blok
+    _single = true;
+    _count = 1;
+    OfflineCycle probe;
+    return BacklogCodec::decodeCycle(record, len, probe);
+}
+
+bool OfflineBlockReader::next(OfflineCycle& cycle) {
+    if (_index >= _count) return false;
+    bool ok = _single ? BacklogCodec::decodeCycle(_data, _len, cycle)
+                      : BacklogCodec::_decodeStep(_state, _data, _len, _pos, _index == 0, cycle);
+    if (!ok) {
+        _index = _count;
+        return false;
+    }
+    _index++;
+    return true;
+}
@@ -0,0 +1,174 @@
+#ifndef BACKLOG_CODEC_H
+#define BACKLOG_CODEC_H
+
+#include <Arduino.h>
+#include "ConfigManager.h"
+
+#define OFFLINE_MAX_TAGS        32      // BLEManager tarama buffer'ı ile aynı
+#define OFFLINE_CYCLE_HEADER    26
+#define OFFLINE_TAG_ENTRY       10
+
+#define OFFLINE_BLOCK_HEADER    12
+#define OFFLINE_BLOCK_CAP       2048    // Blok payload üst sınırı
+#define OFFLINE_BLOCK_CYCLES    30      // Blok başına en fazla periyot (2 dk periyotta 1 saat)
+#define OFFLINE_BLOCK_MACS      48      // Blok içi tag MAC sözlüğü
+
+static_assert(OFFLINE_BLOCK_HEADER + OFFLINE_BLOCK_CAP <= OFFLINE_RECORD_CAP, "offline block exceeds FIFO record cap");
+
+// Çevrimdışı periyot kaydı - bağlantı yokken bir periyodun tüm verisi
+struct OfflineTag {
+  uint8_t mac[6];
+  int16_t tempCenti;    // 0.01 °C
+  uint8_t batt;         // %
+  int8_t rssi;          // dBm
+};
+
+struct OfflineCycle {
+  uint32_t epoch;
+  uint8_t flags;        // OFFLINE_FLAG_*
+  uint8_t batt;         // Cihaz bataryası (%)
+  int8_t rssi;          // Ağ RSSI (dBm)
+  uint8_t alarmState;
+  int32_t latE6;        // Derece * 1e6
+  int32_t lonE6;
+  uint16_t speedDkmh;   // 0.1 km/h
+  uint16_t courseDdeg;  // 0.1 derece
+  uint8_t sats;
+  uint8_t hdopD;        // HDOP * 10
+  int16_t tempCenti;    // Dahili sensör, 0.01 °C
+  uint8_t tagCount;
+  OfflineTag tags[OFFLINE_MAX_TAGS];
+};
+
+#define OFFLINE_FLAG_FIX        0x01    // GPS fix geçerli
+#define OFFLINE_FLAG_SENSOR_OK  0x02    // Dahili sensör okundu
+#define OFFLINE_FLAG_LEGACY     0x80    // Eski OfflineDataRecord'dan dönüştürüldü
+
+// Seri kodlayıcı durumu - yazıcı ve okuyucu aynı durumu adım adım kurar
+struct OfflineSeriesState {
+  uint32_t epoch;
+  int32_t delta;            // Son epoch farkı (delta-of-delta tabanı)
+  uint8_t flags;
+  uint8_t batt;
+  int8_t rssi;
+  uint8_t alarmState;
+  int32_t latE6;            // Son fix
+  int32_t lonE6;
+  uint16_t speedDkmh;
+  uint16_t courseDdeg;
+  uint8_t sats;
+  uint8_t hdopD;
+  int16_t tempCenti;
+  uint8_t macCount;
+  uint8_t macs[OFFLINE_BLOCK_MACS][6];
+  int16_t macTemp[OFFLINE_BLOCK_MACS];
+  uint8_t macBatt[OFFLINE_BLOCK_MACS];
+};
+
+// Açık (yazılmakta olan) blok. .ino bunu RTC_NOINIT bellekte tutar: yazılım reset'i
+// veya watchdog sonrası blok kaldığı yerden devam eder. Güç kaybında kaybolur - .ino
+// şebeke kesilince bloğu kapatır ve bataryada blok boyunu kısaltır.
+struct OfflineBlock {
+  uint32_t magic;
+  uint32_t crc;             // magic ve crc sonrasındaki alanlar + kullanılan payload
+  uint32_t firstEpoch;
+  uint16_t length;          // Payload byte
+  uint8_t count;            // Periyot sayısı
+  OfflineSeriesState state;
+  uint8_t data[OFFLINE_BLOCK_CAP];
+};
+
+// Blok kaydı (v3) - FIFO'ya tek kayıt olarak yazılır:
+//   [0] versiyon (3)  [1] periyot sayısı  [2] payload uzunluğu u16
+//   [4] ilk epoch u32  [8] payload CRC32
+//   payload - her periyot bir öncekine göre:
+//     epoch    : zigzag varint delta-of-delta (ilk periyot yok, sabit periyotta 0 = 1 byte)
+//     maske    : bit0 flags, bit1 batarya, bit2 rssi, bit3 alarm değişti (ardından 1 byte)
+//                bit4 konum (lat, lon zigzag varint fark, 1e-6 derece)
+//                bit5 hareket (hız, yön varint; uydu, hdop 1 byte)
+//                bit6 sıcaklık (zigzag varint fark, 0.01 °C)
+//     tag sayısı, tag başına:
+//       [bit0-5 sözlük indeksi (63 = yeni, ardından 6 byte MAC) | bit6 batarya byte'ı izler]
+//       sıcaklık zigzag varint fark (tag'ın bloktaki önceki değerine göre), rssi i8
+// Sabit periyot ve yavaş değişen soğuk zincir sıcaklığında dahili sensör periyodu ~4,
+// tag başına ~3 byte tutar (OfflineDataRecord: 60 byte).
+//
+// Eski kayıt formatı (v2, little-endian, tek periyot - artık yazılmaz, FIFO'da kalanlar okunur):
+//   [0] versiyon (2)  [1] flags  [2] tag sayısı  [3] batarya
+//   [4] epoch u32  [8] lat i32  [12] lon i32  [16] hız u16  [18] yön u16
+//   [20] uydu  [21] hdop  [22] rssi i8  [23] alarm  [24] sıcaklık i16
+//   + tag başına 10 byte: [MAC 6][sıcaklık i16][batarya][rssi i8]
+// sizeof(OfflineDataRecord) uzunluğundaki kayıtlar eski formattır (v1, sadece dahili sensör).
+//
+// Yükleme mesajı (v2) - tamsayı anahtarlı CBOR map, topic KUTARIoT/backlog/<mac>:
+//   0: şema versiyonu (2)
+//   1: gateway MAC (6 byte bstr)
+//   2: dahili sensör adı
+//   3: dahili sensör mahal ID
+//   4: periyot sayısı
+//   5: ilk periyodun epoch'u
+//   6: blok kaydının sıkıştırılmamış uzunluğu (sadece 7 LZ ile sıkıştırılmışsa)
+//   7: v3 blok kaydı (bstr, başlık dahil) - 6 varsa LZ ile sıkıştırılmış, yoksa ham
+// Tag isimleri gönderilmez - backend MAC ile kendi tag tablosundan eşler.
+//
+// LZ formatı (heatshrink benzeri LZSS, 256 byte pencere):
+//   8 öğelik gruplar, her grubun önünde bayrak byte'ı (LSB ilk öğe, 1 = eşleşme)
+//   literal : 1 byte
+//   eşleşme : [mesafe-1] [uzunluk-3] - mesafe 1..256, uzunluk 3..258 (örtüşme serbest)
+class BacklogCodec {
+public:
+    static const uint8_t RECORD_VERSION = 2;
+    static const uint8_t UPLOAD_VERSION = 2;
+
+    // Tek periyot kaydını çöz (v2 veya eski OfflineDataRecord); tanınmayan/bozuk kayıtta false
+    static bool decodeCycle(const uint8_t* in, size_t len, OfflineCycle& cycle);
+
+    // Sıkıştırılmış blok yazıcı
+    static const uint8_t BLOCK_VERSION = 3;
+    static void resetBlock(OfflineBlock& block);
+    static bool isBlockValid(const OfflineBlock& block); // RTC içeriği tutarlı mı (açılışta)
+    // Periyodu bloğa ekle; blok dolu veya sığmıyorsa false (blok değişmez)
+    static bool appendCycle(OfflineBlock& block, const OfflineCycle& cycle);
+    // Başlık + payload; FIFO kaydı uzunluğu döner
+    static size_t finishBlock(const OfflineBlock& block, uint8_t* out, size_t cap);
+
+    // Sinyal kalitesine göre mesaj başına periyot: zayıf sinyalde küçük parçalar
+    // yeniden gönderim maliyetini düşürür, iyi sinyalde tam blok tek mesajda gider.
+    // rssi dBm; 0 = bilinmiyor
+    static uint8_t uploadCyclesForSignal(int rssi);
+    // Bloğu yükleme mesajına kodla; taşmada 0 döner
+    static size_t encodeUpload(const char* gmac, const char* sensorName, const char* mahalId,
+                               const OfflineBlock& block, uint8_t* out, size_t cap);
+
+    // LZSS; çıktı sığmazsa veya girdi bozuksa 0 döner
+    static size_t compress(const uint8_t* in, size_t len, uint8_t* out, size_t cap);
+    static size_t decompress(const uint8_t* in, size_t len, uint8_t* out, size_t cap);
+
+private:
+    static size_t _encodeStep(OfflineSeriesState& st, const OfflineCycle& cycle, bool first,
+                              uint8_t* out, size_t cap);
+    static bool _decodeStep(OfflineSeriesState& st, const uint8_t* in, size_t len, size_t& pos,
+                            bool first, OfflineCycle& cycle);
+    static uint32_t _blockCrc(const OfflineBlock& block);
+
+    friend class OfflineBlockReader;
+};
+
+// FIFO kaydını periyot periyot okur: v3 blok, v2 tek periyot veya eski kayıt
+class OfflineBlockReader {
+public:
+    bool begin(const uint8_t* record, size_t len); // Bozuk/tanınmayan kayıtta false
+    bool next(OfflineCycle& cycle);
+    uint8_t getCount() { return _count; }
+
+private:
+    const uint8_t* _data;
+    size_t _len;
+    size_t _pos;
+    uint8_t _count;
+    uint8_t _index;
+    bool _single;
+    OfflineSeriesState _state;
+};
+
+#endif
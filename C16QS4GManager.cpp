@@ -1,5 +1,7 @@
 #include "C16QS4GManager.h"
 #include "hardware.h"
+#include "Diagnostics.h"
+#include "Checksum.h"
 
 C16QS4GManager::C16QS4GManager() 
     : _serial(nullptr), _initialized(false), _networkConnected(false), 
@@ -7,7 +9,7 @@ C16QS4GManager::C16QS4GManager()
       _gpsLat(0.0), _gpsLon(0.0), _gpsAlt(0.0), _gpsSats(0), _gpsHdop(99.0),
       _gpsSpeed(0.0), _gpsCourse(0.0), _gpsTime(""), _gpsDate(""),
       _gpsLastUpdate(0), _nmeaBuffer(""),
-      _mqttSessionId(-1), _mqttCallback(nullptr) {
+      _mqttSessionId(-1), _mqttPacketId(0), _mqttCallback(nullptr) {
 }
 
 bool C16QS4GManager::begin() {
@@ -1054,13 +1056,22 @@ bool C16QS4GManager::connectMQTT(const char* broker, int port, const char* clien
     return true;
 }
 
-bool C16QS4GManager::publishMQTT(const char* topic, const char* payload) {
+bool C16QS4GManager::publishMQTT(const char* topic, const char* payload, uint8_t qos, bool dup) {
+    return _publishMQTT(topic, (const uint8_t*)payload, strlen(payload), false, qos, dup);
+}
+
+bool C16QS4GManager::publishMQTT(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool dup) {
+    return _publishMQTT(topic, payload, length, true, qos, dup);
+}
+
+bool C16QS4GManager::_publishMQTT(const char* topic, const uint8_t* payload, size_t length, bool binary,
+                                  uint8_t qos, bool dup) {
     if (!_mqttConnected) {
         Serial.println("[4G] MQTT not connected - cannot publish");
         return false;
     }
     
-    int payloadLen = strlen(payload);
+    int payloadLen = length;
     Serial.printf("[4G] MQTT publish: topic=%s, payload length=%d bytes\n", topic, payloadLen);
     
     // Dokümana göre büyük mesajlar için AT+MQTTPUBLM kullanılmalı (max 20KB)
@@ -1069,14 +1080,21 @@ bool C16QS4GManager::publishMQTT(const char* topic, const char* payload) {
     
     // AT+MQTTPUBLM kullan (tüm mesajlar için)
     int messageSize = payloadLen;
-    int messageId = 1; // Message ID (isteğe bağlı)
+    // QoS 1: her mesaj için farklı packet ID (PUBACK eşleşmesi), QoS 0: sabit
+    int messageId = 1;
+    if (qos > 0) {
+        _mqttPacketId = (_mqttPacketId % 65535) + 1;
+        messageId = _mqttPacketId;
+    }
     
     // AT+MQTTPUBLM komutu
-    String cmd = "AT+MQTTPUBLM=" + String(_mqttSessionId) + ",\"" + String(topic) + "\",0,0,0," + String(messageSize) + "," + String(messageId);
+    String cmd = "AT+MQTTPUBLM=" + String(_mqttSessionId) + ",\"" + String(topic) + "\"," + String(qos) + "," + 
+                 String(dup ? 1 : 0) + ",0," + String(messageSize) + "," + String(messageId);
     
     Serial.printf("[4G] Using AT+MQTTPUBLM - command: %s\n", cmd.c_str());
     
     _serial->flush();
+    uint32_t atStart = millis(); // Round-trip: komuttan SUCCESS/FAIL/timeout'a kadar (Diagnostics)
     _serial->print(cmd);
     _serial->print("\r\n");
     delay(500); // Komut sonrası bekleme
@@ -1099,6 +1117,7 @@ bool C16QS4GManager::publishMQTT(const char* topic, const char* payload) {
             }
             if (response.indexOf("ERROR") >= 0 || response.indexOf("CME ERROR") >= 0) {
                 Serial.printf("\n[4G] ERROR before prompt - response: %s\n", response.c_str());
+                Diagnostics::recordAt(millis() - atStart);
                 return false;
             }
         }
@@ -1107,24 +1126,27 @@ bool C16QS4GManager::publishMQTT(const char* topic, const char* payload) {
     
     if (!gotPrompt) {
         Serial.printf("\n[4G] Timeout waiting for '>' prompt - response: %s\n", response.c_str());
+        Diagnostics::recordAt(millis() - atStart);
         return false;
     }
     
     // Mesajı gönder (payload'u direkt gönder - escape etmeye gerek yok, çünkü Ctrl+Z ile bitiriyoruz)
-    _serial->print(payload);
+    _serial->write(payload, length);
     Serial.printf("[4G] Sent payload (%d bytes)\n", payloadLen);
     
-    // Ctrl+Z (0x1A) gönder (mesajın bittiğini belirtir)
-    _serial->write(0x1A);
-    Serial.println("[4G] Sent Ctrl+Z (0x1A) to terminate message");
+    if (!binary) {
+        // Ctrl+Z (0x1A) gönder (mesajın bittiğini belirtir)
+        _serial->write(0x1A);
+        Serial.println("[4G] Sent Ctrl+Z (0x1A) to terminate message");
+    }
+    // İkili payload 0x1A içerebilir - modül message_size kadar byte okur, sonlandırıcı gönderilmez
     
     delay(1000); // Mesaj gönderildikten sonra bekle (response gelmesi için zaman ver)
     
     // Response'u bekle: +MQTTPUBLM: <session_id>: PUBLISHING sonra +MQTTPUBLM: <session_id>: PUBLISH SUCCESS,<message_id>
-    // veya sadece OK gelebilir
+    // QoS 1'de PUBLISH SUCCESS broker PUBACK'i demektir; QoS 0'da OK yeterli
     startTime = millis();
     response = "";
-    bool publishSuccess = false;
     
     // Önce response'u oku, sonra URC'leri işle
     while (millis() - startTime < 10000) { // 10 saniye timeout
@@ -1134,11 +1156,9 @@ bool C16QS4GManager::publishMQTT(const char* topic, const char* payload) {
             Serial.print(c); // Debug için
             
             // Response kontrolü
-            if (response.indexOf("PUBLISH SUCCESS") >= 0 || 
-                response.indexOf("+MQTTPUBLM:") >= 0 || 
-                response.indexOf("\r\nOK\r\n") >= 0 || 
-                response.indexOf("\nOK\n") >= 0) {
-                publishSuccess = true;
+            bool acked = response.indexOf("PUBLISH SUCCESS") >= 0;
+            bool ok = (response.indexOf("\r\nOK\r\n") >= 0 || response.indexOf("\nOK\n") >= 0);
+            if (acked || (qos == 0 && ok)) {
                 delay(200); // Tam response gelsin
                 while (_serial->available()) {
                     response += (char)_serial->read();
@@ -1147,10 +1167,11 @@ bool C16QS4GManager::publishMQTT(const char* topic, const char* payload) {
                 Serial.println("[4G] MQTT publish successful (response received)");
                 // Şimdi URC'leri kontrol et (config mesajları için)
                 _processUrc();
+                Diagnostics::recordAt(millis() - atStart);
                 return true;
             }
             
-            if (response.indexOf("ERROR") >= 0 || response.indexOf("CME ERROR") >= 0) {
+            if (response.indexOf("ERROR") >= 0 || response.indexOf("PUBLISH FAIL") >= 0) {
                 delay(200);
                 while (_serial->available()) {
                     response += (char)_serial->read();
@@ -1159,6 +1180,7 @@ bool C16QS4GManager::publishMQTT(const char* topic, const char* payload) {
                 Serial.printf("[4G] MQTT publish failed - ERROR in response\n");
                 // Hata olsa bile URC'leri kontrol et
                 _processUrc();
+                Diagnostics::recordAt(millis() - atStart);
                 return false;
             }
         }
@@ -1166,26 +1188,14 @@ bool C16QS4GManager::publishMQTT(const char* topic, const char* payload) {
     }
     Serial.println(""); // Yeni satır
     
-    // Timeout durumu - belki response gelmiştir ama parse edilememiştir
-    if (response.length() > 0) {
-        Serial.printf("[4G] Response received but not recognized: %s\n", response.c_str());
-        // Response varsa başarılı sayalım (belki OK farklı formatta geldi)
-        if (response.indexOf("OK") >= 0 || response.indexOf("SUCCESS") >= 0) {
-            Serial.println("[4G] MQTT publish assumed successful (OK/SUCCESS found in response)");
-            _processUrc();
-            return true;
-        }
-    }
-    
-    // Response gelmedi veya tanınmadı - ama publish başarılı olabilir
-    Serial.printf("[4G] No response received, but publish may have succeeded\n");
-    Serial.printf("[4G] Response buffer: %s\n", response.c_str());
+    // Timeout - teslim doğrulanamadı. Başarılı sayılmaz: çağıran (journal) tekrar gönderir,
+    // backend "mid" ile tekrarı ayıklar.
+    Serial.printf("[4G] MQTT publish not confirmed (qos=%d, id=%d) - response: %s\n", 
+                 qos, messageId, response.c_str());
     // Timeout olsa bile URC'leri kontrol et
     _processUrc();
-    
-    // Response gelmedi ama publish başarılı olabilir - true döndür
-    Serial.println("[4G] MQTT publish assumed successful (no error received)");
-    return true;
+    Diagnostics::recordAt(millis() - atStart);
+    return false;
 }
 
 bool C16QS4GManager::subscribeMQTT(const char* topic) {
@@ -1686,7 +1696,10 @@ bool C16QS4GManager::_sendATCommand(const char* cmd, const char* expected, uint3
     _serial->print(cmd);
     _serial->print("\r\n");
     
-    return _waitForResponse(expected, timeoutMs);
+    uint32_t start = millis();
+    bool ok = _waitForResponse(expected, timeoutMs);
+    Diagnostics::recordAt(millis() - start);
+    return ok;
 }
 
 String C16QS4GManager::_sendATCommandResponse(const char* cmd, uint32_t timeoutMs) {
@@ -1710,6 +1723,7 @@ String C16QS4GManager::_sendATCommandResponse(const char* cmd, uint32_t timeoutM
         delay(10);
     }
     
+    Diagnostics::recordAt(millis() - start);
     return response;
 }
 
@@ -1829,12 +1843,10 @@ void C16QS4GManager::_processUrc() {
                                  payloadStr.substring(0, min(200, (int)payloadStr.length())).c_str());
                     
                     // Callback'i çağır
+                    // Payload String'in kendi buffer'ından verilir - sabit kopya buffer'ı
+                    // 2 KB üstü config'leri kesip uzunluğu yanlış bildiriyordu
                     if (_mqttCallback && payloadStr.length() > 0) {
-                        char topic[128] = {0};
-                        char payload[2048] = {0}; // Büyük payload'lar için buffer artırıldı
-                        strncpy(topic, topicStr.c_str(), sizeof(topic) - 1);
-                        strncpy(payload, payloadStr.c_str(), sizeof(payload) - 1);
-                        _mqttCallback(topic, payload, payloadStr.length());
+                        _mqttCallback(topicStr.c_str(), payloadStr.c_str(), payloadStr.length());
                     }
                     
                     // Pending line'ı temizle
@@ -1935,7 +1947,8 @@ void C16QS4GManager::_readNMEAStream() {
             line.trim();
             _nmeaBuffer = "";
             
-            // NMEA satırlarını parse et
+            // NMEA satırlarını parse et (checksum tutmayan satır atlanır)
+            if (!Checksum::nmeaValid(line.c_str())) continue;
             if (line.indexOf("GNGGA") >= 0 || line.indexOf("$GPGGA") >= 0) {
                 if (_parseGNGGA(line)) {
                     _gpsLastUpdate = millis();
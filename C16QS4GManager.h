@@ -13,7 +13,9 @@ public:
     bool isReady();
     bool connectNetwork();
     bool connectMQTT(const char* broker, int port, const char* clientId, const char* username, const char* password);
-    bool publishMQTT(const char* topic, const char* payload);
+    bool publishMQTT(const char* topic, const char* payload, uint8_t qos = 0, bool dup = false);
+    bool publishMQTT(const char* topic, const uint8_t* payload, size_t length, 
+                     uint8_t qos = 0, bool dup = false); // İkili (CBOR) payload
     bool subscribeMQTT(const char* topic);
     bool isMQTTConnected();
     void loop(); // MQTT mesajlarını işle
@@ -63,6 +65,7 @@ private:
     unsigned long _gpsLastUpdate;
     String _nmeaBuffer;
     int _mqttSessionId;
+    uint16_t _mqttPacketId;   // QoS 1 packet ID (PUBACK eşleşmesi)
     String _ipAddress;
     void (*_mqttCallback)(const char* topic, const char* payload, int len); // Internal callback
     
@@ -74,6 +77,8 @@ private:
     String _sendATCommandResponse(const char* cmd, uint32_t timeoutMs = 2000);
     bool _waitForResponse(const char* expected, uint32_t timeoutMs = 2000);
     void _processUrc(); // Unsolicited Result Code işleme
+    bool _publishMQTT(const char* topic, const uint8_t* payload, size_t length, bool binary,
+                      uint8_t qos, bool dup);
     
     // GPS NMEA parsing
     void _readNMEAStream();
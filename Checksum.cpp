@@ -0,0 +1,98 @@
+#include "Checksum.h"
+
+#if defined(ESP_PLATFORM)
+#include "esp_rom_crc.h"
+#endif
+
+// ===== Derleme zamanı tablo üretimi =====
+// C++11 constexpr (tek return) ile her giriş 8 adımlık bit döngüsünden hesaplanır;
+// tablolar .rodata'ya (flash) yerleşir, çalışma zamanında üretilmez.
+
+static constexpr uint8_t crc8RefEntry(uint8_t c, int bits) {
+    return bits == 0 ? c : crc8RefEntry((c & 0x01) ? (uint8_t)((c >> 1) ^ 0x8C) : (uint8_t)(c >> 1), bits - 1);
+}
+
+static constexpr uint8_t crc8MsbEntry(uint8_t c, int bits) {
+    return bits == 0 ? c : crc8MsbEntry((c & 0x80) ? (uint8_t)((c << 1) ^ 0x31) : (uint8_t)(c << 1), bits - 1);
+}
+
+#define CRC8_MAXIM(i)       crc8RefEntry((uint8_t)(i), 8)
+#define CRC8_SENSIRION(i)   crc8MsbEntry((uint8_t)(i), 8)
+
+#define CRC_T4(f, i)    f(i), f((i) + 1), f((i) + 2), f((i) + 3)
+#define CRC_T16(f, i)   CRC_T4(f, i), CRC_T4(f, (i) + 4), CRC_T4(f, (i) + 8), CRC_T4(f, (i) + 12)
+#define CRC_T64(f, i)   CRC_T16(f, i), CRC_T16(f, (i) + 16), CRC_T16(f, (i) + 32), CRC_T16(f, (i) + 48)
+#define CRC_T256(f)     CRC_T64(f, 0), CRC_T64(f, 64), CRC_T64(f, 128), CRC_T64(f, 192)
+
+static const uint8_t CRC8_MAXIM_TABLE[256] = { CRC_T256(CRC8_MAXIM) };
+static const uint8_t CRC8_SENSIRION_TABLE[256] = { CRC_T256(CRC8_SENSIRION) };
+
+#if !defined(ESP_PLATFORM)
+static constexpr uint32_t crc32Entry(uint32_t c, int bits) {
+    return bits == 0 ? c : crc32Entry((c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1, bits - 1);
+}
+
+#define CRC32_IEEE(i)       crc32Entry((uint32_t)(i), 8)
+
+static const uint32_t CRC32_TABLE[256] = { CRC_T256(CRC32_IEEE) };
+#endif
+
+uint32_t Checksum::crc32(const void* data, size_t len, uint32_t crc) {
+#if defined(ESP_PLATFORM)
+    return esp_rom_crc32_le(crc, (const uint8_t*)data, len);
+#else
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    while (len--) {
+        crc = (crc >> 8) ^ CRC32_TABLE[(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+#endif
+}
+
+uint8_t Checksum::crc8Maxim(const uint8_t* data, size_t len) {
+    uint8_t crc = 0x00;
+    while (len--) {
+        crc = CRC8_MAXIM_TABLE[crc ^ *data++];
+    }
+    return crc;
+}
+
+uint8_t Checksum::crc8Sensirion(const uint8_t* data, size_t len) {
+    uint8_t crc = 0xFF;
+    while (len--) {
+        crc = CRC8_SENSIRION_TABLE[crc ^ *data++];
+    }
+    return crc;
+}
+
+uint8_t Checksum::nmeaXor(const char* data, size_t len) {
+    uint8_t sum = 0;
+    while (len--) {
+        sum ^= (uint8_t)*data++;
+    }
+    return sum;
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+bool Checksum::nmeaValid(const char* line) {
+    // Modem yanıtında cümle satır ortasında olabilir ("+QGPSGNMEA: $GNGGA,...")
+    const char* start = strchr(line, '$');
+    if (!start) {
+        if (line[0] != '+') return false;
+        start = line;
+    }
+    start++;
+    const char* star = strchr(start, '*');
+    if (!star) return false;
+    int hi = hexNibble(star[1]);
+    int lo = hi < 0 ? -1 : hexNibble(star[2]);
+    if (lo < 0) return false;
+    return nmeaXor(start, star - start) == (uint8_t)((hi << 4) | lo);
+}
@@ -0,0 +1,28 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <Arduino.h>
+
+// Ortak checksum fonksiyonları - depolama, journal, sensör ve NMEA yolları
+//
+// CRC32 (IEEE 802.3, yansıtılmış 0xEDB88320, başlangıç/son ~0): ESP32'de ROM'daki
+// crc32_le kullanılır; host derlemesinde derleme zamanında üretilen 256'lık tablo.
+// Zincirleme: crc32(b, n2, crc32(a, n1)) == crc32(a+b). Eski calculateCRC32 ile aynı sonucu verir.
+//
+// CRC8 (tablo, 256 byte flash):
+//   crc8Maxim     - yansıtılmış 0x31 (0x8C), başlangıç 0x00: T117
+//   crc8Sensirion - 0x31, MSB önce, başlangıç 0xFF: AHT20
+//
+// NMEA: '$' (veya modemin '+' öneki) ile '*' arasındaki karakterlerin XOR'u.
+class Checksum {
+public:
+    static uint32_t crc32(const void* data, size_t len, uint32_t crc = 0);
+    static uint8_t crc8Maxim(const uint8_t* data, size_t len);
+    static uint8_t crc8Sensirion(const uint8_t* data, size_t len);
+
+    static uint8_t nmeaXor(const char* data, size_t len);
+    // "*HH" varsa ve tutuyorsa true; checksum alanı olmayan veya bozuk satırda false
+    static bool nmeaValid(const char* line);
+};
+
+#endif
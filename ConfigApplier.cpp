@@ -0,0 +1,59 @@
+#include "ConfigApplier.h"
+
+ConfigApplier::ConfigApplier()
+    : _hookCount(0), _pending(false), _lastFailure(nullptr) {
+}
+
+bool ConfigApplier::registerHook(const char* name, ConfigApplyFn fn) {
+    if (_hookCount >= CONFIG_MAX_HOOKS) {
+        Serial.printf("[CFG] Hook table full - %s not registered\n", name);
+        return false;
+    }
+    _hooks[_hookCount].name = name;
+    _hooks[_hookCount].fn = fn;
+    _hookCount++;
+    return true;
+}
+
+Cfg& ConfigApplier::edit(const Cfg& live) {
+    if (!_pending) {
+        _candidate = live; // Stage edilmemiş yarım düzenlemeler atılır
+    }
+    return _candidate;
+}
+
+bool ConfigApplier::service(Cfg& live, ConfigManager& store) {
+    if (!_pending) return true;
+    _pending = false;
+    _lastFailure = nullptr;
+
+    if (memcmp(&live, &_candidate, sizeof(Cfg)) == 0) {
+        Serial.println("[CFG] No changes to apply");
+        return true;
+    }
+
+    _previous = live;
+    uint8_t applied = 0;
+    for (; applied < _hookCount; applied++) {
+        if (!_hooks[applied].fn(_previous, _candidate)) {
+            _lastFailure = _hooks[applied].name;
+            break;
+        }
+    }
+
+    if (_lastFailure) {
+        Serial.printf("[CFG] %s rejected new configuration - rolling back\n", _lastFailure);
+        while (applied > 0) {
+            applied--;
+            if (!_hooks[applied].fn(_candidate, _previous)) {
+                Serial.printf("[CFG] Rollback of %s failed\n", _hooks[applied].name);
+            }
+        }
+        return false;
+    }
+
+    live = _candidate;
+    store.saveConfiguration(live);
+    Serial.printf("[CFG] Configuration applied by %d hooks and saved (no restart)\n", _hookCount);
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef CONFIG_APPLIER_H
+#define CONFIG_APPLIER_H
+
+#include <Arduino.h>
+#include "ConfigManager.h"
+
+#define CONFIG_MAX_HOOKS    8
+
+// Alt sistem uygulama hook'u: next'i devreye al, başarısızsa kendi durumunu
+// değiştirmeden false dön. Geri alma aynı hook'un (next, prev) ile çağrılmasıdır.
+typedef bool (*ConfigApplyFn)(const Cfg& prev, const Cfg& next);
+
+// Yeniden başlatmadan config uygulama
+// Komutlar aday config'i düzenler (edit/stage); uygulama MQTT callback dışında,
+// loop()'tan service() ile yapılır. Hook'lar kayıt sırasıyla çalışır; biri reddederse
+// daha önce uygulananlar ters sırayla eski config'e döndürülür ve canlı config değişmez.
+class ConfigApplier {
+public:
+    ConfigApplier();
+
+    bool registerHook(const char* name, ConfigApplyFn fn);
+
+    // Aday config: bekleyen yoksa canlı config'in kopyası, varsa birikmiş değişiklikler
+    Cfg& edit(const Cfg& live);
+    void stage() { _pending = true; }
+    bool hasPending() { return _pending; }
+
+    // Bekleyen adayı uygula; başarıda live güncellenir ve kaydedilir
+    bool service(Cfg& live, ConfigManager& store);
+    const char* getLastFailure() { return _lastFailure; }
+
+private:
+    struct Hook {
+        const char* name;
+        ConfigApplyFn fn;
+    };
+
+    Hook _hooks[CONFIG_MAX_HOOKS];
+    uint8_t _hookCount;
+    bool _pending;
+    const char* _lastFailure;
+    Cfg _candidate;
+    Cfg _previous;
+};
+
+#endif
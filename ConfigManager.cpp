@@ -1,30 +1,612 @@
 #include "ConfigManager.h"
 #include <cstddef>
+#include "Checksum.h"
 
-ConfigManager::ConfigManager() {}
+// Migrasyon/tüketme sırasında okunan kayıtlar ve config bölüm kodlaması için
+// (ikisi de stack'e büyük, aynı anda kullanılmazlar)
+static uint8_t s_scratch[CFG_SECTION_CAP > OFFLINE_RECORD_CAP ? CFG_SECTION_CAP : OFFLINE_RECORD_CAP];
+
+ConfigManager::ConfigManager()
+    : _nvsWrites(0), _batching(false), _stateDirty(false), _batchStartMs(0),
+      _batchStartNvs(0), _batchStartFlash(0), _batchRecords(0),
+      _nvsBytes(0), _batchNvsBytes(0), _pushedRecords(0), _schemaVersion(0), _loadedMask(0) {
+    memset(&_lastBatch, 0, sizeof(_lastBatch));
+    memset(_sectionCrc, 0, sizeof(_sectionCrc));
+}
+
+// ===== "set" Alan Tablosu =====
+
+enum CfgFieldType : uint8_t {
+    CFG_STR, CFG_U8, CFG_U16, CFG_U32, CFG_INT, CFG_FLOAT, CFG_BOOL
+};
+
+struct CfgField {
+    const char* key;
+    CfgFieldType type;
+    uint16_t offset;
+    uint16_t size;
+    uint32_t maxVal;   // Tamsayılar için üst sınır (0 = tip sınırı)
+    bool secret;       // Log'da gizlenir
+};
+
+#define CFG_FIELD(key, type, member, maxVal, secret) \
+    { key, type, (uint16_t)offsetof(Cfg, member), (uint16_t)sizeof(((Cfg*)0)->member), maxVal, secret }
+
+static const CfgField CFG_FIELDS[] = {
+    // MQTT Broker
+    CFG_FIELD("mqttHost",          CFG_STR,   mqttHost, 0, false),
+    CFG_FIELD("mqttPort",          CFG_U16,   mqttPort, 0, false),
+    CFG_FIELD("mqttUser",          CFG_STR,   mqttUser, 0, false),
+    CFG_FIELD("mqttPass",          CFG_STR,   mqttPass, 0, true),
+    // WiFi
+    CFG_FIELD("wifiSsid",          CFG_STR,   wifiSsid, 0, false),
+    CFG_FIELD("wifiPass",          CFG_STR,   wifiPass, 0, true),
+    // Zaman
+    CFG_FIELD("dataPeriod",        CFG_U32,   dataPeriod, 0, false),
+    CFG_FIELD("infoPeriod",        CFG_U32,   infoPeriod, 0, false),
+    // advData formatı
+    CFG_FIELD("telemetryFormat",   CFG_U8,    telemetryFormat, 2, false),
+    CFG_FIELD("keyframeEvery",     CFG_U8,    keyframeEvery, 0, false),
+    CFG_FIELD("backlogCompressed", CFG_BOOL,  backlogCompressed, 0, false),
+    // Alarm eşikleri ve dahili sensör örneklemesi
+    CFG_FIELD("sensorSampleMs",    CFG_U32,   sensorSampleMs, 0, false),
+    CFG_FIELD("tempHigh",          CFG_FLOAT, tempHigh, 0, false),
+    CFG_FIELD("tempLow",           CFG_FLOAT, tempLow, 0, false),
+    // Buzzer
+    CFG_FIELD("buzzerEnabled",     CFG_BOOL,  buzzerEnabled, 0, false),
+    // Dahili sensör
+    CFG_FIELD("sensorName",        CFG_STR,   internalSensorName, 0, false),
+    CFG_FIELD("mahalId",           CFG_STR,   internalMahalId, 0, false),
+    // Beacon / varlık algılama
+    CFG_FIELD("scanInterval",      CFG_U32,   beacon.scanInterval, 0, false),
+    CFG_FIELD("beaconTimeoutMs",   CFG_U32,   beacon.timeoutMs, 0, false),
+    CFG_FIELD("presenceEnterRssi", CFG_INT,   beacon.presenceEnterRssi, 0, false),
+    CFG_FIELD("presenceExitRssi",  CFG_INT,   beacon.presenceExitRssi, 0, false),
+    CFG_FIELD("presenceEnterMs",   CFG_U32,   beacon.presenceEnterMs, 0, false),
+    CFG_FIELD("presenceExitMs",    CFG_U32,   beacon.presenceExitMs, 0, false),
+};
+
+bool ConfigManager::applyField(Cfg &config, const char* key, JsonVariantConst value) {
+    const CfgField* field = nullptr;
+    for (size_t i = 0; i < sizeof(CFG_FIELDS) / sizeof(CFG_FIELDS[0]); i++) {
+        if (!strcmp(CFG_FIELDS[i].key, key)) {
+            field = &CFG_FIELDS[i];
+            break;
+        }
+    }
+    if (!field) return false;
+    
+    uint8_t* dst = (uint8_t*)&config + field->offset;
+    
+    if (field->type == CFG_STR) {
+        if (!value.is<const char*>()) return false;
+        strlcpy((char*)dst, value.as<const char*>(), field->size);
+        Serial.printf("[CFG] %s: %s\n", key, field->secret ? "****" : (const char*)dst);
+        return true;
+    }
+    if (field->type == CFG_BOOL) {
+        if (!value.is<bool>()) return false;
+        *(bool*)dst = value.as<bool>();
+        Serial.printf("[CFG] %s: %s\n", key, *(bool*)dst ? "ON" : "OFF");
+        return true;
+    }
+    if (field->type == CFG_FLOAT) {
+        if (!value.is<float>()) return false;
+        *(float*)dst = value.as<float>();
+        Serial.printf("[CFG] %s: %.2f\n", key, *(float*)dst);
+        return true;
+    }
+    if (field->type == CFG_INT) {
+        if (!value.is<int>()) return false;
+        *(int*)dst = value.as<int>();
+        Serial.printf("[CFG] %s: %d\n", key, *(int*)dst);
+        return true;
+    }
+    
+    // İşaretsiz tamsayılar
+    if (!value.is<uint32_t>()) return false;
+    uint32_t v = value.as<uint32_t>();
+    uint32_t limit = (field->type == CFG_U8) ? 0xFF : (field->type == CFG_U16) ? 0xFFFF : 0xFFFFFFFF;
+    if (field->maxVal != 0 && field->maxVal < limit) limit = field->maxVal;
+    if (v > limit) {
+        Serial.printf("[CFG] %s: %lu out of range (max %lu)\n", key, (unsigned long)v, (unsigned long)limit);
+        return false;
+    }
+    switch (field->type) {
+        case CFG_U8:  *(uint8_t*)dst = v; break;
+        case CFG_U16: *(uint16_t*)dst = v; break;
+        default:      *(uint32_t*)dst = v; break;
+    }
+    Serial.printf("[CFG] %s: %lu\n", key, (unsigned long)v);
+    return true;
+}
+
+void ConfigManager::buildSetFilter(JsonDocument &filter) {
+    for (size_t i = 0; i < sizeof(CFG_FIELDS) / sizeof(CFG_FIELDS[0]); i++) {
+        filter[CFG_FIELDS[i].key] = true;
+    }
+}
 
 bool ConfigManager::begin() {
     _loadBufferState();
+    
+    // Flash log varsa NVS FIFO'da kalan kayıtları bir kez taşı
+    if (_log.begin(OFFLINE_LOG_SEGMENTS) && _buffer.recordCount > 0) {
+        uint16_t moved = 0;
+        uint16_t len;
+        _batching = true;
+        while ((len = _popNvsRecord(s_scratch, sizeof(s_scratch))) > 0) {
+            if (_log.append(s_scratch, len)) moved++;
+        }
+        _batching = false;
+        _saveBufferState();
+        _prefs.begin("records", false);
+        _prefs.clear();
+        _prefs.end();
+        _nvsBytes = 0;
+        Serial.printf("[STORAGE] Migrated %u NVS records to flash log\n", moved);
+    } else if (!_log.isReady()) {
+        _reconcileNvsRecords();
+    }
     return true;
 }
 
+// ===== Bölümlü Config Deposu =====
+//
+// "cfg" namespace'inde her bölüm ayrı bir blob'dur: [format u8] + alan başına
+// [id u8][uzunluk u16][değer]. Alanlar id ile tanınır; bilinmeyen id atlanır, eksik
+// alan varsayılanda kalır, boyutu değişen alanın sığan kısmı kopyalanıp kalanı sıfırlanır.
+// Böylece alan ekleme/büyütme migrasyon gerektirmez; tip değişikliği için CFG_MIGRATIONS'a
+// adım eklenir ve CFG_SCHEMA_VERSION artırılır. Şema versiyonu "ver" anahtarındadır.
+// Stringler NUL'suz, kullanılan uzunlukta saklanır.
+
+#define CFG_SECTION_FORMAT  1
+
+enum : uint8_t {
+    STORE_RAW  = 0,
+    STORE_STR  = 1,
+    STORE_TAGS = 2     // Eddystone dizisi: [eleman boyutu u16] + activeSensorCount eleman
+};
+
+struct CfgStoreField {
+    uint8_t id;
+    uint8_t kind;
+    uint16_t offset;
+    uint16_t size;
+};
+
+struct CfgSection {
+    const char* key;
+    const CfgStoreField* fields;
+    uint8_t count;
+    bool deferred;     // Açılışta değil, loadDeferredSections() ile yüklenir
+};
+
+#define STORE_FIELD(id, kind, member) \
+    { id, kind, (uint16_t)offsetof(Cfg, member), (uint16_t)sizeof(((Cfg*)0)->member) }
+
+// Id'ler bölüm içinde kalıcıdır: silinen alanın id'si yeniden kullanılmaz
+static const CfgStoreField NET_FIELDS[] = {
+    STORE_FIELD(1,  STORE_STR, wifiSsid),
+    STORE_FIELD(2,  STORE_STR, wifiPass),
+    STORE_FIELD(3,  STORE_STR, mqttHost),
+    STORE_FIELD(4,  STORE_RAW, mqttPort),
+    STORE_FIELD(5,  STORE_STR, mqttUser),
+    STORE_FIELD(6,  STORE_STR, mqttPass),
+    STORE_FIELD(7,  STORE_RAW, connectionMode),
+};
+
+static const CfgStoreField SCHED_FIELDS[] = {
+    STORE_FIELD(1,  STORE_RAW, dataPeriod),
+    STORE_FIELD(2,  STORE_RAW, infoPeriod),
+    STORE_FIELD(3,  STORE_RAW, publish.backlogPeriod),
+    STORE_FIELD(4,  STORE_RAW, publish.alarmPeriod),
+    STORE_FIELD(5,  STORE_RAW, publish.diagPeriod),
+    STORE_FIELD(6,  STORE_RAW, publish.priority),
+    STORE_FIELD(7,  STORE_RAW, publish.jitterMs),
+    STORE_FIELD(8,  STORE_RAW, telemetryFormat),
+    STORE_FIELD(9,  STORE_RAW, keyframeEvery),
+    STORE_FIELD(10, STORE_RAW, backlogCompressed),
+};
+
+static const CfgStoreField OTA_FIELDS[] = {
+    STORE_FIELD(1,  STORE_STR, otaUrl),
+    STORE_FIELD(2,  STORE_RAW, otaInsecureTLS),
+    STORE_FIELD(3,  STORE_STR, otaUser),
+    STORE_FIELD(4,  STORE_STR, otaPass),
+    STORE_FIELD(5,  STORE_STR, otaBasicB64),
+};
+
+static const CfgStoreField ALARM_FIELDS[] = {
+    STORE_FIELD(1,  STORE_RAW, tempHigh),
+    STORE_FIELD(2,  STORE_RAW, tempLow),
+    STORE_FIELD(3,  STORE_RAW, buzzerEnabled),
+    STORE_FIELD(4,  STORE_RAW, buzPeriodMs),
+    STORE_FIELD(5,  STORE_RAW, buzPulseMs),
+    STORE_FIELD(6,  STORE_RAW, alarmSound.enabled),
+    STORE_FIELD(7,  STORE_RAW, alarmSound.buzPeriodMs),
+    STORE_FIELD(8,  STORE_RAW, alarmSound.buzPulseMs),
+    STORE_FIELD(9,  STORE_RAW, sensorSampleMs),
+};
+
+static const CfgStoreField IDENT_FIELDS[] = {
+    STORE_FIELD(1,  STORE_STR, internalSensorName),
+    STORE_FIELD(2,  STORE_STR, internalMahalId),
+};
+
+static const CfgStoreField BEACON_FIELDS[] = {
+    STORE_FIELD(1,  STORE_RAW, beacon.enabled),
+    STORE_FIELD(2,  STORE_RAW, beacon.scanInterval),
+    STORE_FIELD(3,  STORE_RAW, beacon.rssiThreshold),
+    STORE_FIELD(4,  STORE_STR, beacon.targetPrefix),
+    STORE_FIELD(5,  STORE_RAW, beacon.maxBeacons),
+    STORE_FIELD(6,  STORE_RAW, beacon.timeoutMs),
+    STORE_FIELD(7,  STORE_RAW, beacon.presenceEnterRssi),
+    STORE_FIELD(8,  STORE_RAW, beacon.presenceExitRssi),
+    STORE_FIELD(9,  STORE_RAW, beacon.presenceEnterMs),
+    STORE_FIELD(10, STORE_RAW, beacon.presenceExitMs),
+};
+
+static const CfgStoreField TAG_FIELDS[] = {
+    STORE_FIELD(1,  STORE_RAW, activeSensorCount),
+    STORE_FIELD(2,  STORE_TAGS, eddystoneSensors),
+};
+
+#define SECTION(key, fields, deferred) { key, fields, sizeof(fields) / sizeof(fields[0]), deferred }
+
+static const CfgSection CFG_SECTIONS[CFG_SECTION_COUNT] = {
+    SECTION("net",    NET_FIELDS,    false),
+    SECTION("sched",  SCHED_FIELDS,  false),
+    SECTION("ota",    OTA_FIELDS,    false),
+    SECTION("alarm",  ALARM_FIELDS,  false),
+    SECTION("ident",  IDENT_FIELDS,  false),
+    SECTION("beacon", BEACON_FIELDS, false),
+    SECTION("tags",   TAG_FIELDS,    true),
+    { "rsvd", nullptr, 0, true },   // Sonraki bölüm için yer (maske 8 bit)
+};
+
+static size_t encodeSection(const CfgSection& section, const Cfg& config, uint8_t* out, size_t cap) {
+    const uint8_t* base = (const uint8_t*)&config;
+    size_t pos = 0;
+    out[pos++] = CFG_SECTION_FORMAT;
+    for (uint8_t i = 0; i < section.count; i++) {
+        const CfgStoreField& f = section.fields[i];
+        const uint8_t* src = base + f.offset;
+        uint16_t len = f.size;
+        uint16_t elemSize = sizeof(EddystoneSensorConfig);
+        if (f.kind == STORE_STR) {
+            len = strnlen((const char*)src, f.size);
+        } else if (f.kind == STORE_TAGS) {
+            uint8_t n = config.activeSensorCount > 32 ? 32 : config.activeSensorCount;
+            len = 2 + n * elemSize;
+        }
+        if (pos + 3 + len > cap) return 0;
+        out[pos++] = f.id;
+        out[pos++] = len & 0xFF;
+        out[pos++] = len >> 8;
+        if (f.kind == STORE_TAGS) {
+            out[pos++] = elemSize & 0xFF;
+            out[pos++] = elemSize >> 8;
+            memcpy(out + pos, src, len - 2);
+            pos += len - 2;
+        } else {
+            memcpy(out + pos, src, len);
+            pos += len;
+        }
+    }
+    return pos;
+}
+
+static void decodeTags(const uint8_t* in, uint16_t len, Cfg& config) {
+    if (len < 2) return;
+    uint16_t elemSize = in[0] | (in[1] << 8);
+    if (elemSize == 0) return;
+    uint16_t n = (len - 2) / elemSize;
+    if (n > 32) n = 32;
+    uint16_t copy = elemSize < sizeof(EddystoneSensorConfig) ? elemSize : sizeof(EddystoneSensorConfig);
+    for (uint16_t i = 0; i < n; i++) {
+        EddystoneSensorConfig& s = config.eddystoneSensors[i];
+        memset(&s, 0, sizeof(s));
+        memcpy(&s, in + 2 + i * elemSize, copy);
+        s.macAddress[sizeof(s.macAddress) - 1] = '\0';
+        s.mahalId[sizeof(s.mahalId) - 1] = '\0';
+        s.sensorName[sizeof(s.sensorName) - 1] = '\0';
+    }
+}
+
+static bool decodeSection(const CfgSection& section, const uint8_t* in, size_t len, Cfg& config) {
+    if (len < 1 || in[0] != CFG_SECTION_FORMAT) return false;
+    uint8_t* base = (uint8_t*)&config;
+    size_t pos = 1;
+    while (pos + 3 <= len) {
+        uint8_t id = in[pos];
+        uint16_t flen = in[pos + 1] | (in[pos + 2] << 8);
+        pos += 3;
+        if (pos + flen > len) return false;
+        for (uint8_t i = 0; i < section.count; i++) {
+            const CfgStoreField& f = section.fields[i];
+            if (f.id != id) continue;
+            uint8_t* dst = base + f.offset;
+            if (f.kind == STORE_TAGS) {
+                decodeTags(in + pos, flen, config);
+            } else {
+                // Sığan kısım kopyalanır, kalan sıfırlanır (string'de son byte hep NUL)
+                uint16_t room = (f.kind == STORE_STR) ? f.size - 1 : f.size;
+                uint16_t copy = flen < room ? flen : room;
+                memcpy(dst, in + pos, copy);
+                memset(dst + copy, 0, f.size - copy);
+            }
+            break;
+        }
+        pos += flen;
+    }
+    return true;
+}
+
+// ===== Migrasyonlar =====
+// Stored versiyondan CFG_SCHEMA_VERSION'a sırayla uygulanır. Adım çağrıldığında config
+// varsayılanlarla ve (v2+ ise) mevcut bölümlerle doludur; "cfg" okuma modunda açıktır.
+// Migrasyon sonrası tüm bölümler yeni formatta yazılır.
+
+struct CfgMigration {
+    uint16_t toVersion;
+    void (*apply)(Preferences& prefs, Cfg& config);
+};
+
+// v1 -> v2: ilk firmware'in yazdığı ham Cfg blob'u. Düzen burada dondurulmuştur;
+// Cfg değişse de bu yapılar değişmez. Boyut tutmuyorsa (farklı firmware düzeni)
+// okunamaz, önceki sürümdeki gibi varsayılanlar kalır.
+struct AlarmSoundSettingsV1 {
+  bool enabled;
+  uint32_t buzPeriodMs;
+  uint32_t buzPulseMs;
+};
+
+struct BeaconSettingsV1 {
+  bool enabled;
+  uint32_t scanInterval;
+  int rssiThreshold;
+  char targetPrefix[16];
+  uint8_t maxBeacons;
+  uint32_t timeoutMs;
+};
+
+struct EddystoneSensorConfigV1 {
+  char macAddress[18];
+  char mahalId[25];
+  char sensorName[32];
+  float tempHigh;
+  float tempLow;
+  bool buzzerEnabled;
+  bool enabled;
+};
+
+struct CfgV1 {
+  char wifiSsid[32];
+  char wifiPass[64];
+  char mqttHost[64];
+  uint16_t mqttPort;
+  char mqttUser[32];
+  char mqttPass[64];
+  uint32_t dataPeriod;
+  uint32_t infoPeriod;
+  char otaUrl[128];
+  bool otaInsecureTLS;
+  char otaUser[32];
+  char otaPass[32];
+  char otaBasicB64[96];
+  float tempHigh;
+  float tempLow;
+  bool buzzerEnabled;
+  uint32_t buzPeriodMs;
+  uint32_t buzPulseMs;
+  char internalSensorName[32];
+  char internalMahalId[25];
+  EddystoneSensorConfigV1 eddystoneSensors[32];
+  uint8_t activeSensorCount;
+  AlarmSoundSettingsV1 alarmSound;
+  BeaconSettingsV1 beacon;
+  uint8_t connectionMode;
+};
+
+#define COPY_STR(dst, src) do { memcpy(dst, src, sizeof(dst) < sizeof(src) ? sizeof(dst) : sizeof(src)); \
+                                dst[sizeof(dst) - 1] = '\0'; } while (0)
+
+static void migrateLegacyBlob(Preferences& prefs, Cfg& config) {
+    if (prefs.getBytesLength("config") != sizeof(CfgV1)) {
+        Serial.printf("[CFG] Legacy config blob size mismatch (%u != %u), using defaults\n",
+                      (unsigned)prefs.getBytesLength("config"), (unsigned)sizeof(CfgV1));
+        return;
+    }
+    // Tek seferlik; loop task stack'ine büyük
+    CfgV1* v1 = (CfgV1*)malloc(sizeof(CfgV1));
+    if (!v1) return;
+    prefs.getBytes("config", v1, sizeof(CfgV1));
+    
+    COPY_STR(config.wifiSsid, v1->wifiSsid);
+    COPY_STR(config.wifiPass, v1->wifiPass);
+    COPY_STR(config.mqttHost, v1->mqttHost);
+    config.mqttPort = v1->mqttPort;
+    COPY_STR(config.mqttUser, v1->mqttUser);
+    COPY_STR(config.mqttPass, v1->mqttPass);
+    config.dataPeriod = v1->dataPeriod;
+    config.infoPeriod = v1->infoPeriod;
+    COPY_STR(config.otaUrl, v1->otaUrl);
+    config.otaInsecureTLS = v1->otaInsecureTLS;
+    COPY_STR(config.otaUser, v1->otaUser);
+    COPY_STR(config.otaPass, v1->otaPass);
+    COPY_STR(config.otaBasicB64, v1->otaBasicB64);
+    config.tempHigh = v1->tempHigh;
+    config.tempLow = v1->tempLow;
+    config.buzzerEnabled = v1->buzzerEnabled;
+    config.buzPeriodMs = v1->buzPeriodMs;
+    config.buzPulseMs = v1->buzPulseMs;
+    COPY_STR(config.internalSensorName, v1->internalSensorName);
+    COPY_STR(config.internalMahalId, v1->internalMahalId);
+    
+    config.activeSensorCount = v1->activeSensorCount > 32 ? 32 : v1->activeSensorCount;
+    for (int i = 0; i < 32; i++) {
+        EddystoneSensorConfig& dst = config.eddystoneSensors[i];
+        const EddystoneSensorConfigV1& src = v1->eddystoneSensors[i];
+        COPY_STR(dst.macAddress, src.macAddress);
+        COPY_STR(dst.mahalId, src.mahalId);
+        COPY_STR(dst.sensorName, src.sensorName);
+        dst.tempHigh = src.tempHigh;
+        dst.tempLow = src.tempLow;
+        dst.buzzerEnabled = src.buzzerEnabled;
+        dst.enabled = src.enabled;
+    }
+    
+    config.alarmSound.enabled = v1->alarmSound.enabled;
+    config.alarmSound.buzPeriodMs = v1->alarmSound.buzPeriodMs;
+    config.alarmSound.buzPulseMs = v1->alarmSound.buzPulseMs;
+    
+    // v1 sonrası eklenen beacon/varlık alanları varsayılanda kalır
+    config.beacon.enabled = v1->beacon.enabled;
+    config.beacon.scanInterval = v1->beacon.scanInterval;
+    config.beacon.rssiThreshold = v1->beacon.rssiThreshold;
+    COPY_STR(config.beacon.targetPrefix, v1->beacon.targetPrefix);
+    config.beacon.maxBeacons = v1->beacon.maxBeacons;
+    config.beacon.timeoutMs = v1->beacon.timeoutMs;
+    config.connectionMode = v1->connectionMode;
+    
+    free(v1);
+    Serial.println("[CFG] Legacy config blob migrated");
+}
+
+static const CfgMigration CFG_MIGRATIONS[] = {
+    { 2, migrateLegacyBlob },
+};
+
+void ConfigManager::_loadSection(uint8_t index, Cfg &config) {
+    const CfgSection& section = CFG_SECTIONS[index];
+    _loadedMask |= (1 << index);
+    _sectionCrc[index] = 0;
+    if (!section.fields) return;
+    
+    size_t len = _prefs.getBytesLength(section.key);
+    if (len == 0) return;   // Yok: varsayılanlar kalır, ilk kayıtta yazılır
+    if (len > sizeof(s_scratch) || _prefs.getBytes(section.key, s_scratch, len) != len) {
+        Serial.printf("[CFG] Section '%s' unreadable (%u bytes)\n", section.key, (unsigned)len);
+        return;
+    }
+    if (!decodeSection(section, s_scratch, len, config)) {
+        Serial.printf("[CFG] Section '%s' corrupt, defaults kept\n", section.key);
+        return;
+    }
+    _sectionCrc[index] = Checksum::crc32(s_scratch, len);
+}
+
+uint8_t ConfigManager::_writeSections(const Cfg &config, bool force) {
+    uint8_t written = 0;
+    bool opened = false;
+    for (uint8_t i = 0; i < CFG_SECTION_COUNT; i++) {
+        // Yüklenmemiş bölümün RAM'deki hali varsayılandır, NVS'tekini ezmemeli
+        if (!CFG_SECTIONS[i].fields || !(_loadedMask & (1 << i))) continue;
+        size_t len = encodeSection(CFG_SECTIONS[i], config, s_scratch, sizeof(s_scratch));
+        if (len == 0) {
+            Serial.printf("[CFG] Section '%s' too large\n", CFG_SECTIONS[i].key);
+            continue;
+        }
+        uint32_t crc = Checksum::crc32(s_scratch, len);
+        if (!force && crc == _sectionCrc[i]) continue;
+        if (!opened) {
+            _prefs.begin("cfg", false);
+            opened = true;
+        }
+        if (_prefs.putBytes(CFG_SECTIONS[i].key, s_scratch, len) == len) {
+            _sectionCrc[i] = crc;
+            written++;
+        }
+        _nvsWrites++;
+    }
+    if (opened) _prefs.end();
+    return written;
+}
+
 void ConfigManager::loadConfiguration(Cfg &config) {
+    _setDefaults(config);
+    _loadedMask = 0;
+    memset(_sectionCrc, 0, sizeof(_sectionCrc));
+    
     _prefs.begin("cfg", true);
-    if (_prefs.getBytesLength("config") == sizeof(Cfg)) {
-        _prefs.getBytes("config", &config, sizeof(Cfg));
-    } else {
+    uint16_t stored = _prefs.getUShort("ver", 0);
+    bool legacy = _prefs.getBytesLength("config") > 0;
+    
+    if (stored == 0 && !legacy) {
+        // İlk açılış
+        _prefs.end();
         resetToFactory(config);
+        Serial.println("[CFG] No stored config, factory defaults written");
+        return;
+    }
+    if (stored == 0) stored = 1;
+    
+    bool migrate = stored < CFG_SCHEMA_VERSION;
+    if (stored >= 2) {
+        // Migrasyonda hepsi yeniden yazılacağı için ertelenenler de okunur
+        for (uint8_t i = 0; i < CFG_SECTION_COUNT; i++) {
+            if (migrate || !CFG_SECTIONS[i].deferred) _loadSection(i, config);
+        }
+    }
+    if (migrate) {
+        for (size_t i = 0; i < sizeof(CFG_MIGRATIONS) / sizeof(CFG_MIGRATIONS[0]); i++) {
+            if (CFG_MIGRATIONS[i].toVersion > stored) CFG_MIGRATIONS[i].apply(_prefs, config);
+        }
     }
     _prefs.end();
+    
+    if (migrate) {
+        _loadedMask = 0xFF;
+        _writeSections(config, true);
+        _prefs.begin("cfg", false);
+        _prefs.putUShort("ver", CFG_SCHEMA_VERSION);
+        _prefs.remove("config");
+        _prefs.end();
+        _nvsWrites++;
+        _schemaVersion = CFG_SCHEMA_VERSION;
+        Serial.printf("[CFG] Config schema migrated v%u -> v%u\n", stored, CFG_SCHEMA_VERSION);
+    } else {
+        // Yeni firmware'in yazdığı şema: bilinen alanlar okunur, "ver" değiştirilmez
+        if (stored > CFG_SCHEMA_VERSION) {
+            Serial.printf("[CFG] Config schema v%u newer than firmware (v%u)\n", stored, CFG_SCHEMA_VERSION);
+        }
+        _schemaVersion = stored;
+    }
+}
+
+void ConfigManager::loadDeferredSections(Cfg &config) {
+    bool opened = false;
+    for (uint8_t i = 0; i < CFG_SECTION_COUNT; i++) {
+        if (!CFG_SECTIONS[i].deferred || (_loadedMask & (1 << i))) continue;
+        if (!opened) {
+            _prefs.begin("cfg", true);
+            opened = true;
+        }
+        _loadSection(i, config);
+    }
+    if (opened) _prefs.end();
 }
 
 void ConfigManager::saveConfiguration(const Cfg &config) {
-    _prefs.begin("cfg", false);
-    _prefs.putBytes("config", &config, sizeof(Cfg));
-    _prefs.end();
+    // Sadece içeriği NVS'tekinden farklı bölümler yazılır
+    _writeSections(config, false);
 }
 
 void ConfigManager::resetToFactory(Cfg &config) {
+    _setDefaults(config);
+    _loadedMask = 0xFF;
+    _writeSections(config, false);
+    if (_schemaVersion != CFG_SCHEMA_VERSION) {
+        _prefs.begin("cfg", false);
+        _prefs.putUShort("ver", CFG_SCHEMA_VERSION);
+        _prefs.end();
+        _nvsWrites++;
+        _schemaVersion = CFG_SCHEMA_VERSION;
+    }
+}
+
+void ConfigManager::_setDefaults(Cfg &config) {
     // WiFi
     strlcpy(config.wifiSsid, "WINDESK", sizeof(config.wifiSsid));
     strlcpy(config.wifiPass, "", sizeof(config.wifiPass));
@@ -39,6 +621,15 @@ void ConfigManager::resetToFactory(Cfg &config) {
     config.dataPeriod = 120000;   // 2 dk
     config.infoPeriod = 960000;   // 16 dk (960 saniye)
     
+    // Mesaj sınıfı zamanlaması (data, info, backlog, alarm, diag)
+    config.publish.backlogPeriod = 120000; // FIFO her 2 dk'da bir boşaltılır
+    config.publish.alarmPeriod = 1000;    // Alarm/varlık geçişleri saniyede bir değerlendirilir
+    config.publish.diagPeriod = 0;        // Kapalı
+    const uint8_t defaultPriority[5] = {1, 2, 3, 0, 4};
+    const uint32_t defaultJitter[5] = {15000, 60000, 30000, 0, 60000};
+    memcpy(config.publish.priority, defaultPriority, sizeof(defaultPriority));
+    memcpy(config.publish.jitterMs, defaultJitter, sizeof(defaultJitter));
+    
     // OTA
     strlcpy(config.otaUrl, "http://update.kutar.com.tr:8780/stcFix.bin", sizeof(config.otaUrl));
     config.otaInsecureTLS = true;
@@ -77,11 +668,17 @@ void ConfigManager::resetToFactory(Cfg &config) {
     strlcpy(config.beacon.targetPrefix, "8C696B", sizeof(config.beacon.targetPrefix));
     config.beacon.maxBeacons = 30;
     config.beacon.timeoutMs = 120000;
+    config.beacon.presenceEnterRssi = -75;
+    config.beacon.presenceExitRssi = -85;
+    config.beacon.presenceEnterMs = 5000;
+    config.beacon.presenceExitMs = 15000;
     
     // Bağlantı modu
     config.connectionMode = 1; // 0: WiFi only, 1: WiFi+4G (fallback), 2: 4G only
-    
-    saveConfiguration(config);
+    config.telemetryFormat = 0; // 0: JSON, 1: CBOR (KUTARIoT/bdata), 2: ikisi
+    config.keyframeEvery = 0;   // 0: delta kapalı (her periyot tam advData)
+    config.backlogCompressed = true; // Backlog sıkıştırılmış bloklarla (advData formatından bağımsız)
+    config.sensorSampleMs = 10000;
 }
 
 void ConfigManager::_loadBufferState() {
@@ -98,86 +695,208 @@ void ConfigManager::_saveBufferState() {
     _prefs.begin("buf", false);
     _prefs.putBytes("state", &_buffer, sizeof(OfflineBuffer));
     _prefs.end();
+    _nvsWrites++;
+}
+
+void ConfigManager::_markBufferDirty() {
+    // Batch içinde durum commit()'e kadar RAM'de kalır
+    if (_batching) {
+        _stateDirty = true;
+        return;
+    }
+    _saveBufferState();
 }
 
 uint32_t ConfigManager::calculateCRC32(const OfflineDataRecord &record) {
-    // Basit CRC32 hesaplama (crc32 field hariç)
-    const uint8_t *data = (const uint8_t *)&record;
-    size_t len = offsetof(OfflineDataRecord, crc32);
-    
-    uint32_t crc = 0xFFFFFFFF;
-    for (size_t i = 0; i < len; i++) {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xEDB88320;
-            } else {
-                crc >>= 1;
-            }
+    // crc32 alanı hariç
+    return Checksum::crc32(&record, offsetof(OfflineDataRecord, crc32));
+}
+
+bool ConfigManager::pushRecord(const uint8_t* data, uint16_t len) {
+    if (len == 0 || len > OFFLINE_RECORD_CAP) return false;
+    
+    bool ok = _log.isReady() ? _log.append(data, len) : _pushNvsRecord(data, len);
+    if (ok) _pushedRecords++;
+    return ok;
+}
+
+uint16_t ConfigManager::_popRecord(uint8_t* out, uint16_t cap) {
+    if (!_log.isReady()) return _popNvsRecord(out, cap);
+    
+    // peek sığmayan kaydı tüketmez; bozuk kayıtları kendisi atlar
+    uint16_t len = _log.peek(out, cap);
+    if (len > 0) _log.pop();
+    return len;
+}
+
+void ConfigManager::_reconcileNvsRecords() {
+    // Bekleyen kayıtların toplam boyutu + tüketilmiş ama silinmemiş anahtarlar (eski sürümler
+    // tüketilen kaydı üzerine yazılana kadar NVS'te tutuyordu)
+    _prefs.begin("records", false);
+    uint32_t bytes = 0;
+    uint16_t removed = 0;
+    for (uint16_t i = 0; i < OFFLINE_NVS_MAX_RECORDS; i++) {
+        char key[10];
+        uint16_t slot = (_buffer.readIndex + i) % OFFLINE_NVS_MAX_RECORDS;
+        sprintf(key, "r%d", slot);
+        if (i < _buffer.recordCount) {
+            bytes += _prefs.getBytesLength(key);
+        } else if (_prefs.isKey(key)) {
+            _prefs.remove(key);
+            removed++;
         }
     }
-    return ~crc;
+    _prefs.end();
+    _nvsBytes = (uint16_t)min(bytes, (uint32_t)0xFFFF);
+    if (removed > 0) _nvsWrites++;
+    Serial.printf("[STORAGE] NVS FIFO: %u records, %u bytes (%u stale keys removed)\n",
+                  _buffer.recordCount, _nvsBytes, removed);
 }
 
-bool ConfigManager::pushRecord(OfflineDataRecord record) {
-    // CRC32 hesapla ve kaydet
-    record.crc32 = calculateCRC32(record);
+void ConfigManager::_removeNvsRecords(uint16_t fromIndex, uint16_t count) {
+    if (count == 0) return;
+    _prefs.begin("records", false);
+    for (uint16_t i = 0; i < count; i++) {
+        char key[10];
+        sprintf(key, "r%d", (fromIndex + i) % OFFLINE_NVS_MAX_RECORDS);
+        _prefs.remove(key);
+    }
+    _prefs.end();
+    _nvsWrites++;
+}
+
+bool ConfigManager::_pushNvsRecord(const uint8_t* data, uint16_t len) {
+    // NVS config/excur/journal ile paylaşılır: bayt sınırı aşılacaksa en eski kayıtlar düşer
+    if (len > OFFLINE_NVS_MAX_BYTES) return false;
+    
+    _prefs.begin("records", false);
+    uint16_t dropped = 0;
+    while (_buffer.recordCount > 0 &&
+           (_buffer.recordCount >= OFFLINE_NVS_MAX_RECORDS || _nvsBytes + len > OFFLINE_NVS_MAX_BYTES)) {
+        char oldKey[10];
+        sprintf(oldKey, "r%d", _buffer.readIndex);
+        size_t oldLen = _prefs.getBytesLength(oldKey);
+        _prefs.remove(oldKey);
+        _nvsBytes -= min((size_t)_nvsBytes, oldLen);
+        _buffer.readIndex = (_buffer.readIndex + 1) % OFFLINE_NVS_MAX_RECORDS;
+        _buffer.recordCount--;
+        _buffer.bufferFull = true;
+        dropped++;
+    }
     
     char key[10];
     sprintf(key, "r%d", _buffer.writeIndex);
-    
-    _prefs.begin("records", false);
-    _prefs.putBytes(key, &record, sizeof(OfflineDataRecord));
+    size_t written = _prefs.putBytes(key, data, len);
     _prefs.end();
+    _nvsWrites++;
+    if (dropped > 0) {
+        Serial.printf("[STORAGE] NVS FIFO full - dropped %u oldest records\n", dropped);
+        _markBufferDirty();
+    }
+    if (written != len) {
+        Serial.println("[STORAGE] NVS full - offline record dropped");
+        return false;
+    }
 
     _buffer.totalRecords++;
-    _buffer.writeIndex = (_buffer.writeIndex + 1) % 100; // 100 kayıtlık limit
-    if (_buffer.recordCount < 100) {
-        _buffer.recordCount++;
-        _buffer.bufferFull = false;
-    } else {
-        _buffer.readIndex = (_buffer.readIndex + 1) % 100; // Üzerine yaz
-        _buffer.bufferFull = true;
-    }
+    _buffer.writeIndex = (_buffer.writeIndex + 1) % OFFLINE_NVS_MAX_RECORDS;
+    _buffer.recordCount++;
+    if (dropped == 0) _buffer.bufferFull = false;
+    _nvsBytes += len;
 
-    _saveBufferState();
+    _markBufferDirty();
     return true;
 }
 
-bool ConfigManager::popRecord(OfflineDataRecord &record) {
-    if (_buffer.recordCount == 0) return false;
-
-    char key[10];
-    sprintf(key, "r%d", _buffer.readIndex);
-
+uint16_t ConfigManager::_popNvsRecord(uint8_t* out, uint16_t cap) {
     _prefs.begin("records", true);
-    _prefs.getBytes(key, &record, sizeof(OfflineDataRecord));
+    uint16_t len = 0;
+    bool advanced = false;
+    while (_buffer.recordCount > 0) {
+        char key[10];
+        sprintf(key, "r%d", _buffer.readIndex);
+        len = _prefs.getBytesLength(key);
+        if (len > cap) {
+            len = 0; // Sığmıyor - tüketilmez
+            break;
+        }
+        if (len > 0) _prefs.getBytes(key, out, len);
+        else Serial.printf("[STORAGE] Record %d missing - skipped\n", _buffer.readIndex);
+
+        // Anahtar commit()'te silinir (abortBatch kaydı geri getirebilsin)
+        _nvsBytes -= min(_nvsBytes, len);
+        _buffer.readIndex = (_buffer.readIndex + 1) % OFFLINE_NVS_MAX_RECORDS;
+        _buffer.recordCount--;
+        _buffer.bufferFull = false;
+        advanced = true;
+        if (len > 0) break;
+    }
     _prefs.end();
+    
+    if (advanced) _markBufferDirty();
+    return len;
+}
 
-    // CRC32 kontrolü
-    uint32_t calculatedCRC = calculateCRC32(record);
-    if (record.crc32 != calculatedCRC) {
-        // CRC hatası - kayıt bozulmuş olabilir, devam et ama logla
-        Serial.printf("[STORAGE] CRC mismatch for record %d\n", _buffer.readIndex);
+void ConfigManager::beginBatch() {
+    if (_batching) return;
+    _batching = true;
+    _stateDirty = false;
+    _batchStartMs = millis();
+    _batchStartNvs = _nvsWrites;
+    _batchStartFlash = _log.getWriteCount();
+    _batchRecords = 0;
+    _batchBuffer = _buffer;
+    _batchNvsBytes = _nvsBytes;
+    _log.beginBatch();
+}
+
+void ConfigManager::commit() {
+    if (!_batching) return;
+    _log.commit();
+    _batching = false;
+    if (!_log.isReady()) {
+        // Tüketilen NVS kayıtları silinir - yer config ve journal için açılır
+        _removeNvsRecords(_batchBuffer.readIndex, _batchBuffer.recordCount - _buffer.recordCount);
+    }
+    if (_stateDirty) {
+        _saveBufferState();
+        _stateDirty = false;
     }
 
-    _buffer.readIndex = (_buffer.readIndex + 1) % 100;
-    _buffer.recordCount--;
-    _buffer.bufferFull = false;
+    _lastBatch.records = _batchRecords;
+    _lastBatch.nvsWrites = _nvsWrites - _batchStartNvs;
+    _lastBatch.flashWrites = _log.getWriteCount() - _batchStartFlash;
+    _lastBatch.durationMs = millis() - _batchStartMs;
+}
 
-    _saveBufferState();
-    return true;
+void ConfigManager::abortBatch() {
+    if (!_batching) return;
+    _log.rollback();
+    _buffer = _batchBuffer;
+    _nvsBytes = _batchNvsBytes;
+    _batching = false;
+    _stateDirty = false;
 }
 
-void ConfigManager::clearAllRecords() {
-    _prefs.begin("records", false);
-    for (int i = 0; i < 100; i++) {
-        char key[10];
-        sprintf(key, "r%d", i);
-        _prefs.remove(key);
+uint16_t ConfigManager::peekRecord(uint8_t* out, uint16_t cap, uint32_t &tailSeq) {
+    tailSeq = _tailSeq();
+    beginBatch();
+    uint16_t len = _popRecord(out, cap);
+    abortBatch();
+    return len;
+}
+
+uint16_t ConfigManager::consumeRecords(uint32_t tailSeq, uint16_t count) {
+    // Okumadan bu yana taşmayla düşen kayıtlar zaten gitmiştir
+    uint32_t gone = _tailSeq() - tailSeq;
+    if (gone >= count) return 0;
+
+    beginBatch();
+    uint16_t consumed = 0;
+    while (consumed < count - gone && _popRecord(s_scratch, sizeof(s_scratch)) > 0) {
+        consumed++;
     }
-    _prefs.end();
-    
-    memset(&_buffer, 0, sizeof(OfflineBuffer));
-    _saveBufferState();
-}
\ No newline at end of file
+    _batchRecords = consumed;
+    commit();
+    return consumed;
+}
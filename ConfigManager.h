@@ -3,8 +3,20 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <ArduinoJson.h>
+#include "FlashLog.h"
 
-// Çevrimdışı Kayıt Yapısı
+#define OFFLINE_LOG_SEGMENTS    0       // Flash log sektör sayısı (0 = bölümün tamamı; kayıt = çok periyotlu blok, 4 KB sektöre 1+ kayıt)
+
+#define OFFLINE_RECORD_CAP      2064    // Çevrimdışı kayıt üst sınırı (BacklogCodec sıkıştırılmış blok)
+#define OFFLINE_NVS_MAX_RECORDS 100     // Flash log yoksa NVS FIFO anahtar sayısı
+#define OFFLINE_NVS_MAX_BYTES   8192    // NVS FIFO toplam boyutu (~20 KB NVS config/excur/journal ile paylaşılır)
+
+#define CFG_SCHEMA_VERSION      2       // 1: tek "config" blob'u (ham Cfg), 2: bölümlü TLV
+#define CFG_SECTION_COUNT       8
+#define CFG_SECTION_CAP         3072    // En büyük bölüm (tag listesi) kodlaması
+
+// Eski çevrimdışı kayıt yapısı (v1, sadece dahili sensör) - FIFO'da kalanlar BacklogCodec ile okunur
 struct OfflineDataRecord {
   uint32_t timestamp;
   float temperature;
@@ -29,6 +41,14 @@ struct OfflineBuffer {
   uint8_t reserved[16];
 };
 
+// Son FIFO batch'inin maliyeti (aşınma / boşaltma süresi takibi)
+struct BatchStats {
+  uint16_t records;      // Batch'te okunan kayıt
+  uint32_t nvsWrites;    // NVS yazma (kayıt + durum)
+  uint32_t flashWrites;  // Flash log yazma
+  uint32_t durationMs;   // beginBatch -> commit
+};
+
 // Buzzer Ayarları
 struct AlarmSoundSettings {
   bool enabled;
@@ -36,14 +56,28 @@ struct AlarmSoundSettings {
   uint32_t buzPulseMs;
 };
 
-// Beacon Ayarları (gelecekte kullanım için)
+// Beacon Ayarları (BLE tarama + varlık algılama)
 struct BeaconSettings {
   bool enabled;
-  uint32_t scanInterval;
+  uint32_t scanInterval;  // Tag başına periyot içi örnekleme aralığı (ms, 0 = kapalı)
   int rssiThreshold;
   char targetPrefix[16];
   uint8_t maxBeacons;
-  uint32_t timeoutMs;
+  uint32_t timeoutMs;          // Bu süre görülmeyen tag "yok" sayılır
+  int presenceEnterRssi;       // Filtrelenmiş RSSI bu değerin üstündeyse "var" adayı
+  int presenceExitRssi;        // Filtrelenmiş RSSI bu değerin altındaysa "yok" adayı
+  uint32_t presenceEnterMs;    // "var" olmak için eşik üstünde kalma süresi
+  uint32_t presenceExitMs;     // "yok" olmak için eşik altında kalma süresi
+};
+
+// Mesaj sınıfı zamanlaması (PublishScheduler)
+// Dizi sırası: data, info, backlog, alarm, diag - data/info periyotları dataPeriod/infoPeriod'dadır
+struct PublishSettings {
+  uint32_t backlogPeriod;  // FIFO boşaltma aralığı (0 = kapalı)
+  uint32_t alarmPeriod;    // Alarm/varlık servis aralığı
+  uint32_t diagPeriod;     // Diagnostik mesajı aralığı (0 = kapalı)
+  uint8_t priority[5];     // 0 = en yüksek
+  uint32_t jitterMs[5];    // Cihaz başına sabit gecikme üst sınırı
 };
 
 // Eddystone Sensör Konfigürasyonu (BLE sensörler için - şu an kullanılmıyor)
@@ -72,6 +106,7 @@ struct Cfg {
   // MQTT & Zaman
   uint32_t dataPeriod;   // 2 dk
   uint32_t infoPeriod;   // 10 saat
+  PublishSettings publish; // Sınıf başına periyot/öncelik/jitter
 
   // OTA
   char otaUrl[128];
@@ -103,6 +138,19 @@ struct Cfg {
   
   // Bağlantı modu (0: WiFi, 1: 4G fallback)
   uint8_t connectionMode;
+  
+  // advData formatı (0: JSON, 1: CBOR, 2: ikisi - TelemetryFormat)
+  uint8_t telemetryFormat;
+  
+  // advData delta: N periyotta bir tam keyframe, arada sadece değişen alanlar (0: kapalı)
+  uint8_t keyframeEvery;
+  
+  // Çevrimdışı FIFO boşaltması: LZ sıkıştırılmış çok periyotlu blok (KUTARIoT/backlog)
+  // veya periyot başına advData JSON (backend blok çözücüsü yoksa kapatılır)
+  bool backlogCompressed;
+  
+  // Dahili sensör örnekleme aralığı (ms) - son 4 örneğin ortalaması kullanılır
+  uint32_t sensorSampleMs;
 };
 
 // Güç Durumu
@@ -121,12 +169,37 @@ public:
     void loadConfiguration(Cfg &config);
     void saveConfiguration(const Cfg &config);
     void resetToFactory(Cfg &config);
+    // Ertelenmiş bölümler (Eddystone tag listesi) açılışta okunmaz; ilk kullanımdan
+    // önce çağrılır. Zaten yüklüyse bir şey yapmaz.
+    void loadDeferredSections(Cfg &config);
+    uint16_t getSchemaVersion() { return _schemaVersion; }
+    
+    // "set" komutu alan tablosu (JSON anahtarı -> Cfg üyesi)
+    // Bilinmeyen anahtar veya tip/aralık dışı değer: false, config değişmez
+    static bool applyField(Cfg &config, const char* key, JsonVariantConst value);
+    static void buildSetFilter(JsonDocument &filter); // Tablodaki anahtarlar için parse filtresi
     
-    // FIFO İşlemleri
-    bool pushRecord(OfflineDataRecord record);
-    bool popRecord(OfflineDataRecord &record);
-    uint16_t getPendingCount() { return _buffer.recordCount; }
-    void clearAllRecords();
+    // FIFO İşlemleri - değişken uzunlukta kayıtlar (BacklogCodec bloğu)
+    // Flash log bölümü varsa oraya, yoksa NVS FIFO'ya yazar (OFFLINE_NVS_MAX_BYTES aşılırsa
+    // en eski kayıtlar düşer)
+    bool pushRecord(const uint8_t* data, uint16_t len);
+    uint32_t getPendingCount() { return _log.isReady() ? _log.getCount() : _buffer.recordCount; }
+    FlashLog& getLog() { return _log; }
+    
+    // Grup commit: batch içinde okuma/yazma imleçleri sadece RAM'de ilerler,
+    // commit() durumu tek seferde kalıcı yapar
+    void beginBatch();
+    void commit();
+    void abortBatch();  // Batch'teki okumaları geri al (kayıtlar kuyrukta kalır)
+    const BatchStats& getLastBatch() { return _lastBatch; }
+    
+    // Onaylı boşaltma: kaydı kuyruğu ilerletmeden oku, teslim doğrulanınca tüket.
+    // tailSeq okunduğu andaki kuyruk konumudur; arada taşmayla düşen kayıtlar
+    // consumeRecords'ta düşülür (aynı açılış içinde geçerli).
+    uint16_t peekRecord(uint8_t* out, uint16_t cap, uint32_t &tailSeq);
+    uint16_t consumeRecords(uint32_t tailSeq, uint16_t count);
+    
+    uint32_t getNvsWriteCount() { return _nvsWrites; } // Flash aşınma göstergesi
     
     // CRC32 hesaplama
     static uint32_t calculateCRC32(const OfflineDataRecord &record);
@@ -134,8 +207,37 @@ public:
 private:
     Preferences _prefs;
     OfflineBuffer _buffer;
+    uint32_t _nvsWrites;
+    FlashLog _log;
+    bool _batching;
+    bool _stateDirty;
+    uint32_t _batchStartMs;
+    uint32_t _batchStartNvs;
+    uint32_t _batchStartFlash;
+    uint16_t _batchRecords;
+    BatchStats _lastBatch;
+    OfflineBuffer _batchBuffer;     // abortBatch için NVS FIFO durumu
+    uint16_t _nvsBytes;             // NVS FIFO'daki bekleyen kayıtların toplam boyutu
+    uint16_t _batchNvsBytes;
+    uint32_t _pushedRecords;        // Bu açılışta eklenen kayıt (kuyruk konumu için)
+    uint32_t _tailSeq() { return _pushedRecords - getPendingCount(); }
+    uint16_t _popRecord(uint8_t* out, uint16_t cap); // Onaysız tüketim - sadece batch içinde
+    bool _pushNvsRecord(const uint8_t* data, uint16_t len);
+    void _reconcileNvsRecords();
+    void _removeNvsRecords(uint16_t fromIndex, uint16_t count);
+    uint16_t _popNvsRecord(uint8_t* out, uint16_t cap);
     void _saveBufferState();
+    void _markBufferDirty();
     void _loadBufferState();
+    
+    // Bölümlü config: yüklenen bölümler ve NVS'teki içeriklerinin CRC'si (değişmeyen
+    // bölüm yeniden yazılmaz)
+    uint16_t _schemaVersion;
+    uint8_t _loadedMask;
+    uint32_t _sectionCrc[CFG_SECTION_COUNT];
+    void _setDefaults(Cfg &config);
+    void _loadSection(uint8_t index, Cfg &config);      // "cfg" açıkken
+    uint8_t _writeSections(const Cfg &config, bool force);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "Diagnostics.h"
+#include "TelemetryEncoder.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+DiagHistogram Diagnostics::_loop;
+DiagHistogram Diagnostics::_at;
+DiagHistogram Diagnostics::_cycle;
+uint32_t Diagnostics::_lastEncodeMs = 0;
+uint32_t Diagnostics::_lastBleCallbacks = 0;
+
+// Stack'i izlenen task'lar (bulunamayanlar atlanır)
+static const char* const DIAG_TASKS[] = { "loopTask", "BTU_TASK", "btController", "IDLE0", "IDLE1" };
+
+// ===== DiagHistogram =====
+
+void DiagHistogram::add(uint32_t value) {
+    uint8_t bucket = value ? 32 - __builtin_clz(value) : 0;
+    if (bucket > 31) bucket = 31;
+    buckets[bucket]++;
+    count++;
+    if (value > maxValue) maxValue = value;
+}
+
+uint32_t DiagHistogram::percentile(uint8_t pct) const {
+    if (count == 0) return 0;
+    uint32_t target = ((uint64_t)count * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < 32; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            uint32_t upper = i ? (1UL << i) - 1 : 0;
+            return min(upper, maxValue);
+        }
+    }
+    return maxValue;
+}
+
+static void writeHistogram(CborWriter& w, const DiagHistogram& h) {
+    int first = -1;
+    int last = -1;
+    for (uint8_t i = 0; i < 32; i++) {
+        if (h.buckets[i] == 0) continue;
+        if (first < 0) first = i;
+        last = i;
+    }
+
+    w.beginArray(7);
+    w.writeUint(h.count);
+    w.writeUint(h.maxValue);
+    w.writeUint(h.percentile(50));
+    w.writeUint(h.percentile(90));
+    w.writeUint(h.percentile(99));
+    w.writeUint(first < 0 ? 0 : first);
+    if (first < 0) {
+        w.beginArray(0);
+        return;
+    }
+    w.beginArray(last - first + 1);
+    for (int i = first; i <= last; i++) w.writeUint(h.buckets[i]);
+}
+
+// ===== Diagnostics =====
+
+void Diagnostics::recordLoop(uint32_t us) {
+    _loop.add(us);
+}
+
+void Diagnostics::recordAt(uint32_t ms) {
+    _at.add(ms);
+}
+
+void Diagnostics::recordCycle(uint32_t ms) {
+    _cycle.add(ms);
+}
+
+void Diagnostics::reset() {
+    memset(&_loop, 0, sizeof(_loop));
+    memset(&_at, 0, sizeof(_at));
+    memset(&_cycle, 0, sizeof(_cycle));
+    Serial.println("[DIAG] Counters reset");
+}
+
+size_t Diagnostics::encode(const DiagCounters& counters, uint8_t* buf, size_t cap) {
+    uint32_t now = millis();
+    CborWriter w(buf, cap);
+    w.beginMap(11);
+
+    w.writeUint(0); w.writeUint(1);
+    w.writeUint(1); w.writeUint(now / 1000);
+    w.writeUint(2); writeHistogram(w, _loop);
+    w.writeUint(3); writeHistogram(w, _at);
+    w.writeUint(4); writeHistogram(w, _cycle);
+
+    // Heap: parçalanma = en büyük bloğun boş alana oranının tersi
+    size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    w.writeUint(5);
+    w.beginArray(5);
+    w.writeUint(freeHeap);
+    w.writeUint(heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+    w.writeUint(largest);
+    w.writeUint(freeHeap ? 100 - (largest * 100) / freeHeap : 0);
+    w.writeUint(heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+
+    // Task stack high-water mark'ları
+    TaskHandle_t handles[sizeof(DIAG_TASKS) / sizeof(DIAG_TASKS[0])];
+    uint8_t taskCount = 0;
+    for (uint8_t i = 0; i < sizeof(DIAG_TASKS) / sizeof(DIAG_TASKS[0]); i++) {
+        handles[i] = xTaskGetHandle(DIAG_TASKS[i]);
+        if (handles[i]) taskCount++;
+    }
+    w.writeUint(6);
+    w.beginArray(taskCount);
+    for (uint8_t i = 0; i < sizeof(DIAG_TASKS) / sizeof(DIAG_TASKS[0]); i++) {
+        if (!handles[i]) continue;
+        w.beginArray(2);
+        w.writeText(DIAG_TASKS[i]);
+        w.writeUint(uxTaskGetStackHighWaterMark(handles[i]));
+    }
+
+    // BLE callback hızı (son diag'dan beri)
+    uint32_t elapsed = now - _lastEncodeMs;
+    uint32_t callbacks = counters.bleCallbacks - _lastBleCallbacks;
+    w.writeUint(7);
+    w.beginArray(4);
+    w.writeUint(counters.bleCallbacks);
+    w.writeUint(elapsed ? (uint32_t)((uint64_t)callbacks * 1000 / elapsed) : 0);
+    w.writeUint(counters.bleCallbackMaxUs);
+    w.writeUint(counters.bleTags);
+
+    w.writeUint(8);
+    w.beginArray(3);
+    w.writeUint(counters.cfgNvsWrites);
+    w.writeUint(counters.journalWrites);
+    w.writeUint(counters.journalFlushes);
+
+    w.writeUint(10);
+    w.beginArray(2);
+    w.writeUint(counters.queueDepth);
+    w.writeUint(counters.arenaPeak);
+
+    w.writeUint(11);
+    w.beginArray(6);
+    w.writeUint(counters.pendingRecords);
+    w.writeUint(counters.lastBatch.records);
+    w.writeUint(counters.lastBatch.nvsWrites);
+    w.writeUint(counters.lastBatch.flashWrites);
+    w.writeUint(counters.lastBatch.durationMs);
+    w.writeUint(counters.flashErases);
+
+    if (w.overflow()) return 0;
+
+    _lastEncodeMs = now;
+    _lastBleCallbacks = counters.bleCallbacks;
+    return w.length();
+}
@@ -0,0 +1,65 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <Arduino.h>
+#include "ConfigManager.h"
+
+// log2 histogram: kova i, bit uzunluğu i olan değerler ([2^(i-1), 2^i)); kova 0 = 0
+struct DiagHistogram {
+    uint32_t buckets[32];
+    uint32_t count;
+    uint32_t maxValue;
+
+    void add(uint32_t value);
+    uint32_t percentile(uint8_t pct) const; // Kova üst sınırı olarak
+};
+
+// Diag mesajında alt sistemlerden alınan sayaçlar (.ino doldurur)
+struct DiagCounters {
+    uint32_t bleCallbacks;      // BLE tarama callback toplamı
+    uint32_t bleCallbackMaxUs;  // En uzun callback süresi
+    uint8_t bleTags;            // Buffer'daki tag sayısı
+    uint32_t cfgNvsWrites;      // ConfigManager NVS yazma sayısı
+    uint32_t journalWrites;     // Journal kayıt yazma
+    uint32_t journalFlushes;    // Journal NVS oturumu
+    uint8_t queueDepth;         // Giden kuyruk doluluğu
+    uint32_t arenaPeak;         // JSON arena zirvesi
+    uint32_t pendingRecords;    // Çevrimdışı bekleyen kayıt
+    BatchStats lastBatch;       // Son backlog batch'i
+    uint32_t flashErases;       // Flash log sektör silme
+};
+
+// Saha profilleme (diag komutu / PUB_DIAG) - tüm sayaçlar statik, heap kullanmaz
+// Diag şeması (v1) - tamsayı anahtarlı CBOR map, topic KUTARIoT/diag/<mac>:
+//   0: şema versiyonu (1)
+//   1: uptime (s)
+//   2: loop süresi histogramı (us)
+//   3: AT komut tur süresi histogramı (ms)
+//   4: periyot publish süresi histogramı (ms)
+//      histogram: [adet, max, p50, p90, p99, ilk kova, [kova sayıları...]]
+//   5: heap [boş, min boş, en büyük blok, parçalanma %, PSRAM boş]
+//   6: task stack'leri [[isim, high-water byte], ...]
+//   7: BLE [callback toplamı, callback/s (son diag'dan beri), max callback us, tag sayısı]
+//   8: NVS [config yazma, journal yazma, journal flush]
+//  10: kuyruk [derinlik, arena zirvesi]
+//  11: çevrimdışı [bekleyen, son batch kayıt, NVS yazma, flash yazma, süre ms, flash silme]
+//  (9 journal mid anahtarına ayrılmıştır)
+class Diagnostics {
+public:
+    static void recordLoop(uint32_t us);
+    static void recordAt(uint32_t ms);
+    static void recordCycle(uint32_t ms);
+    static void reset();
+
+    // Snapshot'ı CBOR olarak kodla; taşmada 0 döner
+    static size_t encode(const DiagCounters& counters, uint8_t* buf, size_t cap);
+
+private:
+    static DiagHistogram _loop;
+    static DiagHistogram _at;
+    static DiagHistogram _cycle;
+    static uint32_t _lastEncodeMs;
+    static uint32_t _lastBleCallbacks;
+};
+
+#endif
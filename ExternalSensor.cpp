@@ -1,212 +1,93 @@
 #include "ExternalSensor.h"
+#include "Checksum.h"
 
-ExternalSensor::ExternalSensor() 
-    : _sensorType(SENSOR_NONE), _lastTemp(-99.0f), _lastHumidity(-1.0f) {
-}
+// ===== I2C Yardımcıları =====
 
-bool ExternalSensor::probeI2C(uint8_t addr) {
+static bool i2cWrite(uint8_t addr, const uint8_t* data, uint8_t len) {
     Wire.beginTransmission(addr);
-    return (Wire.endTransmission() == 0);
-}
-
-uint8_t ExternalSensor::crc8_t117(const uint8_t *data, uint8_t len) {
-    uint8_t crc = 0x00;
-    for (uint8_t i = 0; i < len; i++) {
-        crc ^= data[i];
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 0x01) crc = (crc >> 1) ^ 0x8C;
-            else crc >>= 1;
-        }
-    }
-    return crc;
+    Wire.write(data, len);
+    return Wire.endTransmission() == 0;
 }
 
-uint8_t ExternalSensor::crc8_aht20(const uint8_t *data, uint8_t len) {
-    uint8_t crc = 0xFF;
-    for (uint8_t i = 0; i < len; i++) {
-        crc ^= data[i];
-        for (uint8_t j = 0; j < 8; j++) {
-            if (crc & 0x80) crc = (crc << 1) ^ 0x31;
-            else crc <<= 1;
-        }
-    }
-    return crc;
+static bool i2cRead(uint8_t addr, uint8_t* data, uint8_t len) {
+    if (Wire.requestFrom(addr, len) != len) return false;
+    for (uint8_t i = 0; i < len; i++) data[i] = Wire.read();
+    return true;
 }
 
-bool ExternalSensor::begin() {
-    // Sensör gücünü aç
-    HW_sensorPower(true);
-    delay(50);  // Sensörlerin başlaması için bekle
-    
-    _sensorType = SENSOR_NONE;
-    
-    // Önce T117'yi dene (0x41)
-    Serial.println("[SENSOR] Probing T117 (0x41)...");
-    if (probeI2C(T117_ADDR)) {
-        _sensorType = SENSOR_T117;
-        Serial.println("[SENSOR] T117 detected!");
-        return true;
-    }
-    
-    // T117 yoksa AHT20'yi dene (0x38)
-    Serial.println("[SENSOR] Probing AHT20 (0x38)...");
-    if (probeI2C(AHT20_ADDR)) {
-        if (aht20_init()) {
-            _sensorType = SENSOR_AHT20;
-            Serial.println("[SENSOR] AHT20 detected and initialized!");
-            return true;
-        }
-    }
-    
-    Serial.println("[SENSOR] No external sensor found!");
-    return false;
+static bool i2cReadReg(uint8_t addr, uint8_t reg, uint8_t* data, uint8_t len) {
+    Wire.beginTransmission(addr);
+    Wire.write(reg);
+    if (Wire.endTransmission(false) != 0) return false;
+    return i2cRead(addr, data, len);
 }
 
-void ExternalSensor::end() {
-    HW_sensorPower(false);
-    _sensorType = SENSOR_NONE;
-}
+// ===== T117 =====
+// Tek dönüşüm: 0x04 komut register'ına 0xC0, sonuç [LSB, MSB, CRC8-Maxim]
 
-const char* ExternalSensor::getTypeName() {
-    switch (_sensorType) {
-        case SENSOR_T117: return "T117";
-        case SENSOR_AHT20: return "AHT20";
-        default: return "None";
-    }
-}
+static const uint8_t T117_REG_TEMP_LSB = 0x00;
+static const uint8_t T117_REG_TEMP_CMD = 0x04;
+static const uint8_t T117_SINGLE_CONVERT = 0xC0;
 
-bool ExternalSensor::readTemperature(float &tempC) {
-    switch (_sensorType) {
-        case SENSOR_T117:
-            t117_startConvert();
-            delay(15);
-            return t117_readTemp(tempC);
-            
-        case SENSOR_AHT20: {
-            float humidity;
-            bool ok = aht20_readTempHumidity(tempC, humidity);
-            if (ok) _lastHumidity = humidity;
-            return ok;
-        }
-            
-        default:
-            return false;
-    }
+static bool t117Start(uint8_t addr) {
+    const uint8_t cmd[2] = { T117_REG_TEMP_CMD, T117_SINGLE_CONVERT };
+    return i2cWrite(addr, cmd, 2);
 }
 
-bool ExternalSensor::readHumidity(float &humidity) {
-    if (_sensorType == SENSOR_AHT20) {
-        // Son okunan nem değerini döndür
-        if (_lastHumidity >= 0) {
-            humidity = _lastHumidity;
-            return true;
-        }
-        // Yoksa yeni okuma yap
-        float tempC;
-        if (aht20_readTempHumidity(tempC, humidity)) {
-            _lastHumidity = humidity;
-            return true;
-        }
-    }
-    return false;
-}
-
-// ===== T117 Functions =====
-
-void ExternalSensor::t117_startConvert() {
-    Wire.beginTransmission(T117_ADDR);
-    Wire.write(T117_REG_TEMP_CMD);
-    Wire.write(T117_SINGLE_CONVERT);
-    Wire.endTransmission();
-}
-
-bool ExternalSensor::t117_readTemp(float &tempC) {
+static SensorReadResult t117Read(uint8_t addr, float &tempC, float &humidity) {
     uint8_t data[3];
-    
-    Wire.beginTransmission(T117_ADDR);
-    Wire.write(T117_REG_TEMP_LSB);
-    if (Wire.endTransmission(false) != 0) return false;
-    
-    if (Wire.requestFrom(T117_ADDR, (uint8_t)3) != 3) return false;
-    
-    data[0] = Wire.read();
-    data[1] = Wire.read();
-    data[2] = Wire.read();
-    
-    uint8_t calc = crc8_t117(data, 2);
-    if (data[2] != calc) return false;
+    if (!i2cReadReg(addr, T117_REG_TEMP_LSB, data, 3)) return SENSOR_READ_FAIL;
+    if (Checksum::crc8Maxim(data, 2) != data[2]) return SENSOR_READ_FAIL;
     
     int16_t raw = (int16_t)((data[1] << 8) | data[0]);
     tempC = (float)raw / 256.0f + 25.0f;
-    return true;
+    return SENSOR_READ_OK;
 }
 
-// ===== AHT20 Functions =====
+// ===== AHT20 =====
+
+static const uint8_t AHT20_CMD_INIT = 0xBE;
+static const uint8_t AHT20_CMD_TRIGGER = 0xAC;
+static const uint8_t AHT20_CMD_SOFTRESET = 0xBA;
 
-bool ExternalSensor::aht20_init() {
+static bool aht20Init(uint8_t addr) {
     // Soft reset
-    Wire.beginTransmission(AHT20_ADDR);
-    Wire.write(AHT20_CMD_SOFTRESET);
-    Wire.endTransmission();
+    const uint8_t reset = AHT20_CMD_SOFTRESET;
+    i2cWrite(addr, &reset, 1);
     delay(20);
     
     // Calibration check
-    Wire.beginTransmission(AHT20_ADDR);
-    Wire.write(AHT20_CMD_INIT);
-    Wire.write(0x08);
-    Wire.write(0x00);
-    Wire.endTransmission();
+    const uint8_t init[3] = { AHT20_CMD_INIT, 0x08, 0x00 };
+    i2cWrite(addr, init, 3);
     delay(10);
     
-    // Status check
-    Wire.requestFrom(AHT20_ADDR, (uint8_t)1);
-    if (Wire.available()) {
-        uint8_t status = Wire.read();
-        // Bit 3 should be 1 (calibrated)
-        if (status & 0x08) {
-            return true;
-        }
+    // Status check - bit 3 should be 1 (calibrated)
+    uint8_t status;
+    if (i2cRead(addr, &status, 1) && (status & 0x08)) {
+        return true;
     }
     
     // Calibration komutu tekrar gönder
-    Wire.beginTransmission(AHT20_ADDR);
-    Wire.write(AHT20_CMD_INIT);
-    Wire.write(0x08);
-    Wire.write(0x00);
-    Wire.endTransmission();
+    i2cWrite(addr, init, 3);
     delay(10);
     
     return true;  // Devam et, belki çalışır
 }
 
-bool ExternalSensor::aht20_readTempHumidity(float &tempC, float &humidity) {
-    // Trigger measurement
-    Wire.beginTransmission(AHT20_ADDR);
-    Wire.write(AHT20_CMD_TRIGGER);
-    Wire.write(0x33);
-    Wire.write(0x00);
-    Wire.endTransmission();
-    
-    delay(80);  // Ölçüm süresi
-    
-    // Read data (6 bytes: status + 5 data bytes)
+static bool aht20Start(uint8_t addr) {
+    const uint8_t cmd[3] = { AHT20_CMD_TRIGGER, 0x33, 0x00 };
+    return i2cWrite(addr, cmd, 3);
+}
+
+static SensorReadResult aht20Read(uint8_t addr, float &tempC, float &humidity) {
+    // Read data (6 bytes: status + 5 data bytes + CRC)
     uint8_t data[7];
-    if (Wire.requestFrom(AHT20_ADDR, (uint8_t)7) != 7) {
-        return false;
-    }
-    
-    for (int i = 0; i < 7; i++) {
-        data[i] = Wire.read();
-    }
+    if (!i2cRead(addr, data, 7)) return SENSOR_READ_FAIL;
     
     // Status check (bit 7 should be 0 = not busy)
-    if (data[0] & 0x80) {
-        return false;  // Still busy
-    }
+    if (data[0] & 0x80) return SENSOR_READ_BUSY;
     
-    // CRC check (optional - data[6])
-    uint8_t crc = crc8_aht20(data, 6);
-    if (crc != data[6]) {
+    if (Checksum::crc8Sensirion(data, 6) != data[6]) {
         Serial.println("[AHT20] CRC mismatch, continuing anyway");
         // CRC hatası olsa bile devam et
     }
@@ -222,9 +103,262 @@ bool ExternalSensor::aht20_readTempHumidity(float &tempC, float &humidity) {
                        ((uint32_t)data[4] << 8) | 
                        (uint32_t)data[5];
     tempC = (float)rawTemp * 200.0f / 1048576.0f - 50.0f;
+    return SENSOR_READ_OK;
+}
+
+// ===== SHT4x =====
+// Yüksek hassasiyet ölçümü (0xFD, maks. 8.3 ms): [T MSB, LSB, CRC][RH MSB, LSB, CRC]
+
+static const uint8_t SHT4X_CMD_MEASURE_HIGH = 0xFD;
+static const uint8_t SHT4X_CMD_SERIAL = 0x89;
+
+static bool sht4xWordsValid(const uint8_t* data) {
+    return Checksum::crc8Sensirion(data, 2) == data[2] &&
+           Checksum::crc8Sensirion(data + 3, 2) == data[5];
+}
+
+static bool sht4xInit(uint8_t addr) {
+    // Seri numarası CRC'si tutuyorsa SHT4x'tir
+    uint8_t data[6];
+    if (!i2cWrite(addr, &SHT4X_CMD_SERIAL, 1)) return false;
+    delay(2);
+    return i2cRead(addr, data, 6) && sht4xWordsValid(data);
+}
+
+static bool sht4xStart(uint8_t addr) {
+    return i2cWrite(addr, &SHT4X_CMD_MEASURE_HIGH, 1);
+}
+
+static SensorReadResult sht4xRead(uint8_t addr, float &tempC, float &humidity) {
+    uint8_t data[6];
+    if (!i2cRead(addr, data, 6)) return SENSOR_READ_BUSY;   // Ölçüm sürerken NACK verir
+    if (!sht4xWordsValid(data)) return SENSOR_READ_FAIL;
     
-    _lastTemp = tempC;
-    _lastHumidity = humidity;
+    uint16_t rawT = (data[0] << 8) | data[1];
+    uint16_t rawRh = (data[3] << 8) | data[4];
+    tempC = -45.0f + 175.0f * rawT / 65535.0f;
+    humidity = -6.0f + 125.0f * rawRh / 65535.0f;
+    if (humidity < 0.0f) humidity = 0.0f;
+    if (humidity > 100.0f) humidity = 100.0f;
+    return SENSOR_READ_OK;
+}
+
+// ===== TMP117 =====
+// Tek dönüşüm modu (MOD=11, ortalama yok: 15.5 ms); config register'ında Data_Ready biti
+
+static const uint8_t TMP117_REG_TEMP = 0x00;
+static const uint8_t TMP117_REG_CONFIG = 0x01;
+static const uint8_t TMP117_REG_DEVICE_ID = 0x0F;
+static const uint16_t TMP117_ONE_SHOT = 0x0C00;
+static const uint16_t TMP117_DATA_READY = 0x2000;
+
+static bool tmp117Init(uint8_t addr) {
+    uint8_t id[2];
+    if (!i2cReadReg(addr, TMP117_REG_DEVICE_ID, id, 2)) return false;
+    return (((id[0] << 8) | id[1]) & 0x0FFF) == 0x0117;
+}
+
+static bool tmp117Start(uint8_t addr) {
+    const uint8_t cmd[3] = { TMP117_REG_CONFIG, (uint8_t)(TMP117_ONE_SHOT >> 8), (uint8_t)(TMP117_ONE_SHOT & 0xFF) };
+    return i2cWrite(addr, cmd, 3);
+}
+
+static SensorReadResult tmp117Read(uint8_t addr, float &tempC, float &humidity) {
+    uint8_t data[2];
+    if (!i2cReadReg(addr, TMP117_REG_CONFIG, data, 2)) return SENSOR_READ_FAIL;
+    if (!(((data[0] << 8) | data[1]) & TMP117_DATA_READY)) return SENSOR_READ_BUSY;
+    if (!i2cReadReg(addr, TMP117_REG_TEMP, data, 2)) return SENSOR_READ_FAIL;
+    tempC = (int16_t)((data[0] << 8) | data[1]) * 0.0078125f;
+    return SENSOR_READ_OK;
+}
+
+// ===== Sürücü Tablosu =====
+// Sıra önceliktir: dahili sensör tablodaki ilk bulunan sürücüdür (önceki davranış: T117, sonra AHT20)
+
+static const SensorDriver SENSOR_DRIVERS[] = {
+    // type           name      adresler      dönüşüm timeout nem    init        start        read
+    { SENSOR_T117,   "T117",   0x41, 0x41,   15,     15,     false, nullptr,    t117Start,   t117Read },
+    { SENSOR_AHT20,  "AHT20",  0x38, 0x38,   80,     200,    true,  aht20Init,  aht20Start,  aht20Read },
+    { SENSOR_SHT4X,  "SHT4x",  0x44, 0x46,   9,      50,     true,  sht4xInit,  sht4xStart,  sht4xRead },
+    { SENSOR_TMP117, "TMP117", 0x48, 0x4B,   16,     50,     false, tmp117Init, tmp117Start, tmp117Read },
+};
+
+// ===== ExternalSensor =====
+
+ExternalSensor::ExternalSensor() 
+    : _count(0), _sampleIntervalMs(10000), _nextSampleMs(0) {
+    memset(_devices, 0, sizeof(_devices));
+}
+
+bool ExternalSensor::probeI2C(uint8_t addr) {
+    Wire.beginTransmission(addr);
+    return (Wire.endTransmission() == 0);
+}
+
+bool ExternalSensor::begin() {
+    // Sensör gücünü aç
+    HW_sensorPower(true);
+    delay(50);  // Sensörlerin başlaması için bekle
+    
+    _count = 0;
+    memset(_devices, 0, sizeof(_devices));
+    
+    // Tek bus taraması - yanıt veren adresler
+    uint8_t present[16] = {0};
+    Serial.print("[SENSOR] I2C scan:");
+    for (uint8_t addr = 0x08; addr < 0x78; addr++) {
+        if (probeI2C(addr)) {
+            present[addr >> 3] |= (1 << (addr & 7));
+            Serial.printf(" 0x%02X", addr);
+        }
+    }
+    Serial.println();
+    
+    // Sürücü sırasıyla eşleştir
+    for (size_t d = 0; d < sizeof(SENSOR_DRIVERS) / sizeof(SENSOR_DRIVERS[0]); d++) {
+        const SensorDriver& driver = SENSOR_DRIVERS[d];
+        for (uint8_t addr = driver.addrFirst; addr <= driver.addrLast && _count < SENSOR_MAX_DEVICES; addr++) {
+            if (!(present[addr >> 3] & (1 << (addr & 7)))) continue;
+            if (driver.init && !driver.init(addr)) continue;
+            present[addr >> 3] &= ~(1 << (addr & 7));   // Adres sahiplenildi
+            _devices[_count].driver = &driver;
+            _devices[_count].addr = addr;
+            _count++;
+            Serial.printf("[SENSOR] %s detected at 0x%02X\n", driver.name, addr);
+        }
+    }
+    
+    if (_count == 0) {
+        Serial.println("[SENSOR] No external sensor found!");
+        return false;
+    }
+    return true;
+}
+
+void ExternalSensor::end() {
+    HW_sensorPower(false);
+    _count = 0;
+}
+
+uint32_t ExternalSensor::getSampleCount() {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < _count; i++) total += _devices[i].samples;
+    return total;
+}
+
+uint32_t ExternalSensor::getErrorCount() {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < _count; i++) total += _devices[i].errors;
+    return total;
+}
+
+bool ExternalSensor::readTemperature(float &tempC) {
+    if (_count == 0) return false;
+    Device& dev = _devices[0];
+    const SensorDriver* driver = dev.driver;
+    
+    if (!driver->start(dev.addr)) return false;
+    delay(driver->convertMs);
+    
+    float humidity = -1.0f;
+    SensorReadResult result = driver->read(dev.addr, tempC, humidity);
+    for (uint16_t waited = driver->convertMs; result == SENSOR_READ_BUSY && waited < driver->timeoutMs; waited += 5) {
+        delay(5);
+        result = driver->read(dev.addr, tempC, humidity);
+    }
+    if (result != SENSOR_READ_OK) return false;
+    _addSample(dev, tempC, humidity, millis());
+    return true;
+}
+
+bool ExternalSensor::readHumidity(float &humidity) {
+    // Son okunan nem (readTemperature ile birlikte ölçülür)
+    return getHumidity(0, humidity);
+}
+
+// ===== Bloklamayan Örnekleme =====
+
+void ExternalSensor::service(unsigned long now) {
+    if (_count == 0) return;
     
+    // Ortak zamanlama: önceki tur bitmeden yenisi başlamaz
+    bool busy = false;
+    for (uint8_t i = 0; i < _count; i++) busy |= _devices[i].converting;
+    
+    if (!busy && (long)(now - _nextSampleMs) >= 0) {
+        _nextSampleMs = now + _sampleIntervalMs;
+        for (uint8_t i = 0; i < _count; i++) {
+            Device& dev = _devices[i];
+            if (dev.driver->start(dev.addr)) {
+                dev.converting = true;
+                dev.convertStartMs = now;
+            } else {
+                dev.errors++;
+            }
+        }
+        return;
+    }
+    
+    // Dönüşüm sürüyor: süresi dolmadan bus'a gidilmez
+    for (uint8_t i = 0; i < _count; i++) {
+        Device& dev = _devices[i];
+        if (!dev.converting) continue;
+        unsigned long elapsed = now - dev.convertStartMs;
+        if (elapsed < dev.driver->convertMs) continue;
+        
+        float tempC = -99.0f;
+        float humidity = -1.0f;
+        SensorReadResult result = dev.driver->read(dev.addr, tempC, humidity);
+        if (result == SENSOR_READ_BUSY && elapsed < dev.driver->timeoutMs) continue;  // Sonraki turda tekrar bak
+        _finish(dev, result, tempC, humidity, now);
+    }
+}
+
+void ExternalSensor::_finish(Device &dev, SensorReadResult result, float tempC, float humidity, unsigned long now) {
+    dev.converting = false;
+    if (result == SENSOR_READ_OK && tempC > -55.0f && tempC < 125.0f) {
+        _addSample(dev, tempC, humidity, now);
+    } else {
+        dev.errors++;
+    }
+}
+
+void ExternalSensor::_addSample(Device &dev, float tempC, float humidity, unsigned long now) {
+    dev.tempRing[dev.ringPos] = tempC;
+    dev.humRing[dev.ringPos] = dev.driver->hasHumidity ? humidity : -1.0f;
+    dev.ringPos = (dev.ringPos + 1) % SENSOR_AVG_SAMPLES;
+    if (dev.ringCount < SENSOR_AVG_SAMPLES) dev.ringCount++;
+    dev.lastGoodMs = now;
+    dev.hasSample = true;
+    dev.samples++;
+}
+
+bool ExternalSensor::_isStale(const Device &dev) {
+    return _sampleIntervalMs > 0 && millis() - dev.lastGoodMs > (unsigned long)SENSOR_STALE_SAMPLES * _sampleIntervalMs;
+}
+
+bool ExternalSensor::getTemperature(uint8_t index, float &tempC) {
+    if (index >= _count) return false;
+    const Device& dev = _devices[index];
+    if (!dev.hasSample || _isStale(dev)) return false;
+    float sum = 0;
+    for (uint8_t i = 0; i < dev.ringCount; i++) sum += dev.tempRing[i];
+    tempC = sum / dev.ringCount;
+    return true;
+}
+
+bool ExternalSensor::getHumidity(uint8_t index, float &humidity) {
+    if (index >= _count) return false;
+    const Device& dev = _devices[index];
+    if (!dev.driver->hasHumidity || !dev.hasSample || _isStale(dev)) return false;
+    float sum = 0;
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < dev.ringCount; i++) {
+        if (dev.humRing[i] < 0) continue;
+        sum += dev.humRing[i];
+        n++;
+    }
+    if (n == 0) return false;
+    humidity = sum / n;
     return true;
 }
@@ -7,56 +7,98 @@
 enum SensorType {
     SENSOR_NONE = 0,
     SENSOR_T117 = 1,
-    SENSOR_AHT20 = 2
+    SENSOR_AHT20 = 2,
+    SENSOR_SHT4X = 3,
+    SENSOR_TMP117 = 4
 };
 
+#define SENSOR_MAX_DEVICES      4       // Aynı anda örneklenen I2C sensör
+#define SENSOR_AVG_SAMPLES      4       // Ortalama penceresi (son N geçerli örnek)
+#define SENSOR_STALE_SAMPLES    3       // Bu kadar periyot geçerli örnek yoksa değer bayat
+
+enum SensorReadResult : uint8_t {
+    SENSOR_READ_OK = 0,
+    SENSOR_READ_BUSY,       // Dönüşüm bitmedi, sonra tekrar dene
+    SENSOR_READ_FAIL
+};
+
+// Sensör sürücüsü - ExternalSensor.cpp'deki SENSOR_DRIVERS tablosunda
+// Yeni sensör: adres aralığı, zamanlama ve üç fonksiyon ile tabloya bir satır.
+struct SensorDriver {
+    SensorType type;
+    const char* name;
+    uint8_t addrFirst;          // Sensörün alabileceği I2C adresleri
+    uint8_t addrLast;
+    uint16_t convertMs;         // Dönüşüm başlatıldıktan sonra ilk okuma
+    uint16_t timeoutMs;         // Meşgul yanıtı bu süreye kadar tekrar denenir
+    bool hasHumidity;
+    bool (*init)(uint8_t addr);     // Kimlik kontrolü/başlatma (açılışta, bloklayabilir); nullptr = ACK yeterli
+    bool (*start)(uint8_t addr);    // Tek dönüşüm başlat
+    SensorReadResult (*read)(uint8_t addr, float &tempC, float &humidity);
+};
+
+// Harici I2C sensörleri
+// Açılışta bus bir kez taranır; yanıt veren her adres, aralığı tutan ve init'i geçen
+// ilk sürücüye bağlanır. Tüm sensörler ortak örnekleme zamanında birlikte başlatılır,
+// her biri kendi hazır olma süresine göre bloklamadan okunur.
+// 0. sensör (tablo sırasıyla ilk bulunan) "dahili sensör"dür: alarm, offline kayıt, LCD.
 class ExternalSensor {
 public:
     ExternalSensor();
     
-    bool begin();  // Sensör algıla ve başlat
+    bool begin();  // Sensör gücünü aç, bus'ı tara; en az bir sensör varsa true
     void end();    // Sensörü kapat
     
+    // Bloklayan tek okuma (setup) - dahili sensör. Sonuç ortalamaya da eklenir.
     bool readTemperature(float &tempC);
-    bool readHumidity(float &humidity);  // Sadece AHT20 için
+    bool readHumidity(float &humidity);  // Nem ölçen sensörlerde
     
-    SensorType getType() { return _sensorType; }
-    const char* getTypeName();
-    bool isAvailable() { return _sensorType != SENSOR_NONE; }
+    // Bloklamayan örnekleme: loop()'tan her turda çağrılır. Örnek zamanı gelince
+    // dönüşümler başlatılır, sonraki çağrılarda hazır olup olmadıklarına bakılır;
+    // I2C'de beklenmez.
+    void service(unsigned long now);
+    void setSampleInterval(uint32_t ms) { _sampleIntervalMs = ms; }
     
-private:
-    SensorType _sensorType;
+    // Son SENSOR_AVG_SAMPLES geçerli örneğin ortalaması (önbellek, I2C'ye gitmez).
+    // Hiç örnek yoksa veya son örnek bayatsa false.
+    bool getTemperature(float &tempC) { return getTemperature(0, tempC); }
+    bool getHumidity(float &humidity) { return getHumidity(0, humidity); }
+    bool getTemperature(uint8_t index, float &tempC);
+    bool getHumidity(uint8_t index, float &humidity);
     
-    // I2C adresleri
-    static constexpr uint8_t T117_ADDR = 0x41;
-    static constexpr uint8_t AHT20_ADDR = 0x38;
+    uint8_t getSensorCount() { return _count; }
+    const SensorDriver* getDriver(uint8_t index) { return index < _count ? _devices[index].driver : nullptr; }
+    uint8_t getAddress(uint8_t index) { return index < _count ? _devices[index].addr : 0; }
+    uint32_t getSampleCount();
+    uint32_t getErrorCount();
     
-    // T117 registers
-    static constexpr uint8_t T117_REG_TEMP_LSB = 0x00;
-    static constexpr uint8_t T117_REG_TEMP_MSB = 0x01;
-    static constexpr uint8_t T117_REG_CRC_TEMP = 0x02;
-    static constexpr uint8_t T117_REG_TEMP_CMD = 0x04;
-    static constexpr uint8_t T117_SINGLE_CONVERT = 0xC0;
+    SensorType getType() { return _count ? _devices[0].driver->type : SENSOR_NONE; }
+    const char* getTypeName() { return _count ? _devices[0].driver->name : "None"; }
+    bool isAvailable() { return _count > 0; }
     
-    // AHT20 commands
-    static constexpr uint8_t AHT20_CMD_INIT = 0xBE;
-    static constexpr uint8_t AHT20_CMD_TRIGGER = 0xAC;
-    static constexpr uint8_t AHT20_CMD_SOFTRESET = 0xBA;
+private:
+    struct Device {
+        const SensorDriver* driver;
+        uint8_t addr;
+        bool converting;
+        unsigned long convertStartMs;
+        unsigned long lastGoodMs;
+        bool hasSample;
+        float tempRing[SENSOR_AVG_SAMPLES];
+        float humRing[SENSOR_AVG_SAMPLES];
+        uint8_t ringCount;
+        uint8_t ringPos;
+        uint32_t samples;
+        uint32_t errors;
+    };
     
-    // Cached values (AHT20 için)
-    float _lastTemp;
-    float _lastHumidity;
+    Device _devices[SENSOR_MAX_DEVICES];
+    uint8_t _count;
+    uint32_t _sampleIntervalMs;
+    unsigned long _nextSampleMs;
     
-    // Helper functions
     bool probeI2C(uint8_t addr);
-    uint8_t crc8_t117(const uint8_t *data, uint8_t len);
-    uint8_t crc8_aht20(const uint8_t *data, uint8_t len);
-    
-    // T117 functions
-    void t117_startConvert();
-    bool t117_readTemp(float &tempC);
-    
-    // AHT20 functions
-    bool aht20_init();
-    bool aht20_readTempHumidity(float &tempC, float &humidity);
+    void _finish(Device &dev, SensorReadResult result, float tempC, float humidity, unsigned long now);
+    void _addSample(Device &dev, float tempC, float humidity, unsigned long now);
+    bool _isStale(const Device &dev);   // SENSOR_STALE_SAMPLES periyottur geçerli örnek yok
 };
@@ -0,0 +1,406 @@
+#include "FlashLog.h"
+#include "Checksum.h"
+
+static const uint32_t SEG_MAGIC = 0x314C474F;   // "OGL1"
+static const uint32_t SEG_HEADER_SIZE = 16;
+static const uint32_t REC_HEADER_SIZE = 8;
+static const uint8_t REC_WRITING = 0xFF;
+static const uint8_t REC_VALID = 0x7F;
+static const uint8_t REC_CONSUMED = 0x3F;
+static const uint16_t SEG_OPEN = 0xFFFF;        // sealedCount: segment hâlâ yazılıyor
+static const uint16_t SEG_DRAINED = 0x0000;     // drained: tüm kayıtları tüketildi
+
+static inline uint32_t recordSpan(uint16_t len) {
+    return REC_HEADER_SIZE + ((len + 3) & ~3);
+}
+
+FlashLog::FlashLog()
+    : _part(nullptr), _segments(0), _headSeg(0), _headOff(SEG_HEADER_SIZE), _headSeq(0),
+      _headRecords(0), _tailSeg(0), _tailOff(SEG_HEADER_SIZE), _count(0), _erases(0), _writes(0),
+      _batching(false), _batchSeg(0), _batchOff(SEG_HEADER_SIZE), _batchPops(0) {
+}
+
+bool FlashLog::begin(uint16_t maxSegments) {
+    _part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, FLASHLOG_LABEL);
+    bool borrowed = false;
+    if (!_part) {
+        // SPIFFS bölümü sadece daha önce FlashLog tarafından biçimlendirildiyse kullanılır
+        // (başlık taramasında segment magic'i aranır); yabancı dosya sistemi silinmez
+        _part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+        borrowed = (_part != nullptr);
+    }
+    if (!_part) {
+        Serial.println("[FLASHLOG] No data partition - offline records stay in NVS");
+        return false;
+    }
+
+    _segments = _part->size / FLASHLOG_SECTOR;
+    if (maxSegments > 0 && maxSegments < _segments) _segments = maxSegments;
+    if (_segments < 2) {
+        Serial.println("[FLASHLOG] Partition too small");
+        _part = nullptr;
+        return false;
+    }
+
+    // Segment başlıkları: en yüksek seq baş, en düşük seq en eski segment
+    int headSeg = -1;
+    int oldestSeg = -1;
+    uint32_t oldestSeq = 0;
+    for (uint16_t seg = 0; seg < _segments; seg++) {
+        SegmentHeader header;
+        if (!_readSegment(seg, header)) continue;
+        if (headSeg < 0 || header.seq > _headSeq) {
+            headSeg = seg;
+            _headSeq = header.seq;
+        }
+        if (oldestSeg < 0 || header.seq < oldestSeq) {
+            oldestSeg = seg;
+            oldestSeq = header.seq;
+        }
+    }
+
+    if (headSeg < 0) {
+        if (borrowed) {
+            Serial.printf("[FLASHLOG] %s has no log segments - not claiming it (add an \"%s\" partition)\n",
+                         _part->label, FLASHLOG_LABEL);
+            _part = nullptr;
+            return false;
+        }
+        // Boş/biçimlenmemiş bölüm
+        _headSeq = 0;
+        if (!_openSegment(0, 1)) {
+            _part = nullptr;
+            return false;
+        }
+        _headSeg = 0;
+        _headSeq = 1;
+        _headOff = SEG_HEADER_SIZE;
+        _headRecords = 0;
+        _tailSeg = 0;
+        _tailOff = SEG_HEADER_SIZE;
+        _count = 0;
+        Serial.printf("[FLASHLOG] Formatted %s: %u segments (%lu KB)\n",
+                     _part->label, _segments, (unsigned long)(getCapacityBytes() / 1024));
+        return true;
+    }
+
+    _headSeg = headSeg;
+    SegmentHeader headHeader;
+    _readSegment(_headSeg, headHeader);
+    _scanSegment(_headSeg, _headOff, nullptr, &_headRecords);
+    if (headHeader.sealedCount != SEG_OPEN) {
+        _headOff = FLASHLOG_SECTOR; // Sonraki açılmadan kesildi - ilk append yeni segment açar
+    }
+
+    // Kuyruk: en eskiden başa ilk boşaltılmamış segment. Tüketim halka sırasında önek
+    // olduğundan ondan sonraki segmentlerin tüm kayıtları bekler; sayıları başlıktaki
+    // sealedCount'tan gelir. Sadece kuyruk ve baş segmentlerinin kayıtları taranır.
+    bool tailFound = false;
+    _count = 0;
+    uint16_t seg = oldestSeg;
+    for (uint16_t k = 0; k < _segments; k++) {
+        SegmentHeader header;
+        if (_readSegment(seg, header) && header.drained != SEG_DRAINED) {
+            uint32_t endOff;
+            if (!tailFound) {
+                // Tüketilmiş ama işareti yazılamadan kesilmiş segment (live 0) atlanır
+                uint32_t firstLive = 0;
+                uint32_t live = _scanSegment(seg, endOff, &firstLive, nullptr);
+                if (live > 0) {
+                    _count += live;
+                    _tailSeg = seg;
+                    _tailOff = firstLive;
+                    tailFound = true;
+                }
+            } else if (seg == _headSeg) {
+                _count += _headRecords;
+            } else if (header.sealedCount != SEG_OPEN) {
+                _count += header.sealedCount;
+            } else {
+                _count += _scanSegment(seg, endOff, nullptr, nullptr); // Mühürlenmeden kesildi
+            }
+        }
+        if (seg == _headSeg) break;
+        seg = (seg + 1) % _segments;
+    }
+    if (!tailFound) {
+        _tailSeg = _headSeg;
+        _tailOff = _headOff;
+    }
+
+    Serial.printf("[FLASHLOG] %s: %u segments, %lu pending records, head %u:%lu, tail %u:%lu\n",
+                 _part->label, _segments, (unsigned long)_count,
+                 _headSeg, (unsigned long)_headOff, _tailSeg, (unsigned long)_tailOff);
+    return true;
+}
+
+bool FlashLog::_readSegment(uint16_t seg, SegmentHeader& header) {
+    if (esp_partition_read(_part, _addr(seg, 0), &header, sizeof(header)) != ESP_OK) return false;
+    return header.magic == SEG_MAGIC;
+}
+
+bool FlashLog::_openSegment(uint16_t seg, uint32_t seq) {
+    SegmentHeader old;
+    uint32_t eraseCount = _readSegment(seg, old) ? old.eraseCount : 0;
+
+    if (esp_partition_erase_range(_part, _addr(seg, 0), FLASHLOG_SECTOR) != ESP_OK) {
+        Serial.printf("[FLASHLOG] Erase failed at segment %u\n", seg);
+        return false;
+    }
+    _erases++;
+
+    SegmentHeader header;
+    header.magic = SEG_MAGIC;
+    header.seq = seq;
+    header.eraseCount = eraseCount + 1;
+    header.sealedCount = SEG_OPEN;
+    header.drained = 0xFFFF;
+    _writes++;
+    return esp_partition_write(_part, _addr(seg, 0), &header, sizeof(header)) == ESP_OK;
+}
+
+bool FlashLog::_writeHeaderField(uint16_t seg, uint32_t fieldOff, uint16_t value) {
+    // Başlık alanları 0xFFFF ile açılır; sonradan bir kez yazılır (sadece bit temizler)
+    _writes++;
+    return esp_partition_write(_part, _addr(seg, fieldOff), &value, sizeof(value)) == ESP_OK;
+}
+
+void FlashLog::_markDrained(uint16_t seg) {
+    _writeHeaderField(seg, offsetof(SegmentHeader, drained), SEG_DRAINED);
+}
+
+uint32_t FlashLog::_scanSegment(uint16_t seg, uint32_t& endOff, uint32_t* firstLiveOff, uint16_t* written) {
+    uint32_t live = 0;
+    uint32_t off = SEG_HEADER_SIZE;
+    if (written) *written = 0;
+
+    while (off + REC_HEADER_SIZE <= FLASHLOG_SECTOR) {
+        RecordHeader rec;
+        if (esp_partition_read(_part, _addr(seg, off), &rec, sizeof(rec)) != ESP_OK) break;
+        if (rec.length == 0xFFFF) break; // Silinmiş alan - segment sonu
+        if (rec.length == 0 || off + recordSpan(rec.length) > FLASHLOG_SECTOR) {
+            off = FLASHLOG_SECTOR; // Bozuk başlık - segmenti kapat
+            break;
+        }
+        if (rec.state == REC_VALID) {
+            if (firstLiveOff && live == 0) *firstLiveOff = off;
+            live++;
+        }
+        if (written && (rec.state == REC_VALID || rec.state == REC_CONSUMED)) (*written)++;
+        off += recordSpan(rec.length);
+    }
+    endOff = off;
+    return live;
+}
+
+void FlashLog::_advanceTail() {
+    // Kuyruğu bir sonraki geçerli kayda taşı; segment sınırlarını atlar
+    for (uint32_t guard = 0; guard < (uint32_t)_segments * 2 && _count > 0; ) {
+        if (_tailSeg == _headSeg && _tailOff >= _headOff) break;
+
+        RecordHeader rec;
+        bool endOfSegment = (_tailOff + REC_HEADER_SIZE > FLASHLOG_SECTOR);
+        if (!endOfSegment) {
+            esp_partition_read(_part, _addr(_tailSeg, _tailOff), &rec, sizeof(rec));
+            endOfSegment = (rec.length == 0xFFFF || rec.length == 0 ||
+                            _tailOff + recordSpan(rec.length) > FLASHLOG_SECTOR);
+        }
+
+        if (endOfSegment) {
+            if (_tailSeg == _headSeg) break;
+            if (!_batching) _markDrained(_tailSeg); // Batch'te commit() işaretler
+            _tailSeg = (_tailSeg + 1) % _segments;
+            _tailOff = SEG_HEADER_SIZE;
+            guard++;
+            continue;
+        }
+        if (rec.state == REC_VALID) return;
+        _tailOff += recordSpan(rec.length);
+    }
+
+    // Bekleyen kayıt bulunamadı - sayaç flash ile tutarsız
+    if (_count > 0) {
+        Serial.printf("[FLASHLOG] %lu records unaccounted for - resetting count\n", (unsigned long)_count);
+        _count = 0;
+    }
+    if (!_batching) {
+        for (uint16_t seg = _tailSeg; seg != _headSeg; seg = (seg + 1) % _segments) _markDrained(seg);
+    }
+    _tailSeg = _headSeg;
+    _tailOff = _headOff;
+}
+
+bool FlashLog::append(const void* data, uint16_t len) {
+    if (!_part || len == 0 || len > FLASHLOG_MAX_RECORD) return false;
+
+    uint32_t span = recordSpan(len);
+    if (_headOff + span > FLASHLOG_SECTOR) {
+        uint16_t next = (_headSeg + 1) % _segments;
+
+        // Commit edilmemiş batch'in kayıtları düşürülemez
+        if (_batching && next == _batchSeg) {
+            Serial.println("[FLASHLOG] Log full during batch - record rejected");
+            return false;
+        }
+
+        // Halka dolu - en eski segmenti düşür
+        if (_count > 0 && next == _tailSeg) {
+            uint32_t endOff;
+            uint32_t dropped = _scanSegment(next, endOff, nullptr, nullptr);
+            _count = (dropped < _count) ? _count - dropped : 0;
+            _tailSeg = (next + 1) % _segments;
+            _tailOff = SEG_HEADER_SIZE;
+            Serial.printf("[FLASHLOG] Log full - dropped oldest segment (%lu records)\n", (unsigned long)dropped);
+        }
+
+        // Kayıt sayısı başlığa yazılır - açılışta bu segment taranmaz
+        _writeHeaderField(_headSeg, offsetof(SegmentHeader, sealedCount), _headRecords);
+        if (!_openSegment(next, _headSeq + 1)) return false;
+        _headSeg = next;
+        _headSeq++;
+        _headOff = SEG_HEADER_SIZE;
+        _headRecords = 0;
+        if (_count > 0) _advanceTail();
+    }
+
+    RecordHeader rec;
+    rec.length = len;
+    rec.state = REC_WRITING;
+    rec.reserved = 0xFF;
+    rec.crc = Checksum::crc32(data, len);
+
+    // Başlık + payload, ardından durum byte'ı: yarıda kesilen yazma "yazılıyor" kalır
+    uint32_t addr = _addr(_headSeg, _headOff);
+    uint8_t committed = REC_VALID;
+    if (esp_partition_write(_part, addr, &rec, sizeof(rec)) != ESP_OK ||
+        esp_partition_write(_part, addr + REC_HEADER_SIZE, data, len) != ESP_OK ||
+        esp_partition_write(_part, addr + 2, &committed, 1) != ESP_OK) {
+        Serial.println("[FLASHLOG] Write failed - sealing segment");
+        _headOff = FLASHLOG_SECTOR;
+        return false;
+    }
+    _writes += 3;
+
+    if (_count == 0) {
+        _tailSeg = _headSeg;
+        _tailOff = _headOff;
+    }
+    _headOff += span;
+    _headRecords++;
+    _count++;
+    return true;
+}
+
+uint16_t FlashLog::peek(void* out, uint16_t cap) {
+    while (_part && _count > 0) {
+        RecordHeader rec;
+        uint32_t addr = _addr(_tailSeg, _tailOff);
+        if (esp_partition_read(_part, addr, &rec, sizeof(rec)) != ESP_OK) return 0;
+        if (rec.state != REC_VALID || rec.length == 0xFFFF) {
+            _advanceTail();
+            continue;
+        }
+        if (rec.length > cap) {
+            Serial.printf("[FLASHLOG] Record %u bytes exceeds buffer %u\n", rec.length, cap);
+            return 0;
+        }
+        if (esp_partition_read(_part, addr + REC_HEADER_SIZE, out, rec.length) != ESP_OK) return 0;
+        if (Checksum::crc32(out, rec.length) != rec.crc) {
+            Serial.printf("[FLASHLOG] CRC mismatch at %u:%lu - skipping\n", _tailSeg, (unsigned long)_tailOff);
+            pop();
+            continue;
+        }
+        return rec.length;
+    }
+    return 0;
+}
+
+bool FlashLog::pop() {
+    if (!_part || _count == 0) return false;
+
+    RecordHeader rec;
+    uint32_t addr = _addr(_tailSeg, _tailOff);
+    if (esp_partition_read(_part, addr, &rec, sizeof(rec)) != ESP_OK) return false;
+
+    if (!_batching) _markConsumed(addr);
+    else _batchPops++;
+    _count--;
+    if (rec.length != 0xFFFF) _tailOff += recordSpan(rec.length);
+    _advanceTail();
+    return true;
+}
+
+bool FlashLog::_markConsumed(uint32_t addr) {
+    uint8_t consumed = REC_CONSUMED;
+    _writes++;
+    return esp_partition_write(_part, addr + 2, &consumed, 1) == ESP_OK;
+}
+
+void FlashLog::beginBatch() {
+    if (_batching) return;
+    _batching = true;
+    _batchSeg = _tailSeg;
+    _batchOff = _tailOff;
+    _batchPops = 0;
+}
+
+uint32_t FlashLog::commit() {
+    if (!_batching) return 0;
+    _batching = false;
+    if (!_part) return 0;
+
+    // Batch başından güncel kuyruğa kadar geçerli kalan kayıtları tüket
+    uint32_t marked = 0;
+    uint16_t seg = _batchSeg;
+    uint32_t off = _batchOff;
+    for (uint32_t guard = 0; guard <= _segments; ) {
+        if (seg == _tailSeg && off >= _tailOff) break;
+
+        RecordHeader rec;
+        bool endOfSegment = (off + REC_HEADER_SIZE > FLASHLOG_SECTOR);
+        if (!endOfSegment) {
+            esp_partition_read(_part, _addr(seg, off), &rec, sizeof(rec));
+            endOfSegment = (rec.length == 0xFFFF || rec.length == 0 ||
+                            off + recordSpan(rec.length) > FLASHLOG_SECTOR);
+        }
+        if (endOfSegment) {
+            if (seg == _tailSeg) break;
+            _markDrained(seg);
+            seg = (seg + 1) % _segments;
+            off = SEG_HEADER_SIZE;
+            guard++;
+            continue;
+        }
+        if (rec.state == REC_VALID && _markConsumed(_addr(seg, off))) marked++;
+        off += recordSpan(rec.length);
+    }
+    return marked;
+}
+
+void FlashLog::rollback() {
+    if (!_batching) return;
+    _batching = false;
+    _tailSeg = _batchSeg;
+    _tailOff = _batchOff;
+    _count += _batchPops;
+    _batchPops = 0;
+}
+
+void FlashLog::clear() {
+    if (!_part) return;
+    _batching = false;
+    for (uint16_t seg = 0; seg < _segments; seg++) {
+        SegmentHeader header;
+        if (!_readSegment(seg, header)) continue;
+        esp_partition_erase_range(_part, _addr(seg, 0), FLASHLOG_SECTOR);
+        _erases++;
+    }
+    // Aşınmanın dönmesi için sıradaki segmentten devam
+    _headSeg = (_headSeg + 1) % _segments;
+    _openSegment(_headSeg, ++_headSeq);
+    _headOff = SEG_HEADER_SIZE;
+    _headRecords = 0;
+    _tailSeg = _headSeg;
+    _tailOff = _headOff;
+    _count = 0;
+}
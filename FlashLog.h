@@ -0,0 +1,102 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <Arduino.h>
+#include "esp_partition.h"
+
+#define FLASHLOG_SECTOR         4096
+#define FLASHLOG_LABEL          "offlog"   // Özel veri bölümü (partitions.csv)
+#define FLASHLOG_MAX_RECORD     (FLASHLOG_SECTOR - 32)
+
+// Çevrimdışı kayıtlar için segment tabanlı, sadece-ekleme flash log
+//
+// Bölüm: "offlog" etiketli veri bölümü (sketch klasöründeki partitions.csv, 1.4 MB).
+// Yoksa SPIFFS bölümü ancak üzerinde zaten FlashLog segmentleri varsa kullanılır;
+// boş veya başka dosya sistemi taşıyan bölüm silinmez (kayıtlar NVS'te kalır).
+//
+// Her 4 KB sektör bir segmenttir. Segmentler halka düzeninde sırayla doldurulur,
+// böylece silmeler tüm bölüme eşit dağılır (aşınma dengeleme). Halka dolunca en
+// eski segment düşürülür (eski FIFO'daki "üzerine yaz" davranışı).
+//
+// Segment başlığı (16 byte): magic, seq (artan), eraseCount, sealedCount, drained
+//   sealedCount: segment kapanırken yazılan kayıt sayısı (0xFFFF = açık)
+//   drained: kuyruk segmenti geçince 0 yazılır
+// Kayıt: [uzunluk u16][durum u8][rezerv u8][crc32 u32] + payload (4 byte hizalı)
+//   durum: 0xFF yazılıyor (yarım kalırsa atlanır) -> 0x7F geçerli -> 0x3F tüketildi
+// Durum geçişleri sadece bit temizler - kayıt başına silme gerekmez.
+//
+// Açılışta: segment başlıklarından baş/en eski segment bulunur. Kayıt taraması sadece
+// iki segmentte yapılır: baş (yazma ofseti) ve ilk boşaltılmamış segment (kuyruk ofseti).
+// Aradaki segmentlerin bekleyen sayısı başlıktaki sealedCount'tur - açılış süresi
+// kayıt sayısından bağımsızdır.
+class FlashLog {
+public:
+    FlashLog();
+
+    // maxSegments: kullanılacak sektör sayısı (0 = bölümün tamamı). Bölüm yoksa false.
+    bool begin(uint16_t maxSegments = 0);
+    bool isReady() { return _part != nullptr; }
+
+    bool append(const void* data, uint16_t len);
+    uint16_t peek(void* out, uint16_t cap);   // En eski kaydı tüketmeden oku; yoksa 0
+    bool pop();                                // En eski kaydı tüket
+    void clear();
+
+    // Grup commit: batch içindeki pop'lar sadece RAM'deki kuyruğu ilerletir, tüketildi
+    // işaretleri commit()'te toplu yazılır. Commit'ten önce yeniden başlarsa kayıtlar
+    // tekrar okunur. Batch açıkken halka en eski (commit edilmemiş) segmente
+    // ulaşırsa append reddedilir.
+    void beginBatch();
+    uint32_t commit();                         // İşaretlenen kayıt sayısı
+    void rollback();                           // Batch'teki pop'ları geri al (kuyruk batch başına döner)
+    bool inBatch() { return _batching; }
+
+    uint32_t getCount() { return _count; }
+    uint32_t getCapacityBytes() { return (uint32_t)_segments * FLASHLOG_SECTOR; }
+    uint32_t getEraseCount() { return _erases; }   // Bu açılıştaki sektör silme sayısı
+    uint32_t getWriteCount() { return _writes; }   // Flash yazma işlemi sayısı
+
+private:
+    struct SegmentHeader {
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t eraseCount;
+        uint16_t sealedCount;
+        uint16_t drained;
+    };
+
+    struct RecordHeader {
+        uint16_t length;
+        uint8_t state;
+        uint8_t reserved;
+        uint32_t crc;
+    };
+
+    const esp_partition_t* _part;
+    uint16_t _segments;
+
+    uint16_t _headSeg;     // Yazılan segment
+    uint32_t _headOff;
+    uint32_t _headSeq;
+    uint16_t _headRecords; // Baş segmentte yazılan kayıt sayısı (kapanışta başlığa yazılır)
+    uint16_t _tailSeg;     // En eski tüketilmemiş kayıt
+    uint32_t _tailOff;
+    uint32_t _count;
+    uint32_t _erases;
+    uint32_t _writes;
+    bool _batching;
+    uint16_t _batchSeg;    // Batch başındaki kuyruk
+    uint32_t _batchOff;
+    uint32_t _batchPops;
+
+    bool _readSegment(uint16_t seg, SegmentHeader& header);
+    bool _openSegment(uint16_t seg, uint32_t seq);
+    uint32_t _scanSegment(uint16_t seg, uint32_t& endOff, uint32_t* firstLiveOff, uint16_t* written);
+    bool _writeHeaderField(uint16_t seg, uint32_t fieldOff, uint16_t value);
+    void _markDrained(uint16_t seg);
+    void _advanceTail();
+    bool _markConsumed(uint32_t addr);
+    uint32_t _addr(uint16_t seg, uint32_t off) { return (uint32_t)seg * FLASHLOG_SECTOR + off; }
+};
+
+#endif
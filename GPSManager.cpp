@@ -1,5 +1,6 @@
 #include "GPSManager.h"
 #include "hardware.h"
+#include "Checksum.h"
 #include <HardwareSerial.h>
 
 GPSManager::GPSManager() 
@@ -177,6 +178,9 @@ String GPSManager::_readNMEALine() {
 }
 
 void GPSManager::_parseNMEA(const String& line) {
+    // Bozuk satır (UART gürültüsü, kesik satır) yanlış konum üretmesin
+    if (!Checksum::nmeaValid(line.c_str())) return;
+    
     if (line.startsWith("$GNGGA") || line.startsWith("+GNGGA")) {
         _parseGNGGA(line);
     } else if (line.startsWith("$GNRMC") || line.startsWith("+GNRMC")) {
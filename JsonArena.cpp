@@ -0,0 +1,133 @@
+#include "JsonArena.h"
+#include "esp_heap_caps.h"
+
+ArenaJsonDocument* JsonArena::_doc = nullptr;
+char JsonArena::_out[JSON_ARENA_OUT_BYTES];
+bool JsonArena::_busy = false;
+bool JsonArena::_psram = false;
+size_t JsonArena::_highWater = 0;
+uint32_t JsonArena::_fallbacks = 0;
+JsonArena::TagPeak JsonArena::_peaks[12];
+
+// ===== Allocator =====
+
+void* JsonArenaAllocator::allocate(size_t size) {
+    void* ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (ptr) return ptr;
+    return malloc(size);
+}
+
+void JsonArenaAllocator::deallocate(void* ptr) {
+    free(ptr); // heap_caps bellekleri de free() ile bırakılır
+}
+
+void* JsonArenaAllocator::reallocate(void* ptr, size_t newSize) {
+    return realloc(ptr, newSize);
+}
+
+// ===== JsonArena =====
+
+bool JsonArena::begin() {
+    if (_doc) return true;
+
+    // Heap henüz parçalanmamışken tek seferlik ayırma
+    _psram = (heap_caps_get_free_size(MALLOC_CAP_SPIRAM) >= JSON_ARENA_BYTES);
+    _doc = new ArenaJsonDocument(JSON_ARENA_BYTES);
+    if (!_doc || _doc->capacity() == 0) {
+        Serial.println("[ARENA] Allocation failed - using per-message heap documents");
+        delete _doc;
+        _doc = nullptr;
+        return false;
+    }
+    memset(_peaks, 0, sizeof(_peaks));
+    Serial.printf("[ARENA] %u bytes reserved (%s)\n", (unsigned)_doc->capacity(), _psram ? "PSRAM" : "internal");
+    return true;
+}
+
+size_t JsonArena::getCapacity() {
+    return _doc ? _doc->capacity() : 0;
+}
+
+void JsonArena::_record(const char* tag, size_t used) {
+    if (used > _highWater) _highWater = used;
+
+    for (uint8_t i = 0; i < 12; i++) {
+        if (_peaks[i].tag == nullptr) {
+            _peaks[i].tag = tag;
+            _peaks[i].peak = used;
+            Serial.printf("[ARENA] %s: %u/%u bytes\n", tag, (unsigned)used, (unsigned)getCapacity());
+            return;
+        }
+        if (_peaks[i].tag == tag || strcmp(_peaks[i].tag, tag) == 0) {
+            if (used > _peaks[i].peak) {
+                _peaks[i].peak = used;
+                Serial.printf("[ARENA] %s: new peak %u/%u bytes\n", tag, (unsigned)used, (unsigned)getCapacity());
+            }
+            return;
+        }
+    }
+}
+
+void JsonArena::report(JsonObject& out) {
+    out["cap"] = getCapacity();
+    out["peak"] = _highWater;
+    out["psram"] = _psram;
+    out["fallbacks"] = _fallbacks;
+    JsonObject tags = out.createNestedObject("tags");
+    for (uint8_t i = 0; i < 12 && _peaks[i].tag; i++) {
+        tags[_peaks[i].tag] = _peaks[i].peak;
+    }
+}
+
+// ===== JsonLease =====
+
+JsonLease::JsonLease(const char* tag, size_t fallbackCapacity)
+    : _tag(tag), _shared(false), _doc(nullptr), _fallbackDoc(nullptr), _fallbackOut(nullptr) {
+    if (JsonArena::_doc && !JsonArena::_busy) {
+        JsonArena::_busy = true;
+        JsonArena::_doc->clear();
+        _doc = JsonArena::_doc;
+        _shared = true;
+    } else {
+        // Arena meşgul (iç içe kullanım) veya ayrılamadı
+        if (JsonArena::_doc) {
+            JsonArena::_fallbacks++;
+            Serial.printf("[ARENA] %s: arena busy - temporary heap document\n", tag);
+        }
+        _fallbackDoc = new DynamicJsonDocument(fallbackCapacity);
+        _doc = _fallbackDoc;
+    }
+}
+
+JsonLease::~JsonLease() {
+    if (_shared) {
+        JsonArena::_record(_tag, _doc->memoryUsage());
+        _doc->clear();
+        JsonArena::_busy = false;
+    }
+    delete _fallbackDoc;
+    free(_fallbackOut);
+}
+
+const char* JsonLease::serialize(size_t* length) {
+    return serialize(*_doc, length);
+}
+
+const char* JsonLease::serialize(const JsonDocument& source, size_t* length) {
+    size_t needed = measureJson(source);
+    char* out;
+
+    if (_shared && needed < JSON_ARENA_OUT_BYTES) {
+        out = JsonArena::_out;
+    } else {
+        // Paylaşılan çıktı buffer'ı dış kiralamaya ait veya yetersiz
+        free(_fallbackOut);
+        _fallbackOut = (char*)malloc(needed + 1);
+        if (!_fallbackOut) return nullptr;
+        out = _fallbackOut;
+    }
+
+    size_t written = serializeJson(source, out, needed + 1);
+    if (length) *length = written;
+    return out;
+}
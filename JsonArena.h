@@ -0,0 +1,76 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Paylaşılan JSON arena boyutları
+#define JSON_ARENA_BYTES      16384   // Tüm encoder/parser'ların ortak document havuzu
+#define JSON_ARENA_OUT_BYTES  4096    // Serialize çıktı buffer'ı (kuyruk slotu kadar)
+
+// PSRAM varsa oradan, yoksa dahili heap'ten - sadece açılışta bir kez çağrılır
+struct JsonArenaAllocator {
+    void* allocate(size_t size);
+    void deallocate(void* ptr);
+    void* reallocate(void* ptr, size_t newSize);
+};
+
+typedef BasicJsonDocument<JsonArenaAllocator> ArenaJsonDocument;
+
+// Açılışta bir kez ayrılan paylaşımlı JSON document'ı
+// Mesaj başına JsonLease ile kiralanır; her kiralamada sıfırlanır, heap'e dokunulmaz.
+class JsonArena {
+public:
+    static bool begin();
+    static bool isReady() { return _doc != nullptr; }
+    static bool isPsram() { return _psram; }
+    static size_t getCapacity();
+    static size_t getHighWater() { return _highWater; }
+    static uint32_t getFallbackCount() { return _fallbacks; }
+    static void report(JsonObject& out); // Info mesajı için kullanım özeti
+
+private:
+    friend class JsonLease;
+    static ArenaJsonDocument* _doc;
+    static char _out[JSON_ARENA_OUT_BYTES];
+    static bool _busy;
+    static bool _psram;
+    static size_t _highWater;
+    static uint32_t _fallbacks;
+
+    // Mesaj tipi başına zirve kullanım
+    struct TagPeak {
+        const char* tag;
+        uint16_t peak;
+    };
+    static TagPeak _peaks[12];
+
+    static void _record(const char* tag, size_t used);
+};
+
+// Mesaj başına arena kiralaması
+// Yapıcı paylaşılan document'ı temizler; arena meşgulse (ör. publish içinden gelen
+// callback) geçici heap document'ına düşer. Yıkıcı kullanım zirvesini kaydeder.
+class JsonLease {
+public:
+    explicit JsonLease(const char* tag, size_t fallbackCapacity = 1024);
+    ~JsonLease();
+
+    JsonDocument& doc() { return *_doc; }
+
+    // Statik çıktı buffer'ına serialize et (String kopyası yok); hata durumunda nullptr
+    const char* serialize(size_t* length = nullptr);
+    const char* serialize(const JsonDocument& source, size_t* length = nullptr);
+
+private:
+    const char* _tag;
+    bool _shared;
+    JsonDocument* _doc;
+    DynamicJsonDocument* _fallbackDoc;
+    char* _fallbackOut;
+
+    JsonLease(const JsonLease&);
+    JsonLease& operator=(const JsonLease&);
+};
+
+#endif
@@ -1,14 +1,45 @@
 #include "MQTTManager.h"
 #include "C16QS4GManager.h"
+#include "BLEManager.h"
+#include "AlarmManager.h"
+#include "ExternalSensor.h"
+#include "JsonArena.h"
 #include <ArduinoJson.h>
 
+// CBOR çıkış buffer'ı (32 tag + stats ~1.6 KB)
+static uint8_t s_cborBuffer[3072];
+
+// Giden kuyruk hız limiti - C16QS AT+MQTTPUBLM yolu (~115200 baud UART + AT bekleme süreleri)
+static const float MQTT_RATE_BYTES_PER_S = 4096.0f;
+static const float MQTT_RATE_BURST_BYTES = 8192.0f;
+static const uint8_t MQTT_MAX_ATTEMPTS = 3;
+static const uint32_t MQTT_JOURNAL_RETRY_MS = 15000; // Doğrulanamayan QoS 1 publish sonrası bekleme (slot başına)
+static const uint32_t MQTT_JOURNAL_RETRY_MAX_MS = 240000; // Ardışık başarısızlıkta katlanan beklemenin üst sınırı
+static const uint32_t MQTT_ALARM_RETRY_MS = 1000;   // Alarmlar uzun beklemeye girmez
+
+// Öncelik başına yaş limiti (ms) - eski advData/info anlamsızlaşır, alarm daha uzun tutulur
+static const uint32_t MQTT_TTL_MS[] = {
+    600000,     // ALARM: 10 dk
+    300000,     // DATA: 5 dk
+    900000,     // INFO: 15 dk
+    3600000     // BACKLOG: 1 saat
+};
+
 // Default broker bilgileri (Cfg verilmezse kullanılır)
 const char* MQTTManager::DEFAULT_MQTT_HOST = "broker.smarttech.tr";
 const int MQTTManager::DEFAULT_MQTT_PORT = 1883;
 const char* MQTTManager::DEFAULT_MQTT_USER = "anymqtt";
 const char* MQTTManager::DEFAULT_MQTT_PASS = "Anv2023*!";
 
-MQTTManager::MQTTManager() : _client(nullptr), _modem4G(nullptr), _is4GMode(false), _mqttPort(1883) {
+MQTTManager::MQTTManager() : _client(nullptr), _modem4G(nullptr), _is4GMode(false), _mqttPort(1883),
+                             _sentDictId(0), _dictSent(false), _cycleSeq(0), _baseSeq(0),
+                             _keyframeEvery(0), _cyclesSinceKeyframe(0), _forceKeyframe(true),
+                             _hasPrevCycle(false), _curCycleDoc(nullptr), _prevCycleDoc(nullptr),
+                             _queuePool(nullptr), _spillPool(nullptr), _spillFn(nullptr), _nextMessageId(1), _rateTokens(MQTT_RATE_BURST_BYTES),
+                             _rateLastMs(0), _recentHead(0) {
+    memset(_queue, 0, sizeof(_queue));
+    memset(_recentIds, 0, sizeof(_recentIds));
+    memset(_recentStates, 0, sizeof(_recentStates));
     // Default değerleri ayarla
     strlcpy(_mqttHost, DEFAULT_MQTT_HOST, sizeof(_mqttHost));
     strlcpy(_mqttUser, DEFAULT_MQTT_USER, sizeof(_mqttUser));
@@ -34,6 +65,32 @@ bool MQTTManager::begin(const char* macAddr, WiFiClient* wifiClient, C16QS4GMana
         strlcpy(_mqttPass, DEFAULT_MQTT_PASS, sizeof(_mqttPass));
         Serial.printf("[MQTT] Using default broker: %s:%d\n", _mqttHost, _mqttPort);
     }
+    if (config != nullptr) {
+        setKeyframeInterval(config->keyframeEvery);
+    }
+    
+    // Giden kuyruk havuzu (bir kez)
+    if (!_queuePool) {
+        _queuePool = (uint8_t*)malloc(MQTT_QUEUE_SLOTS * MQTT_QUEUE_SLOT_BYTES);
+        if (!_queuePool) {
+            Serial.println("[MQTT] Queue pool allocation failed - publishing synchronously");
+        } else {
+            // Önceki açılıştan teslim edilmemiş mesajlar (PUBACK alınmamış)
+            _journal.begin();
+            if (_journal.getStoredNextMid() > _nextMessageId) {
+                _nextMessageId = _journal.getStoredNextMid();
+            }
+            uint8_t restored = _journal.load(_queue, _queuePool, MQTT_QUEUE_SLOT_BYTES, MQTT_QUEUE_SLOTS);
+            for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+                if (_queue[i].used) _queue[i].ttlMs = MQTT_TTL_MS[min((int)_queue[i].priority, (int)MQTT_PRIO_BACKLOG)];
+            }
+            if (restored > 0) {
+                Serial.printf("[MQTT] %d unacknowledged message(s) will be replayed\n", restored);
+            }
+            // Düşen/yaşlanan advData periyotları için kopya (yoksa sadece devir yapılmaz)
+            _spillPool = (OfflineCycle*)malloc(MQTT_QUEUE_SLOTS * sizeof(OfflineCycle));
+        }
+    }
     
     if (_is4GMode) {
         // 4G mode - C16QS modülü kullan
@@ -72,6 +129,8 @@ bool MQTTManager::connect() {
         
         if (_modem4G->connectMQTT(_mqttHost, _mqttPort, clientId.c_str(), _mqttUser, _mqttPass)) {
             Serial.println("[MQTT-4G] Connected!");
+            _forceKeyframe = true; // Backend durumu kopmuş olabilir
+            _clearRetryBackoff();  // Journal'daki mesajları hemen tekrar gönder
             
             // Subscribe to config topic
             String configTopic = getConfigTopic(_macAddr.c_str());
@@ -100,6 +159,8 @@ bool MQTTManager::connect() {
         
         if (_client->connect(clientId.c_str(), _mqttUser, _mqttPass)) {
             Serial.println("[MQTT-WiFi] Connected!");
+            _forceKeyframe = true; // Backend durumu kopmuş olabilir
+            _clearRetryBackoff();  // Journal'daki mesajları hemen tekrar gönder
             
             // Subscribe to config topic
             String configTopic = getConfigTopic(_macAddr.c_str());
@@ -139,6 +200,7 @@ void MQTTManager::loop() {
             _client->loop();
         }
     }
+    _processQueue();
 }
 
 void MQTTManager::disconnect() {
@@ -153,6 +215,42 @@ void MQTTManager::disconnect() {
     }
 }
 
+bool MQTTManager::applyBrokerConfig(const Cfg& config) {
+    if (!strcmp(_mqttHost, config.mqttHost) && _mqttPort == config.mqttPort &&
+        !strcmp(_mqttUser, config.mqttUser) && !strcmp(_mqttPass, config.mqttPass)) {
+        return true;
+    }
+    if (strlen(config.mqttHost) == 0) return false;
+    
+    char oldHost[sizeof(_mqttHost)];
+    char oldUser[sizeof(_mqttUser)];
+    char oldPass[sizeof(_mqttPass)];
+    uint16_t oldPort = _mqttPort;
+    strlcpy(oldHost, _mqttHost, sizeof(oldHost));
+    strlcpy(oldUser, _mqttUser, sizeof(oldUser));
+    strlcpy(oldPass, _mqttPass, sizeof(oldPass));
+    
+    Serial.printf("[MQTT] Switching broker %s:%d -> %s:%d\n", oldHost, oldPort, config.mqttHost, config.mqttPort);
+    strlcpy(_mqttHost, config.mqttHost, sizeof(_mqttHost));
+    _mqttPort = config.mqttPort;
+    strlcpy(_mqttUser, config.mqttUser, sizeof(_mqttUser));
+    strlcpy(_mqttPass, config.mqttPass, sizeof(_mqttPass));
+    
+    disconnect();
+    if (_client) _client->setServer(_mqttHost, _mqttPort);
+    if (connect()) return true;
+    
+    Serial.println("[MQTT] New broker unreachable - reverting to previous broker");
+    strlcpy(_mqttHost, oldHost, sizeof(_mqttHost));
+    _mqttPort = oldPort;
+    strlcpy(_mqttUser, oldUser, sizeof(_mqttUser));
+    strlcpy(_mqttPass, oldPass, sizeof(_mqttPass));
+    disconnect();
+    if (_client) _client->setServer(_mqttHost, _mqttPort);
+    connect();
+    return false;
+}
+
 String MQTTManager::getDataTopic(const char* macAddr) {
     return String("KUTARIoT/data/") + String(macAddr);
 }
@@ -173,9 +271,26 @@ String MQTTManager::getErrorTopic(const char* macAddr) {
     return String("KUTARIoT/errors/") + String(macAddr);
 }
 
+String MQTTManager::getEventTopic(const char* macAddr) {
+    return String("KUTARIoT/event/") + String(macAddr);
+}
+
+String MQTTManager::getBinaryDataTopic(const char* macAddr) {
+    return String("KUTARIoT/bdata/") + String(macAddr);
+}
+
+String MQTTManager::getDiagTopic(const char* macAddr) {
+    return String("KUTARIoT/diag/") + String(macAddr);
+}
+
+String MQTTManager::getBacklogTopic(const char* macAddr) {
+    return String("KUTARIoT/backlog/") + String(macAddr);
+}
+
 bool MQTTManager::publishData(const char* macAddr, float temp, int battPct, int rssi, 
                                uint32_t epoch, const char* sensorName, const char* mahalId) {
-    DynamicJsonDocument doc(1024);
+    JsonLease lease("data", 1024);
+    JsonDocument& doc = lease.doc();
     doc["msg"] = "advData";
     doc["gmac"] = macAddr;
     doc["stat"] = "online";
@@ -196,74 +311,116 @@ bool MQTTManager::publishData(const char* macAddr, float temp, int battPct, int
     sensor["time"] = epoch;
     
     String topic = getDataTopic(macAddr);
-    String payload;
-    serializeJson(doc, payload);
+    size_t payloadLen = 0;
+    const char* payload = lease.serialize(&payloadLen);
+    if (!payload) return false;
     
-    Serial.printf("[MQTT] Publishing to %s: %s\n", topic.c_str(), payload.c_str());
+    Serial.printf("[MQTT] Publishing to %s: %s\n", topic.c_str(), payload);
     
     if (_is4GMode) {
         if (_modem4G) {
-            return _modem4G->publishMQTT(topic.c_str(), payload.c_str());
+            return _modem4G->publishMQTT(topic.c_str(), payload);
         }
         return false;
     } else {
         if (_client) {
-            return _client->publish(topic.c_str(), payload.c_str());
+            return _client->publish(topic.c_str(), payload);
         }
         return false;
     }
 }
 
-bool MQTTManager::publishDataArray(const char* macAddr, const OfflineDataRecord* records, int count,
-                                   const char* sensorName, const char* mahalId) {
-    if (count == 0) return false;
-    
-    // Dinamik boyut hesapla (her kayıt için ~150 byte)
-    DynamicJsonDocument doc(2048 + (count * 200));
+uint32_t MQTTManager::publishBacklogCycle(const char* macAddr, const OfflineCycle& cycle,
+                                          const char* sensorName, const char* mahalId, BLEManager* ble) {
+    // Çevrimdışı periyodu canlı advData ile aynı şekle aç (istatistik/kimlik alanları hariç)
+    JsonLease lease("backlog", 1024 + cycle.tagCount * 200);
+    JsonDocument& doc = lease.doc();
     doc["msg"] = "advData";
     doc["gmac"] = macAddr;
     doc["stat"] = "online";
-    
-    // Bağlantı tipini ekle: WiFi veya 4G
     doc["conn"] = _is4GMode ? "4G" : "wifi";
+    doc["backlog"] = true; // Bağlantı yokken kaydedildi
+    
+    // Eski kayıtlarda konum yok
+    if (!(cycle.flags & OFFLINE_FLAG_LEGACY)) {
+        char timeStr[9] = "";
+        char dateStr[9] = "";
+        if (cycle.flags & OFFLINE_FLAG_FIX) {
+            time_t t = cycle.epoch;
+            struct tm tmUtc;
+            gmtime_r(&t, &tmUtc);
+            strftime(timeStr, sizeof(timeStr), "%H:%M:%S", &tmUtc);
+            strftime(dateStr, sizeof(dateStr), "%d/%m/%y", &tmUtc);
+        }
+        JsonObject gps = doc.createNestedObject("gps");
+        gps["lat"] = cycle.latE6 / 1e6;
+        gps["lon"] = cycle.lonE6 / 1e6;
+        gps["speed"] = cycle.speedDkmh / 10.0f;
+        gps["course"] = cycle.courseDdeg / 10.0f;
+        gps["time"] = timeStr;
+        gps["date"] = dateStr;
+        gps["sats"] = cycle.sats;
+        gps["hdop"] = cycle.hdopD / 10.0f;
+    }
     
     JsonArray obj = doc.createNestedArray("obj");
     
-    for (int i = 0; i < count; i++) {
-        JsonObject sensor = obj.createNestedObject();
-        sensor["type"] = 1;
-        sensor["dmac"] = macAddr;
-        sensor["name"] = sensorName;
-        sensor["location"] = mahalId;
-        sensor["temp"] = records[i].temperature;
-        sensor["batt"] = records[i].batteryPct;
-        sensor["rssi"] = records[i].rssi;
-        sensor["time"] = records[i].timestamp;
+    JsonObject internalSensor = obj.createNestedObject();
+    internalSensor["type"] = 1;
+    internalSensor["dmac"] = macAddr;
+    internalSensor["name"] = sensorName;
+    internalSensor["location"] = mahalId;
+    internalSensor["temp"] = (cycle.flags & OFFLINE_FLAG_SENSOR_OK) ? cycle.tempCenti / 100.0f : 0;
+    internalSensor["batt"] = cycle.batt;
+    internalSensor["rssi"] = cycle.rssi;
+    internalSensor["time"] = cycle.epoch;
+    if (cycle.alarmState) internalSensor["alarm"] = cycle.alarmState;
+    
+    for (uint8_t i = 0; i < cycle.tagCount; i++) {
+        const OfflineTag& tag = cycle.tags[i];
+        char mac[13];
+        snprintf(mac, sizeof(mac), "%02X%02X%02X%02X%02X%02X",
+                 tag.mac[0], tag.mac[1], tag.mac[2], tag.mac[3], tag.mac[4], tag.mac[5]);
+        BLETagConfig* config = ble ? ble->getTagConfig(mac) : nullptr;
+        
+        JsonObject bleSensor = obj.createNestedObject();
+        bleSensor["type"] = 2;
+        bleSensor["dmac"] = mac;
+        bleSensor["name"] = config ? config->name : "Unknown";
+        bleSensor["location"] = config ? config->mahalId : "";
+        bleSensor["temp"] = tag.tempCenti / 100.0f;
+        bleSensor["batt"] = tag.batt;
+        bleSensor["rssi"] = tag.rssi;
+        bleSensor["time"] = cycle.epoch;
     }
     
-    String topic = getDataTopic(macAddr);
-    String payload;
-    serializeJson(doc, payload);
+    size_t payloadLen = 0;
+    const char* payload = lease.serialize(&payloadLen);
+    if (!payload) return 0;
     
-    Serial.printf("[MQTT] Publishing array (%d records) to %s\n", count, topic.c_str());
+    String topic = getDataTopic(macAddr);
+    Serial.printf("[MQTT] Queueing backlog cycle %lu (%d tags, %u bytes) to %s\n",
+                 (unsigned long)cycle.epoch, cycle.tagCount, (unsigned)payloadLen, topic.c_str());
+    return enqueue(topic.c_str(), (const uint8_t*)payload, payloadLen, MQTT_PRIO_BACKLOG);
+}
+
+uint32_t MQTTManager::publishBacklogBlock(const char* macAddr, const OfflineBlock& block,
+                                          const char* sensorName, const char* mahalId) {
+    size_t len = BacklogCodec::encodeUpload(macAddr, sensorName, mahalId, block,
+                                            s_cborBuffer, sizeof(s_cborBuffer));
+    if (len == 0) return 0;
     
-    if (_is4GMode) {
-        if (_modem4G) {
-            return _modem4G->publishMQTT(topic.c_str(), payload.c_str());
-        }
-        return false;
-    } else {
-        if (_client) {
-            return _client->publish(topic.c_str(), payload.c_str());
-        }
-        return false;
-    }
+    String topic = getBacklogTopic(macAddr);
+    Serial.printf("[MQTT] Queueing backlog block (%u cycles, %u bytes) to %s\n",
+                 block.count, (unsigned)len, topic.c_str());
+    return enqueue(topic.c_str(), s_cborBuffer, len, MQTT_PRIO_BACKLOG, true);
 }
 
 bool MQTTManager::publishInfo(const char* macAddr, const char* fwVersion, uint32_t uptime, 
                                uint32_t heap, uint32_t epoch, int wifiRssi, const Cfg& cfg, 
-                               const PowerStatus& power, bool sensorOK) {
-    DynamicJsonDocument doc(4096);
+                               const PowerStatus& power, bool sensorOK, AlarmManager* alarms) {
+    JsonLease lease("info", 4096);
+    JsonDocument& doc = lease.doc();
     doc["msg"] = "info";
     doc["fw"] = fwVersion;
     doc["uptime"] = uptime;
@@ -322,11 +479,16 @@ bool MQTTManager::publishInfo(const char* macAddr, const char* fwVersion, uint32
     config["wifiSsid"] = cfg.wifiSsid;
     config["dataPeriod"] = cfg.dataPeriod;
     config["infoPeriod"] = cfg.infoPeriod;
+    config["backlogPeriod"] = cfg.publish.backlogPeriod;
+    config["alarmPeriod"] = cfg.publish.alarmPeriod;
+    config["diagPeriod"] = cfg.publish.diagPeriod;
     config["tempHigh"] = cfg.tempHigh;
     config["tempLow"] = cfg.tempLow;
     config["buzzerEnabled"] = cfg.buzzerEnabled;
     config["internalName"] = cfg.internalSensorName;
     config["internalMahal"] = cfg.internalMahalId;
+    config["telemetryFormat"] = cfg.telemetryFormat;
+    config["keyframeEvery"] = cfg.keyframeEvery;
     
     JsonObject beacon = config.createNestedObject("beacon");
     beacon["enabled"] = cfg.beacon.enabled;
@@ -335,6 +497,10 @@ bool MQTTManager::publishInfo(const char* macAddr, const char* fwVersion, uint32
     beacon["targetPrefix"] = cfg.beacon.targetPrefix;
     beacon["maxBeacons"] = cfg.beacon.maxBeacons;
     beacon["timeoutMs"] = cfg.beacon.timeoutMs;
+    beacon["presenceEnterRssi"] = cfg.beacon.presenceEnterRssi;
+    beacon["presenceExitRssi"] = cfg.beacon.presenceExitRssi;
+    beacon["presenceEnterMs"] = cfg.beacon.presenceEnterMs;
+    beacon["presenceExitMs"] = cfg.beacon.presenceExitMs;
     
     JsonObject pwr = doc.createNestedObject("power");
     pwr["mains"] = power.mainsPresent;
@@ -343,30 +509,41 @@ bool MQTTManager::publishInfo(const char* macAddr, const char* fwVersion, uint32
     pwr["battPct"] = power.battPct;
     pwr["powerCut"] = false; // TODO: implement power cut detection
     
+    // Soğuk zincir: MKT, eşik dışı süreler, excursion sayıları (dahili + tag'lar)
+    if (alarms) {
+        JsonObject excursion = doc.createNestedObject("excursion");
+        alarms->report(excursion);
+    }
+    
+    // JSON arena kullanımı (kapasite, mesaj tipi başına zirve)
+    JsonObject arena = doc.createNestedObject("arena");
+    JsonArena::report(arena);
+    
+    // Journal NVS aşınma göstergesi
+    JsonObject journal = doc.createNestedObject("journal");
+    journal["flushes"] = _journal.getFlushCount();
+    journal["writes"] = _journal.getWriteCount();
+    
     String topic = getInfoTopic(macAddr);
-    String payload;
-    serializeJson(doc, payload);
+    size_t payloadLen = 0;
+    const char* payload = lease.serialize(&payloadLen);
+    if (!payload) return false;
     
     Serial.printf("[MQTT] Publishing info to %s\n", topic.c_str());
     
-    if (_is4GMode) {
-        if (_modem4G) {
-            return _modem4G->publishMQTT(topic.c_str(), payload.c_str());
-        }
-        return false;
-    } else {
-        if (_client) {
-            return _client->publish(topic.c_str(), payload.c_str());
-        }
-        return false;
-    }
+    return enqueue(topic.c_str(), (const uint8_t*)payload, payloadLen, MQTT_PRIO_INFO) != 0;
 }
 
 bool MQTTManager::publishAlarm(const char* macAddr, uint8_t alarmState, const char* reason, 
-                                float temp, int battPct) {
-    DynamicJsonDocument doc(512);
+                                float temp, int battPct, const char* sensorMac, const char* sensorName) {
+    JsonLease lease("alarm", 512);
+    JsonDocument& doc = lease.doc();
     doc["msg"] = "alarm";
     doc["gmac"] = macAddr;
+    if (sensorMac) {
+        doc["dmac"] = sensorMac;
+        doc["name"] = sensorName ? sensorName : "";
+    }
     doc["state"] = alarmState;
     doc["reason"] = reason;
     doc["temp"] = temp;
@@ -374,45 +551,60 @@ bool MQTTManager::publishAlarm(const char* macAddr, uint8_t alarmState, const ch
     doc["time"] = time(nullptr);
     
     String topic = getAlarmTopic(macAddr);
-    String payload;
-    serializeJson(doc, payload);
+    size_t payloadLen = 0;
+    const char* payload = lease.serialize(&payloadLen);
+    if (!payload) return false;
     
-    Serial.printf("[MQTT] Publishing alarm to %s: %s\n", topic.c_str(), payload.c_str());
+    Serial.printf("[MQTT] Publishing alarm to %s: %s\n", topic.c_str(), payload);
     
-    if (_is4GMode) {
-        if (_modem4G) {
-            return _modem4G->publishMQTT(topic.c_str(), payload.c_str());
-        }
-        return false;
-    } else {
-        if (_client) {
-            return _client->publish(topic.c_str(), payload.c_str());
-        }
-        return false;
-    }
+    return enqueue(topic.c_str(), (const uint8_t*)payload, payloadLen, MQTT_PRIO_ALARM) != 0;
+}
+
+bool MQTTManager::publishPresence(const char* macAddr, const char* sensorMac, bool present, 
+                                  int rssi, uint32_t epoch) {
+    // Kompakt olay mesajı - geçiş anında gönderilir
+    JsonLease lease("presence", 256);
+    JsonDocument& doc = lease.doc();
+    doc["msg"] = "presence";
+    doc["gmac"] = macAddr;
+    doc["dmac"] = sensorMac;
+    doc["ev"] = present ? "enter" : "exit";
+    doc["rssi"] = rssi;
+    doc["time"] = epoch;
+    
+    String topic = getEventTopic(macAddr);
+    size_t payloadLen = 0;
+    const char* payload = lease.serialize(&payloadLen);
+    if (!payload) return false;
+    
+    Serial.printf("[MQTT] Publishing presence to %s: %s\n", topic.c_str(), payload);
+    
+    return enqueue(topic.c_str(), (const uint8_t*)payload, payloadLen, MQTT_PRIO_ALARM) != 0;
 }
 
 bool MQTTManager::publishError(const char* macAddr, const char* errorMsg) {
-    DynamicJsonDocument doc(512);
+    JsonLease lease("error", 512);
+    JsonDocument& doc = lease.doc();
     doc["msg"] = "error";
     doc["gmac"] = macAddr;
     doc["error"] = errorMsg;
     doc["time"] = time(nullptr);
     
     String topic = getErrorTopic(macAddr);
-    String payload;
-    serializeJson(doc, payload);
+    size_t payloadLen = 0;
+    const char* payload = lease.serialize(&payloadLen);
+    if (!payload) return false;
     
-    Serial.printf("[MQTT] Publishing error to %s: %s\n", topic.c_str(), payload.c_str());
+    Serial.printf("[MQTT] Publishing error to %s: %s\n", topic.c_str(), payload);
     
     if (_is4GMode) {
         if (_modem4G) {
-            return _modem4G->publishMQTT(topic.c_str(), payload.c_str());
+            return _modem4G->publishMQTT(topic.c_str(), payload);
         }
         return false;
     } else {
         if (_client) {
-            return _client->publish(topic.c_str(), payload.c_str());
+            return _client->publish(topic.c_str(), payload);
         }
         return false;
     }
@@ -420,7 +612,8 @@ bool MQTTManager::publishError(const char* macAddr, const char* errorMsg) {
 
 bool MQTTManager::publishDataWithGPS(const char* macAddr, float temp, int battPct, int rssi, 
                                      uint32_t epoch, bool sensorOK, float latitude, float longitude) {
-    DynamicJsonDocument doc(1024);
+    JsonLease lease("gpsData", 1024);
+    JsonDocument& doc = lease.doc();
     doc["msg"] = "advData";
     doc["gmac"] = macAddr;
     doc["stat"] = "online";
@@ -447,36 +640,652 @@ bool MQTTManager::publishDataWithGPS(const char* macAddr, float temp, int battPc
     gps["lon"] = longitude;
     
     String topic = getDataTopic(macAddr);
-    String payload;
-    serializeJson(doc, payload);
+    size_t payloadLen = 0;
+    const char* payload = lease.serialize(&payloadLen);
+    if (!payload) return false;
     
-    Serial.printf("[MQTT] Publishing GPS data to %s: %s\n", topic.c_str(), payload.c_str());
+    Serial.printf("[MQTT] Publishing GPS data to %s: %s\n", topic.c_str(), payload);
     
     if (_is4GMode) {
         if (_modem4G) {
-            return _modem4G->publishMQTT(topic.c_str(), payload.c_str());
+            return _modem4G->publishMQTT(topic.c_str(), payload);
         }
         return false;
     } else {
         if (_client) {
-            return _client->publish(topic.c_str(), payload.c_str());
+            return _client->publish(topic.c_str(), payload);
         }
         return false;
     }
 }
 
-bool MQTTManager::publishRaw(const char* topic, const char* payload) {
+bool MQTTManager::publishRaw(const char* topic, const char* payload, uint8_t qos, bool dup) {
     Serial.printf("[MQTT] Publishing raw to %s: %s\n", topic, payload);
     
     if (_is4GMode) {
         if (_modem4G) {
-            return _modem4G->publishMQTT(topic, payload);
+            return _modem4G->publishMQTT(topic, payload, qos, dup);
         }
         return false;
     } else {
+        // PubSubClient sadece QoS 0 publish eder; WiFi'de at-least-once
+        // garantisi TCP teslimi + journal'ın yeniden bağlanınca tekrarıyla sınırlı
         if (_client) {
             return _client->publish(topic, payload);
         }
         return false;
     }
-}
\ No newline at end of file
+}
+
+bool MQTTManager::publishRaw(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool dup) {
+    Serial.printf("[MQTT] Publishing binary to %s: %u bytes\n", topic, (unsigned)length);
+    
+    if (_is4GMode) {
+        if (_modem4G) {
+            return _modem4G->publishMQTT(topic, payload, length, qos, dup);
+        }
+        return false;
+    } else {
+        if (_client) {
+            return _client->publish(topic, payload, length);
+        }
+        return false;
+    }
+}
+
+void MQTTManager::_buildCycleJson(const CycleSnapshot& snap, JsonDocument& doc) {
+    doc.clear();
+    doc["msg"] = "advData";
+    doc["gmac"] = snap.gmac;
+    doc["stat"] = "online";
+    doc["conn"] = snap.conn;
+    doc["bleOnMs"] = snap.bleOnMs; // Bu periyotta BLE radyosunun açık kaldığı süre
+    
+    // GPS objesi (konum + hız + yön + zaman)
+    JsonObject gps = doc.createNestedObject("gps");
+    gps["lat"] = snap.lat;
+    gps["lon"] = snap.lon;
+    gps["speed"] = snap.speed;        // km/h
+    gps["course"] = snap.course;      // derece (0-360)
+    gps["time"] = snap.gpsTime;       // UTC saat (HH:MM:SS)
+    gps["date"] = snap.gpsDate;       // Tarih (DD/MM/YY)
+    gps["sats"] = snap.sats;          // Uydu sayısı
+    gps["hdop"] = snap.hdop;          // HDOP
+    
+    // Sensör dizisi
+    JsonArray obj = doc.createNestedArray("obj");
+    
+    // 1) Dahili sensör
+    JsonObject internalSensor = obj.createNestedObject();
+    internalSensor["type"] = 1;
+    internalSensor["dmac"] = snap.gmac;
+    internalSensor["name"] = snap.internalName;
+    internalSensor["location"] = snap.internalMahalId;
+    internalSensor["temp"] = snap.sensorOK ? snap.temp : 0;
+    internalSensor["batt"] = snap.batt;
+    internalSensor["rssi"] = snap.rssi;
+    internalSensor["time"] = snap.epoch;
+    
+    // Ek I2C sensörleri - her biri ayrı girdi (dmac: gateway MAC + "-" + I2C adresi)
+    ExternalSensor* ext = snap.ext;
+    float humidity;
+    if (ext && ext->getHumidity(0, humidity)) internalSensor["hum"] = humidity;
+    for (uint8_t i = 1; ext && i < ext->getSensorCount(); i++) {
+        char dmac[20];
+        char name[16];
+        snprintf(dmac, sizeof(dmac), "%s-%02X", snap.gmac, ext->getAddress(i));
+        snprintf(name, sizeof(name), "%s@%02X", ext->getDriver(i)->name, ext->getAddress(i));
+        float temp;
+        bool ok = ext->getTemperature(i, temp);
+        
+        JsonObject sensor = obj.createNestedObject();
+        sensor["type"] = 1;
+        sensor["dmac"] = dmac;
+        sensor["name"] = name;
+        sensor["location"] = snap.internalMahalId;
+        sensor["temp"] = ok ? temp : 0;
+        if (ext->getHumidity(i, humidity)) sensor["hum"] = humidity;
+        sensor["batt"] = snap.batt;
+        sensor["rssi"] = snap.rssi;
+        sensor["time"] = snap.epoch;
+    }
+    
+    // 2) BLE Eddystone sensörler
+    BLEManager* ble = snap.ble;
+    uint8_t bleCount = ble ? ble->getScannedTagCount() : 0;
+    for (uint8_t i = 0; i < bleCount; i++) {
+        BLETagData tag;
+        if (!ble->getScannedTag(i, tag) || !tag.valid) continue;
+        
+        BLETagConfig* config = ble->getTagConfig(tag.macAddress);
+        
+        // MAC'i normalize et
+        String normalizedMac = String(tag.macAddress);
+        normalizedMac.toUpperCase();
+        normalizedMac.replace(":", "");
+        
+        JsonObject bleSensor = obj.createNestedObject();
+        bleSensor["type"] = 2; // BLE sensor type
+        bleSensor["dmac"] = normalizedMac;
+        bleSensor["name"] = config ? config->name : "Unknown";
+        bleSensor["location"] = config ? config->mahalId : "";
+        bleSensor["temp"] = tag.temperature;
+        bleSensor["batt"] = tag.batteryPct;
+        bleSensor["rssi"] = tag.rssi;
+        bleSensor["time"] = snap.epoch;
+        bleSensor["advCount"] = tag.advCount;
+        ble->appendTagStats(bleSensor, tag); // Periyot içi min/max/ort/stddev
+        ble->appendTagIdentity(bleSensor, tag); // UID/URL/iBeacon (biliniyorsa)
+    }
+}
+
+bool MQTTManager::_publishTagDictionary(const CycleSnapshot& snap) {
+    // İkili advData tag'ları config sırası ile taşır; isim/mahal burada bir kez gönderilir
+    if (!snap.ble) return true;
+    uint32_t dictId = snap.ble->getConfigDictionaryId();
+    if (_dictSent && dictId == _sentDictId) return true;
+    
+    JsonLease lease("tagDict", 2048);
+    JsonDocument& doc = lease.doc();
+    doc["msg"] = "tagDict";
+    doc["gmac"] = snap.gmac;
+    doc["dict"] = dictId;
+    doc["ver"] = TelemetryEncoder::SCHEMA_VERSION;
+    JsonArray tags = doc.createNestedArray("tags");
+    for (uint8_t i = 0; i < snap.ble->getConfiguredTagCount(); i++) {
+        BLETagConfig* config = snap.ble->getTagConfigAt(i);
+        if (!config) break;
+        String normalizedMac = String(config->macAddress);
+        normalizedMac.toUpperCase();
+        normalizedMac.replace(":", "");
+        
+        JsonObject t = tags.createNestedObject();
+        t["id"] = i;
+        t["dmac"] = normalizedMac;
+        t["name"] = config->name;
+        t["location"] = config->mahalId;
+    }
+    
+    size_t payloadLen = 0;
+    const char* payload = lease.serialize(&payloadLen);
+    if (!payload) return false;
+    String topic = getDataTopic(snap.gmac);
+    if (enqueue(topic.c_str(), (const uint8_t*)payload, payloadLen, MQTT_PRIO_DATA) == 0) return false;
+    
+    _sentDictId = dictId;
+    _dictSent = true;
+    return true;
+}
+
+// ===== advData Keyframe/Delta =====
+
+// cur'da değişen/eklenen alanları out'a yaz, prev'de olup cur'da olmayanları null yap
+bool MQTTManager::_diffObject(JsonObjectConst cur, JsonObjectConst prev, JsonObject out) {
+    bool changed = false;
+    
+    for (JsonPairConst kv : cur) {
+        if (kv.key() == "seq" || kv.key() == "kf") continue;
+        JsonVariantConst value = kv.value();
+        JsonVariantConst old = prev[kv.key()];
+        
+        if (old.isNull()) {
+            out[kv.key()].set(value);
+            changed = true;
+        } else if (value.is<JsonObjectConst>() && old.is<JsonObjectConst>()) {
+            JsonObject nested = out[kv.key()].to<JsonObject>();
+            if (_diffObject(value.as<JsonObjectConst>(), old.as<JsonObjectConst>(), nested)) {
+                changed = true;
+            } else {
+                out.remove(kv.key());
+            }
+        } else if (kv.key() == "obj" && value.is<JsonArrayConst>() && old.is<JsonArrayConst>()) {
+            JsonArray nested = out[kv.key()].to<JsonArray>();
+            if (_diffSensors(value.as<JsonArrayConst>(), old.as<JsonArrayConst>(), nested)) {
+                changed = true;
+            } else {
+                out.remove(kv.key());
+            }
+        } else if (value != old) {
+            out[kv.key()].set(value);
+            changed = true;
+        }
+    }
+    
+    for (JsonPairConst kv : prev) {
+        if (kv.key() == "seq" || kv.key() == "kf") continue;
+        if (cur[kv.key()].isNull()) {
+            out[kv.key()] = nullptr; // Alan kalktı (ör. stats)
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Sensör dizisi dmac ile eşleştirilir: yeni sensör tam, değişen sadece farkı, kaybolan "gone"
+bool MQTTManager::_diffSensors(JsonArrayConst cur, JsonArrayConst prev, JsonArray out) {
+    bool changed = false;
+    
+    for (JsonVariantConst sensor : cur) {
+        JsonVariantConst dmac = sensor["dmac"];
+        JsonObjectConst old;
+        for (JsonVariantConst candidate : prev) {
+            if (candidate["dmac"] == dmac) {
+                old = candidate.as<JsonObjectConst>();
+                break;
+            }
+        }
+        
+        if (old.isNull()) {
+            out.add(sensor);
+            changed = true;
+            continue;
+        }
+        
+        JsonObject entry = out.createNestedObject();
+        entry["dmac"].set(dmac);
+        if (_diffObject(sensor.as<JsonObjectConst>(), old, entry)) {
+            changed = true;
+        } else {
+            out.remove(out.size() - 1);
+        }
+    }
+    
+    for (JsonVariantConst old : prev) {
+        bool found = false;
+        for (JsonVariantConst sensor : cur) {
+            if (sensor["dmac"] == old["dmac"]) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            JsonObject entry = out.createNestedObject();
+            entry["dmac"].set(old["dmac"]);
+            entry["gone"] = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void MQTTManager::setKeyframeInterval(uint8_t cycles) {
+    _keyframeEvery = cycles;
+    _forceKeyframe = true;
+}
+
+uint32_t MQTTManager::_publishCycleJson(const CycleSnapshot& snap, size_t& payloadLen) {
+    if (!_curCycleDoc) {
+        // Kalıcı iki document (mevcut + son yayınlanan) - bir kez ayrılır
+        _curCycleDoc = new ArenaJsonDocument(4096);
+        _prevCycleDoc = new ArenaJsonDocument(4096);
+    }
+    _buildCycleJson(snap, *_curCycleDoc);
+    
+    bool keyframe = (_keyframeEvery == 0 || _forceKeyframe || !_hasPrevCycle ||
+                     _cyclesSinceKeyframe + 1 >= _keyframeEvery);
+    
+    // Delta arena'da kurulur; keyframe de arena çıktı buffer'ına serialize edilir
+    JsonLease lease("advDelta", 4096);
+    const char* payload = nullptr;
+    payloadLen = 0;
+    
+    if (!keyframe) {
+        // Sadece önceki yayınlanan periyottan farklı alanlar
+        JsonDocument& delta = lease.doc();
+        delta["msg"] = "advDelta";
+        delta["seq"] = _cycleSeq;
+        delta["base"] = _baseSeq;     // Farkın uygulandığı mesaj
+        delta["time"] = snap.epoch;   // Sensör "time" alanları bu değere eşitse gönderilmez
+        _diffObject(_curCycleDoc->as<JsonObjectConst>(), _prevCycleDoc->as<JsonObjectConst>(), 
+                    delta.as<JsonObject>());
+        
+        JsonArray sensors = delta["obj"];
+        for (JsonObject sensor : sensors) {
+            if (sensor["time"] == snap.epoch) sensor.remove("time");
+        }
+        
+        if (delta.overflowed()) {
+            keyframe = true;
+        } else {
+            payload = lease.serialize(&payloadLen);
+            if (!payload || payloadLen >= measureJson(*_curCycleDoc)) {
+                keyframe = true; // Fark tam mesajdan büyükse keyframe gönder
+            }
+        }
+    }
+    
+    if (keyframe) {
+        (*_curCycleDoc)["seq"] = _cycleSeq;
+        (*_curCycleDoc)["kf"] = true;
+        payload = lease.serialize(*_curCycleDoc, &payloadLen);
+    }
+    
+    String topic = getDataTopic(snap.gmac);
+    uint32_t id = payload ? enqueue(topic.c_str(), (const uint8_t*)payload, payloadLen, MQTT_PRIO_DATA) : 0;
+    
+    if (id != 0) {
+        // Yayınlanan periyot bir sonraki farkın tabanı olur
+        ArenaJsonDocument* tmp = _prevCycleDoc;
+        _prevCycleDoc = _curCycleDoc;
+        _curCycleDoc = tmp;
+        _hasPrevCycle = true;
+        _baseSeq = _cycleSeq;
+        _forceKeyframe = false;
+        _cyclesSinceKeyframe = keyframe ? 0 : _cyclesSinceKeyframe + 1;
+    } else {
+        _forceKeyframe = true; // Kuyruğa girmedi - zincir kırıldı
+    }
+    
+    Serial.printf("[TX] advData seq=%lu %s\n", (unsigned long)_cycleSeq, keyframe ? "keyframe" : "delta");
+    _cycleSeq++;
+    return id;
+}
+
+void MQTTManager::_attachSpill(uint32_t id, const OfflineCycle& cycle) {
+    if (!_spillPool || id == 0) return;
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        if (_queue[i].used && _queue[i].id == id) {
+            _spillPool[i] = cycle;
+            _queue[i].spill = true;
+            return;
+        }
+    }
+}
+
+bool MQTTManager::publishCycle(const CycleSnapshot& snap, uint8_t format, const OfflineCycle* spill) {
+    // İkisi birden açıksa biri kuyruğa girdiyse periyot kaybolmamıştır - FIFO'ya
+    // sadece hiçbiri girmediyse düşülür (aksi halde periyot iki kez yüklenir).
+    // Devir tek mesaja bağlanır (JSON, yoksa CBOR) - aynı periyot iki kez FIFO'ya girmez
+    uint32_t jsonId = 0, cborId = 0;
+    uint32_t jsonUs = 0, cborUs = 0;
+    size_t jsonLen = 0, cborLen = 0;
+    
+    if (format == TELEMETRY_JSON || format == TELEMETRY_BOTH) {
+        uint32_t t0 = micros();
+        jsonId = _publishCycleJson(snap, jsonLen);
+        jsonUs = micros() - t0;
+    }
+    
+    if (format == TELEMETRY_CBOR || format == TELEMETRY_BOTH) {
+        // Sözlük gönderilemezse ikili veri çözülemez - JSON'a düş
+        if (!_publishTagDictionary(snap)) {
+            Serial.println("[MQTT] Tag dictionary publish failed");
+            if (format == TELEMETRY_CBOR) {
+                size_t payloadLen;
+                jsonId = _publishCycleJson(snap, payloadLen);
+            }
+            if (spill) _attachSpill(jsonId, *spill);
+            return jsonId != 0;
+        }
+        
+        uint32_t t0 = micros();
+        cborLen = TelemetryEncoder::encodeCycle(snap, s_cborBuffer, sizeof(s_cborBuffer));
+        cborUs = micros() - t0;
+        
+        if (cborLen > 0) {
+            String topic = getBinaryDataTopic(snap.gmac);
+            cborId = enqueue(topic.c_str(), s_cborBuffer, cborLen, MQTT_PRIO_DATA, true);
+        }
+    }
+    if (spill) _attachSpill(jsonId != 0 ? jsonId : cborId, *spill);
+    
+    // Kodlayıcı karşılaştırması (boyut + CPU, JSON süresi publish dahil)
+    if (format == TELEMETRY_BOTH && jsonLen > 0) {
+        Serial.printf("[TX] Encoding: JSON %u bytes / %lu us, CBOR %u bytes / %lu us (%.0f%%)\n",
+                     (unsigned)jsonLen, (unsigned long)jsonUs, (unsigned)cborLen, (unsigned long)cborUs,
+                     100.0f * cborLen / jsonLen);
+    } else {
+        Serial.printf("[TX] Payload size: %u bytes (%s, %lu us)\n",
+                     (unsigned)(jsonLen + cborLen), format == TELEMETRY_CBOR ? "CBOR" : "JSON",
+                     (unsigned long)(jsonUs + cborUs));
+    }
+    return jsonId != 0 || cborId != 0;
+}
+
+// ===== Giden Öncelik Kuyruğu =====
+
+// Journal'lı mesajlara tekrar ayıklama ID'si ekle (sunucu mid ile dedup yapar)
+// JSON: {"mid":N,...}   CBOR: kök map'e 9: mid anahtarı. Eklenemezse payload aynen kopyalanır.
+static size_t injectMessageId(uint8_t* dst, size_t cap, const uint8_t* payload, size_t length,
+                              bool binary, uint32_t mid) {
+    if (!binary && length >= 2 && payload[0] == '{') {
+        int head = snprintf((char*)dst, cap, "{\"mid\":%lu%s", (unsigned long)mid, payload[1] == '}' ? "" : ",");
+        if (head > 0 && (size_t)head + length - 1 < cap) {
+            memcpy(dst + head, payload + 1, length - 1);
+            return head + length - 1;
+        }
+    } else if (binary && length >= 1 && (payload[0] & 0xE0) == 0xA0 && (payload[0] & 0x1F) < 23) {
+        // Kısa formlu map başlığı: eleman sayısını bir artır, anahtarı başa ekle
+        dst[0] = payload[0] + 1;
+        CborWriter w(dst + 1, cap - 1);
+        w.writeUint(9);
+        w.writeUint(mid);
+        size_t head = 1 + w.length();
+        if (!w.overflow() && head + length - 1 < cap) {
+            memcpy(dst + head, payload + 1, length - 1);
+            return head + length - 1;
+        }
+    }
+    if (length >= cap) return 0;
+    memcpy(dst, payload, length);
+    return length;
+}
+
+uint32_t MQTTManager::enqueue(const char* topic, const uint8_t* payload, size_t length, 
+                              uint8_t priority, bool binary) {
+    // Sadece alarmlar journal'a yazılır. Bilgi mesajları bir sonraki periyotta zaten
+    // yenilenir; backlog kaydı teslim doğrulanana kadar FIFO'da kalır (peek/commit);
+    // advData teslim edilemezse FIFO'ya devredilir (publishCycle spill)
+    bool journaled = (priority == MQTT_PRIO_ALARM);
+    
+    // Havuz yoksa veya mesaj slota sığmıyorsa eski davranış: senkron publish
+    // (journal'lı mesajlarda mid için ~16 byte pay bırakılır). Journal'a sığmayan
+    // mesaj QoS 0 ile sessizce kaybolabileceği için reddedilir - çağıran yerinde tutar.
+    size_t reserve = journaled ? 16 : 0;
+    bool fits = _queuePool && length + reserve < MQTT_QUEUE_SLOT_BYTES && strlen(topic) < sizeof(_queue[0].topic);
+    if (!fits && journaled) {
+        Serial.printf("[MQTT-Q] Rejected %u byte prio %d message to %s (exceeds journal slot)\n",
+                     (unsigned)length, priority, topic);
+        return 0;
+    }
+    if (!fits) {
+        Serial.printf("[MQTT-Q] Publishing synchronously (%u bytes)\n", (unsigned)length);
+        bool ok = binary ? publishRaw(topic, payload, length) : publishRaw(topic, (const char*)payload);
+        uint32_t id = _nextMessageId++;
+        _recentIds[_recentHead] = id;
+        _recentStates[_recentHead] = ok ? MQTT_MSG_SENT : MQTT_MSG_FAILED;
+        _recentHead = (_recentHead + 1) % 8;
+        return ok ? id : 0;
+    }
+    
+    // Boş slot ara; yoksa daha düşük öncelikli en eski mesajı düşür.
+    // Journal'lı mesajlar (teslim sözü verilmiş) sadece alarma yer açmak için düşürülür;
+    // düşen advData periyodu FIFO'ya devredilir (_finishSlot).
+    int target = -1;
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        if (!_queue[i].used) {
+            target = i;
+            break;
+        }
+    }
+    if (target < 0) {
+        for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+            if (_queue[i].priority <= priority) continue;
+            if (_queue[i].journaled && priority != MQTT_PRIO_ALARM) continue;
+            if (target < 0 || _queue[i].priority > _queue[target].priority ||
+                (_queue[i].priority == _queue[target].priority && 
+                 (int32_t)(_queue[i].enqueuedMs - _queue[target].enqueuedMs) < 0)) {
+                target = i;
+            }
+        }
+        if (target < 0) {
+            Serial.printf("[MQTT-Q] Queue full - rejected prio %d message to %s\n", priority, topic);
+            return 0;
+        }
+        Serial.printf("[MQTT-Q] Queue full - dropping prio %d message #%lu\n", 
+                     _queue[target].priority, _queue[target].id);
+        _finishSlot(target, MQTT_MSG_DROPPED);
+    }
+    
+    MqttQueueSlot& slot = _queue[target];
+    slot.used = true;
+    slot.binary = binary;
+    slot.journaled = journaled;
+    slot.replayed = false;
+    slot.spill = false;
+    slot.priority = priority;
+    slot.attempts = 0;
+    slot.id = _nextMessageId++;
+    slot.enqueuedMs = millis();
+    slot.retryAfterMs = 0;
+    slot.ttlMs = MQTT_TTL_MS[min((int)priority, (int)MQTT_PRIO_BACKLOG)];
+    strlcpy(slot.topic, topic, sizeof(slot.topic));
+    uint8_t* dst = _queuePool + target * MQTT_QUEUE_SLOT_BYTES;
+    if (journaled) {
+        length = injectMessageId(dst, MQTT_QUEUE_SLOT_BYTES - 1, payload, length, binary, slot.id);
+    } else {
+        memcpy(dst, payload, length);
+    }
+    slot.length = length;
+    dst[length] = '\0'; // Metin payload'lar doğrudan C string olarak gönderilir
+    
+    if (journaled) {
+        // Teslim sözü ancak flash'a yazılınca verilir - yazılamazsa çağıran yerinde tutar
+        _journal.stage(target);
+        if (!_journal.flush(_queue, _queuePool, MQTT_QUEUE_SLOT_BYTES, _nextMessageId)) {
+            Serial.printf("[MQTT-Q] Journal write failed - rejected prio %d message to %s\n", priority, topic);
+            _journal.release(target);
+            slot.used = false;
+            return 0;
+        }
+    }
+    
+    Serial.printf("[MQTT-Q] Queued #%lu prio=%d %u bytes%s (depth %d)\n", 
+                 slot.id, priority, (unsigned)length, journaled ? " [journal]" : "", getQueueDepth());
+    return slot.id;
+}
+
+void MQTTManager::_finishSlot(uint8_t index, MqttMsgState state) {
+    MqttQueueSlot& slot = _queue[index];
+    
+    // Teslim edilemeyen advData delta zincirini kırar - sonraki periyot keyframe
+    if (state != MQTT_MSG_SENT && slot.priority == MQTT_PRIO_DATA) {
+        _forceKeyframe = true;
+    }
+    
+    _recentIds[_recentHead] = slot.id;
+    _recentStates[_recentHead] = state;
+    _recentHead = (_recentHead + 1) % 8;
+    if (slot.journaled) {
+        _journal.release(index); // Flash kaydı sonraki toplu flush'ta silinir
+    }
+    if (slot.spill) {
+        // Teslim edilemeyen periyot kaybolmaz - FIFO'dan backlog olarak gider
+        if (state != MQTT_MSG_SENT && _spillFn) {
+            Serial.printf("[MQTT-Q] Message #%lu handed off to offline FIFO\n", slot.id);
+            _spillFn(_spillPool[index]);
+        }
+        slot.spill = false;
+    }
+    slot.used = false;
+}
+
+void MQTTManager::_processQueue() {
+    uint32_t now = millis();
+    
+    // Token bucket dolumu
+    if (_rateLastMs != 0) {
+        _rateTokens += (now - _rateLastMs) * (MQTT_RATE_BYTES_PER_S / 1000.0f);
+        if (_rateTokens > MQTT_RATE_BURST_BYTES) _rateTokens = MQTT_RATE_BURST_BYTES;
+    }
+    _rateLastMs = now;
+    
+    // Yaşı geçenleri düşür, en öncelikli (eşitse en eski) mesajı seç
+    // Journal'lı alarmlar yaşlanmaz - PUBACK alınana veya yer açmak için düşürülene kadar
+    // kalır; yaşlanan advData FIFO'ya devredilir
+    int best = -1;
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        if (!_queue[i].used) continue;
+        bool ages = !_queue[i].journaled || _queue[i].priority != MQTT_PRIO_ALARM;
+        if (ages && now - _queue[i].enqueuedMs >= _queue[i].ttlMs) {
+            Serial.printf("[MQTT-Q] Message #%lu expired\n", _queue[i].id);
+            _finishSlot(i, MQTT_MSG_EXPIRED);
+            continue;
+        }
+        // Geri çekilmedeki slot diğerlerini bekletmez
+        if (_queue[i].retryAfterMs != 0 && (int32_t)(now - _queue[i].retryAfterMs) < 0) continue;
+        if (best < 0 || _queue[i].priority < _queue[best].priority ||
+            (_queue[i].priority == _queue[best].priority && 
+             (int32_t)(_queue[i].enqueuedMs - _queue[best].enqueuedMs) < 0)) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        // Kuyruk boşaldı - teslim edilenlerin flash kayıtlarını tek oturumda sil
+        if (getQueueDepth() == 0 && _journal.hasPendingErase()) {
+            _journal.flush(_queue, _queuePool, MQTT_QUEUE_SLOT_BYTES, _nextMessageId);
+        }
+        return;
+    }
+    if (!isConnected()) return;
+    
+    MqttQueueSlot& slot = _queue[best];
+    slot.retryAfterMs = 0;
+    
+    // Alarmlar hız limitine takılmaz; diğerleri için token yeterli olmalı
+    float cost = min((float)slot.length, MQTT_RATE_BURST_BYTES);
+    if (slot.priority != MQTT_PRIO_ALARM && _rateTokens < cost) return;
+    
+    // Loop başına tek mesaj - uzun backlog arasında alarm bir sonraki turda gider
+    const uint8_t* payload = _queuePool + best * MQTT_QUEUE_SLOT_BYTES;
+    uint8_t qos = slot.journaled ? 1 : 0;
+    bool dup = slot.journaled && (slot.replayed || slot.attempts > 0);
+    bool ok = slot.binary ? publishRaw(slot.topic, payload, slot.length, qos, dup)
+                          : publishRaw(slot.topic, (const char*)payload, qos, dup);
+    _rateTokens -= cost;
+    slot.attempts++;
+    
+    if (ok) {
+        Serial.printf("[MQTT-Q] Sent #%lu (waited %lu ms)\n", slot.id, now - slot.enqueuedMs);
+        _finishSlot(best, MQTT_MSG_SENT);
+    } else if (slot.journaled) {
+        // Teslim doğrulanamadı - mesaj journal'da kalır, sadece bu slot geri çekilir
+        // (ardışık başarısızlıkta bekleme katlanır; alarmlar kısa aralıkla denenir)
+        uint32_t backoff = MQTT_ALARM_RETRY_MS;
+        if (slot.priority != MQTT_PRIO_ALARM) {
+            backoff = MQTT_JOURNAL_RETRY_MS << min((int)slot.attempts - 1, 4);
+            if (backoff > MQTT_JOURNAL_RETRY_MAX_MS) backoff = MQTT_JOURNAL_RETRY_MAX_MS;
+        }
+        Serial.printf("[MQTT-Q] Message #%lu not acknowledged (attempt %d) - retry in %lu ms\n",
+                     slot.id, slot.attempts, (unsigned long)backoff);
+        slot.retryAfterMs = now + backoff;
+        if (slot.retryAfterMs == 0) slot.retryAfterMs = 1;
+    } else if (slot.attempts >= MQTT_MAX_ATTEMPTS) {
+        Serial.printf("[MQTT-Q] Message #%lu failed after %d attempts\n", slot.id, slot.attempts);
+        _finishSlot(best, MQTT_MSG_FAILED);
+    }
+}
+
+void MQTTManager::_clearRetryBackoff() {
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        _queue[i].retryAfterMs = 0;
+    }
+}
+
+uint8_t MQTTManager::getQueueDepth() {
+    uint8_t depth = 0;
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        if (_queue[i].used) depth++;
+    }
+    return depth;
+}
+
+MqttMsgState MQTTManager::getMessageState(uint32_t id) {
+    for (uint8_t i = 0; i < MQTT_QUEUE_SLOTS; i++) {
+        if (_queue[i].used && _queue[i].id == id) return MQTT_MSG_QUEUED;
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        if (_recentIds[i] == id) return _recentStates[i];
+    }
+    return MQTT_MSG_UNKNOWN;
+}
@@ -4,10 +4,58 @@
 #include <Arduino.h>
 #include <PubSubClient.h>
 #include <WiFi.h>
+#include <ArduinoJson.h>
 #include "ConfigManager.h"
+#include "TelemetryEncoder.h"
+#include "JsonArena.h"
+#include "MessageJournal.h"
+#include "BacklogCodec.h"
 
 // Forward declaration
 class C16QS4GManager;
+class AlarmManager;
+
+// Giden mesaj öncelikleri (küçük = önce gönderilir)
+enum MqttPriority : uint8_t {
+    MQTT_PRIO_ALARM = 0,    // Alarm + varlık olayları (hız limiti dışı)
+    MQTT_PRIO_DATA,         // advData / tagDict
+    MQTT_PRIO_INFO,         // Info
+    MQTT_PRIO_BACKLOG       // Çevrimdışı FIFO parçaları
+};
+
+// Mesaj teslim durumu (getMessageState)
+enum MqttMsgState : uint8_t {
+    MQTT_MSG_UNKNOWN = 0,   // ID bilinmiyor (çok eski)
+    MQTT_MSG_QUEUED,
+    MQTT_MSG_SENT,
+    MQTT_MSG_FAILED,        // Deneme hakkı bitti
+    MQTT_MSG_EXPIRED,       // Yaş limiti aşıldı
+    MQTT_MSG_DROPPED        // Kuyruk dolu - daha öncelikli mesaja yer açıldı
+};
+
+// Giden kuyruk boyutları
+#define MQTT_QUEUE_SLOTS        6       // Sabit slot sayısı
+#define MQTT_QUEUE_SLOT_BYTES   4096    // Slot başına payload (advData JSON sığar)
+
+// Kuyruktan teslim edilmeden çıkan advData periyodunu çevrimdışı FIFO'ya devreder
+typedef void (*MqttSpillFn)(const OfflineCycle& cycle);
+
+// Kuyruk slotu - payload sabit havuzda (_queuePool)
+struct MqttQueueSlot {
+    bool used;
+    bool binary;
+    bool journaled;         // QoS 1 + flash journal (PUBACK'e kadar silinmez)
+    bool replayed;          // Journal'dan geri yüklendi (DUP bayrağı)
+    bool spill;             // Düşer/yaşlanırsa _spillPool'daki periyot FIFO'ya devredilir
+    uint8_t priority;
+    uint8_t attempts;
+    uint32_t id;
+    uint32_t enqueuedMs;
+    uint32_t retryAfterMs;  // Teslim doğrulanamadı - slot bu ana kadar bekler (0 = hemen)
+    uint32_t ttlMs;
+    uint16_t length;
+    char topic[64];
+};
 
 class MQTTManager {
 public:
@@ -18,20 +66,47 @@ public:
     bool isConnected();
     void loop();
     void disconnect();
+    // Broker/kimlik değiştiyse yeni broker'a bağlanmayı dener; ulaşılamazsa eski ayarlara
+    // dönüp yeniden bağlanır ve false döner (ConfigApplier hook'u)
+    bool applyBrokerConfig(const Cfg& config);
     
     // Publish functions
     bool publishData(const char* macAddr, float temp, int battPct, int rssi, uint32_t epoch, 
                      const char* sensorName, const char* mahalId);
     bool publishDataWithGPS(const char* macAddr, float temp, int battPct, int rssi, uint32_t epoch, 
                             bool sensorOK, float latitude, float longitude);
-    bool publishRaw(const char* topic, const char* payload); // For BLE tags
-    bool publishDataArray(const char* macAddr, const OfflineDataRecord* records, int count,
-                         const char* sensorName, const char* mahalId);
+    bool publishRaw(const char* topic, const char* payload, uint8_t qos = 0, bool dup = false); // For BLE tags
+    bool publishRaw(const char* topic, const uint8_t* payload, size_t length, 
+                    uint8_t qos = 0, bool dup = false); // İkili payload
+    // advData (JSON ve/veya CBOR; biri kuyruğa girdiyse true). spill verilirse mesaj
+    // teslim edilmeden kuyruktan çıktığında periyot setSpillHandler'a devredilir
+    bool publishCycle(const CycleSnapshot& snap, uint8_t format, const OfflineCycle* spill = nullptr);
+    void setSpillHandler(MqttSpillFn fn) { _spillFn = fn; }
+    void setKeyframeInterval(uint8_t cycles); // 0 = her periyot tam mesaj (delta kapalı)
+    void requestKeyframe() { _forceKeyframe = true; } // Backend durumu yeniden kurmak istediğinde
+    
+    // Giden öncelik kuyruğu - publish* fonksiyonları kuyruğa ekler, loop() gönderir
+    uint32_t enqueue(const char* topic, const uint8_t* payload, size_t length, uint8_t priority,
+                     bool binary = false); // Mesaj ID'si döner (0 = eklenemedi)
+    uint8_t getQueueDepth();
+    uint8_t getQueueFreeSlots() { return MQTT_QUEUE_SLOTS - getQueueDepth(); }
+    MqttMsgState getMessageState(uint32_t id);
+    // Çevrimdışı periyot kaydını advData olarak kuyrukla (tag isimleri ble config'inden).
+    // Mesaj ID'si döner (teslim getMessageState ile izlenir, 0 = eklenemedi)
+    uint32_t publishBacklogCycle(const char* macAddr, const OfflineCycle& cycle,
+                                 const char* sensorName, const char* mahalId, BLEManager* ble);
+    // Çok periyotlu bloğu LZ ile sıkıştırılmış tek ikili mesaj olarak kuyrukla (KUTARIoT/backlog)
+    uint32_t publishBacklogBlock(const char* macAddr, const OfflineBlock& block,
+                                 const char* sensorName, const char* mahalId);
     bool publishInfo(const char* macAddr, const char* fwVersion, uint32_t uptime, 
                      uint32_t heap, uint32_t epoch, int wifiRssi, const Cfg& cfg, 
-                     const PowerStatus& power, bool sensorOK = true);
+                     const PowerStatus& power, bool sensorOK = true,
+                     AlarmManager* alarms = nullptr); // alarms: soğuk zincir uygunluk özeti
     bool publishAlarm(const char* macAddr, uint8_t alarmState, const char* reason, 
-                      float temp, int battPct);
+                      float temp, int battPct, const char* sensorMac = nullptr, 
+                      const char* sensorName = nullptr); // sensorMac: BLE tag alarmları için
+    bool publishPresence(const char* macAddr, const char* sensorMac, bool present, 
+                         int rssi, uint32_t epoch); // BLE tag giriş/çıkış olayı
     bool publishError(const char* macAddr, const char* errorMsg);
     
     // Topic getters
@@ -40,6 +115,11 @@ public:
     String getInfoTopic(const char* macAddr);
     String getAlarmTopic(const char* macAddr);
     String getErrorTopic(const char* macAddr);
+    String getEventTopic(const char* macAddr);
+    String getBinaryDataTopic(const char* macAddr);
+    String getDiagTopic(const char* macAddr);       // Diagnostik (Diagnostics, CBOR)
+    String getBacklogTopic(const char* macAddr);    // Sıkıştırılmış backlog blokları (BacklogCodec)
+    MessageJournal& getJournal() { return _journal; }
     String getUpdateTopic() { return "KUTARIoT/update"; }
     
 private:
@@ -54,6 +134,44 @@ private:
     char _mqttUser[32];
     char _mqttPass[64];
     
+    // İkili telemetri: sözlük değişince isim/mahal listesi JSON olarak bir kez gönderilir
+    uint32_t _sentDictId;
+    bool _dictSent;
+    
+    // advData keyframe/delta: son yayınlanan tam periyot bir sonraki farkın tabanıdır
+    uint32_t _cycleSeq;           // Her periyotta artar (backend boşlukları algılar)
+    uint32_t _baseSeq;            // _prevCycleDoc'un seq'i
+    uint8_t _keyframeEvery;       // N periyotta bir keyframe
+    uint8_t _cyclesSinceKeyframe;
+    bool _forceKeyframe;          // Boot / yeniden bağlantı / başarısız publish sonrası
+    bool _hasPrevCycle;
+    ArenaJsonDocument* _curCycleDoc;
+    ArenaJsonDocument* _prevCycleDoc;
+    
+    // Giden kuyruk
+    MqttQueueSlot _queue[MQTT_QUEUE_SLOTS];
+    uint8_t* _queuePool;          // MQTT_QUEUE_SLOTS * MQTT_QUEUE_SLOT_BYTES
+    OfflineCycle* _spillPool;     // Slot başına periyot kopyası (spill bayraklı slotlar)
+    MqttSpillFn _spillFn;
+    uint32_t _nextMessageId;
+    float _rateTokens;            // Token bucket (byte)
+    uint32_t _rateLastMs;
+    uint32_t _recentIds[8];       // Son sonuçlanan mesajlar (durum sorgusu için)
+    MqttMsgState _recentStates[8];
+    uint8_t _recentHead;
+    MessageJournal _journal;      // Alarmlar için at-least-once
+    
+    void _processQueue();
+    void _finishSlot(uint8_t index, MqttMsgState state);
+    void _clearRetryBackoff();
+    
+    void _buildCycleJson(const CycleSnapshot& snap, JsonDocument& doc);
+    uint32_t _publishCycleJson(const CycleSnapshot& snap, size_t& payloadLen); // Mesaj ID'si (0 = eklenemedi)
+    void _attachSpill(uint32_t id, const OfflineCycle& cycle);
+    bool _diffObject(JsonObjectConst cur, JsonObjectConst prev, JsonObject out);
+    bool _diffSensors(JsonArrayConst cur, JsonArrayConst prev, JsonArray out);
+    bool _publishTagDictionary(const CycleSnapshot& snap);
+    
     // Default değerler (Cfg verilmezse kullanılır)
     static const char* DEFAULT_MQTT_HOST;
     static const int DEFAULT_MQTT_PORT;
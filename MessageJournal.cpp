@@ -0,0 +1,154 @@
+#include "MessageJournal.h"
+#include "MQTTManager.h"
+
+static const uint16_t JOURNAL_MAGIC = 0x4A31; // "J1"
+
+// Flash'taki slot başlığı (payload ayrı anahtarda)
+struct JournalHeader {
+    uint16_t magic;
+    uint8_t priority;
+    uint8_t binary;
+    uint32_t mid;
+    uint16_t length;
+    char topic[64];
+};
+
+MessageJournal::MessageJournal()
+    : _pendingWrite(0), _pendingErase(0), _onFlash(0), _storedNextMid(1),
+      _flushCount(0), _writeCount(0) {
+}
+
+bool MessageJournal::begin() {
+    if (!_prefs.begin("journal", true)) {
+        // Namespace henüz yok - ilk açılış
+        _storedNextMid = 1;
+        return true;
+    }
+    _storedNextMid = _prefs.getUInt("mid", 1);
+    _prefs.end();
+    return true;
+}
+
+void MessageJournal::stage(uint8_t slot) {
+    _pendingWrite |= (1 << slot);
+    _pendingErase &= ~(1 << slot); // Aynı anahtarların üzerine yazılacak
+}
+
+void MessageJournal::release(uint8_t slot) {
+    _pendingWrite &= ~(1 << slot);
+    if (_onFlash & (1 << slot)) {
+        _pendingErase |= (1 << slot);
+    }
+}
+
+bool MessageJournal::flush(const MqttQueueSlot* slots, const uint8_t* pool, size_t slotBytes, uint32_t nextMid) {
+    if (_pendingWrite == 0 && _pendingErase == 0) return true;
+
+    if (!_prefs.begin("journal", false)) {
+        Serial.println("[JOURNAL] NVS open failed");
+        return false;
+    }
+
+    bool ok = true;
+    char key[4];
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t bit = (1 << i);
+        key[1] = '0' + i;
+        key[2] = '\0';
+
+        if (_pendingErase & bit) {
+            key[0] = 'h';
+            _prefs.remove(key);
+            key[0] = 'p';
+            _prefs.remove(key);
+            _onFlash &= ~bit;
+        }
+
+        if (_pendingWrite & bit) {
+            const MqttQueueSlot& slot = slots[i];
+            JournalHeader header;
+            memset(&header, 0, sizeof(header));
+            header.magic = JOURNAL_MAGIC;
+            header.priority = slot.priority;
+            header.binary = slot.binary;
+            header.mid = slot.id;
+            header.length = slot.length;
+            strlcpy(header.topic, slot.topic, sizeof(header.topic));
+
+            // Önce payload, sonra başlık - yarım yazılmış kayıt açılışta başlıksız kalır
+            key[0] = 'p';
+            bool written = _prefs.putBytes(key, pool + i * slotBytes, slot.length) == slot.length;
+            if (written) {
+                key[0] = 'h';
+                written = _prefs.putBytes(key, &header, sizeof(header)) == sizeof(header);
+            }
+            if (!written) {
+                Serial.printf("[JOURNAL] Write failed for mid=%lu (%u bytes)\n",
+                             (unsigned long)slot.id, slot.length);
+                key[0] = 'h';
+                _prefs.remove(key);
+                key[0] = 'p';
+                _prefs.remove(key);
+                _onFlash &= ~bit;
+                ok = false;
+                continue;
+            }
+            _onFlash |= bit;
+            _writeCount++;
+        }
+    }
+
+    // Tekrar açılışta mid çakışmasın
+    if (nextMid != _storedNextMid) {
+        _prefs.putUInt("mid", nextMid);
+        _storedNextMid = nextMid;
+    }
+    _prefs.end();
+
+    _flushCount++;
+    Serial.printf("[JOURNAL] Flush #%lu: wrote 0x%02X, erased 0x%02X\n",
+                 (unsigned long)_flushCount, _pendingWrite, _pendingErase);
+    _pendingWrite = 0;
+    _pendingErase = 0;
+    return ok;
+}
+
+uint8_t MessageJournal::load(MqttQueueSlot* slots, uint8_t* pool, size_t slotBytes, uint8_t slotCount) {
+    if (!_prefs.begin("journal", true)) return 0;
+
+    uint8_t loaded = 0;
+    char key[4];
+    for (uint8_t i = 0; i < slotCount && i < 8; i++) {
+        key[1] = '0' + i;
+        key[2] = '\0';
+
+        JournalHeader header;
+        key[0] = 'h';
+        if (_prefs.getBytes(key, &header, sizeof(header)) != sizeof(header)) continue;
+        if (header.magic != JOURNAL_MAGIC || header.length >= slotBytes) continue;
+
+        key[0] = 'p';
+        uint8_t* dst = pool + i * slotBytes;
+        if (_prefs.getBytes(key, dst, header.length) != header.length) continue;
+        dst[header.length] = '\0';
+
+        MqttQueueSlot& slot = slots[i];
+        memset(&slot, 0, sizeof(slot));
+        slot.used = true;
+        slot.journaled = true;
+        slot.replayed = true; // DUP bayrağı ile gönderilir
+        slot.binary = header.binary;
+        slot.priority = header.priority;
+        slot.id = header.mid;
+        slot.enqueuedMs = millis();
+        slot.length = header.length;
+        strlcpy(slot.topic, header.topic, sizeof(slot.topic));
+
+        _onFlash |= (1 << i);
+        loaded++;
+        Serial.printf("[JOURNAL] Restored mid=%lu (%u bytes) -> %s\n",
+                     (unsigned long)header.mid, header.length, header.topic);
+    }
+    _prefs.end();
+    return loaded;
+}
@@ -0,0 +1,44 @@
+#ifndef MESSAGE_JOURNAL_H
+#define MESSAGE_JOURNAL_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+struct MqttQueueSlot;
+
+// En az bir kez teslim (at-least-once) için giden kuyruk journal'ı (NVS "journal")
+// Kuyruk slotu i -> "h<i>" (başlık) + "p<i>" (payload). Sadece alarmlar yazılır
+// (seyrek ve küçük); advData her periyot NVS'e yazılırsa flash'ı aşındırır - onun
+// teslimi FIFO devri ile korunur. Silmeler RAM'de işaretlenir, kuyruk boşalınca
+// tek NVS oturumunda toplu uygulanır.
+class MessageJournal {
+public:
+    MessageJournal();
+    bool begin();
+
+    void stage(uint8_t slot);    // Slot gönderilmeden önce flash'a yazılmalı
+    void release(uint8_t slot);  // Slot teslim edildi/düştü - flash kaydı silinebilir
+    bool hasPendingErase() { return _pendingErase != 0; }
+
+    // Bekleyen tüm yazma/silmeleri tek oturumda uygula. Bir kayıt yazılamazsa
+    // (NVS dolu/açılamadı) yarım anahtarları siler ve false döner - o slot flash'ta değildir
+    bool flush(const MqttQueueSlot* slots, const uint8_t* pool, size_t slotBytes, uint32_t nextMid);
+
+    // Açılışta teslim edilmemiş kayıtları kuyruğa geri yükle; yüklenen sayı döner
+    uint8_t load(MqttQueueSlot* slots, uint8_t* pool, size_t slotBytes, uint8_t slotCount);
+    uint32_t getStoredNextMid() { return _storedNextMid; }
+
+    uint32_t getFlushCount() { return _flushCount; }   // NVS oturum sayısı (aşınma göstergesi)
+    uint32_t getWriteCount() { return _writeCount; }   // Yazılan kayıt sayısı
+
+private:
+    Preferences _prefs;
+    uint8_t _pendingWrite;   // Slot bit maskesi
+    uint8_t _pendingErase;
+    uint8_t _onFlash;        // Flash'ta kaydı olan slotlar
+    uint32_t _storedNextMid;
+    uint32_t _flushCount;
+    uint32_t _writeCount;
+};
+
+#endif
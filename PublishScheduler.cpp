@@ -0,0 +1,119 @@
+#include "PublishScheduler.h"
+#include <sys/time.h>
+
+// Bu tarihten önceki saat senkronize sayılmaz (millis tabanlı zamanlamaya düş)
+static const time_t PUB_MIN_VALID_EPOCH = 1700000000;
+
+PublishScheduler::PublishScheduler() : _macHash(0) {
+    memset(_timing, 0, sizeof(_timing));
+    memset(_nextDueMs, 0, sizeof(_nextDueMs));
+    memset(_scheduled, 0, sizeof(_scheduled));
+    memset(_forced, 0, sizeof(_forced));
+}
+
+void PublishScheduler::begin(const char* macAddr) {
+    // FNV-1a - cihaz başına sabit jitter
+    _macHash = 2166136261UL;
+    for (const char* p = macAddr; *p; p++) {
+        _macHash ^= (uint8_t)*p;
+        _macHash *= 16777619UL;
+    }
+}
+
+void PublishScheduler::applyConfig(const Cfg& cfg) {
+    uint32_t periods[PUB_CLASS_COUNT] = {
+        cfg.dataPeriod, cfg.infoPeriod, cfg.publish.backlogPeriod,
+        cfg.publish.alarmPeriod, cfg.publish.diagPeriod
+    };
+
+    for (uint8_t i = 0; i < PUB_CLASS_COUNT; i++) {
+        bool changed = (_timing[i].periodMs != periods[i] || _timing[i].jitterMs != cfg.publish.jitterMs[i]);
+        _timing[i].periodMs = periods[i];
+        _timing[i].priority = cfg.publish.priority[i];
+        _timing[i].jitterMs = cfg.publish.jitterMs[i];
+
+        // Periyot değiştiyse bir sonraki deadline yeni hizaya göre hesaplanır;
+        // kapatılan sınıf yeniden açıldığında ilk kontrolde due olur
+        if (_timing[i].periodMs == 0) {
+            _scheduled[i] = false;
+        } else if (changed && _scheduled[i]) {
+            _nextDueMs[i] = millis() + _delayToNextSlot((PublishClass)i);
+        }
+        Serial.printf("[SCHED] %-7s period=%lu ms prio=%d jitter=%lu ms\n", className((PublishClass)i),
+                     _timing[i].periodMs, _timing[i].priority, _timing[i].jitterMs);
+    }
+}
+
+uint32_t PublishScheduler::_jitterOffset(PublishClass cls) {
+    uint32_t period = _timing[cls].periodMs;
+    uint32_t jitter = _timing[cls].jitterMs;
+    if (jitter == 0 || period <= 1) return 0;
+    if (jitter >= period) jitter = period - 1;
+    // Sınıf başına farklı ofset (aynı cihazın sınıfları da üst üste binmez)
+    uint32_t h = (_macHash ^ (cls * 0x9E3779B9UL)) * 16777619UL;
+    return h % (jitter + 1);
+}
+
+uint32_t PublishScheduler::_delayToNextSlot(PublishClass cls) {
+    uint32_t period = _timing[cls].periodMs;
+    if (period == 0) return UINT32_MAX; // Sınıf kapalı - isDue zaten false döner
+    uint32_t offset = _jitterOffset(cls);
+
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    if (tv.tv_sec < PUB_MIN_VALID_EPOCH) {
+        return period; // Saat yok - periyot sayacı
+    }
+
+    // Duvar saati hizası: sonraki (k * periyot + ofset) anı
+    uint64_t epochMs = (uint64_t)tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+    uint64_t shifted = epochMs - offset;
+    uint64_t next = (shifted / period + 1) * period + offset;
+    uint32_t delay = (uint32_t)(next - epochMs);
+
+    // Çok yakın slot (ör. ilk hizalama) - bir sonrakine atla
+    if (delay < period / 4) delay += period;
+    return delay;
+}
+
+bool PublishScheduler::isDue(PublishClass cls, uint32_t nowMs) {
+    if (_timing[cls].periodMs == 0) return false; // Sınıf kapalı
+    if (_forced[cls] || !_scheduled[cls]) return true;
+    return (int32_t)(nowMs - _nextDueMs[cls]) >= 0;
+}
+
+void PublishScheduler::markDone(PublishClass cls, uint32_t nowMs) {
+    _forced[cls] = false;
+    if (_timing[cls].periodMs == 0) return;
+    _nextDueMs[cls] = nowMs + _delayToNextSlot(cls);
+    _scheduled[cls] = true;
+}
+
+int PublishScheduler::nextDue(uint32_t nowMs, uint8_t mask) {
+    int best = -1;
+    for (uint8_t i = 0; i < PUB_CLASS_COUNT; i++) {
+        if (!(mask & (1 << i))) continue;
+        if (!isDue((PublishClass)i, nowMs)) continue;
+        if (best < 0 || _timing[i].priority < _timing[best].priority) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+uint32_t PublishScheduler::msUntilDue(PublishClass cls, uint32_t nowMs) {
+    if (isDue(cls, nowMs)) return 0;
+    if (_timing[cls].periodMs == 0) return UINT32_MAX;
+    return _nextDueMs[cls] - nowMs;
+}
+
+const char* PublishScheduler::className(PublishClass cls) {
+    switch (cls) {
+        case PUB_DATA:    return "data";
+        case PUB_INFO:    return "info";
+        case PUB_BACKLOG: return "backlog";
+        case PUB_ALARM:   return "alarm";
+        case PUB_DIAG:    return "diag";
+        default:          return "?";
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PUBLISH_SCHEDULER_H
+#define PUBLISH_SCHEDULER_H
+
+#include <Arduino.h>
+#include "ConfigManager.h"
+
+// Mesaj sınıfları (Cfg.publish dizileri bu sırayı kullanır)
+enum PublishClass : uint8_t {
+    PUB_DATA = 0,     // advData periyodu (toplama penceresi başlangıcı)
+    PUB_INFO,         // Info mesajı (IMEI/CSQ AT sorguları içerir)
+    PUB_BACKLOG,      // Çevrimdışı FIFO boşaltma
+    PUB_ALARM,        // Alarm/varlık olaylarının servis aralığı
+    PUB_DIAG,         // Diagnostik mesajı
+    PUB_CLASS_COUNT
+};
+
+// Sınıf başına zamanlama: periyot (0 = kapalı), öncelik (0 = en yüksek), jitter
+struct PublishClassTiming {
+    uint32_t periodMs;
+    uint8_t priority;
+    uint32_t jitterMs;
+};
+
+// Mesaj sınıfı zamanlayıcısı
+// Saat senkronize ise deadline'lar duvar saatine hizalanır (epoch % periyot),
+// cihaz başına sabit jitter MAC'ten türetilir - filo aynı saniyede yayın yapmaz.
+class PublishScheduler {
+public:
+    PublishScheduler();
+    void begin(const char* macAddr);
+    void applyConfig(const Cfg& cfg); // set komutu sonrası yeniden başlatmadan uygulanır
+
+    bool isDue(PublishClass cls, uint32_t nowMs);
+    void markDone(PublishClass cls, uint32_t nowMs); // Sonraki deadline'ı hesapla
+    void trigger(PublishClass cls) { _forced[cls] = true; } // Sonraki kontrolde hemen due
+    int nextDue(uint32_t nowMs, uint8_t mask = 0xFF); // Due olan en öncelikli sınıf (-1 = yok)
+    uint32_t msUntilDue(PublishClass cls, uint32_t nowMs);
+
+    uint32_t getPeriod(PublishClass cls) { return _timing[cls].periodMs; }
+    const char* className(PublishClass cls);
+
+private:
+    PublishClassTiming _timing[PUB_CLASS_COUNT];
+    uint32_t _nextDueMs[PUB_CLASS_COUNT];
+    bool _scheduled[PUB_CLASS_COUNT];  // Deadline hesaplandı mı
+    bool _forced[PUB_CLASS_COUNT];
+    uint32_t _macHash;
+
+    uint32_t _jitterOffset(PublishClass cls);
+    uint32_t _delayToNextSlot(PublishClass cls);
+};
+
+#endif
@@ -23,28 +23,32 @@
 
 // Proje Modülleri
 #include "hardware.h"
-#include "ExternalSensor.h"  // Harici sensör (T117 veya AHT20)
+#include "ExternalSensor.h"  // Harici I2C sensörler (T117, AHT20, SHT4x, TMP117)
 #include "LCD_ST7789.h"
 #include "ConfigManager.h"
 #include "NetworkManager.h"
 #include "C16QS4GManager.h"
 #include "MQTTManager.h"
+#include "JsonArena.h"
 #include "PowerManager.h"
 #include "BuzzerManager.h"
 #include "AlarmManager.h"
 #include "OTAUpdate.h"
 #include "GPSManager.h"  // GPS modülü (oluşturulacak)
 #include "BLEManager.h"  // BLE Eddystone tarayıcı (oluşturulacak)
+#include "PublishScheduler.h"  // Mesaj sınıfı zamanlayıcısı
+#include "BacklogCodec.h"      // Çevrimdışı periyot kayıtları
+#include "ConfigApplier.h"     // Config apply hook'ları
+#include "Diagnostics.h"       // Saha profilleme sayaçları
 
 // ESP32 Sistem Kütüphaneleri
 #include "esp_mac.h"
 
 // ===== CONFIGURATION =====
 static const char* FW_VERSION = "1.0.0";
-static const uint32_t DATA_TX_INTERVAL_MS = 120000; // 2 dakika
 
 // ===== GLOBAL NESNELER =====
-ExternalSensor extSensor;  // Harici sensör (T117 veya AHT20 - otomatik algılama)
+ExternalSensor extSensor;  // Harici I2C sensörler (bus taraması ile otomatik algılama)
 ConfigManager configMgr;
 SmartTrackNetworkManager netMgr;  // 4G only
 MQTTManager mqttMgr;
@@ -53,276 +57,594 @@ BuzzerManager buzzerMgr;
 AlarmManager alarmMgr;
 GPSManager gpsMgr;  // GPS modülü
 BLEManager bleMgr;  // BLE Eddystone tarayıcı
+PublishScheduler pubSched;  // data/info/backlog/alarm/diag zamanlaması
+ConfigApplier cfgApplier;   // Yeniden başlatmadan config uygulama
 
 Cfg cfg;
 PowerStatus gPower;
 String macAddr;
 
 // Timing
-unsigned long lastDataTxTime = 0;
 unsigned long lastBLEDisplayChange = 0;
 uint8_t currentBLEDisplayIndex = 0;
 
-// 2 dakikalık periyot yönetimi
+// Veri periyodu yönetimi (cfg.dataPeriod)
 unsigned long cycleStartTime = 0;
 bool cycleActive = false;
 bool cycleDataReady = false;
 
-// ===== MQTT CALLBACK =====
-void mqttCallback(char* topic, byte* payload, unsigned int len) {
-    Serial.println("\n========== MQTT MESSAGE RECEIVED ==========");
-    Serial.printf("[MQTT] Topic: %s, Length: %d\n", topic, len);
+// ===== CONFIG APPLY HOOK'LARI =====
+// Sıra önemli: ucuz doğrulayan hook'lar (alarm, schedule) önce, broker en son denenir -
+// geçersiz bir config broker bağlantısını hiç koparmaz.
+// Her hook next'i devreye alır; reddederse kendi durumunu değiştirmemiş olmalı.
+
+bool applyBrokerHook(const Cfg& prev, const Cfg& next) {
+    return mqttMgr.applyBrokerConfig(next);
+}
+
+bool applyAlarmHook(const Cfg& prev, const Cfg& next) {
+    // Eşikler loop()'ta canlı cfg'den okunur - burada doğrulama; örnekleme aralığı sensöre aktarılır
+    if (next.tempLow >= next.tempHigh) {
+        Serial.printf("[CFG] tempLow (%.1f) must be below tempHigh (%.1f)\n", next.tempLow, next.tempHigh);
+        return false;
+    }
+    if (next.sensorSampleMs < 1000) {
+        Serial.printf("[CFG] sensorSampleMs %lu ms too short\n", next.sensorSampleMs);
+        return false;
+    }
+    extSensor.setSampleInterval(next.sensorSampleMs);
+    return true;
+}
+
+bool applyScheduleHook(const Cfg& prev, const Cfg& next) {
+    if (next.dataPeriod < 10000) {
+        Serial.printf("[CFG] dataPeriod %lu ms too short\n", next.dataPeriod);
+        return false;
+    }
+    // Alarm sınıfı kapatılamaz: aynı zamanlayıcı tag alarm/varlık değerlendirmesini ve
+    // soğuk zincir muhasebesini de sürer (loop adım 5)
+    if (next.publish.alarmPeriod == 0) {
+        Serial.println("[CFG] alarm period 0 rejected - alarm evaluation cannot be disabled");
+        return false;
+    }
+    // Periyot 0 = sınıf kapalı; açık sınıfta jitter periyottan kısa olmalı
+    const uint32_t periods[PUB_CLASS_COUNT] = {
+        next.dataPeriod, next.infoPeriod, next.publish.backlogPeriod,
+        next.publish.alarmPeriod, next.publish.diagPeriod
+    };
+    for (uint8_t i = 0; i < PUB_CLASS_COUNT; i++) {
+        if (periods[i] != 0 && periods[i] < 1000) {
+            Serial.printf("[CFG] %s period %lu ms too short\n", pubSched.className((PublishClass)i), periods[i]);
+            return false;
+        }
+        if (periods[i] != 0 && next.publish.jitterMs[i] >= periods[i]) {
+            Serial.printf("[CFG] %s jitter %lu ms >= period\n", pubSched.className((PublishClass)i), next.publish.jitterMs[i]);
+            return false;
+        }
+    }
+    pubSched.applyConfig(next);
+    mqttMgr.setKeyframeInterval(next.keyframeEvery);
+    return true;
+}
+
+bool applyBleHook(const Cfg& prev, const Cfg& next) {
+    // Tag listesi değiştiyse tam yeniden yükleme (tag durumu sıfırlanır), yoksa sadece beacon ayarları
+    if (prev.activeSensorCount != next.activeSensorCount ||
+        memcmp(prev.eddystoneSensors, next.eddystoneSensors, sizeof(next.eddystoneSensors)) != 0) {
+        // Tarama callback'i (BT task) tag tablolarını okurken yeniden yüklenmesin;
+        // pencere bir sonraki scan() çağrısında yeniden açılır
+        bleMgr.pauseScan();
+        bleMgr.loadConfigFromCfg(next);
+    } else {
+        bleMgr.applyBeaconSettings(next.beacon);
+    }
+    return true;
+}
+
+// Bekleyen config'i uygula; sonuç info (başarı) veya error (ret) ile bildirilir
+void serviceConfigApply() {
+    if (!cfgApplier.hasPending()) return;
+    if (cfgApplier.service(cfg, configMgr)) {
+        pubSched.trigger(PUB_INFO);
+    } else if (mqttMgr.isConnected()) {
+        String reason = String("config rejected by ") + cfgApplier.getLastFailure();
+        mqttMgr.publishError(macAddr.c_str(), reason.c_str());
+    }
+}
+
+// ===== DİAGNOSTİK =====
+static uint8_t s_diagBuffer[1024];
+
+// Diag snapshot'ını CBOR olarak diag topic'ine kuyrukla
+bool publishDiagnostics() {
+    DiagCounters counters;
+    counters.bleCallbacks = bleMgr.getCallbackCount();
+    counters.bleCallbackMaxUs = bleMgr.getCallbackMaxUs();
+    counters.bleTags = bleMgr.getScannedTagCount();
+    counters.cfgNvsWrites = configMgr.getNvsWriteCount();
+    counters.journalWrites = mqttMgr.getJournal().getWriteCount();
+    counters.journalFlushes = mqttMgr.getJournal().getFlushCount();
+    counters.queueDepth = mqttMgr.getQueueDepth();
+    counters.arenaPeak = JsonArena::getHighWater();
+    counters.pendingRecords = configMgr.getPendingCount();
+    counters.lastBatch = configMgr.getLastBatch();
+    counters.flashErases = configMgr.getLog().getEraseCount();
     
-    // Payload'ı yazdır (debug için)
-    if (len > 0) {
-        char payloadStr[len + 1];
-        memcpy(payloadStr, payload, len);
-        payloadStr[len] = '\0';
-        Serial.printf("[MQTT] Payload: %s\n", payloadStr);
+    size_t len = Diagnostics::encode(counters, s_diagBuffer, sizeof(s_diagBuffer));
+    if (len == 0) {
+        Serial.println("[DIAG] Encode failed");
+        return false;
     }
-    Serial.println("===========================================\n");
+    String topic = mqttMgr.getDiagTopic(macAddr.c_str());
+    Serial.printf("[DIAG] Queueing %u bytes to %s\n", (unsigned)len, topic.c_str());
+    return mqttMgr.enqueue(topic.c_str(), s_diagBuffer, len, MQTT_PRIO_INFO, true) != 0;
+}
 
-    String tpc(topic);
-    bool isCfgTopic = (tpc == mqttMgr.getConfigTopic(macAddr.c_str()));
-    bool isUpdateTopic = (tpc == mqttMgr.getUpdateTopic());
+// ===== MQTT KOMUTLARI =====
+// Her komut kendi parse filtresini tanımlar: payload'daki tanımsız alanlar belleğe
+// hiç alınmaz, doküman arena kapasitesiyle sınırlı kalır (payload boyutundan bağımsız).
 
-    if (!isCfgTopic && !isUpdateTopic) {
-        Serial.printf("[MQTT] Topic ignored. Expected: %s or %s\n",
-                     mqttMgr.getConfigTopic(macAddr.c_str()).c_str(),
-                     mqttMgr.getUpdateTopic().c_str());
-        return;
+// UPDATE (OTA)
+void cmdUpdateFilter(JsonDocument& filter) {
+    filter["url"] = true;
+}
+
+void cmdUpdate(JsonDocument& doc) {
+    Serial.println("[OTA] UPDATE command received");
+    const char* url = doc["url"] | cfg.otaUrl;
+    // OTA update logic here
+    // ...
+}
+
+// RESET
+void cmdReset(JsonDocument& doc) {
+    alarmMgr.save();
+    ESP.restart();
+}
+
+// FACTORY DEFAULT
+void cmdFactoryDefault(JsonDocument& doc) {
+    configMgr.resetToFactory(cfg);
+    ESP.restart();
+}
+
+// BUZZER SILENCE
+void cmdSilence(JsonDocument& doc) {
+    buzzerMgr.alarmStop();
+}
+
+// RESET EXCURSIONS - yeni sevkiyat/dönem: MKT ve excursion birikimi sıfırdan başlar
+void cmdResetExcursions(JsonDocument& doc) {
+    alarmMgr.reset();
+    pubSched.trigger(PUB_INFO);
+}
+
+// KEYFRAME - backend delta zincirini kaybettiğinde sonraki advData tam gönderilir
+void cmdKeyframe(JsonDocument& doc) {
+    mqttMgr.requestKeyframe();
+}
+
+// DIAG - {"cmd":"diag"} anlık snapshot, "reset": sayaçları sıfırla, "period": periyodik gönderim (ms, 0 = kapalı)
+void cmdDiagFilter(JsonDocument& filter) {
+    filter["reset"] = true;
+    filter["period"] = true;
+}
+
+void cmdDiag(JsonDocument& doc) {
+    if (doc.containsKey("period")) {
+        Cfg& next = cfgApplier.edit(cfg);
+        next.publish.diagPeriod = doc["period"];
+        // Kısa periyotta varsayılan jitter (60 s) doğrulamaya takılmasın
+        if (next.publish.jitterMs[PUB_DIAG] >= next.publish.diagPeriod) {
+            next.publish.jitterMs[PUB_DIAG] = next.publish.diagPeriod / 4;
+        }
+        cfgApplier.stage();
     }
+    publishDiagnostics();
+    if (doc["reset"] | false) {
+        Diagnostics::reset();
+    }
+}
 
-    char payloadStr[len + 1];
-    memcpy(payloadStr, payload, len);
-    payloadStr[len] = '\0';
-    Serial.printf("[CFG] Received JSON (original, %d bytes): %s\n", len, payloadStr);
+// SET - alanlar ConfigManager tablosundan doğrudan Cfg'ye uygulanır
+void cmdSetFilter(JsonDocument& filter) {
+    ConfigManager::buildSetFilter(filter);
+    filter["schedule"] = true;
+}
 
-    // JSON'u minify et (gereksiz boşlukları kaldır)
-    String minifiedJson = "";
-    bool inString = false;
-    bool escapeNext = false;
-    for (unsigned int i = 0; i < len; i++) {
-        char c = payloadStr[i];
+void cmdSet(JsonDocument& doc) {
+    Serial.println("[CFG] SET command received");
+    Cfg& next = cfgApplier.edit(cfg);
+    
+    for (JsonPairConst kv : doc.as<JsonObjectConst>()) {
+        const char* key = kv.key().c_str();
+        if (!strcmp(key, "schedule")) continue;
+        if (!ConfigManager::applyField(next, key, kv.value())) {
+            Serial.printf("[CFG] Invalid value for %s - ignored\n", key);
+        }
+    }
+    
+    // Mesaj sınıfı zamanlaması: {"schedule":{"info":{"period":..,"prio":..,"jitter":..}}}
+    if (doc.containsKey("schedule")) {
+        JsonObject schedule = doc["schedule"];
+        for (uint8_t i = 0; i < PUB_CLASS_COUNT; i++) {
+            const char* name = pubSched.className((PublishClass)i);
+            if (!schedule.containsKey(name)) continue;
+            JsonObject entry = schedule[name];
+            
+            if (entry.containsKey("period")) {
+                uint32_t period = entry["period"];
+                switch (i) {
+                    case PUB_DATA:    next.dataPeriod = period; break;
+                    case PUB_INFO:    next.infoPeriod = period; break;
+                    case PUB_BACKLOG: next.publish.backlogPeriod = period; break;
+                    case PUB_ALARM:   next.publish.alarmPeriod = period; break;
+                    case PUB_DIAG:    next.publish.diagPeriod = period; break;
+                }
+            }
+            if (entry.containsKey("prio")) {
+                next.publish.priority[i] = entry["prio"];
+            }
+            if (entry.containsKey("jitter")) {
+                next.publish.jitterMs[i] = entry["jitter"];
+            }
+        }
+    }
+    
+    // Alt sistemlere loop()'ta, callback dışında uygulanır (broker değişimi yeniden bağlanır)
+    cfgApplier.stage();
+}
+
+// SET EDDYSTONE CONFIGS
+void cmdSetEddystoneConfigsFilter(JsonDocument& filter) {
+    JsonObject sensor = filter["eddystoneSensors"].createNestedObject();
+    sensor["macAddress"] = true;
+    sensor["mahalId"] = true;
+    sensor["sensorName"] = true;
+    sensor["tempHigh"] = true;
+    sensor["tempLow"] = true;
+    sensor["buzzerEnabled"] = true;
+    sensor["enabled"] = true;
+}
+
+void cmdSetEddystoneConfigs(JsonDocument& doc) {
+    Serial.println("[CFG] setEddystoneConfigs command received");
+    
+    if (!doc.containsKey("eddystoneSensors")) {
+        Serial.println("[CFG] 'eddystoneSensors' array not found in payload.");
+        return;
+    }
+    
+    JsonArray sensorsArray = doc["eddystoneSensors"];
+    int count = sensorsArray.size();
+    if (count > 32) {
+        count = 32; // Max limit
+    }
+    
+    Cfg& next = cfgApplier.edit(cfg);
+    next.activeSensorCount = 0;
+    for (int i = 0; i < count; i++) {
+        JsonObject sensor = sensorsArray[i];
         
-        if (escapeNext) {
-            minifiedJson += c;
-            escapeNext = false;
-            continue;
+        if (sensor.containsKey("macAddress")) {
+            strlcpy(next.eddystoneSensors[next.activeSensorCount].macAddress, 
+                   sensor["macAddress"], 
+                   sizeof(next.eddystoneSensors[next.activeSensorCount].macAddress));
         }
         
-        if (c == '\\') {
-            escapeNext = true;
-            minifiedJson += c;
-            continue;
+        if (sensor.containsKey("mahalId")) {
+            strlcpy(next.eddystoneSensors[next.activeSensorCount].mahalId, 
+                   sensor["mahalId"], 
+                   sizeof(next.eddystoneSensors[next.activeSensorCount].mahalId));
         }
         
-        if (c == '"') {
-            inString = !inString;
-            minifiedJson += c;
-            continue;
+        if (sensor.containsKey("sensorName")) {
+            strlcpy(next.eddystoneSensors[next.activeSensorCount].sensorName, 
+                   sensor["sensorName"], 
+                   sizeof(next.eddystoneSensors[next.activeSensorCount].sensorName));
         }
         
-        if (inString) {
-            // String içindeyse tüm karakterleri koru
-            minifiedJson += c;
-        } else {
-            // String dışındayken gereksiz boşlukları kaldır
-            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
-                minifiedJson += c;
-            }
+        if (sensor.containsKey("tempHigh")) {
+            next.eddystoneSensors[next.activeSensorCount].tempHigh = sensor["tempHigh"];
+        }
+        
+        if (sensor.containsKey("tempLow")) {
+            next.eddystoneSensors[next.activeSensorCount].tempLow = sensor["tempLow"];
+        }
+        
+        if (sensor.containsKey("buzzerEnabled")) {
+            next.eddystoneSensors[next.activeSensorCount].buzzerEnabled = sensor["buzzerEnabled"];
+        }
+        
+        if (sensor.containsKey("enabled")) {
+            next.eddystoneSensors[next.activeSensorCount].enabled = sensor["enabled"];
         }
+        
+        next.activeSensorCount++;
     }
     
-    Serial.printf("[CFG] Minified JSON (%d bytes): %s\n", minifiedJson.length(), minifiedJson.c_str());
+    Serial.printf("[CFG] Staged %d Eddystone sensor configurations\n", next.activeSensorCount);
+    cfgApplier.stage();
+}
+
+typedef void (*CommandFilterFn)(JsonDocument& filter);
+typedef void (*CommandHandlerFn)(JsonDocument& doc);
+
+struct ConfigCommand {
+    const char* cmd;
+    bool anyTopic;              // Update topic'inden de kabul edilir
+    CommandFilterFn filter;     // nullptr: "cmd" dışında alan yok
+    CommandHandlerFn handler;
+};
+
+static const ConfigCommand CONFIG_COMMANDS[] = {
+    { "update",              true,  cmdUpdateFilter,              cmdUpdate },
+    { "reset",               false, nullptr,                      cmdReset },
+    { "factoryDefault",      false, nullptr,                      cmdFactoryDefault },
+    { "silence",             false, nullptr,                      cmdSilence },
+    { "keyframe",            false, nullptr,                      cmdKeyframe },
+    { "resetExcursions",     false, nullptr,                      cmdResetExcursions },
+    { "diag",                false, cmdDiagFilter,                cmdDiag },
+    { "set",                 false, cmdSetFilter,                 cmdSet },
+    { "setEddystoneConfigs", false, cmdSetEddystoneConfigsFilter, cmdSetEddystoneConfigs },
+};
+
+// ===== MQTT CALLBACK =====
+void mqttCallback(char* topic, byte* payload, unsigned int len) {
+    Serial.println("\n========== MQTT MESSAGE RECEIVED ==========");
+    Serial.printf("[MQTT] Topic: %s, Length: %d\n", topic, len);
+    Serial.printf("[MQTT] Payload: %.*s\n", (int)len, (const char*)payload);
+    Serial.println("===========================================\n");
 
-    DynamicJsonDocument doc(8192);
-    DeserializationError err = deserializeJson(doc, minifiedJson.c_str(), minifiedJson.length());
+    String tpc(topic);
+    bool isCfgTopic = (tpc == mqttMgr.getConfigTopic(macAddr.c_str()));
+    bool isUpdateTopic = (tpc == mqttMgr.getUpdateTopic());
+
+    if (!isCfgTopic && !isUpdateTopic) {
+        Serial.printf("[MQTT] Topic ignored. Expected: %s or %s\n",
+                     mqttMgr.getConfigTopic(macAddr.c_str()).c_str(),
+                     mqttMgr.getUpdateTopic().c_str());
+        return;
+    }
+
+    // Komut config'i düzenleyip kaydedebilir: ertelenmiş bölümler RAM'de olmalı
+    configMgr.loadDeferredSections(cfg);
+
+    // 1) Sadece "cmd" alanı - küçük sabit doküman, payload kopyalanmaz
+    StaticJsonDocument<16> cmdFilter;
+    cmdFilter["cmd"] = true;
+    StaticJsonDocument<96> head;
+    DeserializationError err = deserializeJson(head, (const char*)payload, len,
+                                               DeserializationOption::Filter(cmdFilter));
     if (err) {
         Serial.printf("[CFG] JSON parse error: %s\n", err.c_str());
         return;
     }
 
-    const char* cmd = doc["cmd"] | "";
+    const char* cmd = head["cmd"] | "";
     Serial.printf("[CFG] Command: %s\n", cmd);
 
-    // UPDATE command (OTA)
-    if (!strcmp(cmd, "update")) {
-        Serial.println("[OTA] UPDATE command received");
-        const char* url = doc["url"] | cfg.otaUrl;
-        // OTA update logic here
-        // ...
+    const ConfigCommand* entry = nullptr;
+    for (size_t i = 0; i < sizeof(CONFIG_COMMANDS) / sizeof(CONFIG_COMMANDS[0]); i++) {
+        if (!strcmp(CONFIG_COMMANDS[i].cmd, cmd)) {
+            entry = &CONFIG_COMMANDS[i];
+            break;
+        }
+    }
+    if (!isCfgTopic && !(entry && entry->anyTopic)) {
+        return; // Update topic'inde sadece update komutu
+    }
+    if (!entry) {
+        Serial.println("[CFG] Unknown command");
         return;
     }
-
-    // Config topic only from here
-    if (!isCfgTopic) {
+    if (!entry->filter) {
+        entry->handler(head);
         return;
     }
 
-    // RESET
-    if (!strcmp(cmd, "reset")) {
-        ESP.restart();
+    // 2) Komutun filtresiyle ikinci geçiş - sadece tanımlı alanlar arena dokümanına girer
+    StaticJsonDocument<768> filter;
+    entry->filter(filter);
+    JsonLease lease("config", 8192);
+    JsonDocument& doc = lease.doc();
+    err = deserializeJson(doc, (const char*)payload, len, DeserializationOption::Filter(filter));
+    if (err) {
+        Serial.printf("[CFG] JSON parse error: %s\n", err.c_str());
         return;
     }
+    entry->handler(doc);
+}
+
+// ===== ÇEVRİMDIŞI BACKLOG =====
+// Bağlantı yokken periyodun tamamı (konum, dahili sensör, tüm tag'lar) açık sıkıştırılmış
+// bloğa eklenir; blok dolunca veya boşaltma başlarken FIFO'ya tek kayıt olarak yazılır.
+// Açık blok RTC belleğinde yazılım reset'ini atlatır ama güç kaybında gider: şebeke
+// kesilince blok hemen kapatılır, bataryada bloklar kısa tutulur, batarya kritikken
+// her periyot ayrı kayıt olarak yazılır.
+RTC_NOINIT_ATTR static OfflineBlock s_openBlock;   // Yazılım reset'inde korunur
+static OfflineCycle s_offlineCycle;
+static uint8_t s_offlineRecord[OFFLINE_RECORD_CAP];
+static const uint8_t OFFLINE_BATTERY_BLOCK_CYCLES = 5;  // Bataryada en fazla 10 dk kayıp riski
+static const uint8_t OFFLINE_CRITICAL_BATT_PCT = 10;    // Altında blok tutulmaz
+static bool s_lastMainsPresent = true;
 
-    // FACTORY DEFAULT
-    if (!strcmp(cmd, "factoryDefault")) {
-        configMgr.resetToFactory(cfg);
-        ESP.restart();
+void resumeOfflineBlock() {
+    if (BacklogCodec::isBlockValid(s_openBlock)) {
+        if (s_openBlock.count > 0) {
+            Serial.printf("[BACKLOG] Resumed open block: %u cycles, %u bytes\n",
+                         s_openBlock.count, s_openBlock.length);
+        }
         return;
     }
+    BacklogCodec::resetBlock(s_openBlock);
+}
 
-    // BUZZER SILENCE
-    if (!strcmp(cmd, "silence")) {
-        buzzerMgr.alarmStop();
-        return;
+// Açık bloğu FIFO'ya yaz
+void closeOfflineBlock() {
+    if (s_openBlock.count == 0) return;
+    size_t len = BacklogCodec::finishBlock(s_openBlock, s_offlineRecord, sizeof(s_offlineRecord));
+    if (len > 0 && configMgr.pushRecord(s_offlineRecord, len)) {
+        Serial.printf("[BACKLOG] Stored block: %u cycles in %u bytes (%lu pending)\n",
+                     s_openBlock.count, (unsigned)len, (unsigned long)configMgr.getPendingCount());
+    } else {
+        Serial.printf("[BACKLOG] Failed to store block of %u cycles\n", s_openBlock.count);
     }
+    BacklogCodec::resetBlock(s_openBlock);
+}
 
-    // SET command
-    if (!strcmp(cmd, "set")) {
-        Serial.println("[CFG] SET command received");
-        
-        // MQTT Broker ayarları
-        if (doc.containsKey("mqttHost")) {
-            strlcpy(cfg.mqttHost, doc["mqttHost"], sizeof(cfg.mqttHost));
-            Serial.printf("[CFG] MQTT Host: %s\n", cfg.mqttHost);
-        }
-        if (doc.containsKey("mqttPort")) {
-            cfg.mqttPort = doc["mqttPort"];
-            Serial.printf("[CFG] MQTT Port: %d\n", cfg.mqttPort);
-        }
-        if (doc.containsKey("mqttUser")) {
-            strlcpy(cfg.mqttUser, doc["mqttUser"], sizeof(cfg.mqttUser));
-            Serial.printf("[CFG] MQTT User: %s\n", cfg.mqttUser);
-        }
-        if (doc.containsKey("mqttPass")) {
-            strlcpy(cfg.mqttPass, doc["mqttPass"], sizeof(cfg.mqttPass));
-            Serial.println("[CFG] MQTT Pass: ****");
-        }
-        
-        // WiFi ayarları
-        if (doc.containsKey("wifiSsid")) {
-            strlcpy(cfg.wifiSsid, doc["wifiSsid"], sizeof(cfg.wifiSsid));
-            Serial.printf("[CFG] WiFi SSID: %s\n", cfg.wifiSsid);
-        }
-        if (doc.containsKey("wifiPass")) {
-            strlcpy(cfg.wifiPass, doc["wifiPass"], sizeof(cfg.wifiPass));
-            Serial.println("[CFG] WiFi Pass: ****");
-        }
-        
-        // Zaman ayarları
-        if (doc.containsKey("dataPeriod")) {
-            cfg.dataPeriod = doc["dataPeriod"];
-            Serial.printf("[CFG] Data Period: %lu ms\n", cfg.dataPeriod);
-        }
-        if (doc.containsKey("infoPeriod")) {
-            cfg.infoPeriod = doc["infoPeriod"];
-            Serial.printf("[CFG] Info Period: %lu ms\n", cfg.infoPeriod);
-        }
-        
-        // Alarm eşikleri
-        if (doc.containsKey("tempHigh")) {
-            cfg.tempHigh = doc["tempHigh"];
-            Serial.printf("[CFG] Temp High: %.1f\n", cfg.tempHigh);
-        }
-        if (doc.containsKey("tempLow")) {
-            cfg.tempLow = doc["tempLow"];
-            Serial.printf("[CFG] Temp Low: %.1f\n", cfg.tempLow);
-        }
-        
-        // Buzzer ayarları
-        if (doc.containsKey("buzzerEnabled")) {
-            cfg.buzzerEnabled = doc["buzzerEnabled"];
-            Serial.printf("[CFG] Buzzer: %s\n", cfg.buzzerEnabled ? "ON" : "OFF");
-        }
-        
-        // Dahili sensör bilgileri
-        if (doc.containsKey("sensorName")) {
-            strlcpy(cfg.internalSensorName, doc["sensorName"], sizeof(cfg.internalSensorName));
-            Serial.printf("[CFG] Sensor Name: %s\n", cfg.internalSensorName);
-        }
-        if (doc.containsKey("mahalId")) {
-            strlcpy(cfg.internalMahalId, doc["mahalId"], sizeof(cfg.internalMahalId));
-            Serial.printf("[CFG] Mahal ID: %s\n", cfg.internalMahalId);
-        }
-        
-        configMgr.saveConfiguration(cfg);
-        Serial.println("[CFG] Configuration saved. Restart recommended for MQTT changes.");
-        return;
+// Periyodu çevrimdışı kayıt biçiminde kur (s_offlineCycle)
+const OfflineCycle& buildOfflineCycle(uint32_t epoch, bool sensorOK, float tempC, uint8_t alarmState) {
+    OfflineCycle& c = s_offlineCycle;
+    memset(&c, 0, sizeof(c));
+    c.epoch = epoch;
+    c.batt = gPower.battPct;
+    c.rssi = (int8_t)constrain(netMgr.getRSSI(), -128, 127);
+    c.alarmState = alarmState;
+    if (sensorOK) {
+        c.flags |= OFFLINE_FLAG_SENSOR_OK;
+        c.tempCenti = (int16_t)lroundf(tempC * 100.0f);
     }
+    
+    float lat = 0.0f, lon = 0.0f;
+    if (netMgr.getGPSLocation(&lat, &lon)) {
+        c.flags |= OFFLINE_FLAG_FIX;
+        c.latE6 = (int32_t)lroundf(lat * 1e6f);
+        c.lonE6 = (int32_t)lroundf(lon * 1e6f);
+        c.speedDkmh = (uint16_t)constrain(lroundf(netMgr.getGPSSpeed() * 10.0f), 0, 65535);
+        c.courseDdeg = (uint16_t)constrain(lroundf(netMgr.getGPSCourse() * 10.0f), 0, 3600);
+        c.sats = (uint8_t)constrain(netMgr.getGPSSatellites(), 0, 255);
+        c.hdopD = (uint8_t)constrain(lroundf(netMgr.getGPSHDOP() * 10.0f), 0, 255);
+    }
+    
+    uint8_t bleCount = bleMgr.getScannedTagCount();
+    for (uint8_t i = 0; i < bleCount && c.tagCount < OFFLINE_MAX_TAGS; i++) {
+        BLETagData tag;
+        if (!bleMgr.getScannedTag(i, tag) || !tag.valid) continue;
+        OfflineTag& t = c.tags[c.tagCount++];
+        TelemetryEncoder::parseMac(tag.macAddress, t.mac);
+        t.tempCenti = (int16_t)lroundf(tag.temperature * 100.0f);
+        t.batt = (uint8_t)constrain(tag.batteryPct, 0, 100);
+        t.rssi = (int8_t)constrain(tag.rssi, -128, 127);
+    }
+    return c;
+}
 
-    // SET EDDYSTONE CONFIGS command
-    if (!strcmp(cmd, "setEddystoneConfigs")) {
-        Serial.println("[CFG] setEddystoneConfigs command received");
-        
-        if (!doc.containsKey("eddystoneSensors")) {
-            Serial.println("[CFG] 'eddystoneSensors' array not found in payload.");
-            return;
-        }
-        
-        JsonArray sensorsArray = doc["eddystoneSensors"];
-        int count = sensorsArray.size();
-        if (count > 32) {
-            count = 32; // Max limit
-        }
+// Periyodu açık bloğa ekle; MQTT kuyruğundan teslim edilmeden çıkan advData da
+// buraya devredilir (setSpillHandler)
+void appendOfflineCycle(const OfflineCycle& c) {
+    if (!BacklogCodec::appendCycle(s_openBlock, c)) {
+        closeOfflineBlock();
+        BacklogCodec::appendCycle(s_openBlock, c);
+    }
+    Serial.printf("[TX] Saved offline cycle: %u tags, block %u cycles / %u bytes\n",
+                 c.tagCount, s_openBlock.count, s_openBlock.length);
+    
+    uint8_t blockLimit = OFFLINE_BLOCK_CYCLES;
+    if (!gPower.mainsPresent) {
+        blockLimit = (gPower.battPct <= OFFLINE_CRITICAL_BATT_PCT) ? 1 : OFFLINE_BATTERY_BLOCK_CYCLES;
+    }
+    if (s_openBlock.count >= blockLimit) closeOfflineBlock();
+}
+
+// Şebeke kesildiğinde açık bloğu flash'a yaz (her loop'ta güç durumu okunduktan sonra)
+void sealOfflineBlockOnPowerLoss() {
+    if (s_lastMainsPresent && !gPower.mainsPresent && s_openBlock.count > 0) {
+        Serial.println("[BACKLOG] Mains lost - sealing open block");
+        closeOfflineBlock();
+    }
+    s_lastMainsPresent = gPower.mainsPresent;
+}
+
+// Onaylı boşaltma: kayıt FIFO'dan tüketilmeden okunur, içindeki periyotlar sırayla
+// gönderilir; kayıt ancak son periyodun mesajı teslim edilince (getMessageState == SENT)
+// tüketilir. Teslim edilemezse kayıt FIFO'da kalır ve aynı periyottan devam edilir.
+// Yolda tek mesaj vardır - RAM backlog derinliğinden bağımsız sabittir.
+// backlogCompressed açıksa (varsayılan) periyotlar sinyal kalitesine göre seçilen
+// sayıda yeniden bloklanıp LZ ile sıkıştırılmış tek mesajda gider; kapalıysa her
+// periyot ayrı advData mesajına açılır. Canlı advData formatından bağımsızdır.
+static uint32_t s_backlogMsgId = 0;     // Yoldaki mesajın ID'si (0 = yok)
+static uint32_t s_backlogTailSeq = 0;   // Kayıt okunduğundaki kuyruk konumu
+static uint8_t s_backlogCycle = 0;      // Kayıt içinde gönderilecek sıradaki periyot
+static uint8_t s_backlogCycles = 0;     // Kayıttaki periyot sayısı
+static uint8_t s_backlogInFlight = 0;   // Yoldaki mesajın taşıdığı periyot sayısı
+static bool s_backlogDraining = false;  // PUB_BACKLOG başlatır; boşalma veya hata durdurur
+static OfflineBlock s_uploadBlock;      // Yükleme parçası (kayıttan yeniden kodlanır)
+
+void serviceBacklog() {
+    if (s_backlogMsgId != 0) {
+        MqttMsgState state = mqttMgr.getMessageState(s_backlogMsgId);
+        if (state == MQTT_MSG_QUEUED) return;
         
-        cfg.activeSensorCount = 0;
-        for (int i = 0; i < count; i++) {
-            JsonObject sensor = sensorsArray[i];
-            
-            if (sensor.containsKey("macAddress")) {
-                strlcpy(cfg.eddystoneSensors[cfg.activeSensorCount].macAddress, 
-                       sensor["macAddress"], 
-                       sizeof(cfg.eddystoneSensors[cfg.activeSensorCount].macAddress));
-            }
-            
-            if (sensor.containsKey("mahalId")) {
-                strlcpy(cfg.eddystoneSensors[cfg.activeSensorCount].mahalId, 
-                       sensor["mahalId"], 
-                       sizeof(cfg.eddystoneSensors[cfg.activeSensorCount].mahalId));
-            }
-            
-            if (sensor.containsKey("sensorName")) {
-                strlcpy(cfg.eddystoneSensors[cfg.activeSensorCount].sensorName, 
-                       sensor["sensorName"], 
-                       sizeof(cfg.eddystoneSensors[cfg.activeSensorCount].sensorName));
-            }
-            
-            if (sensor.containsKey("tempHigh")) {
-                cfg.eddystoneSensors[cfg.activeSensorCount].tempHigh = sensor["tempHigh"];
+        if (state == MQTT_MSG_SENT) {
+            s_backlogCycle += s_backlogInFlight;
+            if (s_backlogCycle >= s_backlogCycles) {
+                configMgr.consumeRecords(s_backlogTailSeq, 1);
+                s_backlogCycle = 0;
+                const BatchStats& batch = configMgr.getLastBatch();
+                Serial.printf("[BACKLOG] Block of %u cycles delivered, %lu NVS + %lu flash writes, %lu pending\n",
+                             s_backlogCycles, (unsigned long)batch.nvsWrites,
+                             (unsigned long)batch.flashWrites, (unsigned long)configMgr.getPendingCount());
             }
-            
-            if (sensor.containsKey("tempLow")) {
-                cfg.eddystoneSensors[cfg.activeSensorCount].tempLow = sensor["tempLow"];
-            }
-            
-            if (sensor.containsKey("buzzerEnabled")) {
-                cfg.eddystoneSensors[cfg.activeSensorCount].buzzerEnabled = sensor["buzzerEnabled"];
-            }
-            
-            if (sensor.containsKey("enabled")) {
-                cfg.eddystoneSensors[cfg.activeSensorCount].enabled = sensor["enabled"];
-            }
-            
-            cfg.activeSensorCount++;
+        } else {
+            // Düşürüldü/başarısız - kayıt FIFO'da, bir sonraki backlog slot'unda tekrar
+            Serial.printf("[BACKLOG] Message #%lu not delivered (state %d) - record kept\n",
+                         s_backlogMsgId, state);
+            s_backlogDraining = false;
         }
-        
-        configMgr.saveConfiguration(cfg);
-        
-        // BLE Manager'a yeni config'leri yükle
-        bleMgr.loadConfigFromCfg(cfg);
-        
-        Serial.printf("[CFG] Loaded %d Eddystone sensor configurations\n", cfg.activeSensorCount);
-        
-        // Config değişti, cihazı yeniden başlat
-        Serial.println("[CFG] Configuration saved. Restarting in 3 seconds...");
-        delay(3000);
-        ESP.restart();
+        s_backlogMsgId = 0;
+    }
+    
+    if (!s_backlogDraining) return;
+    if (configMgr.getPendingCount() == 0) {
+        s_backlogDraining = false;
         return;
     }
-
-    Serial.println("[CFG] Unknown command");
+    // Kuyrukta alarm için bir slot boş kalır
+    if (!mqttMgr.isConnected() || mqttMgr.getQueueFreeSlots() <= 1) return;
+    
+    uint32_t tailSeq;
+    uint16_t len = configMgr.peekRecord(s_offlineRecord, sizeof(s_offlineRecord), tailSeq);
+    if (len == 0) return;
+    if (tailSeq != s_backlogTailSeq) {
+        s_backlogTailSeq = tailSeq; // Kuyrukta yeni kayıt - baştan başla
+        s_backlogCycle = 0;
+    }
+    
+    // Kayıt başından sıradaki periyoda kadar çöz (delta zinciri)
+    OfflineBlockReader reader;
+    bool ok = reader.begin(s_offlineRecord, len);
+    for (uint8_t i = 0; ok && i <= s_backlogCycle; i++) {
+        ok = reader.next(s_offlineCycle);
+    }
+    if (!ok) {
+        // Okunamayan kayıt - teslim edilemez, atla
+        Serial.printf("[BACKLOG] Unreadable %u byte record dropped\n", len);
+        configMgr.consumeRecords(s_backlogTailSeq, 1);
+        s_backlogCycle = 0;
+        return;
+    }
+    s_backlogCycles = reader.getCount();
+    
+    if (cfg.backlogCompressed) {
+        uint8_t chunk = BacklogCodec::uploadCyclesForSignal(netMgr.getRSSI());
+        BacklogCodec::resetBlock(s_uploadBlock);
+        // Kayıttaki periyotlar zaten tek blokta sığmıştı - yeniden kodlama taşmaz
+        BacklogCodec::appendCycle(s_uploadBlock, s_offlineCycle);
+        while (s_uploadBlock.count < chunk && reader.next(s_offlineCycle)) {
+            if (!BacklogCodec::appendCycle(s_uploadBlock, s_offlineCycle)) break;
+        }
+        s_backlogInFlight = s_uploadBlock.count;
+        s_backlogMsgId = mqttMgr.publishBacklogBlock(macAddr.c_str(), s_uploadBlock,
+                                                     cfg.internalSensorName, cfg.internalMahalId);
+        if (s_backlogMsgId == 0) s_backlogDraining = false;
+        return;
+    }
+    
+    s_backlogInFlight = 1;
+    s_backlogMsgId = mqttMgr.publishBacklogCycle(macAddr.c_str(), s_offlineCycle,
+                                                 cfg.internalSensorName, cfg.internalMahalId, &bleMgr);
+    if (s_backlogMsgId == 0) s_backlogDraining = false;
 }
 
 // ===== SETUP =====
@@ -335,23 +657,20 @@ void setup() {
     tzset();
     Serial.println("[TIME] Timezone set to TUR-3 (UTC+3)");
 
+    // Paylaşılan JSON arena - heap parçalanmadan önce tek seferlik ayırma
+    JsonArena::begin();
+
     // 1) Konfigürasyon
     configMgr.begin();
     configMgr.loadConfiguration(cfg);
+    resumeOfflineBlock();
+    alarmMgr.begin();
     
     // Config'i serial porttan yazdır
     Serial.println("\n========== CURRENT CONFIG ==========");
     Serial.printf("Internal Sensor Name: %s\n", cfg.internalSensorName);
     Serial.printf("Internal Mahal ID: %s\n", cfg.internalMahalId);
-    Serial.printf("Active Eddystone Sensors: %d\n", cfg.activeSensorCount);
-    for (int i = 0; i < cfg.activeSensorCount && i < 4; i++) {
-        Serial.printf("  Sensor %d: MAC=%s, Name=%s, Mahal=%s, Enabled=%d\n", 
-                     i+1, 
-                     cfg.eddystoneSensors[i].macAddress,
-                     cfg.eddystoneSensors[i].sensorName,
-                     cfg.eddystoneSensors[i].mahalId,
-                     cfg.eddystoneSensors[i].enabled);
-    }
+    Serial.printf("Config schema: v%u\n", configMgr.getSchemaVersion());
     Serial.println("====================================\n");
 
     // MAC adresini al
@@ -373,6 +692,19 @@ void setup() {
     Serial.printf("MAC Address: %s\n", macAddr.c_str());
     Serial.println("========================================\n");
 
+    // Mesaj zamanlayıcısı (jitter MAC'ten türetilir)
+    pubSched.begin(macAddr.c_str());
+    if (cfg.publish.alarmPeriod == 0) {
+        cfg.publish.alarmPeriod = 1000; // Önceki sürümde kaydedilmiş 0 - alarm değerlendirmesi kapanmasın
+    }
+    pubSched.applyConfig(cfg);
+    
+    // Canlı config değişikliklerinin alt sistemlere uygulanması
+    cfgApplier.registerHook("alarm", applyAlarmHook);
+    cfgApplier.registerHook("schedule", applyScheduleHook);
+    cfgApplier.registerHook("ble", applyBleHook);
+    cfgApplier.registerHook("broker", applyBrokerHook);
+
     // 2) Donanım Başlatma
     HW_beginI2C();
     LCD_begin();
@@ -388,14 +720,15 @@ void setup() {
     float humidity = -1.0;
     
     if (extSensor.begin()) {
-        Serial.printf("[SENSOR] External sensor type: %s\n", extSensor.getTypeName());
+        Serial.printf("[SENSOR] External sensor type: %s (%u sensors)\n", extSensor.getTypeName(), extSensor.getSensorCount());
+        extSensor.setSampleInterval(cfg.sensorSampleMs);
         if (extSensor.readTemperature(tempC)) {
             if (tempC > -55.0f && tempC < 125.0f) {
                 sensorOK = true;
                 Serial.printf("[SENSOR] Temp: %.2f C (Sensor OK)\n", tempC);
                 
-                // AHT20 ise nem de oku
-                if (extSensor.getType() == SENSOR_AHT20) {
+                // Nem ölçen sensörse nem de oku
+                if (extSensor.getDriver(0)->hasHumidity) {
                     if (extSensor.readHumidity(humidity)) {
                         Serial.printf("[SENSOR] Humidity: %.1f %%\n", humidity);
                     }
@@ -430,6 +763,7 @@ void setup() {
         Serial.println("\n[STEP 7] Connecting to MQTT broker...");
         mqttMgr.begin(macAddr.c_str(), nullptr, netMgr.get4GModem(), true, &cfg);
         mqttMgr.setCallback(mqttCallback);
+        mqttMgr.setSpillHandler(appendOfflineCycle);
         
         if (mqttMgr.connect()) {
             Serial.println("[MQTT] Connected!");
@@ -443,8 +777,9 @@ void setup() {
             time_t now_t = time(nullptr);
             mqttMgr.publishInfo(macAddr.c_str(), FW_VERSION, millis()/1000, 
                                ESP.getFreeHeap(), (uint32_t)now_t, netMgr.getRSSI(), 
-                               cfg, gPower, sensorOK);
+                               cfg, gPower, sensorOK, &alarmMgr);
             Serial.println("[MQTT] Info message sent");
+            pubSched.markDone(PUB_INFO, millis());
             delay(200);
             
             // ===== 9) DATA MESAJI GÖNDER =====
@@ -467,8 +802,17 @@ void setup() {
     // ===== 10) BLE SCAN BAŞLAT =====
     Serial.println("\n[STEP 10] Initializing BLE scanner...");
     bleMgr.begin();
+    configMgr.loadDeferredSections(cfg);  // Tag listesi ilk burada gerekir
     bleMgr.loadConfigFromCfg(cfg);
     Serial.printf("[BLE] Loaded %d Eddystone sensor configs\n", cfg.activeSensorCount);
+    for (int i = 0; i < cfg.activeSensorCount && i < 4; i++) {
+        Serial.printf("  Sensor %d: MAC=%s, Name=%s, Mahal=%s, Enabled=%d\n", 
+                     i+1, 
+                     cfg.eddystoneSensors[i].macAddress,
+                     cfg.eddystoneSensors[i].sensorName,
+                     cfg.eddystoneSensors[i].mahalId,
+                     cfg.eddystoneSensors[i].enabled);
+    }
     
     // Kısa bir BLE scan yap (varsa sensör dataları gönder)
     if (cfg.activeSensorCount > 0 && mqttMgr.isConnected()) {
@@ -482,6 +826,7 @@ void setup() {
             delay(100);
         }
         
+        bleMgr.endScanCycle();
         Serial.printf("[BLE] Initial scan complete - found %d tags\n", bleMgr.getScannedTagCount());
     }
 
@@ -537,39 +882,82 @@ void setup() {
                   mqttMgr.isConnected() ? "OK" : "FAIL");
     Serial.println("========================================\n");
     
-    lastDataTxTime = millis();
+    pubSched.markDone(PUB_DATA, millis()); // İlk periyot bir sonraki data slot'unda
+}
+
+// ===== ZAMANLANMIŞ MESAJLAR =====
+// Döngü başına en fazla bir arka plan mesajı - due olanlardan en öncelikli olanı
+void serviceScheduledPublishes(unsigned long now, bool sensorOK) {
+    const uint8_t mask = (1 << PUB_INFO) | (1 << PUB_BACKLOG) | (1 << PUB_DIAG);
+    int cls = pubSched.nextDue(now, mask);
+    if (cls < 0) return;
+    
+    // Bağlantı sadece veri periyodunda kurulur; arka plan mesajları bağlantı varken gider
+    if (!mqttMgr.isConnected()) return;
+    
+    time_t now_time;
+    time(&now_time);
+    uint32_t epoch = (uint32_t)now_time;
+    
+    switch (cls) {
+        case PUB_INFO:
+            mqttMgr.publishInfo(macAddr.c_str(), FW_VERSION, millis() / 1000,
+                              ESP.getFreeHeap(), epoch, netMgr.getRSSI(), cfg, gPower, sensorOK, &alarmMgr);
+            break;
+            
+        case PUB_BACKLOG:
+            // Açık bloğu kapat ve boşaltmayı başlat - periyotlar serviceBacklog() ile teslim edildikçe gider
+            closeOfflineBlock();
+            s_backlogDraining = configMgr.getPendingCount() > 0;
+            serviceBacklog();
+            break;
+            
+        case PUB_DIAG:
+            publishDiagnostics();
+            break;
+    }
+    
+    pubSched.markDone((PublishClass)cls, now);
 }
 
 // ===== LOOP =====
 void loop() {
     unsigned long now = millis();
+    uint32_t loopStartUs = micros();
 
     // 1) Power status update
     powerMgr.update();
     gPower = powerMgr.getStatus();
+    sealOfflineBlockOnPowerLoss();
 
     // 2) GPS update - NMEA stream oku (sürekli çağrılmalı)
     netMgr.updateGPS();
+    
+    // MQTT komutlarıyla gelen config değişiklikleri
+    serviceConfigApply();
 
-    // 3) Dahili sensör okuma
+    // 3) Dahili sensör - örnekleme arka planda, burada sadece önbellekteki ortalama
+    extSensor.service(now);
     float tempC = -99.0;
-    bool sensorOK = false;
-    if (extSensor.isAvailable()) {
-        if (extSensor.readTemperature(tempC)) {
-            if (tempC > -55.0f && tempC < 125.0f) {
-                sensorOK = true;
-            }
-        }
-    }
+    bool sensorOK = extSensor.getTemperature(tempC);
 
     // 4) Alarm kontrolü
     uint8_t alarmState = 0;
     if (sensorOK) {
         alarmState = alarmMgr.checkTemperature(tempC, cfg.tempHigh, cfg.tempLow);
     }
+    alarmMgr.service(now);
 
-    // 5) Buzzer kontrolü
-    if (cfg.buzzerEnabled && alarmState != 0) {
+    // 5) BLE tag alarmları ve giriş/çıkış olayları - veri periyodu beklemeden publish et
+    if (pubSched.isDue(PUB_ALARM, now)) {
+        bleMgr.processAlarms(&mqttMgr, macAddr.c_str());
+        bleMgr.processPresence(&mqttMgr, macAddr.c_str());
+        alarmMgr.serviceTags(bleMgr);
+        pubSched.markDone(PUB_ALARM, now);
+    }
+
+    // 6) Buzzer kontrolü (dahili sensör + buzzer'ı açık BLE tag'lar)
+    if ((cfg.buzzerEnabled && alarmState != 0) || bleMgr.isBuzzerRequested()) {
         if (!buzzerMgr.isAlarming()) {
             buzzerMgr.alarmStart(10000);
         }
@@ -578,28 +966,27 @@ void loop() {
     }
     buzzerMgr.update();
 
-    // ===== 2 DAKİKALIK PERİYOT YÖNETİMİ =====
-    // Periyot başında: buffer temizle, scan başlat
-    // Periyot süresince: tüm kayıtlı sensörler bulunana kadar scan et
-    // Periyot sonunda: GPS + tüm sensörler tek JSON'da publish et
+    // ===== VERİ PERİYODU YÖNETİMİ (cfg.dataPeriod, duvar saatine hizalı) =====
+    // BLE tarama sürekli zamanlanır: TLM beklenen anlarda kısa pencereler açılır,
+    // periyot boyunca tag istatistikleri (min/max/ort) birikir
+    // Periyot başında: tüm kayıtlı sensörler bulunduysa hemen publish et
+    // Periyot sonunda: GPS + tüm sensörler tek JSON'da publish et, buffer temizle
+    bleMgr.scan();
     
     // Yeni periyot başlat
-    if (!cycleActive && (now - lastDataTxTime >= DATA_TX_INTERVAL_MS || lastDataTxTime == 0)) {
+    if (!cycleActive && pubSched.isDue(PUB_DATA, now)) {
         cycleActive = true;
         cycleDataReady = false;
         cycleStartTime = now;
+        pubSched.markDone(PUB_DATA, now);
         
-        bleMgr.startScanCycle();
-        Serial.println("\n========== NEW 2-MINUTE CYCLE STARTED ==========");
+        Serial.printf("\n========== NEW %lu-SECOND CYCLE STARTED ==========\n", cfg.dataPeriod / 1000);
         Serial.printf("[CYCLE] Looking for %d configured Eddystone sensors\n", bleMgr.getConfiguredTagCount());
         Serial.println("=================================================\n");
     }
     
-    // Aktif periyot - BLE scan devam ediyor
+    // Aktif periyot - tüm sensörler bulunana kadar bekle
     if (cycleActive && !cycleDataReady) {
-        // BLE scan (tüm sensörler bulunana kadar devam et)
-        bleMgr.scan();
-        
         // Progress log (her 30 saniyede bir)
         static unsigned long lastProgressLog = 0;
         if (now - lastProgressLog >= 30000) {
@@ -610,9 +997,9 @@ void loop() {
             Serial.printf("[CYCLE] Progress: %d/%d sensors found (%lu sec elapsed)\n", found, total, elapsed);
         }
         
-        // Tüm sensörler bulundu mu veya 2 dakika doldu mu?
+        // Tüm sensörler bulundu mu veya periyot doldu mu?
         bool allFound = bleMgr.allConfiguredTagsFound();
-        bool timeExpired = (now - cycleStartTime >= DATA_TX_INTERVAL_MS);
+        bool timeExpired = (now - cycleStartTime >= cfg.dataPeriod);
         
         if (allFound || timeExpired) {
             cycleDataReady = true;
@@ -629,11 +1016,15 @@ void loop() {
     
     // Veri hazır - publish et
     if (cycleActive && cycleDataReady) {
-        lastDataTxTime = now;
         cycleActive = false;
         cycleDataReady = false;
         
         Serial.println("\n========== PUBLISHING CYCLE DATA ==========");
+        uint32_t publishStartMs = millis();
+        
+        // Açık BLE penceresini kapat, periyot radyo süresini al
+        bleMgr.endScanCycle();
+        uint32_t bleRadioOnMs = bleMgr.getCycleRadioOnMs();
         
         // Time sync
         netMgr.syncTimeGSM();
@@ -658,121 +1049,66 @@ void loop() {
                 Serial.println("[GPS] No GPS fix available");
             }
 
-            // ===== TEK JSON'DA TÜM VERİLERİ PUBLISH ET =====
-            DynamicJsonDocument doc(4096);
-            doc["msg"] = "advData";
-            doc["gmac"] = macAddr;
-            doc["stat"] = "online";
-            doc["conn"] = "4G";
-            
-            // GPS objesi (konum + hız + yön + zaman)
-            JsonObject gps = doc.createNestedObject("gps");
-            gps["lat"] = lat;
-            gps["lon"] = lon;
-            gps["speed"] = netMgr.getGPSSpeed();      // km/h
-            gps["course"] = netMgr.getGPSCourse();    // derece (0-360)
-            gps["time"] = netMgr.getGPSTime();        // UTC saat (HH:MM:SS)
-            gps["date"] = netMgr.getGPSDate();        // Tarih (DD/MM/YY)
-            gps["sats"] = netMgr.getGPSSatellites();  // Uydu sayısı
-            gps["hdop"] = netMgr.getGPSHDOP();        // HDOP
-            
-            // Sensör dizisi
-            JsonArray obj = doc.createNestedArray("obj");
-            
-            // 1) Dahili sensör
-            JsonObject internalSensor = obj.createNestedObject();
-            internalSensor["type"] = 1;
-            internalSensor["dmac"] = macAddr;
-            internalSensor["name"] = cfg.internalSensorName;
-            internalSensor["location"] = cfg.internalMahalId;
-            internalSensor["temp"] = sensorOK ? tempC : 0;
-            internalSensor["batt"] = gPower.battPct;
-            internalSensor["rssi"] = netMgr.getRSSI();
-            internalSensor["time"] = epoch;
+            // ===== TÜM VERİLERİ TEK MESAJDA PUBLISH ET (JSON ve/veya CBOR) =====
+            CycleSnapshot snap;
+            snap.gmac = macAddr.c_str();
+            snap.conn = "4G";
+            snap.epoch = epoch;
+            snap.bleOnMs = bleRadioOnMs; // Bu periyotta BLE radyosunun açık kaldığı süre
+            snap.lat = lat;
+            snap.lon = lon;
+            snap.speed = netMgr.getGPSSpeed();
+            snap.course = netMgr.getGPSCourse();
+            snap.gpsTime = netMgr.getGPSTime();
+            snap.gpsDate = netMgr.getGPSDate();
+            snap.sats = netMgr.getGPSSatellites();
+            snap.hdop = netMgr.getGPSHDOP();
+            snap.internalName = cfg.internalSensorName;
+            snap.internalMahalId = cfg.internalMahalId;
+            snap.sensorOK = sensorOK;
+            snap.temp = tempC;
+            snap.batt = gPower.battPct;
+            snap.rssi = netMgr.getRSSI();
+            snap.ext = &extSensor;
+            snap.ble = &bleMgr;
             
-            // 2) BLE Eddystone sensörler
-            uint8_t bleCount = bleMgr.getScannedTagCount();
-            for (uint8_t i = 0; i < bleCount; i++) {
-                BLETagData* tag = bleMgr.getScannedTag(i);
-                if (!tag || !tag->valid) continue;
-                
-                BLETagConfig* config = bleMgr.getTagConfig(tag->macAddress);
-                
-                // MAC'i normalize et
-                String normalizedMac = String(tag->macAddress);
-                normalizedMac.toUpperCase();
-                normalizedMac.replace(":", "");
-                
-                JsonObject bleSensor = obj.createNestedObject();
-                bleSensor["type"] = 2; // BLE sensor type
-                bleSensor["dmac"] = normalizedMac;
-                bleSensor["name"] = config ? config->name : "Unknown";
-                bleSensor["location"] = config ? config->mahalId : "";
-                bleSensor["temp"] = tag->temperature;
-                bleSensor["batt"] = tag->batteryPct;
-                bleSensor["rssi"] = tag->rssi;
-                bleSensor["time"] = epoch;
-                bleSensor["advCount"] = tag->advCount;
+            // Periyot kuyruktan teslim edilmeden çıkarsa (alarma yer açma, yaş limiti)
+            // bu kopya FIFO'ya devredilir
+            const OfflineCycle& offline = buildOfflineCycle(epoch, sensorOK, tempC, alarmState);
+            if (!mqttMgr.publishCycle(snap, cfg.telemetryFormat, &offline)) {
+                // Kuyruk/journal kabul etmedi - periyot kaybolmasın, FIFO'dan sonra gider
+                Serial.println("[TX] Cycle not queued - saving to FIFO");
+                appendOfflineCycle(offline);
             }
             
-            // JSON'u publish et
-            String payload;
-            serializeJson(doc, payload);
-            
-            String topic = mqttMgr.getDataTopic(macAddr.c_str());
-            mqttMgr.publishRaw(topic.c_str(), payload.c_str());
-            
-            Serial.printf("[TX] Published combined data: %d sensors (1 internal + %d BLE)\n", 
-                         1 + bleCount, bleCount);
+            uint8_t bleCount = bleMgr.getScannedTagCount();
+            uint8_t wiredCount = extSensor.getSensorCount() > 0 ? extSensor.getSensorCount() : 1;
+            Serial.printf("[TX] Published combined data: %d sensors (%d wired + %d BLE)\n", 
+                         wiredCount + bleCount, wiredCount, bleCount);
             Serial.printf("[TX] GPS: lat=%.6f, lon=%.6f, speed=%.1f km/h, course=%.1f°\n", 
-                         lat, lon, netMgr.getGPSSpeed(), netMgr.getGPSCourse());
+                         lat, lon, snap.speed, snap.course);
             Serial.printf("[TX] GPS Time: %s %s UTC | Sats: %d | HDOP: %.1f\n",
-                         netMgr.getGPSDate().c_str(), netMgr.getGPSTime().c_str(),
-                         netMgr.getGPSSatellites(), netMgr.getGPSHDOP());
-            Serial.printf("[TX] Payload size: %d bytes\n", payload.length());
-
-            // Info message
-            mqttMgr.publishInfo(macAddr.c_str(), FW_VERSION, millis() / 1000,
-                              ESP.getFreeHeap(), epoch, netMgr.getRSSI(), cfg, gPower, sensorOK);
-
-            // FIFO'dan bekleyen kayıtları gönder
-            uint16_t pendingCount = configMgr.getPendingCount();
-            if (pendingCount > 0) {
-                OfflineDataRecord* records = new OfflineDataRecord[pendingCount];
-                int actualCount = 0;
-                OfflineDataRecord record;
-                while (configMgr.popRecord(record) && actualCount < pendingCount) {
-                    records[actualCount] = record;
-                    actualCount++;
-                }
-                if (actualCount > 0) {
-                    mqttMgr.publishDataArray(macAddr.c_str(), records, actualCount,
-                                            cfg.internalSensorName, cfg.internalMahalId);
-                }
-                delete[] records;
-                configMgr.clearAllRecords();
-            }
+                         snap.gpsDate.c_str(), snap.gpsTime.c_str(), snap.sats, snap.hdop);
         } else {
-            // Bağlantı yoksa FIFO'ya kaydet
+            // Bağlantı yoksa periyodu FIFO'ya kaydet
             Serial.println("[TX] Connection failed - saving to FIFO");
             time_t now_time;
             time(&now_time);
-            uint32_t epochForRecord = (uint32_t)now_time;
-            OfflineDataRecord record;
-            memset(&record, 0, sizeof(OfflineDataRecord));
-            record.timestamp = epochForRecord;
-            record.temperature = sensorOK ? tempC : -99.0f;
-            record.batteryPct = gPower.battPct;
-            record.rssi = netMgr.getRSSI();
-            record.alarmState = alarmState;
-            strlcpy(record.sensorId, "INTERNAL", sizeof(record.sensorId));
-            configMgr.pushRecord(record);
+            appendOfflineCycle(buildOfflineCycle((uint32_t)now_time, sensorOK, tempC, alarmState));
         }
         
+        // Yeni periyot için tag buffer'ı ve istatistikleri sıfırla
+        bleMgr.startScanCycle();
+        Diagnostics::recordCycle(millis() - publishStartMs);
+        
         Serial.println("============================================\n");
     }
+    
+    // Zamanlanmış arka plan mesajları (info, backlog, diag)
+    serviceScheduledPublishes(now, sensorOK);
+    serviceBacklog();
 
-    // 6) LCD güncelleme - Sıralı gösterim (dahili sensör + BLE sensörler)
+    // 7) LCD güncelleme - Sıralı gösterim (dahili sensör + BLE sensörler)
     static unsigned long lastLCDUpdate = 0;
     static uint8_t lcdDisplayIndex = 0;
     
@@ -809,24 +1145,21 @@ void loop() {
                           bleMgr.getScannedTagCount(), mqttMgr.isConnected(), FW_VERSION);
         } else {
             uint8_t bleIndex = lcdDisplayIndex - 1;
-            BLETagData* tag = bleMgr.getScannedTag(bleIndex);
+            BLETagData tag;
             
-            if (tag && tag->valid) {
-                BLETagConfig* config = bleMgr.getTagConfig(tag->macAddress);
+            if (bleMgr.getScannedTag(bleIndex, tag) && tag.valid) {
+                BLETagConfig* config = bleMgr.getTagConfig(tag.macAddress);
                 
-                uint8_t bleAlarmState = 0;
                 float bleHighLimit = config ? config->tempHigh : cfg.tempHigh;
                 float bleLowLimit = config ? config->tempLow : cfg.tempLow;
-                
-                if (tag->temperature > bleHighLimit) bleAlarmState = 1;
-                else if (tag->temperature < bleLowLimit) bleAlarmState = 2;
+                uint8_t bleAlarmState = bleMgr.getTagAlarmState(tag.macAddress);
                 
                 LCD_showBLESensor(
                     config ? config->name : "Unknown",
-                    tag->macAddress,
-                    tag->temperature,
-                    tag->batteryPct,
-                    tag->rssi,
+                    tag.macAddress,
+                    tag.temperature,
+                    tag.batteryPct,
+                    tag.rssi,
                     gPower,
                     netMgr.getRSSI(),
                     true,
@@ -851,8 +1184,9 @@ void loop() {
         }
     }
 
-    // 7) MQTT loop
+    // 8) MQTT loop (URC işleme + giden kuyruktan en öncelikli mesaj)
     mqttMgr.loop();
 
+    Diagnostics::recordLoop(micros() - loopStartUs);
     delay(10);
 }
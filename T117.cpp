@@ -1,19 +1,8 @@
 #include "T117.h"
+#include "Checksum.h"
 
 T117::T117(uint8_t addr) : _addr(addr) {}
 
-uint8_t T117::crc8(const uint8_t *data, uint8_t len) {
-  uint8_t crc = 0x00;
-  for (uint8_t i = 0; i < len; i++) {
-    crc ^= data[i];
-    for (uint8_t j = 0; j < 8; j++) {
-      if (crc & 0x01) crc = (crc >> 1) ^ 0x8C; // reflected poly 0x31
-      else crc >>= 1;
-    }
-  }
-  return crc;
-}
-
 bool T117::probe() {
   Wire.beginTransmission(_addr);
   return (Wire.endTransmission() == 0);
@@ -50,7 +39,7 @@ bool T117::readTemperatureC(float &tempC) {
   data[1] = Wire.read();
   data[2] = Wire.read();
 
-  uint8_t calc = crc8(data, 2);
+  uint8_t calc = Checksum::crc8Maxim(data, 2);
   if (data[2] != calc) return false;
 
   int16_t raw = (int16_t)((data[1] << 8) | data[0]);
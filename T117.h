@@ -24,7 +24,6 @@ private:
 
   static constexpr uint8_t SINGLE_CONVERT = 0xC0;
 
-  uint8_t crc8(const uint8_t *data, uint8_t len);
   bool probe();
 };
 
@@ -0,0 +1,226 @@
+#include "TelemetryEncoder.h"
+#include "BLEManager.h"
+#include "ExternalSensor.h"
+#include <math.h>
+
+// ===== CborWriter =====
+
+void CborWriter::_byte(uint8_t b) {
+    if (_len >= _cap) {
+        _overflow = true;
+        return;
+    }
+    _buf[_len++] = b;
+}
+
+void CborWriter::_head(uint8_t major, uint32_t value) {
+    uint8_t mt = major << 5;
+    if (value < 24) {
+        _byte(mt | value);
+    } else if (value <= 0xFF) {
+        _byte(mt | 24);
+        _byte(value);
+    } else if (value <= 0xFFFF) {
+        _byte(mt | 25);
+        _byte(value >> 8);
+        _byte(value);
+    } else {
+        _byte(mt | 26);
+        _byte(value >> 24);
+        _byte(value >> 16);
+        _byte(value >> 8);
+        _byte(value);
+    }
+}
+
+void CborWriter::writeInt(int32_t v) {
+    if (v >= 0) {
+        _head(0, (uint32_t)v);
+    } else {
+        _head(1, (uint32_t)(-1 - v)); // CBOR negatif: -1 - n
+    }
+}
+
+void CborWriter::writeFloat(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    _byte(0xFA);
+    _byte(bits >> 24);
+    _byte(bits >> 16);
+    _byte(bits >> 8);
+    _byte(bits);
+}
+
+void CborWriter::writeBytes(const uint8_t* data, size_t len) {
+    _head(2, len);
+    for (size_t i = 0; i < len; i++) _byte(data[i]);
+}
+
+void CborWriter::writeText(const char* str) {
+    size_t len = str ? strlen(str) : 0;
+    _head(3, len);
+    for (size_t i = 0; i < len; i++) _byte(str[i]);
+}
+
+// ===== TelemetryEncoder =====
+
+void TelemetryEncoder::writeMac(CborWriter& w, const char* mac) {
+    uint8_t bytes[6];
+    parseMac(mac, bytes);
+    w.writeBytes(bytes, 6);
+}
+
+void TelemetryEncoder::parseMac(const char* mac, uint8_t bytes[6]) {
+    // "AABBCCDDEEFF" veya "AA:BB:CC:DD:EE:FF" -> 6 byte
+    memset(bytes, 0, 6);
+    uint8_t n = 0;
+    int hi = -1;
+    for (const char* p = mac; *p && n < 6; p++) {
+        int v;
+        if (*p >= '0' && *p <= '9') v = *p - '0';
+        else if (*p >= 'a' && *p <= 'f') v = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F') v = *p - 'A' + 10;
+        else continue; // ':' ayırıcı
+        if (hi < 0) {
+            hi = v;
+        } else {
+            bytes[n++] = (hi << 4) | v;
+            hi = -1;
+        }
+    }
+}
+
+uint32_t TelemetryEncoder::_packClock(const String& text) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < text.length(); i++) {
+        char c = text[i];
+        if (c >= '0' && c <= '9') v = v * 10 + (c - '0');
+    }
+    return v;
+}
+
+static inline int32_t _centi(float v) {
+    return (int32_t)lroundf(v * 100.0f);
+}
+
+size_t TelemetryEncoder::encodeCycle(const CycleSnapshot& snap, uint8_t* buf, size_t cap) {
+    CborWriter w(buf, cap);
+
+    uint8_t extCount = snap.ext ? snap.ext->getSensorCount() : 0;
+    w.beginMap(extCount > 1 ? 10 : 9);
+
+    w.writeUint(0);
+    w.writeUint(SCHEMA_VERSION);
+
+    w.writeUint(1);
+    writeMac(w, snap.gmac);
+
+    w.writeUint(2);
+    w.writeUint(snap.epoch);
+
+    w.writeUint(3);
+    w.writeText(snap.conn);
+
+    w.writeUint(4);
+    w.writeUint(snap.bleOnMs);
+
+    // GPS - sabit noktalı tamsayılar (float32'den kısa ve kayıpsız yeterli çözünürlük)
+    w.writeUint(5);
+    w.beginArray(8);
+    w.writeInt((int32_t)lroundf(snap.lat * 1e6f));
+    w.writeInt((int32_t)lroundf(snap.lon * 1e6f));
+    w.writeUint((uint32_t)lroundf(snap.speed * 10.0f));
+    w.writeUint((uint32_t)lroundf(snap.course * 10.0f));
+    w.writeUint(snap.sats > 0 ? snap.sats : 0);
+    w.writeUint((uint32_t)lroundf(snap.hdop * 10.0f));
+    w.writeUint(_packClock(snap.gpsTime));
+    w.writeUint(_packClock(snap.gpsDate));
+
+    // Dahili sensör
+    w.writeUint(6);
+    w.beginArray(3);
+    if (snap.sensorOK) {
+        w.writeInt(_centi(snap.temp));
+    } else {
+        w.writeNull();
+    }
+    w.writeInt(snap.batt);
+    w.writeInt(snap.rssi);
+
+    // Tag sözlüğü - isim/mahal/location tekrar gönderilmez
+    BLEManager* ble = snap.ble;
+    w.writeUint(7);
+    w.writeUint(ble ? ble->getConfigDictionaryId() : 0);
+
+    // Geçerli tag sayısı (map/array başlıkları sayı ister)
+    uint8_t tagCount = ble ? ble->getScannedTagCount() : 0;
+    uint8_t validCount = 0;
+    BLETagData tag;
+    for (uint8_t i = 0; i < tagCount; i++) {
+        if (ble->getScannedTag(i, tag) && tag.valid) validCount++;
+    }
+
+    w.writeUint(8);
+    // Tag'lar BLE task'ında güncellenir; her tag tutarlı kopyadan yazılır, dizi
+    // başlığındaki sayı aşılmaz
+    w.beginArray(validCount);
+    uint8_t written = 0;
+    for (uint8_t i = 0; i < tagCount && written < validCount; i++) {
+        if (!ble->getScannedTag(i, tag) || !tag.valid) continue;
+        written++;
+
+        w.beginArray(6);
+        int configIndex = ble->getTagConfigIndex(tag.macAddress);
+        if (configIndex >= 0) {
+            w.writeUint(configIndex);
+        } else {
+            writeMac(w, tag.macAddress);
+        }
+        w.writeInt(_centi(tag.temperature));
+        w.writeInt(tag.batteryPct);
+        w.writeInt(tag.rssi);
+        w.writeUint(tag.advCount);
+
+        const BLETagStats& st = tag.stats;
+        if (st.frameCount == 0) {
+            w.writeNull();
+            continue;
+        }
+        float tempStd = (st.tlmCount > 1) ? sqrtf(st.tempM2 / st.tlmCount) : 0.0f;
+        w.beginArray(11);
+        w.writeInt(_centi(st.tempMin));
+        w.writeInt(_centi(st.tempMax));
+        w.writeInt(_centi(st.tempMean));
+        w.writeInt(_centi(tempStd));
+        w.writeInt(st.rssiMin);
+        w.writeInt(st.rssiMax);
+        w.writeInt((int32_t)lroundf(st.rssiMean * 10.0f));
+        w.writeUint(st.frameCount);
+        w.writeUint(st.tlmCount);
+        // Zamanlar periyot epoch'una göre ofset (küçük tamsayı)
+        w.writeUint(snap.epoch >= st.firstSeenTime ? snap.epoch - st.firstSeenTime : 0);
+        w.writeUint(snap.epoch >= tag.lastSeenTime ? snap.epoch - tag.lastSeenTime : 0);
+    }
+
+    // Ek I2C sensörleri (0. sensör anahtar 6'da)
+    if (extCount > 1) {
+        w.writeUint(10);
+        w.beginArray(extCount - 1);
+        for (uint8_t i = 1; i < extCount; i++) {
+            float temp, humidity;
+            w.beginArray(4);
+            w.writeUint(snap.ext->getAddress(i));
+            w.writeUint(snap.ext->getDriver(i)->type);
+            if (snap.ext->getTemperature(i, temp)) w.writeInt(_centi(temp));
+            else w.writeNull();
+            if (snap.ext->getHumidity(i, humidity)) w.writeInt(_centi(humidity));
+            else w.writeNull();
+        }
+    }
+
+    if (w.overflow()) {
+        Serial.printf("[CBOR] Buffer overflow (cap=%u bytes)\n", (unsigned)cap);
+        return 0;
+    }
+    return w.length();
+}
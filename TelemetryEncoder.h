@@ -0,0 +1,110 @@
+#ifndef TELEMETRY_ENCODER_H
+#define TELEMETRY_ENCODER_H
+
+#include <Arduino.h>
+
+class BLEManager;
+class ExternalSensor;
+
+// Periyot verisi formatı (Cfg.telemetryFormat)
+enum TelemetryFormat : uint8_t {
+    TELEMETRY_JSON = 0,   // Sadece JSON (KUTARIoT/data/<mac>)
+    TELEMETRY_CBOR = 1,   // Sadece ikili CBOR (KUTARIoT/bdata/<mac>)
+    TELEMETRY_BOTH = 2    // İkisi birden - boyut/süre karşılaştırması loglanır
+};
+
+// Periyot sonu anlık görüntüsü - JSON ve CBOR kodlayıcılar aynı girdiyi kullanır
+struct CycleSnapshot {
+    const char* gmac;           // Gateway MAC (12 hex)
+    const char* conn;           // "4G" / "WiFi"
+    uint32_t epoch;
+    uint32_t bleOnMs;           // Periyotta BLE radyosunun açık kaldığı süre
+
+    // GPS
+    float lat;
+    float lon;
+    float speed;                // km/h
+    float course;               // derece
+    String gpsTime;             // "HH:MM:SS" UTC
+    String gpsDate;             // "DD/MM/YY"
+    int sats;
+    float hdop;
+
+    // Dahili sensör
+    const char* internalName;
+    const char* internalMahalId;
+    bool sensorOK;
+    float temp;
+    int batt;
+    int rssi;
+
+    // Tüm I2C sensörleri (0. sensör yukarıdaki dahili sensördür; diğerleri ayrı obj girdisi)
+    ExternalSensor* ext;
+
+    // BLE tag buffer + config sözlüğü
+    BLEManager* ble;
+};
+
+// Minimal CBOR (RFC 8949) yazıcı - sabit buffer, heap kullanmaz
+// Taşma olursa overflow() true döner, çıktı geçersizdir
+class CborWriter {
+public:
+    CborWriter(uint8_t* buf, size_t cap) : _buf(buf), _cap(cap), _len(0), _overflow(false) {}
+
+    void writeUint(uint32_t v) { _head(0, v); }
+    void writeInt(int32_t v);
+    void writeFloat(float v);
+    void writeBool(bool v) { _byte(v ? 0xF5 : 0xF4); }
+    void writeNull() { _byte(0xF6); }
+    void writeBytes(const uint8_t* data, size_t len);
+    void writeText(const char* str);
+    void beginArray(uint32_t count) { _head(4, count); }
+    void beginMap(uint32_t count) { _head(5, count); }
+
+    size_t length() const { return _len; }
+    bool overflow() const { return _overflow; }
+
+private:
+    uint8_t* _buf;
+    size_t _cap;
+    size_t _len;
+    bool _overflow;
+
+    void _byte(uint8_t b);
+    void _head(uint8_t major, uint32_t value);
+};
+
+// advData ikili şeması (v1) - tamsayı anahtarlı CBOR map:
+//   0: şema versiyonu (1)
+//   1: gateway MAC (6 byte bstr)
+//   2: epoch
+//   3: bağlantı ("4G"/"WiFi")
+//   4: bleOnMs
+//   5: GPS  [latE6, lonE6, hız*10, yön*10, uydu, hdop*10, hhmmss, ddmmyy]
+//   6: dahili sensör [sıcaklık*100 | null, batarya, rssi]
+//   7: tag sözlük ID'si (config MAC listesinin FNV-1a özeti)
+//   8: tag dizisi, her biri:
+//        [id, sıcaklık*100, batarya, rssi, advCount, stats | null]
+//        id: config sırası (uint, sözlükten isim/mahal) veya config'de yoksa MAC (6 byte bstr)
+//        stats: [tMin*100, tMax*100, tAvg*100, tStd*100, rMin, rMax, rAvg*10,
+//                frames, tlm, epoch-first, epoch-last]
+//   9: mid - journal tekrar ayıklama ID'si (MQTTManager kuyruğa alırken ekler)
+//  10: ek I2C sensörleri (dahili sensör dışında bulunan varsa), her biri:
+//        [I2C adresi, SensorType, sıcaklık*100 | null, nem*100 | null]
+// Standart CBOR çözücüler (ör. Python cbor2) doğrudan okuyabilir.
+class TelemetryEncoder {
+public:
+    static const uint8_t SCHEMA_VERSION = 1;
+
+    // Snapshot'ı CBOR olarak kodla; taşmada 0 döner
+    static size_t encodeCycle(const CycleSnapshot& snap, uint8_t* buf, size_t cap);
+
+    // "AABBCCDDEEFF" / "AA:BB:..." -> 6 byte bstr
+    static void writeMac(CborWriter& w, const char* mac);
+    static void parseMac(const char* mac, uint8_t bytes[6]); // Çevrimdışı kayıtlar da kullanır
+
+private:
+    static uint32_t _packClock(const String& text); // "HH:MM:SS" -> HHMMSS
+};
+
+#endif
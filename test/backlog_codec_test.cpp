@@ -0,0 +1,276 @@
+// BacklogCodec host testi: sentetik soğuk zincir izleri bloklara kodlanır, FIFO kaydı
+// ve yükleme mesajı (LZ) üzerinden geri çözülür, bit bit karşılaştırılır.
+// Sıkıştırma oranı eski OfflineDataRecord (örnek başına sizeof) ile kıyaslanır.
+#include "BacklogCodec.h"
+#include "Checksum.h"
+#include "cbor_reader.h"
+#include <assert.h>
+#include <random>
+#include <vector>
+
+// Eski kayıt CRC'si (ConfigManager.cpp ile aynı tanım; ConfigManager bu teste bağlanmaz)
+uint32_t ConfigManager::calculateCRC32(const OfflineDataRecord& record) {
+    return Checksum::crc32(&record, offsetof(OfflineDataRecord, crc32));
+}
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while (0)
+
+static OfflineBlock s_block;
+static uint8_t s_record[OFFLINE_RECORD_CAP];
+static uint8_t s_message[3072];
+static uint8_t s_unpacked[OFFLINE_RECORD_CAP];
+
+struct Trace {
+    const char* name;
+    int tags;
+    bool moving;
+    float baseTemp;     // Dahili sensör
+    float tagTemp;      // Tag'lar
+};
+
+// 2 dk periyot, ara sıra 1 sn kayma; defrost/kapı açılması sıçramaları; hareket halinde GPS
+static std::vector<OfflineCycle> makeTrace(const Trace& tr, int cycles, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::vector<OfflineCycle> out;
+    uint32_t epoch = 1760000000;
+    float temp = tr.baseTemp;
+    float tagTemp[OFFLINE_MAX_TAGS];
+    for (int i = 0; i < OFFLINE_MAX_TAGS; i++) tagTemp[i] = tr.tagTemp + 0.1f * i;
+    int32_t lat = 41015000, lon = 28979000;
+
+    for (int k = 0; k < cycles; k++) {
+        OfflineCycle c;
+        memset(&c, 0, sizeof(c));
+        epoch += 120 + ((k % 47 == 0) ? 1 : 0);
+        c.epoch = epoch;
+        c.flags = OFFLINE_FLAG_SENSOR_OK;
+        c.batt = 95 - k / 40;
+        c.rssi = -95 + (k / 10) % 4;
+
+        // Sıcaklık: rastgele yürüyüş, her 180 periyotta (6 saat) 10 periyotluk defrost
+        temp += 0.02f * noise(rng);
+        bool defrost = (k % 180) < 10;
+        float shown = defrost ? temp + 0.8f * (k % 180) : temp;
+        c.tempCenti = (int16_t)lroundf(shown * 100.0f);
+        c.alarmState = (shown > tr.baseTemp + 5.0f) ? 1 : 0;
+
+        if (tr.moving && (k / 30) % 4 != 3) { // Her 2 saatte 1 saat fix yok
+            c.flags |= OFFLINE_FLAG_FIX;
+            lat += 150 + (int32_t)(20 * noise(rng));
+            lon += 90 + (int32_t)(20 * noise(rng));
+            c.latE6 = lat;
+            c.lonE6 = lon;
+            c.speedDkmh = 650 + (k % 5) * 10;
+            c.courseDdeg = 450;
+            c.sats = 9;
+            c.hdopD = 11;
+        }
+
+        c.tagCount = tr.tags;
+        for (int t = 0; t < tr.tags; t++) {
+            OfflineTag& tag = c.tags[t];
+            const uint8_t mac[6] = {0xAC, 0x23, 0x3F, 0x00, (uint8_t)(t >> 8), (uint8_t)t};
+            memcpy(tag.mac, mac, 6);
+            tagTemp[t] += 0.03f * noise(rng);
+            tag.tempCenti = (int16_t)lroundf(tagTemp[t] * 100.0f);
+            tag.batt = 80 - t % 3;
+            tag.rssi = (int8_t)(-70 - (k + t) % 6);
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+// Blokları .ino ile aynı şekilde doldur; her FIFO kaydını çözüp karşılaştır
+static void roundTrip(const Trace& tr, const std::vector<OfflineCycle>& cycles) {
+    size_t storedBytes = 0, records = 0, decoded = 0;
+    double encodeUs = 0, decodeUs = 0;
+    OfflineCycle got;
+
+    auto flush = [&]() {
+        size_t len = BacklogCodec::finishBlock(s_block, s_record, sizeof(s_record));
+        CHECK(len > 0);
+        storedBytes += len;
+        records++;
+
+        unsigned long t0 = micros();
+        OfflineBlockReader reader;
+        CHECK(reader.begin(s_record, len));
+        while (reader.next(got)) {
+            CHECK(decoded < cycles.size());
+            CHECK(memcmp(&got, &cycles[decoded], sizeof(got)) == 0);
+            decoded++;
+        }
+        decodeUs += micros() - t0;
+        BacklogCodec::resetBlock(s_block);
+    };
+
+    BacklogCodec::resetBlock(s_block);
+    for (const OfflineCycle& c : cycles) {
+        unsigned long t0 = micros();
+        bool ok = BacklogCodec::appendCycle(s_block, c);
+        encodeUs += micros() - t0;
+        if (!ok) {
+            flush();
+            CHECK(BacklogCodec::appendCycle(s_block, c));
+        }
+        CHECK(BacklogCodec::isBlockValid(s_block));
+        if (s_block.count >= OFFLINE_BLOCK_CYCLES) flush();
+    }
+    if (s_block.count > 0) flush();
+    CHECK(decoded == cycles.size());
+
+    size_t samples = cycles.size() * (1 + tr.tags);
+    double perSample = (double)storedBytes / samples;
+    double ratio = (double)sizeof(OfflineDataRecord) / perSample;
+    printf("  %-22s %4zu cycles %3zu records %6zu bytes  %.2f B/sample  %5.1fx  enc %.1f us/cycle  dec %.1f us/cycle\n",
+           tr.name, cycles.size(), records, storedBytes, perSample, ratio,
+           encodeUs / cycles.size(), decodeUs / cycles.size());
+    // Hedef: sadece dahili sensörde eski kayda göre >10x
+    if (tr.tags == 0) CHECK(ratio > 10.0);
+}
+
+// Yükleme mesajı: CBOR başlığı + LZ -> v3 kayıt -> periyotlar
+static void uploadRoundTrip(const std::vector<OfflineCycle>& cycles) {
+    BacklogCodec::resetBlock(s_block);
+    size_t n = 0;
+    while (n < cycles.size() && BacklogCodec::appendCycle(s_block, cycles[n])) n++;
+
+    size_t len = BacklogCodec::encodeUpload("AABBCCDDEEFF", "Dahili", "M-01", s_block,
+                                            s_message, sizeof(s_message));
+    CHECK(len > 0);
+
+    CborReader r(s_message, len);
+    uint32_t fields = r.readMap();
+    CHECK(fields == 7 || fields == 8);
+    CHECK(r.readUint() == 0 && r.readUint() == BacklogCodec::UPLOAD_VERSION);
+    const uint8_t* mac;
+    CHECK(r.readUint() == 1 && r.readBytes(mac) == 6 && mac[0] == 0xAA && mac[5] == 0xFF);
+    CHECK(r.readUint() == 2 && r.readText() == "Dahili");
+    CHECK(r.readUint() == 3 && r.readText() == "M-01");
+    CHECK(r.readUint() == 4 && r.readUint() == n);
+    CHECK(r.readUint() == 5 && r.readUint() == cycles[0].epoch);
+    uint32_t rawLen = 0;
+    if (fields == 8) {
+        CHECK(r.readUint() == 6);
+        rawLen = r.readUint();
+    }
+    const uint8_t* body;
+    CHECK(r.readUint() == 7);
+    size_t bodyLen = r.readBytes(body);
+    CHECK(!r.error() && r.atEnd());
+
+    const uint8_t* record = body;
+    size_t recordLen = bodyLen;
+    if (fields == 8) {
+        recordLen = BacklogCodec::decompress(body, bodyLen, s_unpacked, sizeof(s_unpacked));
+        CHECK(recordLen == rawLen);
+        record = s_unpacked;
+    }
+
+    OfflineBlockReader reader;
+    CHECK(reader.begin(record, recordLen));
+    CHECK(reader.getCount() == n);
+    OfflineCycle got;
+    for (size_t i = 0; i < n; i++) {
+        CHECK(reader.next(got));
+        CHECK(memcmp(&got, &cycles[i], sizeof(got)) == 0);
+    }
+    printf("  upload %2zu cycles: message %4zu bytes (%s)\n", n, len, fields == 8 ? "LZ" : "raw");
+}
+
+// LZSS kenar durumları: boş, tekrar dizisi, rastgele (genişleme sınırı)
+static void lzRoundTrip() {
+    static uint8_t in[2048], packed[2048 + 2048 / 8 + 1], out[2048];
+    std::mt19937 rng(7);
+    for (int mode = 0; mode < 3; mode++) {
+        size_t len = (mode == 0) ? 0 : sizeof(in);
+        for (size_t i = 0; i < len; i++) in[i] = (mode == 1) ? (uint8_t)(i % 3) : (uint8_t)rng();
+        size_t p = BacklogCodec::compress(in, len, packed, sizeof(packed));
+        CHECK(len == 0 || p > 0);
+        CHECK(p <= len + len / 8 + 1);
+        CHECK(BacklogCodec::decompress(packed, p, out, sizeof(out)) == len);
+        CHECK(memcmp(in, out, len) == 0);
+    }
+    // Bozuk girdi: pencere dışı mesafe
+    const uint8_t bad[] = {0x01, 0x05, 0x00};
+    CHECK(BacklogCodec::decompress(bad, sizeof(bad), out, sizeof(out)) == 0);
+}
+
+// Eski formatlar FIFO'da kalmış olabilir: v1 OfflineDataRecord ve v2 tek periyot
+static void legacyRecords() {
+    OfflineDataRecord old;
+    memset(&old, 0, sizeof(old));
+    old.timestamp = 1700000000;
+    old.temperature = 4.25f;
+    old.batteryPct = 77;
+    old.rssi = -81;
+    old.alarmState = 1;
+    old.crc32 = ConfigManager::calculateCRC32(old);
+
+    OfflineBlockReader reader;
+    OfflineCycle c;
+    CHECK(reader.begin((const uint8_t*)&old, sizeof(old)) && reader.getCount() == 1);
+    CHECK(reader.next(c) && !reader.next(c));
+    CHECK(c.epoch == old.timestamp && c.tempCenti == 425 && c.batt == 77 && c.rssi == -81);
+    CHECK(c.flags == (OFFLINE_FLAG_LEGACY | OFFLINE_FLAG_SENSOR_OK));
+
+    old.crc32 ^= 1;
+    CHECK(!reader.begin((const uint8_t*)&old, sizeof(old)));
+
+    uint8_t v2[OFFLINE_CYCLE_HEADER + OFFLINE_TAG_ENTRY] = {0};
+    v2[0] = BacklogCodec::RECORD_VERSION;
+    v2[1] = OFFLINE_FLAG_SENSOR_OK;
+    v2[2] = 1;                              // Tag sayısı
+    v2[4] = 0x10;                           // Epoch 0x10
+    v2[24] = 0x90; v2[25] = 0x01;           // 400 = 4.00 °C
+    v2[OFFLINE_CYCLE_HEADER] = 0xAC;        // Tag MAC
+    v2[OFFLINE_CYCLE_HEADER + 6] = 0x2C; v2[OFFLINE_CYCLE_HEADER + 7] = 0x01; // 300
+    CHECK(reader.begin(v2, sizeof(v2)) && reader.next(c));
+    CHECK(c.epoch == 0x10 && c.tempCenti == 400 && c.tagCount == 1 && c.tags[0].tempCenti == 300);
+    CHECK(!reader.begin(v2, sizeof(v2) - 1));
+}
+
+// RTC'de kalan açık bloğun bütünlüğü ve bozuk kaydın reddi
+static void corruption(const std::vector<OfflineCycle>& cycles) {
+    BacklogCodec::resetBlock(s_block);
+    for (int i = 0; i < 5; i++) CHECK(BacklogCodec::appendCycle(s_block, cycles[i]));
+    CHECK(BacklogCodec::isBlockValid(s_block));
+    s_block.data[3] ^= 0x40;
+    CHECK(!BacklogCodec::isBlockValid(s_block));
+    s_block.data[3] ^= 0x40;
+    s_block.length = OFFLINE_BLOCK_CAP + 1;
+    CHECK(!BacklogCodec::isBlockValid(s_block));
+    s_block.length = 0;
+    BacklogCodec::resetBlock(s_block);
+
+    for (int i = 0; i < 5; i++) CHECK(BacklogCodec::appendCycle(s_block, cycles[i]));
+    size_t len = BacklogCodec::finishBlock(s_block, s_record, sizeof(s_record));
+    s_record[len - 1] ^= 0x01;
+    OfflineBlockReader reader;
+    CHECK(!reader.begin(s_record, len));
+}
+
+int main() {
+    const Trace traces[] = {
+        {"reefer, internal only", 0, false, -18.0f, 0.0f},
+        {"chiller, 4 tags", 4, false, 4.0f, 3.5f},
+        {"truck, 16 tags", 16, true, 4.0f, -18.0f},
+        {"truck, 32 tags", 32, true, 4.0f, 5.0f},
+    };
+
+    printf("backlog codec (OfflineDataRecord = %zu bytes/sample)\n", sizeof(OfflineDataRecord));
+    for (const Trace& tr : traces) {
+        std::vector<OfflineCycle> cycles = makeTrace(tr, 720, 1); // 1 gün
+        roundTrip(tr, cycles);
+    }
+    for (const Trace& tr : traces) {
+        uploadRoundTrip(makeTrace(tr, 30, 2));
+    }
+    lzRoundTrip();
+    legacyRecords();
+    corruption(makeTrace(traces[1], 5, 3));
+    printf("backlog_codec_test: OK\n");
+    return 0;
+}
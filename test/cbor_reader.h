@@ -0,0 +1,81 @@
+// Host testleri için asgari CBOR (RFC 8949) okuyucu - cihazın yazdığı alt küme:
+// uint/negatif int, bstr, tstr, dizi, map, null, bool, float32
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+class CborReader {
+public:
+    CborReader(const uint8_t* buf, size_t len) : _buf(buf), _len(len), _pos(0), _error(false) {}
+
+    enum Type { UINT, NINT, BYTES, TEXT, ARRAY, MAP, SIMPLE, END };
+
+    // Sıradaki öğenin türü (tüketmez)
+    Type peek() {
+        if (_pos >= _len) return END;
+        return (Type)(_buf[_pos] >> 5);
+    }
+    bool isNull() { return _pos < _len && _buf[_pos] == 0xF6; }
+
+    uint32_t readUint() { return _expect(0); }
+    int64_t readInt() {
+        if (peek() == NINT) return -1 - (int64_t)_expect(1);
+        return _expect(0);
+    }
+    // null ise false döner ve null'ı tüketir
+    bool readIntOrNull(int64_t& v) {
+        if (isNull()) { _pos++; return false; }
+        v = readInt();
+        return true;
+    }
+    size_t readBytes(const uint8_t*& data) {
+        uint32_t n = _expect(2);
+        data = _buf + _pos;
+        _advance(n);
+        return n;
+    }
+    std::string readText() {
+        uint32_t n = _expect(3);
+        std::string s((const char*)_buf + (_pos <= _len ? _pos : _len), _pos + n <= _len ? n : 0);
+        _advance(n);
+        return s;
+    }
+    uint32_t readArray() { return _expect(4); }
+    uint32_t readMap() { return _expect(5); }
+    float readFloat() {
+        if (_pos + 5 > _len || _buf[_pos] != 0xFA) { _error = true; return 0; }
+        uint32_t bits = ((uint32_t)_buf[_pos + 1] << 24) | ((uint32_t)_buf[_pos + 2] << 16) |
+                        ((uint32_t)_buf[_pos + 3] << 8) | _buf[_pos + 4];
+        _pos += 5;
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+
+    size_t position() const { return _pos; }
+    bool error() const { return _error; }
+    bool atEnd() const { return _pos == _len; }
+
+private:
+    const uint8_t* _buf;
+    size_t _len;
+    size_t _pos;
+    bool _error;
+
+    void _advance(size_t n) {
+        if (_pos + n > _len) { _error = true; _pos = _len; return; }
+        _pos += n;
+    }
+    uint32_t _expect(uint8_t major) {
+        if (_pos >= _len || (_buf[_pos] >> 5) != major) { _error = true; return 0; }
+        uint8_t info = _buf[_pos++] & 0x1F;
+        if (info < 24) return info;
+        size_t n = (info == 24) ? 1 : (info == 25) ? 2 : (info == 26) ? 4 : 0;
+        if (n == 0 || _pos + n > _len) { _error = true; return 0; }
+        uint32_t v = 0;
+        for (size_t i = 0; i < n; i++) v = (v << 8) | _buf[_pos++];
+        return v;
+    }
+};
@@ -0,0 +1,86 @@
+// Checksum host testi: referans vektörler, bitwise referans uygulamalarla eşitlik
+// ve tablo/bitwise hız karşılaştırması (ns/byte).
+#include "Checksum.h"
+#include <random>
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while (0)
+
+// Bitwise referanslar (eski sürücülerdeki döngüler)
+static uint32_t crc32Bitwise(const uint8_t* data, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    return ~crc;
+}
+
+static uint8_t crc8MaximBitwise(const uint8_t* data, size_t len) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) crc = (crc & 1) ? (crc >> 1) ^ 0x8C : crc >> 1;
+    }
+    return crc;
+}
+
+static uint8_t crc8SensirionBitwise(const uint8_t* data, size_t len) {
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+static uint8_t s_buf[4096];
+
+static void vectors() {
+    CHECK(Checksum::crc32("123456789", 9) == 0xCBF43926);
+    CHECK(Checksum::crc32(s_buf, 0) == 0);
+
+    // Zincirleme: journal/FlashLog kayıtları parça parça hesaplar
+    CHECK(Checksum::crc32(s_buf + 100, 900, Checksum::crc32(s_buf, 100)) == Checksum::crc32(s_buf, 1000));
+
+    for (size_t n = 0; n < 64; n++) {
+        CHECK(Checksum::crc32(s_buf, n) == crc32Bitwise(s_buf, n));
+        CHECK(Checksum::crc8Maxim(s_buf, n) == crc8MaximBitwise(s_buf, n));
+        CHECK(Checksum::crc8Sensirion(s_buf, n) == crc8SensirionBitwise(s_buf, n));
+    }
+
+    // Sensirion veri sayfası örneği
+    const uint8_t beef[2] = {0xBE, 0xEF};
+    CHECK(Checksum::crc8Sensirion(beef, 2) == 0x92);
+
+    CHECK(Checksum::nmeaValid("$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47"));
+    CHECK(!Checksum::nmeaValid("$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*48"));
+    CHECK(Checksum::nmeaValid("+QGPSGNMEA: $GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47"));
+    CHECK(!Checksum::nmeaValid("$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,"));
+}
+
+template <typename F>
+static void bench(const char* name, F f) {
+    const int iterations = 20000;
+    volatile uint32_t sink = 0;
+    unsigned long t0 = micros();
+    for (int i = 0; i < iterations; i++) sink = sink + f(s_buf, sizeof(s_buf));
+    double ns = (micros() - t0) * 1000.0 / iterations / sizeof(s_buf);
+    printf("  %-22s %.2f ns/B\n", name, ns);
+}
+
+int main() {
+    std::mt19937 rng(1);
+    for (size_t i = 0; i < sizeof(s_buf); i++) s_buf[i] = (uint8_t)rng();
+
+    vectors();
+
+    printf("checksum (%zu byte buffer, host)\n", sizeof(s_buf));
+    bench("crc32 bitwise", crc32Bitwise);
+    bench("crc32 table", [](const uint8_t* d, size_t n) { return Checksum::crc32(d, n); });
+    bench("crc8 maxim bitwise", crc8MaximBitwise);
+    bench("crc8 maxim table", Checksum::crc8Maxim);
+    bench("crc8 sensirion bitwise", crc8SensirionBitwise);
+    bench("crc8 sensirion table", Checksum::crc8Sensirion);
+    printf("checksum_test: OK\n");
+    return 0;
+}
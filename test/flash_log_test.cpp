@@ -0,0 +1,141 @@
+// FlashLog host testi: RAM'de NOR flash (yazma sadece bit temizler, silme 4 KB).
+// Halka sırası, tüketim, batch commit/rollback ve yeniden başlatma sonrası kurtarma
+// doğrulanır; açılışın kayıt sayısından bağımsız okuma yaptığı ölçülür.
+#include "FlashLog.h"
+#include <vector>
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while (0)
+
+static const uint32_t PART_SIZE = 64 * FLASHLOG_SECTOR;
+static std::vector<uint8_t> s_flash(PART_SIZE, 0xFF);
+static esp_partition_t s_part = {ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0, PART_SIZE, "offlog"};
+static const char* s_label = "offlog";
+static uint32_t s_reads;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t subtype,
+                                                const char* label) {
+    if (label) return (s_label && !strcmp(label, s_label)) ? &s_part : nullptr;
+    return (subtype == ESP_PARTITION_SUBTYPE_DATA_SPIFFS && !s_label) ? &s_part : nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t*, size_t offset, void* dst, size_t size) {
+    if (offset + size > PART_SIZE) return ESP_FAIL;
+    s_reads++;
+    memcpy(dst, &s_flash[offset], size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t*, size_t offset, const void* src, size_t size) {
+    if (offset + size > PART_SIZE) return ESP_FAIL;
+    const uint8_t* p = (const uint8_t*)src;
+    for (size_t i = 0; i < size; i++) s_flash[offset + i] &= p[i]; // NOR: 1 -> 0
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t*, size_t offset, size_t size) {
+    if (offset % FLASHLOG_SECTOR || size % FLASHLOG_SECTOR || offset + size > PART_SIZE) return ESP_FAIL;
+    memset(&s_flash[offset], 0xFF, size);
+    return ESP_OK;
+}
+
+// Kayıt: sıra numarası + değişken uzunluklu dolgu (blok kayıtları gibi 200-2000 byte)
+static uint16_t makeRecord(uint32_t id, uint8_t* buf) {
+    uint16_t len = 200 + (id * 397) % 1800;
+    memcpy(buf, &id, sizeof(id));
+    for (uint16_t i = sizeof(id); i < len; i++) buf[i] = (uint8_t)(id + i);
+    return len;
+}
+
+static uint32_t readId(FlashLog& log) {
+    static uint8_t buf[FLASHLOG_MAX_RECORD];
+    uint16_t len = log.peek(buf, sizeof(buf));
+    CHECK(len > 0);
+    uint32_t id;
+    memcpy(&id, buf, sizeof(id));
+    static uint8_t expect[FLASHLOG_MAX_RECORD];
+    CHECK(makeRecord(id, expect) == len && memcmp(buf, expect, len) == 0);
+    return id;
+}
+
+// Yeniden başlatma: yeni nesne aynı flash'tan kurulur
+static void reboot(FlashLog& log, uint32_t expectCount, uint32_t expectTail) {
+    log = FlashLog();
+    s_reads = 0;
+    CHECK(log.begin());
+    CHECK(log.getCount() == expectCount);
+    if (expectCount > 0) CHECK(readId(log) == expectTail);
+}
+
+int main() {
+    static uint8_t buf[FLASHLOG_MAX_RECORD];
+    FlashLog log;
+    CHECK(log.begin());
+
+    // Halkanın yarısı: ~2 kayıt/segment
+    uint32_t next = 0, tail = 0;
+    for (; next < 60; next++) CHECK(log.append(buf, makeRecord(next, buf)));
+    CHECK(log.getCount() == 60);
+    reboot(log, 60, 0);
+
+    // Tekli tüketim, segment sınırları geçilir
+    for (int i = 0; i < 25; i++) {
+        CHECK(readId(log) == tail);
+        CHECK(log.pop());
+        tail++;
+    }
+    reboot(log, next - tail, tail);
+
+    // Açılış okuması kayıt sayısından bağımsız: segment başlıkları + iki segment taraması
+    uint32_t bootReads = s_reads;
+    for (int i = 0; i < 40; i++, next++) CHECK(log.append(buf, makeRecord(next, buf)));
+    reboot(log, next - tail, tail);
+    printf("  boot reads: %u (%u pending) -> %u (%u pending), %u segments\n",
+           bootReads, 35u, s_reads, next - tail, PART_SIZE / FLASHLOG_SECTOR);
+    // Başlık okumaları (en fazla 2 x segment) + iki segmentin kayıt başlıkları
+    CHECK(s_reads <= 2 * 64 + 2 * (FLASHLOG_SECTOR / 208) + 4);
+
+    // Batch: rollback kuyruğu geri alır, commit kalıcı işaretler
+    log.beginBatch();
+    for (int i = 0; i < 10; i++) CHECK(log.pop());
+    log.rollback();
+    CHECK(readId(log) == tail);
+    log.beginBatch();
+    for (int i = 0; i < 10; i++, tail++) {
+        CHECK(readId(log) == tail);
+        CHECK(log.pop());
+    }
+    CHECK(log.commit() == 10);
+    reboot(log, next - tail, tail);
+
+    // Commit edilmeden yeniden başlama: kayıtlar tekrar okunur
+    log.beginBatch();
+    for (int i = 0; i < 5; i++) CHECK(log.pop());
+    reboot(log, next - tail, tail);
+
+    // Halka dolunca en eski segment düşer; sayım ve sıra korunur
+    for (int i = 0; i < 200; i++, next++) CHECK(log.append(buf, makeRecord(next, buf)));
+    uint32_t pending = log.getCount();
+    CHECK(pending < next - tail);
+    tail = next - pending;
+    reboot(log, pending, tail);
+
+    // Hepsini tüket: boş log yeniden başlamada boş kalır
+    while (log.getCount() > 0) {
+        CHECK(readId(log) == tail);
+        CHECK(log.pop());
+        tail++;
+    }
+    CHECK(tail == next);
+    reboot(log, 0, 0);
+    CHECK(log.append(buf, makeRecord(next, buf)));
+    reboot(log, 1, next);
+
+    // Etiketli bölüm yoksa boş SPIFFS bölümü sahiplenilmez
+    s_label = nullptr;
+    std::fill(s_flash.begin(), s_flash.end(), 0xFF);
+    FlashLog borrowed;
+    CHECK(!borrowed.begin());
+
+    printf("flash_log_test: OK\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Host testleri için asgari Arduino-ESP32 yüzeyi - sadece test edilen modüllerin
+// (BacklogCodec, Checksum, TelemetryEncoder) derlenmesine yetecek kadar.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+typedef uint8_t byte;
+
+using std::min;
+using std::max;
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+inline unsigned long micros() {
+    using namespace std::chrono;
+    return (unsigned long)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+inline unsigned long millis() { return micros() / 1000; }
+inline void delay(unsigned long) {}
+
+// GPIO - hardware.h yardımcıları derlensin diye boş
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int digitalRead(int) { return LOW; }
+
+// FreeRTOS kritik bölümü - host testleri tek iş parçacıklı
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+
+class String {
+public:
+    String(const char* s = "") : _s(s ? s : "") {}
+    String(const std::string& s) : _s(s) {}
+    const char* c_str() const { return _s.c_str(); }
+    size_t length() const { return _s.size(); }
+    char operator[](size_t i) const { return _s[i]; }
+    String operator+(const String& o) const { return String(_s + o._s); }
+    bool operator==(const char* o) const { return _s == o; }
+private:
+    std::string _s;
+};
+
+// Serial çıktısı testlerde susturulur (HOST_VERBOSE ile açılır)
+class HostSerial {
+public:
+    template <typename... A> int printf(const char* fmt, A... args) {
+#ifdef HOST_VERBOSE
+        return ::printf(fmt, args...);
+#else
+        (void)fmt;
+        return 0;
+#endif
+    }
+    void println(const char* s = "") { printf("%s\n", s); }
+    void print(const char* s) { printf("%s", s); }
+};
+extern HostSerial Serial;
@@ -0,0 +1,6 @@
+// Host testleri: başlıklardaki imzalar için ileri bildirimler (JSON kodu test edilmez)
+#pragma once
+class JsonDocument;
+class JsonObject;
+class JsonArray;
+class JsonVariantConst;
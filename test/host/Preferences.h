@@ -0,0 +1,9 @@
+// Host testleri: ConfigManager.h üye tipi için boş Preferences
+#pragma once
+#include <Arduino.h>
+
+class Preferences {
+public:
+    bool begin(const char*, bool = false) { return false; }
+    void end() {}
+};
@@ -0,0 +1,10 @@
+// Host testleri: ExternalSensor.h için boş I2C veri yolu
+#pragma once
+#include <Arduino.h>
+
+class TwoWire {
+public:
+    bool begin(int, int) { return true; }
+    void setClock(uint32_t) {}
+};
+extern TwoWire Wire;
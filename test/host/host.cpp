@@ -0,0 +1,5 @@
+#include <Arduino.h>
+#include <Wire.h>
+
+HostSerial Serial;
+TwoWire Wire;
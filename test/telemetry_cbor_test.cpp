@@ -0,0 +1,215 @@
+// TelemetryEncoder host testi: sentetik periyot CBOR'a kodlanır, telemetry_decoder.h ile
+// çözülüp canlı advData JSON biçimine geri yazılır; alanlar (centi-derece) karşılaştırılır.
+// Tag sayısına göre CBOR/JSON boyutu ve kodlama süresi raporlanır.
+// Cihaz üstündeki ArduinoJson karşılaştırması TELEMETRY_BOTH ile loglanır ([CBOR] satırı).
+#include "TelemetryEncoder.h"
+#include "BLEManager.h"
+#include "ExternalSensor.h"
+#include "telemetry_decoder.h"
+#include <random>
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); exit(1); } } while (0)
+
+// ===== Bağlantı dikişleri: BLEManager/ExternalSensor yerine test verisi =====
+// (BLEManager.cpp NimBLE ister; kodlayıcının kullandığı yüzey burada taklit edilir)
+
+static BLETagData s_tags[32];
+static uint8_t s_tagCount;
+static TagDictionaryEntry s_dict[32];
+static char s_dictMac[32][18];
+static char s_dictName[32][32];
+static char s_dictMahal[32][25];
+static uint8_t s_dictCount;
+
+BLEManager::BLEManager() {}
+uint8_t BLEManager::getScannedTagCount() { return s_tagCount; }
+bool BLEManager::getScannedTag(uint8_t index, BLETagData& out) {
+    if (index >= s_tagCount) return false;
+    out = s_tags[index];
+    return true;
+}
+
+uint32_t BLEManager::getConfigDictionaryId() {
+    // BLEManager.cpp ile aynı FNV-1a; çözücünün dictionaryId()'si bağımsız olarak karşılaştırılır
+    uint32_t hash = 2166136261UL;
+    for (uint8_t i = 0; i < s_dictCount; i++) {
+        for (const char* p = s_dictMac[i]; *p; p++) {
+            char c = toupper(*p);
+            if (c == ':') continue;
+            hash ^= (uint8_t)c;
+            hash *= 16777619UL;
+        }
+        hash ^= 0xFF;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+int BLEManager::_findConfigIndex(const char* macAddress) {
+    for (uint8_t i = 0; i < s_dictCount; i++) {
+        if (strcasecmp(s_dictMac[i], macAddress) == 0) return i;
+    }
+    return -1;
+}
+
+bool ExternalSensor::getTemperature(uint8_t, float&) { return false; }
+bool ExternalSensor::getHumidity(uint8_t, float&) { return false; }
+
+static BLEManager s_ble;
+static uint8_t s_cbor[4096];
+
+// n tag: dörtte üçü config'de (sözlükten çözülür), kalanı bilinmeyen MAC
+static CycleSnapshot makeCycle(int n, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> temp(-25.0f, 8.0f);
+    std::uniform_int_distribution<int> rssi(-100, -40);
+
+    s_tagCount = 0;
+    s_dictCount = 0;
+    for (int i = 0; i < n; i++) {
+        BLETagData& t = s_tags[s_tagCount++];
+        memset(&t, 0, sizeof(t));
+        snprintf(t.macAddress, sizeof(t.macAddress), "8c:69:6b:%02x:%02x:%02x",
+                 (uint8_t)(0x10 + i), (uint8_t)(i * 7), (uint8_t)(0xA0 ^ i));
+        t.temperature = roundf(temp(rng) * 100.0f) / 100.0f;
+        t.batteryPct = 100 - i;
+        t.rssi = rssi(rng);
+        t.advCount = 100000u + 977u * i;
+        t.lastSeenTime = 1760000000 - 3 - i;
+        t.valid = (i % 9 != 8); // Ara sıra geçersiz kayıt atlanmalı
+        if (i % 3 != 2) {
+            t.stats.tempMin = t.temperature - 0.4f;
+            t.stats.tempMax = t.temperature + 0.3f;
+            t.stats.tempMean = t.temperature + 0.01f;
+            t.stats.tempM2 = 0.12f * (i + 1);
+            t.stats.rssiMin = t.rssi - 6;
+            t.stats.rssiMax = t.rssi + 4;
+            t.stats.rssiMean = t.rssi - 0.35f;
+            t.stats.frameCount = 40 + i;
+            t.stats.tlmCount = 12 + i % 5;
+            t.stats.firstSeenTime = 1760000000 - 110 + i;
+        }
+        if (i % 4 != 3) {
+            snprintf(s_dictMac[s_dictCount], sizeof(s_dictMac[0]), "%s", t.macAddress);
+            snprintf(s_dictName[s_dictCount], sizeof(s_dictName[0]), "Dolap %d", i + 1);
+            snprintf(s_dictMahal[s_dictCount], sizeof(s_dictMahal[0]), "64f0c2a1b3d4e5f6a7b8c9%02u", (unsigned)(i % 32));
+            s_dict[s_dictCount] = {s_dictMac[s_dictCount], s_dictName[s_dictCount], s_dictMahal[s_dictCount]};
+            s_dictCount++;
+        }
+    }
+
+    CycleSnapshot snap;
+    snap.gmac = "A1B2C3D4E5F6";
+    snap.conn = "4G";
+    snap.epoch = 1760000000;
+    snap.bleOnMs = 8421;
+    snap.lat = 41.015137f;
+    snap.lon = 28.979530f;
+    snap.speed = 62.4f;
+    snap.course = 181.5f;
+    snap.gpsTime = "09:41:07";
+    snap.gpsDate = "18/10/26";
+    snap.sats = 9;
+    snap.hdop = 1.1f;
+    snap.internalName = "Dahili";
+    snap.internalMahalId = "64f0c2a1b3d4e5f6a7b8c900";
+    snap.sensorOK = true;
+    snap.temp = -18.37f;
+    snap.batt = 87;
+    snap.rssi = -77;
+    snap.ext = nullptr;
+    snap.ble = &s_ble;
+    return snap;
+}
+
+static int32_t centi(float v) { return (int32_t)lroundf(v * 100.0f); }
+
+static void roundTrip(int n) {
+    CycleSnapshot snap = makeCycle(n, 7 + n);
+    size_t len = TelemetryEncoder::encodeCycle(snap, s_cbor, sizeof(s_cbor));
+    CHECK(len > 0);
+
+    DecodedCycle c;
+    CHECK(decodeAdvData(s_cbor, len, c));
+    CHECK(c.version == TelemetryEncoder::SCHEMA_VERSION);
+    CHECK(memcmp(c.gmac, "\xA1\xB2\xC3\xD4\xE5\xF6", 6) == 0);
+    CHECK(c.epoch == snap.epoch && c.conn == "4G" && c.bleOnMs == snap.bleOnMs);
+    CHECK(c.latE6 == (int32_t)lroundf(snap.lat * 1e6f) && c.lonE6 == (int32_t)lroundf(snap.lon * 1e6f));
+    CHECK(c.speedD == 624 && c.courseD == 1815 && c.sats == 9 && c.hdopD == 11);
+    CHECK(c.hhmmss == 94107 && c.ddmmyy == 181026);
+    CHECK(c.sensorOK && c.tempCenti == -1837 && c.batt == 87 && c.rssi == -77);
+    CHECK(c.dictId == dictionaryId(s_dict, s_dictCount));
+
+    size_t k = 0;
+    for (uint8_t i = 0; i < s_tagCount; i++) {
+        const BLETagData& t = s_tags[i];
+        if (!t.valid) continue;
+        CHECK(k < c.tags.size());
+        const DecodedTag& d = c.tags[k++];
+        int idx = s_ble.getTagConfigIndex(t.macAddress);
+        CHECK(d.configIndex == idx);
+        if (idx < 0) {
+            uint8_t mac[6];
+            TelemetryEncoder::parseMac(t.macAddress, mac);
+            CHECK(memcmp(d.mac, mac, 6) == 0);
+        }
+        CHECK(d.tempCenti == centi(t.temperature));
+        CHECK(d.batt == t.batteryPct && d.rssi == t.rssi && d.advCount == t.advCount);
+        CHECK(d.hasStats == (t.stats.frameCount > 0));
+        if (d.hasStats) {
+            CHECK(d.stats[0] == centi(t.stats.tempMin) && d.stats[1] == centi(t.stats.tempMax));
+            CHECK(d.stats[2] == centi(t.stats.tempMean));
+            CHECK(d.stats[3] == centi(sqrtf(t.stats.tempM2 / t.stats.tlmCount)));
+            CHECK(d.stats[4] == t.stats.rssiMin && d.stats[5] == t.stats.rssiMax);
+            CHECK(d.stats[6] == (int32_t)lroundf(t.stats.rssiMean * 10.0f));
+            CHECK(d.stats[7] == t.stats.frameCount && d.stats[8] == t.stats.tlmCount);
+            CHECK(snap.epoch - d.stats[9] == t.stats.firstSeenTime);
+            CHECK(snap.epoch - d.stats[10] == t.lastSeenTime);
+        }
+    }
+    CHECK(k == c.tags.size());
+
+    // Sözlükten isim/mahal çözümü; sözlük değiştiyse isimler çözülmemeli
+    std::string json = advDataJson(c, s_dict, s_dictCount, snap.internalName, snap.internalMahalId);
+    if (s_dictCount > 0) {
+        CHECK(json.find("\"name\":\"Dolap 1\"") != std::string::npos);
+        CHECK(advDataJson(c, s_dict, s_dictCount - 1, "", "").find("Dolap 1") == std::string::npos);
+    }
+    CHECK(json.find("\"temp\":-18.37") != std::string::npos);
+    CHECK(json.find("\"time\":\"09:41:07\"") != std::string::npos);
+
+    // Küçük buffer taşması geçersiz çıktı üretmemeli
+    CHECK(TelemetryEncoder::encodeCycle(snap, s_cbor, len - 1) == 0);
+}
+
+// Boyut ve süre: CBOR kodlama vs aynı periyodun JSON metni
+static void benchmark(int n) {
+    CycleSnapshot snap = makeCycle(n, 100 + n);
+    const int iterations = 2000;
+    size_t len = 0;
+    unsigned long t0 = micros();
+    for (int i = 0; i < iterations; i++) len = TelemetryEncoder::encodeCycle(snap, s_cbor, sizeof(s_cbor));
+    double cborUs = (double)(micros() - t0) / iterations;
+    CHECK(len > 0);
+
+    DecodedCycle c;
+    CHECK(decodeAdvData(s_cbor, len, c));
+    std::string json;
+    t0 = micros();
+    for (int i = 0; i < iterations; i++) json = advDataJson(c, s_dict, s_dictCount, snap.internalName, snap.internalMahalId);
+    double jsonUs = (double)(micros() - t0) / iterations;
+
+    printf("  %2d tags: cbor %5zu bytes %6.2f us  json %5zu bytes %6.2f us  size %.1fx\n",
+           n, len, cborUs, json.size(), jsonUs, (double)json.size() / len);
+    CHECK(len < json.size());
+}
+
+int main() {
+    const int tagCounts[] = {0, 4, 16, 32};
+    for (int n : tagCounts) roundTrip(n);
+
+    printf("telemetry cbor vs json (host, snprintf JSON; stats'lı tag'lar dahil)\n");
+    for (int n : tagCounts) benchmark(n);
+    printf("telemetry_cbor_test: OK\n");
+    return 0;
+}
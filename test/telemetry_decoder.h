@@ -0,0 +1,221 @@
+// advData ikili şeması (v1, KUTARIoT/bdata/<mac>) için host tarafı çözücü.
+// Şema TelemetryEncoder.h'de; bu dosya backend köprüsü için referans uygulamadır:
+// CBOR -> DecodedCycle -> canlı advData JSON'u ile aynı biçimde metin.
+#pragma once
+#include "cbor_reader.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+struct DecodedTag {
+    int configIndex;            // Sözlük sırası; config'de yoksa -1 ve mac dolu
+    uint8_t mac[6];
+    int32_t tempCenti;
+    int32_t batt;
+    int32_t rssi;
+    uint32_t advCount;
+    bool hasStats;
+    int32_t stats[11];          // tMin, tMax, tAvg, tStd (x100), rMin, rMax, rAvg (x10),
+                                // frames, tlm, epoch-first, epoch-last
+};
+
+struct DecodedExtSensor {
+    uint32_t addr;
+    uint32_t type;
+    bool hasTemp;
+    int32_t tempCenti;
+    bool hasHumidity;
+    int32_t humidityCenti;
+};
+
+struct DecodedCycle {
+    uint32_t version;
+    uint8_t gmac[6];
+    uint32_t epoch;
+    std::string conn;
+    uint32_t bleOnMs;
+    int32_t latE6, lonE6;
+    uint32_t speedD, courseD, sats, hdopD, hhmmss, ddmmyy;
+    bool sensorOK;
+    int32_t tempCenti;
+    int32_t batt, rssi;
+    uint32_t dictId;
+    uint32_t mid;               // 0 = yok
+    std::vector<DecodedTag> tags;
+    std::vector<DecodedExtSensor> ext;
+};
+
+// Backend'in tag tablosu (config sırası) - isim/mahal sözlükten çözülür
+struct TagDictionaryEntry {
+    const char* mac;            // "AA:BB:CC:DD:EE:FF" veya "AABBCCDDEEFF"
+    const char* name;
+    const char* mahalId;
+};
+
+// Cihazdaki BLEManager::getConfigDictionaryId ile aynı FNV-1a
+inline uint32_t dictionaryId(const TagDictionaryEntry* dict, size_t count) {
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < count; i++) {
+        for (const char* p = dict[i].mac; *p; p++) {
+            char c = (*p >= 'a' && *p <= 'z') ? *p - 32 : *p;
+            if (c == ':') continue;
+            hash ^= (uint8_t)c;
+            hash *= 16777619UL;
+        }
+        hash ^= 0xFF;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+inline bool decodeAdvData(const uint8_t* buf, size_t len, DecodedCycle& out) {
+    CborReader r(buf, len);
+    out = DecodedCycle();
+    uint32_t fields = r.readMap();
+    for (uint32_t f = 0; f < fields && !r.error(); f++) {
+        uint32_t key = r.readUint();
+        int64_t v;
+        switch (key) {
+            case 0: out.version = r.readUint(); break;
+            case 1: {
+                const uint8_t* mac;
+                if (r.readBytes(mac) != 6) return false;
+                memcpy(out.gmac, mac, 6);
+                break;
+            }
+            case 2: out.epoch = r.readUint(); break;
+            case 3: out.conn = r.readText(); break;
+            case 4: out.bleOnMs = r.readUint(); break;
+            case 5:
+                if (r.readArray() != 8) return false;
+                out.latE6 = (int32_t)r.readInt();
+                out.lonE6 = (int32_t)r.readInt();
+                out.speedD = r.readUint();
+                out.courseD = r.readUint();
+                out.sats = r.readUint();
+                out.hdopD = r.readUint();
+                out.hhmmss = r.readUint();
+                out.ddmmyy = r.readUint();
+                break;
+            case 6:
+                if (r.readArray() != 3) return false;
+                out.sensorOK = r.readIntOrNull(v);
+                out.tempCenti = out.sensorOK ? (int32_t)v : 0;
+                out.batt = (int32_t)r.readInt();
+                out.rssi = (int32_t)r.readInt();
+                break;
+            case 7: out.dictId = r.readUint(); break;
+            case 8: {
+                uint32_t n = r.readArray();
+                for (uint32_t i = 0; i < n && !r.error(); i++) {
+                    DecodedTag t = DecodedTag();
+                    if (r.readArray() != 6) return false;
+                    if (r.peek() == CborReader::BYTES) {
+                        const uint8_t* mac;
+                        if (r.readBytes(mac) != 6) return false;
+                        memcpy(t.mac, mac, 6);
+                        t.configIndex = -1;
+                    } else {
+                        t.configIndex = (int)r.readUint();
+                    }
+                    t.tempCenti = (int32_t)r.readInt();
+                    t.batt = (int32_t)r.readInt();
+                    t.rssi = (int32_t)r.readInt();
+                    t.advCount = r.readUint();
+                    if (r.isNull()) {
+                        r.readIntOrNull(v);
+                    } else {
+                        if (r.readArray() != 11) return false;
+                        t.hasStats = true;
+                        for (int k = 0; k < 11; k++) t.stats[k] = (int32_t)r.readInt();
+                    }
+                    out.tags.push_back(t);
+                }
+                break;
+            }
+            case 9: out.mid = r.readUint(); break;
+            case 10: {
+                uint32_t n = r.readArray();
+                for (uint32_t i = 0; i < n && !r.error(); i++) {
+                    DecodedExtSensor s = DecodedExtSensor();
+                    if (r.readArray() != 4) return false;
+                    s.addr = r.readUint();
+                    s.type = r.readUint();
+                    s.hasTemp = r.readIntOrNull(v);
+                    s.tempCenti = s.hasTemp ? (int32_t)v : 0;
+                    s.hasHumidity = r.readIntOrNull(v);
+                    s.humidityCenti = s.hasHumidity ? (int32_t)v : 0;
+                    out.ext.push_back(s);
+                }
+                break;
+            }
+            default:
+                return false; // Bilinmeyen anahtar - şema versiyonu yükseltilmeli
+        }
+    }
+    return !r.error() && r.atEnd();
+}
+
+// Çözülen periyodu canlı advData JSON'u ile aynı alanlarla yaz (MQTTManager::_buildCycleJson).
+// Sözlük ID'si eşleşmezse config sıraları çözülemez - "Unknown" yazılır.
+inline std::string advDataJson(const DecodedCycle& c, const TagDictionaryEntry* dict, size_t dictCount,
+                               const char* internalName, const char* internalMahalId) {
+    char buf[256];
+    std::string s;
+    char gmac[13];
+    snprintf(gmac, sizeof(gmac), "%02X%02X%02X%02X%02X%02X",
+             c.gmac[0], c.gmac[1], c.gmac[2], c.gmac[3], c.gmac[4], c.gmac[5]);
+    bool dictOk = (dictionaryId(dict, dictCount) == c.dictId);
+
+    snprintf(buf, sizeof(buf), "{\"msg\":\"advData\",\"gmac\":\"%s\",\"stat\":\"online\",\"conn\":\"%s\",\"bleOnMs\":%u,",
+             gmac, c.conn.c_str(), c.bleOnMs);
+    s += buf;
+    snprintf(buf, sizeof(buf),
+             "\"gps\":{\"lat\":%.6f,\"lon\":%.6f,\"speed\":%g,\"course\":%g,\"time\":\"%02u:%02u:%02u\","
+             "\"date\":\"%02u/%02u/%02u\",\"sats\":%u,\"hdop\":%g},",
+             c.latE6 / 1e6, c.lonE6 / 1e6, c.speedD / 10.0, c.courseD / 10.0,
+             c.hhmmss / 10000, c.hhmmss / 100 % 100, c.hhmmss % 100,
+             c.ddmmyy / 10000, c.ddmmyy / 100 % 100, c.ddmmyy % 100, c.sats, c.hdopD / 10.0);
+    s += buf;
+    snprintf(buf, sizeof(buf),
+             "\"obj\":[{\"type\":1,\"dmac\":\"%s\",\"name\":\"%s\",\"location\":\"%s\",\"temp\":%g,"
+             "\"batt\":%d,\"rssi\":%d,\"time\":%u}",
+             gmac, internalName, internalMahalId, c.sensorOK ? c.tempCenti / 100.0 : 0.0, c.batt, c.rssi, c.epoch);
+    s += buf;
+
+    for (const DecodedTag& t : c.tags) {
+        char mac[13];
+        const char* name = "Unknown";
+        const char* mahal = "";
+        if (t.configIndex >= 0 && dictOk && (size_t)t.configIndex < dictCount) {
+            const TagDictionaryEntry& e = dict[t.configIndex];
+            size_t n = 0;
+            for (const char* p = e.mac; *p && n < 12; p++) {
+                if (*p != ':') mac[n++] = (*p >= 'a' && *p <= 'z') ? *p - 32 : *p;
+            }
+            mac[n] = '\0';
+            name = e.name;
+            mahal = e.mahalId;
+        } else {
+            snprintf(mac, sizeof(mac), "%02X%02X%02X%02X%02X%02X",
+                     t.mac[0], t.mac[1], t.mac[2], t.mac[3], t.mac[4], t.mac[5]);
+        }
+        snprintf(buf, sizeof(buf),
+                 ",{\"type\":2,\"dmac\":\"%s\",\"name\":\"%s\",\"location\":\"%s\",\"temp\":%g,"
+                 "\"batt\":%d,\"rssi\":%d,\"time\":%u,\"advCount\":%u",
+                 mac, name, mahal, t.tempCenti / 100.0, t.batt, t.rssi, c.epoch, t.advCount);
+        s += buf;
+        if (t.hasStats) {
+            snprintf(buf, sizeof(buf),
+                     ",\"stats\":{\"tMin\":%g,\"tMax\":%g,\"tAvg\":%g,\"tStd\":%g,\"rMin\":%d,\"rMax\":%d,"
+                     "\"rAvg\":%g,\"frames\":%d,\"tlm\":%d,\"first\":%u,\"last\":%u}",
+                     t.stats[0] / 100.0, t.stats[1] / 100.0, t.stats[2] / 100.0, t.stats[3] / 100.0,
+                     t.stats[4], t.stats[5], t.stats[6] / 10.0, t.stats[7], t.stats[8],
+                     c.epoch - t.stats[9], c.epoch - t.stats[10]);
+            s += buf;
+        }
+        s += "}";
+    }
+    s += "]}";
+    return s;
+}